@@ -0,0 +1,6 @@
+#include <ideep/benchmark.hpp>
+#include <ideep_pin_singletons.hpp>
+
+int main(int argc, char** argv) {
+  return ideep::benchmark::run_from_args(argc, argv);
+}
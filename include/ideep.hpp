@@ -38,6 +38,7 @@
 
 #include "ideep/abstract_types.hpp"
 #include "ideep/tensor.hpp"
+#include "ideep/lru_cache.hpp"
 #include "ideep/computations.hpp"
 
 #endif
@@ -66,6 +66,20 @@ enum rnn_kind {
   GRU = 3
 };
 
+enum reduction_kind {
+  REDUCE_SUM = 0,
+  REDUCE_MEAN = 1,
+  REDUCE_MAX = 2,
+  REDUCE_MIN = 3,
+  REDUCE_NORM_L1 = 4,
+  REDUCE_NORM_L2 = 5
+};
+
+enum resampling_kind {
+  RESAMPLE_NEAREST = 0,
+  RESAMPLE_LINEAR = 1
+};
+
 /// cpu execution engine only.
 struct engine : public dnnl::engine {
   friend class tensor;
@@ -51,6 +51,23 @@ struct attr_t : public dnnl::primitive_attr {
     return attr;
   }
 
+  /// PReLU after the op. A single slope maps onto DNNL's eltwise relu with
+  /// alpha and is fused in the primitive. Per-channel slopes are kept here
+  /// and applied by the op to its dst in place, right after execution.
+  static attr_t fuse_prelu(const scale_t& weights) {
+    IDEEP_ENFORCE(!weights.empty(), "PReLU needs at least one slope");
+    if (weights.size() == 1) {
+      return fuse_relu(1.0, weights[0]);
+    }
+    attr_t attr;
+    attr.prelu_weights_ = weights;
+    return attr;
+  }
+
+  bool has_prelu() const { return !prelu_weights_.empty(); }
+
+  const scale_t& get_prelu_weights() const { return prelu_weights_; }
+
   static attr_t attr_post_ops(post_ops po) {
     attr_t attr;
     attr.set_post_ops(po);
@@ -103,6 +120,9 @@ struct attr_t : public dnnl::primitive_attr {
 
     return true;
   }
+
+ private:
+  scale_t prelu_weights_;
 };
 
 }  // namespace ideep
@@ -0,0 +1,2774 @@
+#ifndef IDEEP_BENCHMARK_HPP
+#define IDEEP_BENCHMARK_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "../ideep.hpp"
+
+namespace ideep {
+namespace benchmark {
+
+/// Operator-level benchmarks over layer shapes of common models.
+///
+/// Not part of ideep.hpp: a benchmark binary is one translation unit
+///
+///   #include <ideep/benchmark.hpp>
+///   #include <ideep_pin_singletons.hpp>
+///   int main(int argc, char** argv) {
+///     return ideep::benchmark::run_from_args(argc, argv);
+///   }
+///
+/// bench/ builds this as ideep_bench. Run with e.g. --sets=resnet50,bert
+/// --dtypes=f32,bf16,int8 --formats=nchw,nhwc,blocked --threads=1,8
+/// --iters=100. The sets are resnet50, mobilenet_v2, bert, dlrm, unet, rnn
+/// and alexnet, covering the forward and backward passes and the optimizer
+/// step of their layers. Each case reports latency percentiles, throughput
+/// in samples/s, GFLOP/s and GB/s, the last counting every input and output
+/// byte once. Convolutions, inner products and matmuls are timed through
+/// the 2-in-1 compute and through prepare + compute(param, ...) separately.
+/// The 2-in-1 compute fetches its primitive from the computation cache, so
+/// the difference is the per-call key building, cache lookup and scratchpad
+/// allocation. The [2in1,nocache] variant runs with that cache disabled, as
+/// IDEEP_LRU_CACHE_CAPACITY=0 would, to show the primitive creation cost.
+///
+/// --replay=<file> instead re-runs a call sequence captured by
+/// utils::recorder, on synthetic data, timing every call. Max pooling and
+/// LRN backward calls first run one untimed training forward for the
+/// workspace they read.
+
+enum class layout { nchw, nhwc, blocked };
+
+struct options {
+  int warmup = 5;
+  int iters = 50;
+  // keep iterating past iters until this much time has been spent
+  double min_time_ms = 0.;
+  // 0 uses each shape set's default batch size
+  dim batch = 0;
+  // empty runs with the current OpenMP setting
+  std::vector<int> threads;
+  std::vector<data_type> dtypes {data_type::f32};
+  std::vector<layout> formats {layout::nchw};
+  std::vector<std::string> sets {"resnet50", "mobilenet_v2", "bert", "dlrm",
+                                 "unet",     "rnn",          "alexnet"};
+  // only cases whose name contains this substring
+  std::string filter;
+  bool csv = false;
+};
+
+struct config {
+  data_type dtype;
+  layout format;
+  int threads;
+  dim batch;
+};
+
+struct result {
+  std::string name;
+  std::string shape;
+  std::string config;
+  int64_t iters = 0;
+  double mean_ms = 0.;
+  double p50_ms = 0.;
+  double p90_ms = 0.;
+  double p99_ms = 0.;
+  double samples_per_s = 0.;
+  double gflops = 0.;
+  double gbps = 0.;
+};
+
+inline const char* to_string(layout l) {
+  switch (l) {
+    case layout::nhwc: return "nhwc";
+    case layout::blocked: return "blocked";
+    default: return "nchw";
+  }
+}
+
+inline const char* to_string(data_type dt) {
+  switch (dt) {
+    case data_type::bf16: return "bf16";
+    case data_type::s8:
+    case data_type::u8: return "int8";
+    default: return "f32";
+  }
+}
+
+inline std::string to_string(const dims& adims) {
+  std::ostringstream os;
+  for (size_t i = 0; i < adims.size(); i++) os << (i ? "x" : "") << adims[i];
+  return os.str();
+}
+
+/// Activations in the requested layout. Only 4D tensors have an nhwc or
+/// blocked variant; the rest, and channel counts that do not block, stay
+/// plain.
+inline tensor::desc make_desc(const dims& adims, data_type dt, layout l) {
+  if (adims.size() == 4 && l == layout::nhwc)
+    return {adims, dt, tag::nhwc};
+  if (adims.size() == 4 && l == layout::blocked) {
+    if (adims[1] % 16 == 0) return {adims, dt, tag::nChw16c};
+    if (adims[1] % 8 == 0) return {adims, dt, tag::nChw8c};
+  }
+  return {adims, dt};
+}
+
+/// Fills t with uniform random data, [0, 1) for u8 and [-1, 1) otherwise,
+/// quantized with t's scale
+inline void fill_random(tensor& t) {
+  static std::mt19937 gen(2020);
+  tensor plain({t.get_dims(), data_type::f32});
+  std::uniform_real_distribution<float> dist(
+      t.get_data_type() == data_type::u8 ? 0.f : -1.f, 1.f);
+  auto data = static_cast<float*>(plain.get_data_handle());
+  for (dim i = 0; i < plain.get_nelems(); i++) data[i] = dist(gen);
+  t.feed_from(plain);
+}
+
+/// A random tensor. int8 tensors carry the scale that maps the range of
+/// fill_random.
+inline tensor make_tensor(const dims& adims, data_type dt,
+                          layout l = layout::nchw) {
+  tensor t(make_desc(adims, dt, l));
+  if (dt == data_type::u8) t.set_scale({255.f});
+  if (dt == data_type::s8) t.set_scale({127.f});
+  fill_random(t);
+  return t;
+}
+
+/// A random tensor of a recorded desc and scales; an empty spec gives an
+/// empty tensor, as for an output the op allocates
+inline tensor make_tensor(const utils::recorder::tensor_spec& spec) {
+  if (spec.empty()) return tensor();
+  tensor t(spec.desc);
+  if (!spec.scale.empty()) t.set_scale(spec.scale);
+  fill_random(t);
+  return t;
+}
+
+/// Latency stats of per-call times in ms
+inline result summarize(std::vector<double> ms) {
+  result r;
+  if (ms.empty()) return r;
+  std::sort(ms.begin(), ms.end());
+  auto pct = [&](double q) {
+    return ms[std::min(ms.size() - 1, static_cast<size_t>(q * ms.size()))];
+  };
+  r.iters = ms.size();
+  r.mean_ms = std::accumulate(ms.begin(), ms.end(), 0.) / ms.size();
+  r.p50_ms = pct(0.5);
+  r.p90_ms = pct(0.9);
+  r.p99_ms = pct(0.99);
+  return r;
+}
+
+template <typename F>
+inline result measure(const options& opt, F fn) {
+  using clock = std::chrono::steady_clock;
+  for (int i = 0; i < opt.warmup; i++) fn();
+
+  std::vector<double> ms;
+  double spent = 0.;
+  while (ms.size() < static_cast<size_t>(opt.iters) ||
+         spent < opt.min_time_ms) {
+    auto start = clock::now();
+    fn();
+    ms.push_back(std::chrono::duration<double, std::milli>(
+        clock::now() - start).count());
+    spent += ms.back();
+  }
+  return summarize(std::move(ms));
+}
+
+/// measure with the computation cache of value_t disabled, so that every
+/// call creates its primitive
+template <class value_t, typename F>
+inline result measure_uncached(const options& opt, F fn) {
+  using cache = utils::computation_cache<value_t>;
+  cache::resize(0);
+  auto r = measure(opt, fn);
+  cache::resize(utils::get_cache_capacity());
+  return r;
+}
+
+/// One benchmark: the dtypes it supports, and a body that runs it for a
+/// config and appends one result per variant timed
+struct bench_case {
+  std::string name;
+  std::string shape;
+  std::vector<data_type> dtypes;
+  std::function<void(const config&, const options&, std::vector<result>&)>
+      run;
+};
+
+namespace detail {
+
+inline void finish(result r, const std::string& name, const std::string& shape,
+                   const config& cfg, double flops, double bytes,
+                   std::vector<result>& results) {
+  std::ostringstream os;
+  os << to_string(cfg.dtype) << "/" << to_string(cfg.format) << "/t"
+     << cfg.threads;
+  r.name = name;
+  r.shape = shape;
+  r.config = os.str();
+  r.samples_per_s = cfg.batch * 1e3 / r.mean_ms;
+  r.gflops = flops / r.mean_ms / 1e6;
+  r.gbps = bytes / r.mean_ms / 1e6;
+  results.push_back(r);
+}
+
+// activations are u8 and weights s8 for int8 runs
+inline data_type act_type(data_type dt) {
+  return dt == data_type::s8 ? data_type::u8 : dt;
+}
+
+inline double bytes_of(std::initializer_list<const tensor*> ts) {
+  double bytes = 0.;
+  for (auto t : ts) bytes += t->get_size();
+  return bytes;
+}
+
+struct conv_shape {
+  const char* name;
+  dim ic, ih, iw, oc, kh, kw, stride, pad, groups;
+};
+
+struct gemm_shape {
+  const char* name;
+  // rows per sample, e.g. the sequence length for BERT
+  dim m, k, n;
+};
+
+inline void add_conv(std::vector<bench_case>& cases, const conv_shape& s,
+                     bool backward) {
+  const auto oh = (s.ih + 2 * s.pad - s.kh) / s.stride + 1;
+  const auto ow = (s.iw + 2 * s.pad - s.kw) / s.stride + 1;
+  std::ostringstream os;
+  os << s.name << ":ic" << s.ic << "ih" << s.ih << "oc" << s.oc << "k"
+     << s.kh << "s" << s.stride << "g" << s.groups;
+  const auto shape = os.str();
+
+  auto geometry = [=](dim n) {
+    dims src_dims {n, s.ic, s.ih, s.iw};
+    dims weights_dims {s.oc, s.ic / s.groups, s.kh, s.kw};
+    dims dst_dims {n, s.oc, oh, ow};
+    double flops = 2.0 * n * s.oc * oh * ow * (s.ic / s.groups) * s.kh * s.kw;
+    return std::make_tuple(src_dims, weights_dims, dst_dims, flops);
+  };
+  const dims strides {s.stride, s.stride}, dilates {1, 1},
+      padding {s.pad, s.pad};
+
+  cases.push_back({"convolution_forward", shape,
+                   {data_type::f32, data_type::bf16, data_type::s8},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    dims src_dims, weights_dims, dst_dims;
+    double flops;
+    std::tie(src_dims, weights_dims, dst_dims, flops) = geometry(cfg.batch);
+    auto src = make_tensor(src_dims, act_type(cfg.dtype), cfg.format);
+    auto weights = make_tensor(weights_dims, cfg.dtype);
+    auto bias = make_tensor({s.oc}, data_type::f32);
+    tensor dst;
+
+    convolution_forward_params param;
+    auto prepare = [&]() {
+      convolution_forward::prepare(param, src, weights, bias, dst_dims, dst,
+                                   strides, dilates, padding, padding,
+                                   s.groups);
+    };
+    prepare();
+    // weights in the primitive's format, as a framework would cache them
+    auto expected_weights = weights.make_grouped_weights(s.groups)
+        .reorder_if_differ_in({param.pd.weights_desc(), s.groups});
+    if (weights.has_scale()) expected_weights.set_scale(weights.get_scale());
+    auto bytes = bytes_of({&src, &expected_weights, &dst});
+
+    finish(measure(opt, prepare), "convolution_forward::prepare",
+           shape, cfg, 0., 0., results);
+    finish(measure(opt, [&]() {
+             convolution_forward::compute(param, src, expected_weights, bias,
+                                          dst);
+           }),
+           "convolution_forward[param]", shape, cfg, flops, bytes,
+           results);
+    finish(measure(opt, [&]() {
+             convolution_forward::compute(src, expected_weights, bias,
+                                          dst_dims, dst, strides, dilates,
+                                          padding, padding, s.groups);
+           }),
+           "convolution_forward[2in1]", shape, cfg, flops, bytes,
+           results);
+    finish(measure_uncached<convolution_forward::params>(opt, [&]() {
+             convolution_forward::compute(src, expected_weights, bias,
+                                          dst_dims, dst, strides, dilates,
+                                          padding, padding, s.groups);
+           }),
+           "convolution_forward[2in1,nocache]", shape, cfg, flops, bytes,
+           results);
+  }});
+
+  if (!backward) return;
+
+  cases.push_back({"convolution_backward", shape,
+                   {data_type::f32, data_type::bf16},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    dims src_dims, weights_dims, dst_dims;
+    double flops;
+    std::tie(src_dims, weights_dims, dst_dims, flops) = geometry(cfg.batch);
+    auto src = make_tensor(src_dims, cfg.dtype, cfg.format);
+    auto weights = make_tensor(weights_dims, cfg.dtype);
+    auto diff_dst = make_tensor(dst_dims, cfg.dtype, cfg.format);
+    tensor diff_src, diff_weights, diff_bias;
+    auto bytes = bytes_of({&src, &weights, &diff_dst});
+
+    finish(measure(opt, [&]() {
+             convolution_backward_data::compute(
+                 diff_dst, weights, src_dims, diff_src, strides, dilates,
+                 padding, padding, s.groups);
+           }),
+           "convolution_backward_data", shape, cfg, flops, bytes,
+           results);
+    finish(measure(opt, [&]() {
+             convolution_backward_weights::compute(
+                 src, diff_dst, weights_dims, diff_weights, diff_bias,
+                 strides, dilates, padding, padding, s.groups);
+           }),
+           "convolution_backward_weights", shape, cfg, flops, bytes,
+           results);
+  }});
+}
+
+// s describes the convolution the deconvolution transposes: ic and ih are
+// the deconvolution's input, oc its output channels
+inline void add_deconv(std::vector<bench_case>& cases,
+                       const conv_shape& s) {
+  const auto oh = (s.ih - 1) * s.stride - 2 * s.pad + s.kh;
+  const auto ow = (s.iw - 1) * s.stride - 2 * s.pad + s.kw;
+  std::ostringstream os;
+  os << s.name << ":ic" << s.ic << "ih" << s.ih << "oc" << s.oc << "k"
+     << s.kh << "s" << s.stride;
+  const auto shape = os.str();
+  const dims strides {s.stride, s.stride}, dilates {1, 1},
+      padding {s.pad, s.pad};
+
+  cases.push_back({"convolution_transpose", shape,
+                   {data_type::f32, data_type::bf16},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    const dims src_dims {cfg.batch, s.ic, s.ih, s.iw};
+    const dims weights_dims {s.ic, s.oc, s.kh, s.kw};
+    const dims dst_dims {cfg.batch, s.oc, oh, ow};
+    const double flops =
+        2.0 * cfg.batch * s.ic * s.ih * s.iw * s.oc * s.kh * s.kw;
+    auto src = make_tensor(src_dims, cfg.dtype, cfg.format);
+    auto weights = make_tensor(weights_dims, cfg.dtype);
+    auto bias = make_tensor({s.oc}, data_type::f32);
+    auto diff_dst = make_tensor(dst_dims, cfg.dtype, cfg.format);
+    tensor dst, diff_src, diff_weights, diff_bias;
+    convolution_transpose_forward::compute(src, weights, bias, dst_dims, dst,
+                                           strides, padding, padding,
+                                           dilates);
+    auto bytes = bytes_of({&src, &weights, &dst});
+
+    finish(measure(opt, [&]() {
+             convolution_transpose_forward::compute(
+                 src, weights, bias, dst_dims, dst, strides, padding,
+                 padding, dilates);
+           }),
+           "convolution_transpose_forward", shape, cfg, flops, bytes,
+           results);
+    finish(measure(opt, [&]() {
+             convolution_transpose_backward_data::compute(
+                 diff_dst, weights, src_dims, diff_src, strides, padding,
+                 padding, dilates);
+           }),
+           "convolution_transpose_backward_data", shape, cfg, flops, bytes,
+           results);
+    finish(measure(opt, [&]() {
+             convolution_transpose_backward_weights::compute(
+                 src, diff_dst, weights_dims, diff_weights, diff_bias,
+                 strides, padding, padding, dilates);
+           }),
+           "convolution_transpose_backward_weights", shape, cfg, flops,
+           bytes, results);
+  }});
+}
+
+inline void add_gemm(std::vector<bench_case>& cases, const gemm_shape& s,
+                     bool backward) {
+  std::ostringstream os;
+  os << s.name << ":m" << s.m << "k" << s.k << "n" << s.n;
+  const auto shape = os.str();
+
+  cases.push_back({"inner_product_forward", shape,
+                   {data_type::f32, data_type::bf16, data_type::s8},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    auto m = s.m * cfg.batch;
+    auto src = make_tensor({m, s.k}, act_type(cfg.dtype));
+    auto weights = make_tensor({s.n, s.k}, cfg.dtype);
+    auto bias = make_tensor({s.n}, data_type::f32);
+    const double flops = 2.0 * m * s.k * s.n;
+    tensor dst;
+    inner_product_forward::compute(src, weights, bias, dst);
+    auto bytes = bytes_of({&src, &weights, &dst});
+    finish(measure(opt, [&]() {
+             inner_product_forward::compute(src, weights, bias, dst);
+           }),
+           "inner_product_forward[2in1]", shape, cfg, flops, bytes, results);
+    finish(measure_uncached<inner_product_forward::params>(opt, [&]() {
+             inner_product_forward::compute(src, weights, bias, dst);
+           }),
+           "inner_product_forward[2in1,nocache]", shape, cfg, flops, bytes,
+           results);
+    // prepare packs the weights once; it takes f32 and bf16 only
+    if (cfg.dtype == data_type::s8) return;
+
+    inner_product_forward_params param;
+    auto prepare = [&]() {
+      inner_product_forward::prepare(param, weights, bias);
+    };
+    prepare();
+    finish(measure(opt, prepare), "inner_product_forward::prepare", shape,
+           cfg, 0., 0., results);
+    finish(measure(opt, [&]() {
+             inner_product_forward::compute(param, src, dst);
+           }),
+           "inner_product_forward[param]", shape, cfg, flops, bytes,
+           results);
+  }});
+
+  cases.push_back({"matmul_forward", shape,
+                   {data_type::f32, data_type::bf16, data_type::s8},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    auto m = s.m * cfg.batch;
+    auto src = make_tensor({m, s.k}, act_type(cfg.dtype));
+    auto weights = make_tensor({s.k, s.n}, cfg.dtype);
+    const double flops = 2.0 * m * s.k * s.n;
+    tensor dst;
+    matmul_forward::compute(src, weights, dst);
+    auto bytes = bytes_of({&src, &weights, &dst});
+    finish(measure(opt, [&]() { matmul_forward::compute(src, weights, dst); }),
+           "matmul_forward[2in1]", shape, cfg, flops, bytes, results);
+    finish(measure_uncached<matmul_forward::params>(opt, [&]() {
+             matmul_forward::compute(src, weights, dst);
+           }),
+           "matmul_forward[2in1,nocache]", shape, cfg, flops, bytes, results);
+    if (cfg.dtype == data_type::s8) return;
+
+    matmul_forward_params param;
+    auto prepare = [&]() { matmul_forward::prepare(param, weights); };
+    prepare();
+    finish(measure(opt, prepare), "matmul_forward::prepare", shape, cfg, 0.,
+           0., results);
+    finish(measure(opt, [&]() {
+             matmul_forward::compute(param, src, dst);
+           }),
+           "matmul_forward[param]", shape, cfg, flops, bytes, results);
+  }});
+
+  if (!backward) return;
+
+  cases.push_back({"inner_product_backward", shape,
+                   {data_type::f32, data_type::bf16},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    auto m = s.m * cfg.batch;
+    auto src = make_tensor({m, s.k}, cfg.dtype);
+    auto weights = make_tensor({s.n, s.k}, cfg.dtype);
+    auto diff_dst = make_tensor({m, s.n}, cfg.dtype);
+    const double flops = 2.0 * m * s.k * s.n;
+    tensor diff_src, diff_weights, diff_bias;
+    auto bytes = bytes_of({&src, &weights, &diff_dst});
+    finish(measure(opt, [&]() {
+             inner_product_backward_data::compute(diff_dst, weights,
+                                                  {m, s.k}, diff_src);
+           }),
+           "inner_product_backward_data", shape, cfg, flops, bytes,
+           results);
+    finish(measure(opt, [&]() {
+             inner_product_backward_weights::compute(src, diff_dst,
+                                                     diff_weights,
+                                                     diff_bias);
+           }),
+           "inner_product_backward_weights", shape, cfg, flops, bytes,
+           results);
+  }});
+}
+
+// Elementwise-style ops over one activation shape, which batch is dim 0
+inline void add_unary(std::vector<bench_case>& cases, const std::string& name,
+                      const dims& sample_dims,
+                      std::vector<data_type> dtypes,
+                      std::function<void(const tensor&, tensor&)> op) {
+  auto shape = to_string(sample_dims);
+  cases.push_back({name, shape, dtypes,
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    auto adims = sample_dims;
+    adims[0] *= cfg.batch;
+    auto src = make_tensor(adims, cfg.dtype, cfg.format);
+    tensor dst;
+    op(src, dst);
+    auto bytes = bytes_of({&src, &dst});
+    finish(measure(opt, [&]() { op(src, dst); }), name, shape, cfg, 0.,
+           bytes, results);
+  }});
+}
+
+// The tensors of an optimizer step; the states and master copies are
+// created by the first step
+struct optimizer_args {
+  std::vector<tensor> weights, master_weights, grads, state0, state1;
+  int64_t step = 0;
+};
+
+// One optimizer step over a model's parameters in the config's dtype
+inline void add_optimizer(std::vector<bench_case>& cases,
+                          const std::string& name, const std::string& shape,
+                          const std::vector<dims>& params,
+                          std::function<void(optimizer_args&)> step) {
+  cases.push_back({name, shape, {data_type::f32, data_type::bf16},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    optimizer_args a;
+    for (auto& p : params) {
+      a.weights.push_back(make_tensor(p, cfg.dtype));
+      a.grads.push_back(make_tensor(p, cfg.dtype));
+    }
+    step(a);
+    // weights, master copies and states are read and written, grads read
+    double bytes = 0.;
+    for (auto ts : {&a.weights, &a.master_weights, &a.state0, &a.state1})
+      for (auto& t : *ts) bytes += 2. * t.get_size();
+    for (auto& t : a.grads) bytes += t.get_size();
+    finish(measure(opt, [&]() { step(a); }), name, shape, cfg, 0., bytes,
+           results);
+  }});
+}
+
+inline std::vector<bench_case> resnet50_cases() {
+  static const conv_shape shapes[] = {
+      {"conv1", 3, 224, 224, 64, 7, 7, 2, 3, 1},
+      {"res2_1x1a", 64, 56, 56, 64, 1, 1, 1, 0, 1},
+      {"res2_3x3", 64, 56, 56, 64, 3, 3, 1, 1, 1},
+      {"res2_1x1b", 64, 56, 56, 256, 1, 1, 1, 0, 1},
+      {"res3_1x1a", 256, 56, 56, 128, 1, 1, 1, 0, 1},
+      {"res3_3x3_s2", 128, 56, 56, 128, 3, 3, 2, 1, 1},
+      {"res3_3x3", 128, 28, 28, 128, 3, 3, 1, 1, 1},
+      {"res4_3x3", 256, 14, 14, 256, 3, 3, 1, 1, 1},
+      {"res4_1x1b", 256, 14, 14, 1024, 1, 1, 1, 0, 1},
+      {"res5_3x3", 512, 7, 7, 512, 3, 3, 1, 1, 1},
+      {"res5_1x1b", 512, 7, 7, 2048, 1, 1, 1, 0, 1},
+  };
+  std::vector<bench_case> cases;
+  for (auto& s : shapes) add_conv(cases, s, /*backward=*/true);
+
+  const std::vector<data_type> fp {data_type::f32, data_type::bf16};
+  add_unary(cases, "eltwise_forward[relu]", {1, 256, 56, 56},
+            {data_type::f32, data_type::bf16, data_type::s8},
+            [](const tensor& src, tensor& dst) {
+              eltwise_forward::compute(src, dst);
+            });
+  add_unary(cases, "pooling_forward[max3x3s2]", {1, 64, 112, 112}, fp,
+            [](const tensor& src, tensor& dst) {
+              auto n = src.get_dim(0);
+              pooling_forward::compute(src, {n, 64, 56, 56}, dst, {2, 2},
+                                       {3, 3}, {1, 1}, {1, 1},
+                                       algorithm::pooling_max,
+                                       prop_kind::forward_inference);
+            });
+  add_unary(cases, "pooling_forward[global_avg]", {1, 2048, 7, 7}, fp,
+            [](const tensor& src, tensor& dst) {
+              auto n = src.get_dim(0);
+              pooling_forward::compute(src, {n, 2048, 1, 1}, dst, {1, 1},
+                                       {7, 7}, {0, 0}, {0, 0},
+                                       algorithm::pooling_avg,
+                                       prop_kind::forward_inference);
+            });
+  add_unary(cases, "batch_normalization_forward_inference", {1, 256, 56, 56},
+            fp, [](const tensor& src, tensor& dst) {
+              static auto scale = make_tensor({256}, data_type::f32);
+              static auto shift = make_tensor({256}, data_type::f32);
+              batch_normalization_forward_inference::compute(
+                  src, scale, shift, dst, 1e-5f);
+            });
+  add_unary(cases, "sum", {1, 256, 56, 56}, fp,
+            [](const tensor& src, tensor& dst) {
+              sum::compute({1.f, 1.f}, {src, src}, dst);
+            });
+  add_unary(cases, "reduction[mean]", {1, 2048, 7, 7}, fp,
+            [](const tensor& src, tensor& dst) {
+              reduction::compute(src, dst, {2, 3}, REDUCE_MEAN, true);
+            });
+
+  const dims act {1, 256, 56, 56};
+  cases.push_back({"batch_normalization_training", to_string(act), fp,
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    auto adims = act;
+    adims[0] = cfg.batch;
+    auto src = make_tensor(adims, cfg.dtype, cfg.format);
+    auto diff_dst = make_tensor(adims, cfg.dtype, cfg.format);
+    auto scale = make_tensor({adims[1]}, data_type::f32);
+    auto shift = make_tensor({adims[1]}, data_type::f32);
+    tensor dst, mean, variance, diff_src, diff_scale_shift;
+    auto forward = [&]() {
+      batch_normalization_forward_training::compute(
+          src, scale, shift, dst, mean, variance, 0.1f, 1e-5f);
+    };
+    auto backward = [&]() {
+      batch_normalization_backward::compute(src, mean, variance, diff_dst,
+                                            scale, diff_src,
+                                            diff_scale_shift, 1e-5f);
+    };
+    forward();
+    backward();
+    finish(measure(opt, forward), "batch_normalization_forward_training",
+           to_string(act), cfg, 0., bytes_of({&src, &dst}), results);
+    finish(measure(opt, backward), "batch_normalization_backward",
+           to_string(act), cfg, 0., bytes_of({&src, &diff_dst, &diff_src}),
+           results);
+  }});
+
+  cases.push_back({"eltwise_backward[relu]", to_string(act),
+                   {data_type::f32, data_type::bf16},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    auto adims = act;
+    adims[0] = cfg.batch;
+    auto src = make_tensor(adims, cfg.dtype, cfg.format);
+    auto diff_dst = make_tensor(adims, cfg.dtype, cfg.format);
+    tensor diff_src;
+    eltwise_backward::compute(src, diff_dst, diff_src);
+    finish(measure(opt, [&]() {
+             eltwise_backward::compute(src, diff_dst, diff_src);
+           }),
+           "eltwise_backward[relu]", to_string(act), cfg, 0.,
+           bytes_of({&src, &diff_dst, &diff_src}), results);
+  }});
+
+  // max pooling backward reads the indices a training forward keeps
+  const dims pool_src {1, 64, 112, 112};
+  cases.push_back({"pooling_training[max3x3s2]", to_string(pool_src), fp,
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    const dims strides {2, 2}, kernel {3, 3}, padding {1, 1};
+    auto src = make_tensor({cfg.batch, 64, 112, 112}, cfg.dtype, cfg.format);
+    auto diff_dst = make_tensor({cfg.batch, 64, 56, 56}, cfg.dtype,
+                                cfg.format);
+    tensor dst, diff_src;
+    auto forward = [&]() {
+      pooling_forward::compute(src, {cfg.batch, 64, 56, 56}, dst, strides,
+                               kernel, padding, padding,
+                               algorithm::pooling_max,
+                               prop_kind::forward_training);
+    };
+    auto backward = [&]() {
+      pooling_backward::compute(diff_dst, dst, src, diff_src, strides,
+                                kernel, padding, padding,
+                                algorithm::pooling_max);
+    };
+    forward();
+    backward();
+    finish(measure(opt, forward), "pooling_forward[training]",
+           to_string(pool_src), cfg, 0., bytes_of({&src, &dst}), results);
+    finish(measure(opt, backward), "pooling_backward",
+           to_string(pool_src), cfg, 0.,
+           bytes_of({&diff_dst, &diff_src}), results);
+  }});
+
+  const dims head_src {1, 2048, 7, 7};
+  cases.push_back({"adaptive_pooling_training", to_string(head_src), fp,
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    const dims dst_dims {cfg.batch, 2048, 1, 1};
+    auto src = make_tensor({cfg.batch, 2048, 7, 7}, cfg.dtype, cfg.format);
+    auto diff_dst = make_tensor(dst_dims, cfg.dtype, cfg.format);
+    for (auto alg : {algorithm::pooling_avg, algorithm::pooling_max}) {
+      auto suffix = alg == algorithm::pooling_max ? "[max]" : "[avg]";
+      tensor dst, diff_src;
+      adaptive_pooling_forward::compute(src, dst_dims, dst, alg,
+                                        prop_kind::forward_training);
+      adaptive_pooling_backward::compute(diff_dst, dst, src, diff_src, alg);
+      finish(measure(opt, [&]() {
+               adaptive_pooling_forward::compute(
+                   src, dst_dims, dst, alg, prop_kind::forward_training);
+             }),
+             std::string("adaptive_pooling_forward") + suffix,
+             to_string(head_src), cfg, 0., bytes_of({&src, &dst}), results);
+      finish(measure(opt, [&]() {
+               adaptive_pooling_backward::compute(diff_dst, dst, src,
+                                                  diff_src, alg);
+             }),
+             std::string("adaptive_pooling_backward") + suffix,
+             to_string(head_src), cfg, 0., bytes_of({&diff_dst, &diff_src}),
+             results);
+    }
+  }});
+
+  std::vector<dims> params {{1000, 2048}, {1000}};
+  for (auto& s : shapes)
+    params.push_back({s.oc, s.ic / s.groups, s.kh, s.kw});
+  const auto params_shape = std::to_string(params.size()) + " tensors";
+  add_optimizer(cases, "sgd_update", params_shape, params,
+                [](optimizer_args& a) {
+    if (a.weights[0].get_data_type() == data_type::bf16)
+      sgd_update::compute(a.weights, a.master_weights, a.grads, a.state0,
+                          0.1f, 0.9f, 1e-4f);
+    else
+      sgd_update::compute(a.weights, a.grads, a.state0, 0.1f, 0.9f, 1e-4f);
+  });
+  return cases;
+}
+
+inline std::vector<bench_case> mobilenet_v2_cases() {
+  static const conv_shape shapes[] = {
+      {"conv1", 3, 224, 224, 32, 3, 3, 2, 1, 1},
+      {"dw_112", 32, 112, 112, 32, 3, 3, 1, 1, 32},
+      {"pw_112", 32, 112, 112, 16, 1, 1, 1, 0, 1},
+      {"expand_56", 24, 56, 56, 144, 1, 1, 1, 0, 1},
+      {"dw_56_s2", 144, 56, 56, 144, 3, 3, 2, 1, 144},
+      {"dw_14", 384, 14, 14, 384, 3, 3, 1, 1, 384},
+      {"project_14", 384, 14, 14, 64, 1, 1, 1, 0, 1},
+      {"dw_7", 960, 7, 7, 960, 3, 3, 1, 1, 960},
+      {"conv_last", 320, 7, 7, 1280, 1, 1, 1, 0, 1},
+  };
+  std::vector<bench_case> cases;
+  for (auto& s : shapes) add_conv(cases, s, /*backward=*/false);
+  add_unary(cases, "eltwise_forward[relu6]", {1, 144, 56, 56},
+            {data_type::f32, data_type::bf16},
+            [](const tensor& src, tensor& dst) {
+              eltwise_forward::compute(src, dst,
+                                       algorithm::eltwise_bounded_relu,
+                                       prop_kind::forward_inference, 6.f);
+            });
+  add_unary(cases, "channel_shuffle_forward", {1, 144, 56, 56},
+            {data_type::f32}, [](const tensor& src, tensor& dst) {
+              channel_shuffle_forward::compute(src, dst, 4);
+            });
+  return cases;
+}
+
+inline std::vector<bench_case> bert_cases() {
+  const dim seq = 128, hidden = 768, heads = 12, head_dim = hidden / heads;
+  static const gemm_shape shapes[] = {
+      {"qkv", seq, hidden, 3 * hidden},
+      {"attn_out", seq, hidden, hidden},
+      {"ffn_in", seq, hidden, 4 * hidden},
+      {"ffn_out", seq, 4 * hidden, hidden},
+  };
+  std::vector<bench_case> cases;
+  for (auto& s : shapes) add_gemm(cases, s, /*backward=*/true);
+
+  const std::vector<data_type> fp {data_type::f32, data_type::bf16};
+  auto attn = "heads12xseq128xd64";
+  cases.push_back({"matmul_forward[attention]", attn, fp,
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    auto bh = cfg.batch * heads;
+    auto q = make_tensor({bh, seq, head_dim}, cfg.dtype);
+    auto k = make_tensor({bh, head_dim, seq}, cfg.dtype);
+    auto v = make_tensor({bh, seq, head_dim}, cfg.dtype);
+    tensor scores, context;
+    matmul_forward::compute(q, k, scores);
+    const double flops = 2.0 * bh * seq * seq * head_dim;
+    finish(measure(opt, [&]() { matmul_forward::compute(q, k, scores); }),
+           "matmul_forward[q*k]", attn, cfg, flops,
+           bytes_of({&q, &k, &scores}), results);
+    finish(measure(opt, [&]() {
+             matmul_forward::compute(scores, v, context);
+           }),
+           "matmul_forward[scores*v]", attn, cfg, flops,
+           bytes_of({&scores, &v, &context}), results);
+  }});
+  add_unary(cases, "softmax_forward", {heads, seq, seq}, fp,
+            [](const tensor& src, tensor& dst) {
+              softmax_forward::compute(src, dst, 2);
+            });
+  add_unary(cases, "layer_normalization_forward", {seq, hidden}, fp,
+            [=](const tensor& src, tensor& dst) {
+              static auto scale = make_tensor({hidden}, data_type::f32);
+              static auto shift = make_tensor({hidden}, data_type::f32);
+              layer_normalization_forward::compute(src, scale, shift, dst,
+                                                   1e-12f);
+            });
+  add_unary(cases, "binary[add]", {seq, hidden}, fp,
+            [](const tensor& src, tensor& dst) {
+              binary::compute(src, src, dst, algorithm::binary_add);
+            });
+  add_unary(cases, "eltwise_forward[gelu]", {seq, 4 * hidden}, fp,
+            [](const tensor& src, tensor& dst) {
+              eltwise_forward::compute(src, dst, algorithm::eltwise_gelu);
+            });
+  add_unary(cases, "log_softmax_forward", {heads, seq, seq}, fp,
+            [](const tensor& src, tensor& dst) {
+              log_softmax_forward::compute(src, dst, 2);
+            });
+
+  cases.push_back({"softmax_backward", attn, fp,
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    const dims adims {cfg.batch * heads, seq, seq};
+    auto dst = make_tensor(adims, cfg.dtype);
+    auto diff_dst = make_tensor(adims, cfg.dtype);
+    tensor diff_src;
+    softmax_backward::compute(dst, diff_dst, diff_src, 2);
+    finish(measure(opt, [&]() {
+             softmax_backward::compute(dst, diff_dst, diff_src, 2);
+           }),
+           "softmax_backward", attn, cfg, 0.,
+           bytes_of({&dst, &diff_dst, &diff_src}), results);
+  }});
+
+  const auto tokens = "seq128xhidden768";
+  cases.push_back({"layer_normalization_training", tokens, fp,
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    const dims adims {cfg.batch * seq, hidden};
+    auto src = make_tensor(adims, cfg.dtype);
+    auto diff_dst = make_tensor(adims, cfg.dtype);
+    auto scale = make_tensor({hidden}, data_type::f32);
+    auto shift = make_tensor({hidden}, data_type::f32);
+    tensor dst, mean, variance, diff_src, diff_scale, diff_shift;
+    auto forward = [&]() {
+      layer_normalization_forward::compute(src, scale, shift, dst, mean,
+                                           variance, 1e-12f);
+    };
+    auto backward = [&]() {
+      layer_normalization_backward::compute(src, mean, variance, diff_dst,
+                                            scale, shift, diff_src,
+                                            diff_scale, diff_shift, 1e-12f);
+    };
+    forward();
+    backward();
+    finish(measure(opt, forward), "layer_normalization_forward[training]",
+           tokens, cfg, 0., bytes_of({&src, &dst}), results);
+    finish(measure(opt, backward), "layer_normalization_backward", tokens,
+           cfg, 0., bytes_of({&src, &diff_dst, &diff_src}), results);
+  }});
+
+  // dropout masks f32 and integer data only
+  cases.push_back({"dropout", tokens, {data_type::f32},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    const dims adims {cfg.batch * seq, hidden};
+    auto src = make_tensor(adims, cfg.dtype);
+    auto diff_dst = make_tensor(adims, cfg.dtype);
+    tensor dst, mask, diff_src;
+    uint64_t offset = 0;
+    auto forward = [&]() {
+      dropout_forward::compute(src, 0.1f, dst, mask, 2020, offset++);
+    };
+    auto backward = [&]() {
+      dropout_backward::compute(mask, 0.1f, diff_dst, diff_src);
+    };
+    forward();
+    backward();
+    finish(measure(opt, forward), "dropout_forward", tokens, cfg, 0.,
+           bytes_of({&src, &dst, &mask}), results);
+    finish(measure(opt, backward), "dropout_backward", tokens, cfg, 0.,
+           bytes_of({&mask, &diff_dst, &diff_src}), results);
+  }});
+
+  // q, k and v as views of the fused qkv projection
+  cases.push_back({"spliter", "seq128x3x768", fp,
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    auto qkv = make_tensor({cfg.batch * seq, 3 * hidden}, cfg.dtype);
+    std::vector<int32_t> axis_info(3, hidden);
+    finish(measure(opt, [&]() { spliter::compute(qkv, axis_info, 1); }),
+           "spliter", "seq128x3x768", cfg, 0., 0., results);
+  }});
+
+  // the masked LM head, over the ~15% of tokens that are masked
+  const dim masked = 20, vocab = 30522;
+  const auto mlm = "masked20xvocab30522";
+  cases.push_back({"softmax_cross_entropy", mlm, fp,
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    auto logits = make_tensor({cfg.batch * masked, vocab}, cfg.dtype);
+    std::mt19937 gen(2020);
+    std::uniform_int_distribution<dim> pick(0, vocab - 1);
+    std::vector<dim> labels(cfg.batch * masked);
+    for (auto& l : labels) l = pick(gen);
+    tensor loss, diff_src;
+    softmax_cross_entropy::compute(logits, labels, loss, diff_src);
+    finish(measure(opt, [&]() {
+             softmax_cross_entropy::compute(logits, labels, loss, diff_src);
+           }),
+           "softmax_cross_entropy", mlm, cfg, 0.,
+           bytes_of({&logits, &diff_src}), results);
+  }});
+
+  // one encoder layer's parameters
+  std::vector<dims> params;
+  for (auto& s : shapes) {
+    params.push_back({s.n, s.k});
+    params.push_back({s.n});
+  }
+  for (int i = 0; i < 4; i++) params.push_back({hidden});
+  const auto params_shape = std::to_string(params.size()) + " tensors";
+  add_optimizer(cases, "adam_update", params_shape, params,
+                [](optimizer_args& a) {
+    if (a.weights[0].get_data_type() == data_type::bf16)
+      adam_update::compute(a.weights, a.master_weights, a.grads, a.state0,
+                           a.state1, ++a.step, 1e-4f);
+    else
+      adam_update::compute(a.weights, a.grads, a.state0, a.state1,
+                           ++a.step, 1e-4f);
+  });
+  add_optimizer(cases, "lamb_update", params_shape, params,
+                [](optimizer_args& a) {
+    if (a.weights[0].get_data_type() == data_type::bf16)
+      lamb_update::compute(a.weights, a.master_weights, a.grads, a.state0,
+                           a.state1, ++a.step, 1e-3f);
+    else
+      lamb_update::compute(a.weights, a.grads, a.state0, a.state1,
+                           ++a.step, 1e-3f);
+  });
+  return cases;
+}
+
+inline std::vector<bench_case> dlrm_cases() {
+  static const gemm_shape shapes[] = {
+      {"bot_mlp0", 1, 13, 512},     {"bot_mlp1", 1, 512, 256},
+      {"bot_mlp2", 1, 256, 64},     {"top_mlp0", 1, 479, 1024},
+      {"top_mlp1", 1, 1024, 1024},  {"top_mlp2", 1, 1024, 512},
+      {"top_mlp3", 1, 512, 256},    {"top_mlp4", 1, 256, 1},
+  };
+  std::vector<bench_case> cases;
+  for (auto& s : shapes) add_gemm(cases, s, /*backward=*/false);
+
+  const dim rows = 100000, emb_dim = 64, pooling = 20, tables = 26;
+  cases.push_back({"embedding_bag", "rows100000xd64:pool20",
+                   {data_type::f32, data_type::bf16},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    auto weights = make_tensor({rows, emb_dim}, cfg.dtype);
+    std::mt19937 gen(2020);
+    std::uniform_int_distribution<dim> pick(0, rows - 1);
+    std::vector<dim> indices(cfg.batch * pooling), offsets(cfg.batch);
+    for (auto& i : indices) i = pick(gen);
+    for (dim b = 0; b < cfg.batch; b++) offsets[b] = b * pooling;
+    tensor dst;
+    // each gathered row is read once, plus the pooled output
+    double bytes = indices.size() * emb_dim * weights.get_size() /
+                   weights.get_nelems();
+    finish(measure(opt, [&]() {
+             embedding_bag::compute(weights, indices, offsets, dst);
+           }),
+           "embedding_bag", "rows100000xd64:pool20", cfg, 0., bytes, results);
+
+    // the sparse gradient: one row per lookup read, coalesced per table row
+    auto diff_dst = make_tensor({cfg.batch, emb_dim}, data_type::f32);
+    std::vector<dim> grad_rows;
+    tensor grad_values;
+    embedding_bag_backward::compute(diff_dst, indices, offsets, grad_rows,
+                                    grad_values);
+    finish(measure(opt, [&]() {
+             embedding_bag_backward::compute(diff_dst, indices, offsets,
+                                             grad_rows, grad_values);
+           }),
+           "embedding_bag_backward", "rows100000xd64:pool20", cfg, 0.,
+           indices.size() * emb_dim * sizeof(float) + grad_values.get_size(),
+           results);
+  }});
+  cases.push_back({"concat", "27x64", {data_type::f32, data_type::bf16},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    std::vector<tensor> inputs;
+    for (dim t = 0; t <= tables; t++)
+      inputs.push_back(make_tensor({cfg.batch, emb_dim}, cfg.dtype));
+    tensor dst;
+    concat::compute(inputs, 1, dst);
+    finish(measure(opt, [&]() { concat::compute(inputs, 1, dst); }),
+           "concat", "27x64", cfg, 0., 2. * dst.get_size(), results);
+  }});
+  return cases;
+}
+
+inline std::vector<bench_case> unet_cases() {
+  // the decoder's 2x2 up-convolutions
+  static const conv_shape shapes[] = {
+      {"up4", 1024, 28, 28, 512, 2, 2, 2, 0, 1},
+      {"up3", 512, 56, 56, 256, 2, 2, 2, 0, 1},
+      {"up2", 256, 112, 112, 128, 2, 2, 2, 0, 1},
+  };
+  std::vector<bench_case> cases;
+  for (auto& s : shapes) add_deconv(cases, s);
+
+  const std::vector<data_type> fp {data_type::f32, data_type::bf16};
+  const dims act {1, 128, 56, 56};
+  const auto shape = to_string(act);
+  cases.push_back({"resampling", shape, fp,
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    const dims src_dims {cfg.batch, 128, 56, 56};
+    const dims dst_dims {cfg.batch, 128, 112, 112};
+    auto src = make_tensor(src_dims, cfg.dtype, cfg.format);
+    auto diff_dst = make_tensor(dst_dims, cfg.dtype, cfg.format);
+    for (auto akind : {RESAMPLE_NEAREST, RESAMPLE_LINEAR}) {
+      auto suffix = akind == RESAMPLE_LINEAR ? "[linear]" : "[nearest]";
+      tensor dst, diff_src;
+      resampling_forward::compute(src, dst_dims, dst, akind);
+      resampling_backward::compute(diff_dst, src_dims, diff_src, akind);
+      finish(measure(opt, [&]() {
+               resampling_forward::compute(src, dst_dims, dst, akind);
+             }),
+             std::string("resampling_forward") + suffix, shape, cfg, 0.,
+             bytes_of({&src, &dst}), results);
+      finish(measure(opt, [&]() {
+               resampling_backward::compute(diff_dst, src_dims, diff_src,
+                                            akind);
+             }),
+             std::string("resampling_backward") + suffix, shape, cfg, 0.,
+             bytes_of({&diff_dst, &diff_src}), results);
+    }
+  }});
+
+  const int groups = 32;
+  cases.push_back({"group_normalization", shape, fp,
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    const dims adims {cfg.batch, 128, 56, 56};
+    auto src = make_tensor(adims, cfg.dtype, cfg.format);
+    auto diff_dst = make_tensor(adims, cfg.dtype, cfg.format);
+    auto scale = make_tensor({128}, data_type::f32);
+    auto shift = make_tensor({128}, data_type::f32);
+    tensor dst, mean, variance, diff_src, diff_scale, diff_shift;
+    auto inference = [&]() {
+      group_normalization_forward::compute(src, scale, shift, dst, groups,
+                                           1e-5f, true);
+    };
+    auto forward = [&]() {
+      group_normalization_forward::compute(src, scale, shift, dst, mean,
+                                           variance, groups, 1e-5f);
+    };
+    auto backward = [&]() {
+      group_normalization_backward::compute(
+          src, mean, variance, diff_dst, scale, shift, diff_src, diff_scale,
+          diff_shift, groups, 1e-5f);
+    };
+    inference();
+    forward();
+    backward();
+    auto bytes = bytes_of({&src, &dst});
+    finish(measure(opt, inference), "group_normalization_forward[relu]",
+           shape, cfg, 0., bytes, results);
+    finish(measure(opt, forward), "group_normalization_forward[training]",
+           shape, cfg, 0., bytes, results);
+    finish(measure(opt, backward), "group_normalization_backward", shape,
+           cfg, 0., bytes_of({&src, &diff_dst, &diff_src}), results);
+  }});
+
+  cases.push_back({"prelu", shape, fp,
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    const dims adims {cfg.batch, 128, 56, 56};
+    auto src = make_tensor(adims, cfg.dtype, cfg.format);
+    auto diff_dst = make_tensor(adims, cfg.dtype, cfg.format);
+    auto weights = make_tensor({128}, data_type::f32);
+    tensor dst, diff_src, diff_weights;
+    prelu_forward::compute(src, weights, dst);
+    prelu_backward::compute(src, weights, diff_dst, diff_src, diff_weights);
+    finish(measure(opt, [&]() { prelu_forward::compute(src, weights, dst); }),
+           "prelu_forward", shape, cfg, 0., bytes_of({&src, &dst}), results);
+    finish(measure(opt, [&]() {
+             prelu_backward::compute(src, weights, diff_dst, diff_src,
+                                     diff_weights);
+           }),
+           "prelu_backward", shape, cfg, 0.,
+           bytes_of({&src, &diff_dst, &diff_src}), results);
+  }});
+  return cases;
+}
+
+struct rnn_shape {
+  const char* name;
+  dim seq, input, hidden;
+};
+
+// Inputs of a single-layer, unidirectional cell with the given number of
+// gates; lbr_gru has one more bias row than gates. The states are f32.
+struct rnn_args {
+  dims dst_layer_dims, dst_iter_dims;
+  tensor src_layer, src_iter, src_iter_c, weights_layer, weights_iter, bias;
+  tensor diff_dst_layer, diff_dst_iter, diff_dst_iter_c;
+  double flops;
+
+  rnn_args(const rnn_shape& s, dim batch, dim gates, dim bias_gates,
+           bool lstm, data_type dt)
+      : dst_layer_dims {s.seq, batch, s.hidden},
+        dst_iter_dims {1, 1, batch, s.hidden} {
+    src_layer = make_tensor({s.seq, batch, s.input}, dt);
+    src_iter = make_tensor(dst_iter_dims, dt);
+    weights_layer = make_tensor({1, 1, s.input, gates, s.hidden}, dt);
+    weights_iter = make_tensor({1, 1, s.hidden, gates, s.hidden}, dt);
+    bias = make_tensor({1, 1, bias_gates, s.hidden}, data_type::f32);
+    diff_dst_layer = make_tensor(dst_layer_dims, data_type::f32);
+    diff_dst_iter = make_tensor(dst_iter_dims, data_type::f32);
+    if (lstm) {
+      src_iter_c = make_tensor(dst_iter_dims, data_type::f32);
+      diff_dst_iter_c = make_tensor(dst_iter_dims, data_type::f32);
+    }
+    flops = 2.0 * s.seq * batch * gates * s.hidden * (s.input + s.hidden);
+  }
+
+  double bytes(const tensor& dst_layer) const {
+    return bytes_of({&src_layer, &weights_layer, &weights_iter, &dst_layer});
+  }
+};
+
+template <class forward_op, class backward_op>
+inline void add_gru(std::vector<bench_case>& cases, const rnn_shape& s,
+                    const std::string& name, dim bias_gates) {
+  cases.push_back({name, s.name, {data_type::f32, data_type::bf16},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    rnn_args a(s, cfg.batch, 3, bias_gates, false, cfg.dtype);
+    const auto dir = dnnl_unidirectional_left2right;
+    tensor dst_layer, dst_iter, workspace, diff_src_layer, diff_src_iter,
+        diff_weights_layer, diff_weights_iter, diff_bias;
+    auto fwd = [&]() {
+      forward_op::compute(a.src_layer, a.src_iter, a.weights_layer,
+                          a.weights_iter, a.bias, a.dst_layer_dims,
+                          dst_layer, a.dst_iter_dims, dst_iter, workspace,
+                          dir);
+    };
+    fwd();
+    finish(measure(opt, fwd), name + "_forward", s.name, cfg, a.flops,
+           a.bytes(dst_layer), results);
+    finish(measure(opt, [&]() {
+             backward_op::compute(
+                 a.src_layer, a.src_iter, a.weights_layer, a.weights_iter,
+                 a.bias, dst_layer, dst_iter, a.diff_dst_layer,
+                 a.diff_dst_iter, workspace, diff_src_layer, diff_src_iter,
+                 diff_weights_layer, diff_weights_iter, diff_bias, dir);
+           }),
+           name + "_backward", s.name, cfg, 2. * a.flops,
+           a.bytes(dst_layer), results);
+  }});
+}
+
+inline void add_rnn(std::vector<bench_case>& cases, const rnn_shape& s) {
+  const auto dir = dnnl_unidirectional_left2right;
+  cases.push_back({"lstm", s.name, {data_type::f32, data_type::bf16},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    rnn_args a(s, cfg.batch, 4, 4, true, cfg.dtype);
+    tensor dst_layer, dst_iter, dst_iter_c, workspace, diff_src_layer,
+        diff_src_iter, diff_src_iter_c, diff_weights_layer,
+        diff_weights_iter, diff_bias;
+    auto forward = [&]() {
+      lstm_forward::compute(a.src_layer, a.src_iter, a.src_iter_c,
+                            a.weights_layer, a.weights_iter, a.bias,
+                            a.dst_layer_dims, dst_layer, a.dst_iter_dims,
+                            dst_iter, dst_iter_c, workspace, dir);
+    };
+    forward();
+    finish(measure(opt, forward), "lstm_forward", s.name, cfg, a.flops,
+           a.bytes(dst_layer), results);
+    finish(measure(opt, [&]() {
+             lstm_backward::compute(
+                 a.src_layer, a.src_iter, a.src_iter_c, a.weights_layer,
+                 a.weights_iter, a.bias, dst_layer, dst_iter, dst_iter_c,
+                 a.diff_dst_layer, a.diff_dst_iter, a.diff_dst_iter_c,
+                 workspace, diff_src_layer, diff_src_iter, diff_src_iter_c,
+                 diff_weights_layer, diff_weights_iter, diff_bias, dir);
+           }),
+           "lstm_backward", s.name, cfg, 2. * a.flops, a.bytes(dst_layer),
+           results);
+  }});
+
+  add_gru<gru_forward, gru_backward>(cases, s, "gru", 3);
+  add_gru<lbr_gru_forward, lbr_gru_backward>(cases, s, "lbr_gru", 4);
+
+  cases.push_back({"rnn[tanh]", s.name, {data_type::f32},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    rnn_args a(s, cfg.batch, 1, 1, false, cfg.dtype);
+    tensor dst_layer, dst_iter, workspace, diff_src_layer, diff_src_iter,
+        diff_weights_layer, diff_weights_iter, diff_bias;
+    auto forward = [&]() {
+      rnn_forward::compute(a.src_layer, a.src_iter, a.weights_layer,
+                           a.weights_iter, a.bias, a.dst_layer_dims,
+                           dst_layer, a.dst_iter_dims, dst_iter, workspace,
+                           RNN_TANH, dir);
+    };
+    forward();
+    finish(measure(opt, forward), "rnn_forward[tanh]", s.name, cfg, a.flops,
+           a.bytes(dst_layer), results);
+    finish(measure(opt, [&]() {
+             rnn_backward::compute(
+                 a.src_layer, a.src_iter, a.weights_layer, a.weights_iter,
+                 a.bias, dst_layer, dst_iter, a.diff_dst_layer,
+                 a.diff_dst_iter, workspace, true, diff_src_layer,
+                 diff_src_iter, diff_weights_layer, diff_weights_iter,
+                 diff_bias, RNN_TANH, dir);
+           }),
+           "rnn_backward[tanh]", s.name, cfg, 2. * a.flops,
+           a.bytes(dst_layer), results);
+  }});
+}
+
+inline std::vector<bench_case> rnn_cases() {
+  static const rnn_shape shapes[] = {
+      {"gnmt:t50c1024", 50, 1024, 1024},
+      {"deepspeech:t200c512", 200, 512, 512},
+  };
+  std::vector<bench_case> cases;
+  for (auto& s : shapes) add_rnn(cases, s);
+  return cases;
+}
+
+inline std::vector<bench_case> alexnet_cases() {
+  static const conv_shape shapes[] = {
+      {"conv1", 3, 227, 227, 96, 11, 11, 4, 0, 1},
+      {"conv2", 96, 27, 27, 256, 5, 5, 1, 2, 2},
+      {"conv3", 256, 13, 13, 384, 3, 3, 1, 1, 1},
+  };
+  static const gemm_shape fcs[] = {
+      {"fc6", 1, 9216, 4096},
+      {"fc7", 1, 4096, 4096},
+  };
+  std::vector<bench_case> cases;
+  for (auto& s : shapes) add_conv(cases, s, /*backward=*/true);
+  for (auto& s : fcs) add_gemm(cases, s, /*backward=*/true);
+
+  const dims act {1, 96, 55, 55};
+  cases.push_back({"lrn", to_string(act), {data_type::f32, data_type::bf16},
+                   [=](const config& cfg, const options& opt,
+                       std::vector<result>& results) {
+    auto adims = act;
+    adims[0] = cfg.batch;
+    auto src = make_tensor(adims, cfg.dtype, cfg.format);
+    auto diff_dst = make_tensor(adims, cfg.dtype, cfg.format);
+    tensor dst, diff_src;
+    auto forward = [&]() {
+      lrn_forward::compute(src, dst, 5, 1e-4f, 0.75f);
+    };
+    auto backward = [&]() {
+      lrn_backward::compute(src, diff_dst, dst, diff_src, 5, 1e-4f, 0.75f);
+    };
+    forward();
+    backward();
+    finish(measure(opt, forward), "lrn_forward", to_string(act), cfg, 0.,
+           bytes_of({&src, &dst}), results);
+    finish(measure(opt, backward), "lrn_backward", to_string(act), cfg, 0.,
+           bytes_of({&src, &diff_dst, &diff_src}), results);
+  }});
+  return cases;
+}
+
+inline dim default_batch(const std::string& set) {
+  if (set == "dlrm") return 2048;
+  if (set == "bert") return 8;
+  if (set == "rnn") return 64;
+  if (set == "unet") return 4;
+  return 16;
+}
+
+inline std::vector<bench_case> cases_of(const std::string& set) {
+  if (set == "resnet50") return resnet50_cases();
+  if (set == "mobilenet_v2") return mobilenet_v2_cases();
+  if (set == "bert") return bert_cases();
+  if (set == "dlrm") return dlrm_cases();
+  if (set == "unet") return unet_cases();
+  if (set == "rnn") return rnn_cases();
+  if (set == "alexnet") return alexnet_cases();
+  throw error(dnnl_invalid_arguments, "unknown benchmark shape set");
+}
+
+inline std::vector<std::string> split(const std::string& s) {
+  std::vector<std::string> parts;
+  std::istringstream is(s);
+  std::string part;
+  while (std::getline(is, part, ',')) parts.push_back(part);
+  return parts;
+}
+
+}  // namespace detail
+
+/// Runs every case of the selected sets over dtypes x formats x threads.
+/// Cases that an op rejects for a config are reported on stderr and skipped.
+inline std::vector<result> run(const options& opt) {
+  std::vector<result> results;
+  std::vector<int> threads = opt.threads;
+  if (threads.empty()) threads.push_back(omp_get_max_threads());
+
+  for (auto& set : opt.sets) {
+    const dim batch = opt.batch > 0 ? opt.batch : detail::default_batch(set);
+    for (auto& c : detail::cases_of(set)) {
+      if (!opt.filter.empty() &&
+          (c.name + " " + c.shape).find(opt.filter) == std::string::npos)
+        continue;
+      for (auto nthr : threads) {
+#ifdef _OPENMP
+        omp_set_num_threads(nthr);
+#endif
+        for (auto dt : opt.dtypes) {
+          if (std::find(c.dtypes.begin(), c.dtypes.end(), dt) ==
+              c.dtypes.end())
+            continue;
+          for (auto fmt : opt.formats) {
+            try {
+              c.run({dt, fmt, nthr, batch}, opt, results);
+            } catch (const error& e) {
+              std::cerr << "skipped " << c.name << " " << c.shape << " "
+                        << to_string(dt) << "/" << to_string(fmt) << ": "
+                        << e.what() << "\n";
+            }
+          }
+        }
+      }
+    }
+  }
+  return results;
+}
+
+namespace detail {
+
+/// One call of a recording, bound to synthetic tensors
+struct replay_call {
+  std::string name;
+  std::string shape;
+  std::function<void()> run;
+};
+
+// The params of the recorded prepare calls, by the address they were
+// prepared at, for the compute(param, ...) records that follow
+struct replay_params {
+  std::map<uint64_t, std::shared_ptr<convolution_forward_params>> conv;
+  std::map<uint64_t, std::shared_ptr<matmul_forward_params>> matmul;
+  std::map<uint64_t, std::shared_ptr<rnn_forward_params>> rnn;
+};
+
+// The params a prepare record was decoded into; null, with a note, when
+// that prepare was not recorded
+template <typename T>
+inline std::shared_ptr<T> find_prepared(
+    std::map<uint64_t, std::shared_ptr<T>>& prepared, uint64_t handle,
+    const std::string& op) {
+  auto it = prepared.find(handle);
+  if (it != prepared.end()) return it->second;
+  std::cerr << "replay: skipped a " << op << " whose prepare was not "
+               "recorded\n";
+  return nullptr;
+}
+
+inline std::vector<tensor> make_tensors(
+    const std::vector<utils::recorder::tensor_spec>& specs) {
+  std::vector<tensor> ts;
+  for (auto& s : specs) ts.push_back(make_tensor(s));
+  return ts;
+}
+
+// Convolution arguments shared by the 2-in-1 compute and prepare records
+struct conv_args {
+  tensor src, weights, bias, dst;
+  dims dst_dims, strides, dilates, padding_l, padding_r;
+  int groups;
+  scale_t src_scales, weights_scales, dst_scales;
+  attr_t attr;
+  algorithm aalgorithm;
+  prop_kind aprop_kind;
+  lowp_kind alowp_kind;
+
+  explicit conv_args(utils::recorder::reader& in) {
+    src = make_tensor(in.get_tensor());
+    weights = make_tensor(in.get_tensor());
+    bias = make_tensor(in.get_tensor());
+    dst_dims = in.get_dims();
+    dst = make_tensor(in.get_tensor());
+    strides = in.get_dims();
+    dilates = in.get_dims();
+    padding_l = in.get_dims();
+    padding_r = in.get_dims();
+    groups = in.get_int();
+    src_scales = in.get_scales();
+    weights_scales = in.get_scales();
+    dst_scales = in.get_scales();
+    attr = in.get_attr();
+    aalgorithm = in.get_algorithm();
+    aprop_kind = in.get_prop_kind();
+    alowp_kind = in.get_lowp_kind();
+  }
+};
+
+/// Decodes the record in, in the argument order its op passes to
+/// IDEEP_RECORD. false for ops replay does not know.
+inline bool decode(utils::recorder::reader& in, utils::recorder::op_id op,
+                   replay_params& params, replay_call& call) {
+  using rec = utils::recorder;
+  using prof = utils::profiler;
+  switch (op) {
+    case rec::convolution_forward: {
+      conv_args a(in);
+      call.name = "convolution_forward";
+      call.shape = prof::signature(a.src, a.weights);
+      call.run = [a]() mutable {
+        if (a.bias.is_empty())
+          convolution_forward::compute(
+              a.src, a.weights, a.dst_dims, a.dst, a.strides, a.dilates,
+              a.padding_l, a.padding_r, a.groups, a.src_scales,
+              a.weights_scales, a.dst_scales, a.attr, a.aalgorithm,
+              a.aprop_kind, a.alowp_kind);
+        else
+          convolution_forward::compute(
+              a.src, a.weights, a.bias, a.dst_dims, a.dst, a.strides,
+              a.dilates, a.padding_l, a.padding_r, a.groups, a.src_scales,
+              a.weights_scales, a.dst_scales, a.attr, a.aalgorithm,
+              a.aprop_kind, a.alowp_kind);
+      };
+      return true;
+    }
+    case rec::convolution_forward_prepare: {
+      auto handle = in.get_handle();
+      conv_args a(in);
+      auto param = std::make_shared<convolution_forward_params>();
+      params.conv[handle] = param;
+      call.name = "convolution_forward::prepare";
+      call.shape = prof::signature(a.src, a.weights);
+      call.run = [a, param]() mutable {
+        if (a.bias.is_empty())
+          convolution_forward::prepare(
+              *param, a.src, a.weights, a.dst_dims, a.dst, a.strides,
+              a.dilates, a.padding_l, a.padding_r, a.groups, a.src_scales,
+              a.weights_scales, a.dst_scales, a.attr, a.aalgorithm,
+              a.aprop_kind, a.alowp_kind);
+        else
+          convolution_forward::prepare(
+              *param, a.src, a.weights, a.bias, a.dst_dims, a.dst,
+              a.strides, a.dilates, a.padding_l, a.padding_r, a.groups,
+              a.src_scales, a.weights_scales, a.dst_scales, a.attr,
+              a.aalgorithm, a.aprop_kind, a.alowp_kind);
+      };
+      return true;
+    }
+    case rec::convolution_forward_param: {
+      auto param = find_prepared(params.conv, in.get_handle(),
+                                 "convolution_forward");
+      if (!param) return false;
+      auto src = make_tensor(in.get_tensor());
+      auto weights = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      call.name = "convolution_forward[param]";
+      call.shape = prof::signature(src, weights);
+      call.run = [=]() mutable {
+        if (bias.is_empty())
+          convolution_forward::compute(*param, src, weights, dst);
+        else
+          convolution_forward::compute(*param, src, weights, bias, dst);
+      };
+      return true;
+    }
+    case rec::inner_product_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto weights = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto src_scales = in.get_scales();
+      auto weights_scales = in.get_scales();
+      auto dst_scales = in.get_scales();
+      auto attr = in.get_attr();
+      auto aprop_kind = in.get_prop_kind();
+      auto alowp_kind = in.get_lowp_kind();
+      call.name = "inner_product_forward";
+      call.shape = prof::signature(src, weights);
+      call.run = [=]() mutable {
+        if (bias.is_empty())
+          inner_product_forward::compute(src, weights, dst, src_scales,
+                                         weights_scales, dst_scales, attr,
+                                         aprop_kind, alowp_kind);
+        else
+          inner_product_forward::compute(src, weights, bias, dst, src_scales,
+                                         weights_scales, dst_scales, attr,
+                                         aprop_kind, alowp_kind);
+      };
+      return true;
+    }
+    case rec::matmul_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto weights = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto dst_coeff = in.get_float();
+      auto bias_coeff = in.get_float();
+      auto sum_coeff = in.get_float();
+      auto src_scales = in.get_scales();
+      auto weights_scales = in.get_scales();
+      auto dst_scales = in.get_scales();
+      auto attr = in.get_attr();
+      auto alowp_kind = in.get_lowp_kind();
+      call.name = "matmul_forward";
+      call.shape = prof::signature(src, weights);
+      call.run = [=]() mutable {
+        if (bias.is_empty())
+          matmul_forward::compute(src, weights, dst, dst_coeff, bias_coeff,
+                                  sum_coeff, src_scales, weights_scales,
+                                  dst_scales, attr, alowp_kind);
+        else
+          matmul_forward::compute(src, weights, bias, dst, dst_coeff,
+                                  bias_coeff, sum_coeff, src_scales,
+                                  weights_scales, dst_scales, attr,
+                                  alowp_kind);
+      };
+      return true;
+    }
+    case rec::pooling_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto output_sizes = in.get_dims();
+      auto dst = make_tensor(in.get_tensor());
+      auto strides = in.get_dims();
+      auto kernel = in.get_dims();
+      auto padding_l = in.get_dims();
+      auto padding_r = in.get_dims();
+      auto aalgorithm = in.get_algorithm();
+      auto aprop_kind = in.get_prop_kind();
+      call.name = "pooling_forward";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        pooling_forward::compute(src, output_sizes, dst, strides, kernel,
+                                 padding_l, padding_r, aalgorithm, aprop_kind);
+      };
+      return true;
+    }
+    case rec::eltwise_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto aalgorithm = in.get_algorithm();
+      auto aprop_kind = in.get_prop_kind();
+      auto alpha = in.get_float();
+      auto beta = in.get_float();
+      call.name = "eltwise_forward";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        eltwise_forward::compute(src, dst, aalgorithm, aprop_kind, alpha,
+                                 beta);
+      };
+      return true;
+    }
+    case rec::batch_normalization_forward_inference: {
+      auto src = make_tensor(in.get_tensor());
+      auto mean = make_tensor(in.get_tensor());
+      auto variance = make_tensor(in.get_tensor());
+      auto scale = make_tensor(in.get_tensor());
+      auto shift = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto epsilon = in.get_float();
+      call.name = "batch_normalization_forward_inference";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        if (mean.is_empty())
+          batch_normalization_forward_inference::compute(
+              src, scale, shift, dst, epsilon);
+        else
+          batch_normalization_forward_inference::compute(
+              src, mean, variance, scale, shift, dst, epsilon);
+      };
+      return true;
+    }
+    case rec::softmax_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto softmax_axis = in.get_int();
+      auto aprop_kind = in.get_prop_kind();
+      call.name = "softmax_forward";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        softmax_forward::compute(src, dst, softmax_axis, aprop_kind);
+      };
+      return true;
+    }
+    case rec::binary: {
+      auto src0 = make_tensor(in.get_tensor());
+      auto src1 = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto aalgorithm = in.get_algorithm();
+      auto attr = in.get_attr();
+      call.name = "binary";
+      call.shape = prof::signature(src0, src1);
+      call.run = [=]() mutable {
+        binary::compute(src0, src1, dst, aalgorithm, attr);
+      };
+      return true;
+    }
+    case rec::sum: {
+      auto scales = in.get_scales();
+      auto srcs = make_tensors(in.get_tensors());
+      auto dst = make_tensor(in.get_tensor());
+      call.name = "sum";
+      call.shape = std::to_string(srcs.size()) + " x " +
+                   prof::signature(srcs.front());
+      call.run = [=]() mutable { sum::compute(scales, srcs, dst); };
+      return true;
+    }
+    case rec::concat: {
+      auto inputs = make_tensors(in.get_tensors());
+      auto axis = in.get_int();
+      auto output = make_tensor(in.get_tensor());
+      call.name = "concat";
+      call.shape = std::to_string(inputs.size()) + " x " +
+                   prof::signature(inputs.front());
+      call.run = [=]() mutable { concat::compute(inputs, axis, output); };
+      return true;
+    }
+    case rec::convolution_transpose_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto weights = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto dst_dims = in.get_dims();
+      auto dst = make_tensor(in.get_tensor());
+      auto strides = in.get_dims();
+      auto dilates = in.get_dims();
+      auto padding_l = in.get_dims();
+      auto padding_r = in.get_dims();
+      auto groups = in.get_int();
+      auto attr = in.get_attr();
+      auto aalgorithm = in.get_algorithm();
+      auto aprop_kind = in.get_prop_kind();
+      call.name = "convolution_transpose_forward";
+      call.shape = prof::signature(src, weights);
+      call.run = [=]() mutable {
+        if (bias.is_empty())
+          convolution_transpose_forward::compute(
+              src, weights, dst_dims, dst, strides, padding_l, padding_r,
+              dilates, groups, attr, aalgorithm, aprop_kind);
+        else
+          convolution_transpose_forward::compute(
+              src, weights, bias, dst_dims, dst, strides, padding_l,
+              padding_r, dilates, groups, attr, aalgorithm, aprop_kind);
+      };
+      return true;
+    }
+    case rec::lrn_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto local_size = in.get_dim();
+      auto alpha = in.get_float();
+      auto beta = in.get_float();
+      auto k = in.get_float();
+      auto aalgorithm = in.get_algorithm();
+      auto aprop_kind = in.get_prop_kind();
+      call.name = "lrn_forward";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        lrn_forward::compute(src, dst, local_size, alpha, beta, k, aalgorithm,
+                             aprop_kind);
+      };
+      return true;
+    }
+    case rec::layer_normalization_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto residual = make_tensor(in.get_tensor());
+      auto scale = make_tensor(in.get_tensor());
+      auto shift = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto epsilon = in.get_float();
+      call.name = "layer_normalization_forward";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        if (residual.is_empty())
+          layer_normalization_forward::compute(src, scale, shift, dst,
+                                               epsilon);
+        else
+          layer_normalization_forward::compute_with_residual(
+              src, residual, scale, shift, dst, epsilon);
+      };
+      return true;
+    }
+    case rec::channel_shuffle_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto group = in.get_int();
+      auto axis = in.get_int();
+      auto aprop_kind = in.get_prop_kind();
+      call.name = "channel_shuffle_forward";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        channel_shuffle_forward::compute(src, dst, group, axis, aprop_kind);
+      };
+      return true;
+    }
+    case rec::prelu_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto weights = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      call.name = "prelu_forward";
+      call.shape = prof::signature(src, weights);
+      call.run = [=]() mutable { prelu_forward::compute(src, weights, dst); };
+      return true;
+    }
+    case rec::reduction: {
+      auto src = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto axes_dims = in.get_dims();
+      std::vector<int> axes(axes_dims.begin(), axes_dims.end());
+      auto akind = in.get_reduction_kind();
+      auto keep_dims = in.get_bool();
+      call.name = "reduction";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        reduction::compute(src, dst, axes, akind, keep_dims);
+      };
+      return true;
+    }
+    case rec::resampling_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto output_sizes = in.get_dims();
+      auto factors = in.get_scales();
+      auto dst = make_tensor(in.get_tensor());
+      auto akind = in.get_resampling_kind();
+      call.name = "resampling_forward";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        if (factors.empty())
+          resampling_forward::compute(src, output_sizes, dst, akind);
+        else
+          resampling_forward::compute_with_factors(src, factors, dst, akind);
+      };
+      return true;
+    }
+    case rec::group_normalization_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto scale = make_tensor(in.get_tensor());
+      auto shift = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto groups = in.get_int();
+      auto epsilon = in.get_float();
+      auto fuse_relu = in.get_bool();
+      call.name = "group_normalization_forward";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        group_normalization_forward::compute(src, scale, shift, dst, groups,
+                                             epsilon, fuse_relu);
+      };
+      return true;
+    }
+    case rec::adaptive_pooling_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto output_sizes = in.get_dims();
+      auto dst = make_tensor(in.get_tensor());
+      auto aalgorithm = in.get_algorithm();
+      auto aprop_kind = in.get_prop_kind();
+      call.name = "adaptive_pooling_forward";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        adaptive_pooling_forward::compute(src, output_sizes, dst, aalgorithm,
+                                          aprop_kind);
+      };
+      return true;
+    }
+    case rec::log_softmax_forward: {
+      auto src = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto softmax_axis = in.get_int();
+      call.name = "log_softmax_forward";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        log_softmax_forward::compute(src, dst, softmax_axis);
+      };
+      return true;
+    }
+    case rec::embedding_bag: {
+      auto weights = make_tensor(in.get_tensor());
+      auto num_indices = in.get_dim();
+      auto num_bags = in.get_dim();
+      auto dst = make_tensor(in.get_tensor());
+      auto mode = in.get_reduction_kind();
+      // the indices were not recorded: random rows, in bags of equal size
+      std::mt19937 gen(2020);
+      std::uniform_int_distribution<dim> pick(0, weights.get_dim(0) - 1);
+      std::vector<dim> indices(num_indices), offsets(num_bags);
+      for (auto& i : indices) i = pick(gen);
+      for (dim b = 0; b < num_bags; b++)
+        offsets[b] = b * num_indices / num_bags;
+      call.name = "embedding_bag";
+      call.shape = prof::signature(weights) + " " +
+                   std::to_string(num_indices) + "/" +
+                   std::to_string(num_bags);
+      call.run = [=]() mutable {
+        embedding_bag::compute(weights, indices, offsets, dst, mode);
+      };
+      return true;
+    }
+    case rec::lstm_forward: {
+      auto src_layer = make_tensor(in.get_tensor());
+      auto src_iter = make_tensor(in.get_tensor());
+      auto src_iter_c = make_tensor(in.get_tensor());
+      auto weights_layer = make_tensor(in.get_tensor());
+      auto weights_iter = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto dst_layer_dims = in.get_dims();
+      auto dst_layer = make_tensor(in.get_tensor());
+      auto dst_iter_dims = in.get_dims();
+      auto dst_iter = make_tensor(in.get_tensor());
+      auto dst_iter_c = make_tensor(in.get_tensor());
+      auto direction = in.get_direction();
+      auto aprop_kind = in.get_prop_kind();
+      tensor workspace;
+      call.name = "lstm_forward";
+      call.shape = prof::signature(src_layer, weights_layer);
+      call.run = [=]() mutable {
+        lstm_forward::compute(src_layer, src_iter, src_iter_c, weights_layer,
+                              weights_iter, bias, dst_layer_dims, dst_layer,
+                              dst_iter_dims, dst_iter, dst_iter_c, workspace,
+                              direction, aprop_kind);
+      };
+      return true;
+    }
+    case rec::gru_forward: {
+      auto lbr = in.get_bool();
+      auto src_layer = make_tensor(in.get_tensor());
+      auto src_iter = make_tensor(in.get_tensor());
+      auto weights_layer = make_tensor(in.get_tensor());
+      auto weights_iter = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto dst_layer_dims = in.get_dims();
+      auto dst_layer = make_tensor(in.get_tensor());
+      auto dst_iter_dims = in.get_dims();
+      auto dst_iter = make_tensor(in.get_tensor());
+      auto direction = in.get_direction();
+      auto aprop_kind = in.get_prop_kind();
+      tensor workspace;
+      call.name = lbr ? "lbr_gru_forward" : "gru_forward";
+      call.shape = prof::signature(src_layer, weights_layer);
+      call.run = [=]() mutable {
+        if (lbr)
+          lbr_gru_forward::compute(src_layer, src_iter, weights_layer,
+                                   weights_iter, bias, dst_layer_dims,
+                                   dst_layer, dst_iter_dims, dst_iter,
+                                   workspace, direction, aprop_kind);
+        else
+          gru_forward::compute(src_layer, src_iter, weights_layer,
+                               weights_iter, bias, dst_layer_dims, dst_layer,
+                               dst_iter_dims, dst_iter, workspace, direction,
+                               aprop_kind);
+      };
+      return true;
+    }
+    case rec::rnn_forward: {
+      auto src_layer = make_tensor(in.get_tensor());
+      auto src_iter = make_tensor(in.get_tensor());
+      auto weights_layer = make_tensor(in.get_tensor());
+      auto weights_iter = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto dst_layer_dims = in.get_dims();
+      auto dst_layer = make_tensor(in.get_tensor());
+      auto dst_iter_dims = in.get_dims();
+      auto dst_iter = make_tensor(in.get_tensor());
+      auto akind = in.get_rnn_kind();
+      auto direction = in.get_direction();
+      auto aprop_kind = in.get_prop_kind();
+      tensor workspace;
+      call.name = "rnn_forward";
+      call.shape = prof::signature(src_layer, weights_layer);
+      call.run = [=]() mutable {
+        rnn_forward::compute(src_layer, src_iter, weights_layer, weights_iter,
+                             bias, dst_layer_dims, dst_layer, dst_iter_dims,
+                             dst_iter, workspace, akind, direction,
+                             aprop_kind);
+      };
+      return true;
+    }
+    case rec::matmul_forward_prepare: {
+      auto handle = in.get_handle();
+      auto weights = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto dst_coeff = in.get_float();
+      auto bias_coeff = in.get_float();
+      auto sum_coeff = in.get_float();
+      auto attr = in.get_attr();
+      auto param = std::make_shared<matmul_forward_params>();
+      params.matmul[handle] = param;
+      call.name = "matmul_forward::prepare";
+      call.shape = prof::signature(weights);
+      call.run = [=]() mutable {
+        if (bias.is_empty())
+          matmul_forward::prepare(*param, weights, dst_coeff, sum_coeff,
+                                  attr);
+        else
+          matmul_forward::prepare(*param, weights, bias, dst_coeff,
+                                  bias_coeff, sum_coeff, attr);
+      };
+      return true;
+    }
+    case rec::matmul_forward_param: {
+      auto param = find_prepared(params.matmul, in.get_handle(),
+                                 "matmul_forward");
+      if (!param) return false;
+      auto src = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      call.name = "matmul_forward[param]";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable { matmul_forward::compute(*param, src, dst); };
+      return true;
+    }
+    case rec::inner_product_forward_prepare: {
+      auto handle = in.get_handle();
+      auto weights = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto attr = in.get_attr();
+      auto param = std::make_shared<inner_product_forward_params>();
+      params.matmul[handle] = param;
+      call.name = "inner_product_forward::prepare";
+      call.shape = prof::signature(weights);
+      call.run = [=]() mutable {
+        if (bias.is_empty())
+          inner_product_forward::prepare(*param, weights, attr);
+        else
+          inner_product_forward::prepare(*param, weights, bias, attr);
+      };
+      return true;
+    }
+    case rec::inner_product_forward_param: {
+      auto param = find_prepared(params.matmul, in.get_handle(),
+                                 "inner_product_forward");
+      if (!param) return false;
+      auto src = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      call.name = "inner_product_forward[param]";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        inner_product_forward::compute(*param, src, dst);
+      };
+      return true;
+    }
+    case rec::rnn_forward_prepare: {
+      auto handle = in.get_handle();
+      auto src_layer = make_tensor(in.get_tensor());
+      auto src_iter = make_tensor(in.get_tensor());
+      auto weights_layer = make_tensor(in.get_tensor());
+      auto weights_iter = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto dst_layer_dims = in.get_dims();
+      auto dst_iter_dims = in.get_dims();
+      auto akind = in.get_rnn_kind();
+      auto direction = in.get_direction();
+      auto aprop_kind = in.get_prop_kind();
+      auto param = std::make_shared<rnn_forward_params>();
+      params.rnn[handle] = param;
+      call.name = "rnn_forward::prepare";
+      call.shape = prof::signature(src_layer, weights_layer);
+      call.run = [=]() mutable {
+        rnn_forward::prepare(*param, src_layer, src_iter, weights_layer,
+                             weights_iter, bias, dst_layer_dims,
+                             dst_iter_dims, akind, direction, aprop_kind);
+      };
+      return true;
+    }
+    case rec::rnn_forward_param: {
+      auto param = find_prepared(params.rnn, in.get_handle(), "rnn_forward");
+      if (!param) return false;
+      auto src_layer = make_tensor(in.get_tensor());
+      auto src_iter = make_tensor(in.get_tensor());
+      auto weights_layer = make_tensor(in.get_tensor());
+      auto weights_iter = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto dst_layer = make_tensor(in.get_tensor());
+      auto dst_iter = make_tensor(in.get_tensor());
+      tensor workspace;
+      call.name = "rnn_forward[param]";
+      call.shape = prof::signature(src_layer, weights_layer);
+      call.run = [=]() mutable {
+        rnn_forward::compute(*param, src_layer, src_iter, weights_layer,
+                             weights_iter, bias, dst_layer, dst_iter,
+                             workspace);
+      };
+      return true;
+    }
+    case rec::convolution_backward_data: {
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto weights = make_tensor(in.get_tensor());
+      auto diff_src_dims = in.get_dims();
+      auto diff_src = make_tensor(in.get_tensor());
+      auto strides = in.get_dims();
+      auto dilates = in.get_dims();
+      auto padding_l = in.get_dims();
+      auto padding_r = in.get_dims();
+      auto groups = in.get_int();
+      auto aalgorithm = in.get_algorithm();
+      call.name = "convolution_backward_data";
+      call.shape = prof::signature(diff_dst, weights);
+      call.run = [=]() mutable {
+        convolution_backward_data::compute(
+            diff_dst, weights, diff_src_dims, diff_src, strides, dilates,
+            padding_l, padding_r, groups, aalgorithm);
+      };
+      return true;
+    }
+    case rec::convolution_backward_weights: {
+      auto src = make_tensor(in.get_tensor());
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto diff_weights_dims = in.get_dims();
+      auto diff_weights = make_tensor(in.get_tensor());
+      auto with_diff_bias = in.get_bool();
+      auto strides = in.get_dims();
+      auto dilates = in.get_dims();
+      auto padding_l = in.get_dims();
+      auto padding_r = in.get_dims();
+      auto groups = in.get_int();
+      auto aalgorithm = in.get_algorithm();
+      tensor diff_bias;
+      call.name = "convolution_backward_weights";
+      call.shape = prof::signature(src, diff_dst);
+      call.run = [=]() mutable {
+        if (with_diff_bias)
+          convolution_backward_weights::compute(
+              src, diff_dst, diff_weights_dims, diff_weights, diff_bias,
+              strides, dilates, padding_l, padding_r, groups, aalgorithm);
+        else
+          convolution_backward_weights::compute(
+              src, diff_dst, diff_weights_dims, diff_weights, strides,
+              dilates, padding_l, padding_r, groups, aalgorithm);
+      };
+      return true;
+    }
+    case rec::convolution_transpose_backward_data: {
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto weights = make_tensor(in.get_tensor());
+      auto diff_src_dims = in.get_dims();
+      auto diff_src = make_tensor(in.get_tensor());
+      auto strides = in.get_dims();
+      auto padding_l = in.get_dims();
+      auto padding_r = in.get_dims();
+      auto dilates = in.get_dims();
+      auto groups = in.get_int();
+      auto aalgorithm = in.get_algorithm();
+      call.name = "convolution_transpose_backward_data";
+      call.shape = prof::signature(diff_dst, weights);
+      call.run = [=]() mutable {
+        convolution_transpose_backward_data::compute(
+            diff_dst, weights, diff_src_dims, diff_src, strides, padding_l,
+            padding_r, dilates, groups, aalgorithm);
+      };
+      return true;
+    }
+    case rec::convolution_transpose_backward_weights: {
+      auto src = make_tensor(in.get_tensor());
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto diff_weights_dims = in.get_dims();
+      auto diff_weights = make_tensor(in.get_tensor());
+      auto with_diff_bias = in.get_bool();
+      auto strides = in.get_dims();
+      auto padding_l = in.get_dims();
+      auto padding_r = in.get_dims();
+      auto dilates = in.get_dims();
+      auto groups = in.get_int();
+      auto aalgorithm = in.get_algorithm();
+      tensor diff_bias;
+      call.name = "convolution_transpose_backward_weights";
+      call.shape = prof::signature(src, diff_dst);
+      call.run = [=]() mutable {
+        if (with_diff_bias)
+          convolution_transpose_backward_weights::compute(
+              src, diff_dst, diff_weights_dims, diff_weights, diff_bias,
+              strides, padding_l, padding_r, dilates, groups, aalgorithm);
+        else
+          convolution_transpose_backward_weights::compute(
+              src, diff_dst, diff_weights_dims, diff_weights, strides,
+              padding_l, padding_r, dilates, groups, aalgorithm);
+      };
+      return true;
+    }
+    case rec::inner_product_backward_data: {
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto weights = make_tensor(in.get_tensor());
+      auto diff_src_dims = in.get_dims();
+      auto diff_src = make_tensor(in.get_tensor());
+      call.name = "inner_product_backward_data";
+      call.shape = prof::signature(diff_dst, weights);
+      call.run = [=]() mutable {
+        inner_product_backward_data::compute(diff_dst, weights, diff_src_dims,
+                                             diff_src);
+      };
+      return true;
+    }
+    case rec::inner_product_backward_weights: {
+      auto src = make_tensor(in.get_tensor());
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto diff_weights = make_tensor(in.get_tensor());
+      auto with_diff_bias = in.get_bool();
+      tensor diff_bias;
+      call.name = "inner_product_backward_weights";
+      call.shape = prof::signature(src, diff_dst);
+      call.run = [=]() mutable {
+        if (with_diff_bias)
+          inner_product_backward_weights::compute(src, diff_dst, diff_weights,
+                                                  diff_bias);
+        else
+          inner_product_backward_weights::compute(src, diff_dst,
+                                                  diff_weights);
+      };
+      return true;
+    }
+    case rec::pooling_backward: {
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto src = make_tensor(in.get_tensor());
+      auto diff_src = make_tensor(in.get_tensor());
+      auto strides = in.get_dims();
+      auto kernel = in.get_dims();
+      auto padding_l = in.get_dims();
+      auto padding_r = in.get_dims();
+      auto aalgorithm = in.get_algorithm();
+      // max pooling reads the indices a training forward keeps with dst,
+      // which were not recorded
+      if (aalgorithm == algorithm::pooling_max)
+        pooling_forward::compute(src, dst.get_dims(), dst, strides, kernel,
+                                 padding_l, padding_r, aalgorithm,
+                                 prop_kind::forward_training);
+      call.name = "pooling_backward";
+      call.shape = prof::signature(diff_dst, src);
+      call.run = [=]() mutable {
+        pooling_backward::compute(diff_dst, dst, src, diff_src, strides,
+                                  kernel, padding_l, padding_r, aalgorithm);
+      };
+      return true;
+    }
+    case rec::eltwise_backward: {
+      auto src = make_tensor(in.get_tensor());
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto diff_src = make_tensor(in.get_tensor());
+      auto aalgorithm = in.get_algorithm();
+      auto alpha = in.get_float();
+      auto beta = in.get_float();
+      call.name = "eltwise_backward";
+      call.shape = prof::signature(src, diff_dst);
+      call.run = [=]() mutable {
+        eltwise_backward::compute(src, diff_dst, diff_src, aalgorithm, alpha,
+                                  beta);
+      };
+      return true;
+    }
+    case rec::softmax_backward:
+    case rec::log_softmax_backward: {
+      auto dst = make_tensor(in.get_tensor());
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto diff_src = make_tensor(in.get_tensor());
+      auto softmax_axis = in.get_int();
+      bool log = op == rec::log_softmax_backward;
+      call.name = log ? "log_softmax_backward" : "softmax_backward";
+      call.shape = prof::signature(dst, diff_dst);
+      call.run = [=]() mutable {
+        if (log)
+          log_softmax_backward::compute(dst, diff_dst, diff_src,
+                                        softmax_axis);
+        else
+          softmax_backward::compute(dst, diff_dst, diff_src, softmax_axis);
+      };
+      return true;
+    }
+    case rec::softmax_cross_entropy: {
+      auto logits = make_tensor(in.get_tensor());
+      auto num_labels = in.get_dim();
+      auto loss = make_tensor(in.get_tensor());
+      auto diff_src = make_tensor(in.get_tensor());
+      auto ignore_index = in.get_dim();
+      // the labels were not recorded: random classes
+      std::mt19937 gen(2020);
+      std::uniform_int_distribution<dim> pick(0, logits.get_dim(1) - 1);
+      std::vector<dim> labels(num_labels);
+      for (auto& l : labels) l = pick(gen);
+      call.name = "softmax_cross_entropy";
+      call.shape = prof::signature(logits);
+      call.run = [=]() mutable {
+        softmax_cross_entropy::compute(logits, labels, loss, diff_src,
+                                       ignore_index);
+      };
+      return true;
+    }
+    case rec::batch_normalization_forward_training: {
+      auto src = make_tensor(in.get_tensor());
+      auto scale = make_tensor(in.get_tensor());
+      auto shift = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto mean = make_tensor(in.get_tensor());
+      auto variance = make_tensor(in.get_tensor());
+      auto running_mean = make_tensor(in.get_tensor());
+      auto running_var = make_tensor(in.get_tensor());
+      auto momentum = in.get_float();
+      auto epsilon = in.get_float();
+      call.name = "batch_normalization_forward_training";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        if (running_mean.is_empty())
+          batch_normalization_forward_training::compute(
+              src, scale, shift, dst, mean, variance, momentum, epsilon);
+        else
+          batch_normalization_forward_training::compute(
+              src, scale, shift, dst, mean, variance, running_mean,
+              running_var, momentum, epsilon);
+      };
+      return true;
+    }
+    case rec::batch_normalization_backward: {
+      auto split = in.get_bool();
+      auto src = make_tensor(in.get_tensor());
+      auto mean = make_tensor(in.get_tensor());
+      auto variance = make_tensor(in.get_tensor());
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto scale = make_tensor(in.get_tensor());
+      auto diff_src = make_tensor(in.get_tensor());
+      auto epsilon = in.get_float();
+      tensor diff_scale_shift, diff_scale, diff_shift;
+      call.name = "batch_normalization_backward";
+      call.shape = prof::signature(src, diff_dst);
+      call.run = [=]() mutable {
+        if (split)
+          batch_normalization_backward::compute(
+              src, mean, variance, diff_dst, scale, diff_src, diff_scale,
+              diff_shift, epsilon);
+        else
+          batch_normalization_backward::compute(
+              src, mean, variance, diff_dst, scale, diff_src,
+              diff_scale_shift, epsilon);
+      };
+      return true;
+    }
+    case rec::layer_normalization_forward_training: {
+      auto src = make_tensor(in.get_tensor());
+      auto scale = make_tensor(in.get_tensor());
+      auto shift = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto mean = make_tensor(in.get_tensor());
+      auto variance = make_tensor(in.get_tensor());
+      auto epsilon = in.get_float();
+      call.name = "layer_normalization_forward[training]";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        layer_normalization_forward::compute(src, scale, shift, dst, mean,
+                                             variance, epsilon);
+      };
+      return true;
+    }
+    case rec::layer_normalization_backward: {
+      auto src = make_tensor(in.get_tensor());
+      auto mean = make_tensor(in.get_tensor());
+      auto variance = make_tensor(in.get_tensor());
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto scale = make_tensor(in.get_tensor());
+      auto shift = make_tensor(in.get_tensor());
+      auto diff_src = make_tensor(in.get_tensor());
+      auto epsilon = in.get_float();
+      tensor diff_scale_shift, diff_scale, diff_shift;
+      call.name = "layer_normalization_backward";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        // an empty shift means scale holds the packed scale_shift
+        if (shift.is_empty())
+          layer_normalization_backward::compute(
+              src, mean, variance, diff_dst, scale, diff_src,
+              diff_scale_shift, epsilon);
+        else
+          layer_normalization_backward::compute(
+              src, mean, variance, diff_dst, scale, shift, diff_src,
+              diff_scale, diff_shift, epsilon);
+      };
+      return true;
+    }
+    case rec::lrn_backward: {
+      auto src = make_tensor(in.get_tensor());
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto diff_src = make_tensor(in.get_tensor());
+      auto local_size = in.get_dim();
+      auto alpha = in.get_float();
+      auto beta = in.get_float();
+      auto k = in.get_float();
+      auto aalgorithm = in.get_algorithm();
+      // the workspace a training forward keeps with dst was not recorded
+      lrn_forward::compute(src, dst, local_size, alpha, beta, k, aalgorithm,
+                           prop_kind::forward_training);
+      call.name = "lrn_backward";
+      call.shape = prof::signature(diff_dst);
+      call.run = [=]() mutable {
+        lrn_backward::compute(src, diff_dst, dst, diff_src, local_size, alpha,
+                              beta, k, aalgorithm);
+      };
+      return true;
+    }
+    case rec::channel_shuffle_backward: {
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto diff_src = make_tensor(in.get_tensor());
+      auto group = in.get_int();
+      auto axis = in.get_int();
+      call.name = "channel_shuffle_backward";
+      call.shape = prof::signature(diff_dst);
+      call.run = [=]() mutable {
+        channel_shuffle_backward::compute(diff_dst, diff_src, group, axis);
+      };
+      return true;
+    }
+    case rec::prelu_backward: {
+      auto src = make_tensor(in.get_tensor());
+      auto weights = make_tensor(in.get_tensor());
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto diff_src = make_tensor(in.get_tensor());
+      auto diff_weights = make_tensor(in.get_tensor());
+      call.name = "prelu_backward";
+      call.shape = prof::signature(src, weights);
+      call.run = [=]() mutable {
+        prelu_backward::compute(src, weights, diff_dst, diff_src,
+                                diff_weights);
+      };
+      return true;
+    }
+    case rec::group_normalization_forward_training: {
+      auto src = make_tensor(in.get_tensor());
+      auto scale = make_tensor(in.get_tensor());
+      auto shift = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto mean = make_tensor(in.get_tensor());
+      auto variance = make_tensor(in.get_tensor());
+      auto groups = in.get_int();
+      auto epsilon = in.get_float();
+      auto fuse_relu = in.get_bool();
+      call.name = "group_normalization_forward[training]";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        group_normalization_forward::compute(src, scale, shift, dst, mean,
+                                             variance, groups, epsilon,
+                                             fuse_relu);
+      };
+      return true;
+    }
+    case rec::group_normalization_backward: {
+      auto src = make_tensor(in.get_tensor());
+      auto mean = make_tensor(in.get_tensor());
+      auto variance = make_tensor(in.get_tensor());
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto scale = make_tensor(in.get_tensor());
+      auto shift = make_tensor(in.get_tensor());
+      auto diff_src = make_tensor(in.get_tensor());
+      auto groups = in.get_int();
+      auto epsilon = in.get_float();
+      auto fuse_relu = in.get_bool();
+      tensor diff_scale, diff_shift;
+      call.name = "group_normalization_backward";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        group_normalization_backward::compute(
+            src, mean, variance, diff_dst, scale, shift, diff_src,
+            diff_scale, diff_shift, groups, epsilon, fuse_relu);
+      };
+      return true;
+    }
+    case rec::adaptive_pooling_backward: {
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto dst = make_tensor(in.get_tensor());
+      auto src = make_tensor(in.get_tensor());
+      auto diff_src = make_tensor(in.get_tensor());
+      auto aalgorithm = in.get_algorithm();
+      // as for pooling_backward, max reads the indices kept with dst
+      if (aalgorithm == algorithm::pooling_max)
+        adaptive_pooling_forward::compute(src, dst.get_dims(), dst,
+                                          aalgorithm,
+                                          prop_kind::forward_training);
+      call.name = "adaptive_pooling_backward";
+      call.shape = prof::signature(diff_dst);
+      call.run = [=]() mutable {
+        adaptive_pooling_backward::compute(diff_dst, dst, src, diff_src,
+                                           aalgorithm);
+      };
+      return true;
+    }
+    case rec::resampling_backward: {
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto src_sizes = in.get_dims();
+      auto diff_src = make_tensor(in.get_tensor());
+      auto akind = in.get_resampling_kind();
+      auto factors = in.get_scales();
+      call.name = "resampling_backward";
+      call.shape = prof::signature(diff_dst);
+      call.run = [=]() mutable {
+        resampling_backward::compute(diff_dst, src_sizes, diff_src, akind,
+                                     factors);
+      };
+      return true;
+    }
+    case rec::embedding_bag_backward: {
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto num_indices = in.get_dim();
+      auto num_bags = in.get_dim();
+      auto mode = in.get_reduction_kind();
+      // neither the rows nor the table size were recorded: rows are drawn
+      // from as many as there are lookups
+      std::mt19937 gen(2020);
+      std::uniform_int_distribution<dim> pick(0, num_indices - 1);
+      std::vector<dim> rows(num_indices), offsets(num_bags);
+      for (auto& r : rows) r = pick(gen);
+      for (dim b = 0; b < num_bags; b++)
+        offsets[b] = b * num_indices / num_bags;
+      std::vector<dim> grad_rows;
+      tensor grad_values;
+      call.name = "embedding_bag_backward";
+      call.shape = prof::signature(diff_dst) + " " +
+                   std::to_string(num_indices) + "/" +
+                   std::to_string(num_bags);
+      call.run = [=]() mutable {
+        if (mode == REDUCE_MAX)
+          embedding_bag_backward::compute(diff_dst, rows, grad_rows,
+                                          grad_values);
+        else
+          embedding_bag_backward::compute(diff_dst, rows, offsets, grad_rows,
+                                          grad_values, mode);
+      };
+      return true;
+    }
+    case rec::lstm_backward: {
+      auto src_layer = make_tensor(in.get_tensor());
+      auto src_iter = make_tensor(in.get_tensor());
+      auto src_iter_c = make_tensor(in.get_tensor());
+      auto weights_layer = make_tensor(in.get_tensor());
+      auto weights_iter = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto dst_layer = make_tensor(in.get_tensor());
+      auto dst_iter = make_tensor(in.get_tensor());
+      auto dst_iter_c = make_tensor(in.get_tensor());
+      auto diff_dst_layer = make_tensor(in.get_tensor());
+      auto diff_dst_iter = make_tensor(in.get_tensor());
+      auto diff_dst_iter_c = make_tensor(in.get_tensor());
+      auto workspace = make_tensor(in.get_tensor());
+      auto direction = in.get_direction();
+      tensor diff_src_layer, diff_src_iter, diff_src_iter_c;
+      tensor diff_weights_layer, diff_weights_iter, diff_bias;
+      call.name = "lstm_backward";
+      call.shape = prof::signature(src_layer, weights_layer);
+      call.run = [=]() mutable {
+        lstm_backward::compute(
+            src_layer, src_iter, src_iter_c, weights_layer, weights_iter,
+            bias, dst_layer, dst_iter, dst_iter_c, diff_dst_layer,
+            diff_dst_iter, diff_dst_iter_c, workspace, diff_src_layer,
+            diff_src_iter, diff_src_iter_c, diff_weights_layer,
+            diff_weights_iter, diff_bias, direction);
+      };
+      return true;
+    }
+    case rec::gru_backward: {
+      auto lbr = in.get_bool();
+      auto src_layer = make_tensor(in.get_tensor());
+      auto src_iter = make_tensor(in.get_tensor());
+      auto weights_layer = make_tensor(in.get_tensor());
+      auto weights_iter = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto dst_layer = make_tensor(in.get_tensor());
+      auto dst_iter = make_tensor(in.get_tensor());
+      auto diff_dst_layer = make_tensor(in.get_tensor());
+      auto diff_dst_iter = make_tensor(in.get_tensor());
+      auto workspace = make_tensor(in.get_tensor());
+      auto direction = in.get_direction();
+      tensor diff_src_layer, diff_src_iter;
+      tensor diff_weights_layer, diff_weights_iter, diff_bias;
+      call.name = lbr ? "lbr_gru_backward" : "gru_backward";
+      call.shape = prof::signature(src_layer, weights_layer);
+      call.run = [=]() mutable {
+        if (lbr)
+          lbr_gru_backward::compute(
+              src_layer, src_iter, weights_layer, weights_iter, bias,
+              dst_layer, dst_iter, diff_dst_layer, diff_dst_iter, workspace,
+              diff_src_layer, diff_src_iter, diff_weights_layer,
+              diff_weights_iter, diff_bias, direction);
+        else
+          gru_backward::compute(
+              src_layer, src_iter, weights_layer, weights_iter, bias,
+              dst_layer, dst_iter, diff_dst_layer, diff_dst_iter, workspace,
+              diff_src_layer, diff_src_iter, diff_weights_layer,
+              diff_weights_iter, diff_bias, direction);
+      };
+      return true;
+    }
+    case rec::rnn_backward: {
+      auto src_layer = make_tensor(in.get_tensor());
+      auto src_iter = make_tensor(in.get_tensor());
+      auto weights_layer = make_tensor(in.get_tensor());
+      auto weights_iter = make_tensor(in.get_tensor());
+      auto bias = make_tensor(in.get_tensor());
+      auto dst_layer = make_tensor(in.get_tensor());
+      auto dst_iter = make_tensor(in.get_tensor());
+      auto diff_dst_layer = make_tensor(in.get_tensor());
+      auto diff_dst_iter = make_tensor(in.get_tensor());
+      auto workspace = make_tensor(in.get_tensor());
+      auto with_bias = in.get_bool();
+      auto akind = in.get_rnn_kind();
+      auto direction = in.get_direction();
+      auto aprop_kind = in.get_prop_kind();
+      tensor diff_src_layer, diff_src_iter;
+      tensor diff_weights_layer, diff_weights_iter, diff_bias;
+      call.name = "rnn_backward";
+      call.shape = prof::signature(src_layer, weights_layer);
+      call.run = [=]() mutable {
+        rnn_backward::compute(
+            src_layer, src_iter, weights_layer, weights_iter, bias,
+            dst_layer, dst_iter, diff_dst_layer, diff_dst_iter, workspace,
+            with_bias, diff_src_layer, diff_src_iter, diff_weights_layer,
+            diff_weights_iter, diff_bias, akind, direction, aprop_kind);
+      };
+      return true;
+    }
+    case rec::dropout_forward: {
+      auto packed = in.get_bool();
+      auto src = make_tensor(in.get_tensor());
+      auto ratio = in.get_float();
+      auto dst = make_tensor(in.get_tensor());
+      tensor mask;
+      call.name = "dropout_forward";
+      call.shape = prof::signature(src);
+      call.run = [=]() mutable {
+        if (packed)
+          dropout_forward::compute(src, ratio, dst, mask, 2020, 0);
+        else
+          dropout_forward::compute(src, ratio, dst, mask);
+      };
+      return true;
+    }
+    case rec::dropout_backward: {
+      auto packed = in.get_bool();
+      auto mask = make_tensor(in.get_tensor());
+      auto ratio = in.get_float();
+      auto diff_dst = make_tensor(in.get_tensor());
+      auto diff_src = make_tensor(in.get_tensor());
+      call.name = "dropout_backward";
+      call.shape = prof::signature(diff_dst);
+      call.run = [=]() mutable {
+        if (packed)
+          dropout_backward::compute(mask, ratio, diff_dst, diff_src);
+        else
+          dropout_backward::compute(mask, diff_dst, diff_src);
+      };
+      return true;
+    }
+    case rec::sgd_update: {
+      auto with_master = in.get_bool();
+      auto weights = make_tensors(in.get_tensors());
+      auto grads = make_tensors(in.get_tensors());
+      auto lr = in.get_float();
+      auto momentum = in.get_float();
+      auto weight_decay = in.get_float();
+      auto dampening = in.get_float();
+      auto nesterov = in.get_bool();
+      // master weights and momentum buffers are created by the first run
+      std::vector<tensor> master_weights, momentum_buffers;
+      call.name = "sgd_update";
+      call.shape = prof::signature(weights);
+      call.run = [=]() mutable {
+        if (with_master)
+          sgd_update::compute(weights, master_weights, grads,
+                              momentum_buffers, lr, momentum, weight_decay,
+                              dampening, nesterov);
+        else
+          sgd_update::compute(weights, grads, momentum_buffers, lr, momentum,
+                              weight_decay, dampening, nesterov);
+      };
+      return true;
+    }
+    case rec::adam_update:
+    case rec::lamb_update: {
+      bool lamb = op == rec::lamb_update;
+      auto with_master = in.get_bool();
+      auto weights = make_tensors(in.get_tensors());
+      auto grads = make_tensors(in.get_tensors());
+      auto step = in.get_dim();
+      auto lr = in.get_float();
+      auto beta1 = in.get_float();
+      auto beta2 = in.get_float();
+      auto epsilon = in.get_float();
+      auto weight_decay = in.get_float();
+      auto decoupled = lamb ? false : in.get_bool();
+      std::vector<tensor> master_weights, exp_avg, exp_avg_sq;
+      call.name = lamb ? "lamb_update" : "adam_update";
+      call.shape = prof::signature(weights);
+      call.run = [=]() mutable {
+        if (lamb && with_master)
+          lamb_update::compute(weights, master_weights, grads, exp_avg,
+                               exp_avg_sq, step, lr, beta1, beta2, epsilon,
+                               weight_decay);
+        else if (lamb)
+          lamb_update::compute(weights, grads, exp_avg, exp_avg_sq, step, lr,
+                               beta1, beta2, epsilon, weight_decay);
+        else if (with_master)
+          adam_update::compute(weights, master_weights, grads, exp_avg,
+                               exp_avg_sq, step, lr, beta1, beta2, epsilon,
+                               weight_decay, decoupled);
+        else
+          adam_update::compute(weights, grads, exp_avg, exp_avg_sq, step, lr,
+                               beta1, beta2, epsilon, weight_decay,
+                               decoupled);
+      };
+      return true;
+    }
+    default:
+      std::cerr << "replay: skipped an unknown op "
+                << static_cast<int>(op) << "\n";
+      return false;
+  }
+}
+
+}  // namespace detail
+
+/// Re-runs the calls recorded by utils::recorder in path, in order, on
+/// random data of the recorded descs. The whole sequence runs warmup +
+/// iters times; there is one result per call and one for the sequence.
+inline std::vector<result> replay(const std::string& path,
+                                  const options& opt) {
+  using clock = std::chrono::steady_clock;
+#ifdef _OPENMP
+  if (!opt.threads.empty()) omp_set_num_threads(opt.threads.front());
+#endif
+  utils::recorder::reader in(path);
+  detail::replay_params params;
+  std::vector<detail::replay_call> calls;
+  utils::recorder::op_id op;
+  while (in.next(op)) {
+    detail::replay_call call;
+    if (detail::decode(in, op, params, call)) calls.push_back(call);
+  }
+
+  for (int i = 0; i < opt.warmup; i++)
+    for (auto& c : calls) c.run();
+
+  std::vector<std::vector<double>> ms(calls.size());
+  std::vector<double> total;
+  double spent = 0.;
+  while (total.size() < static_cast<size_t>(opt.iters) ||
+         spent < opt.min_time_ms) {
+    auto seq_start = clock::now();
+    for (size_t k = 0; k < calls.size(); k++) {
+      auto start = clock::now();
+      calls[k].run();
+      ms[k].push_back(std::chrono::duration<double, std::milli>(
+          clock::now() - start).count());
+    }
+    total.push_back(std::chrono::duration<double, std::milli>(
+        clock::now() - seq_start).count());
+    spent += total.back();
+  }
+
+  std::vector<result> results;
+  for (size_t k = 0; k < calls.size(); k++) {
+    auto r = summarize(std::move(ms[k]));
+    r.name = "#" + std::to_string(k) + " " + calls[k].name;
+    r.shape = calls[k].shape;
+    r.config = "replay";
+    results.push_back(r);
+  }
+  auto r = summarize(std::move(total));
+  r.name = "sequence";
+  r.shape = std::to_string(calls.size()) + " calls";
+  r.config = "replay";
+  results.push_back(r);
+  return results;
+}
+
+inline std::string report(const std::vector<result>& results,
+                          bool csv = false) {
+  std::ostringstream os;
+  if (csv) {
+    os << "op,shape,config,iters,mean_ms,p50_ms,p90_ms,p99_ms,samples_per_s,"
+          "gflops,gbps\n";
+    for (auto& r : results)
+      os << r.name << "," << r.shape << "," << r.config << "," << r.iters
+         << "," << r.mean_ms << "," << r.p50_ms << "," << r.p90_ms << ","
+         << r.p99_ms << "," << r.samples_per_s << "," << r.gflops << ","
+         << r.gbps << "\n";
+    return os.str();
+  }
+  os << std::left << std::setw(38) << "op" << std::setw(36) << "shape"
+     << std::setw(16) << "config" << std::right << std::setw(10) << "p50(ms)"
+     << std::setw(10) << "p90(ms)" << std::setw(10) << "p99(ms)"
+     << std::setw(12) << "samples/s" << std::setw(10) << "GFLOP/s"
+     << std::setw(8) << "GB/s" << "\n";
+  os << std::fixed << std::setprecision(3);
+  for (auto& r : results) {
+    os << std::left << std::setw(38) << r.name << std::setw(36) << r.shape
+       << std::setw(16) << r.config << std::right << std::setw(10) << r.p50_ms
+       << std::setw(10) << r.p90_ms << std::setw(10) << r.p99_ms
+       << std::setprecision(1) << std::setw(12) << r.samples_per_s
+       << std::setw(10) << r.gflops << std::setw(8) << r.gbps
+       << std::setprecision(3) << "\n";
+  }
+  return os.str();
+}
+
+/// Parses --sets, --dtypes, --formats, --threads, --batch, --iters,
+/// --warmup, --min-time-ms, --filter, --csv and --replay, runs, and prints
+/// the report
+inline int run_from_args(int argc, char** argv) {
+  options opt;
+  std::string replay_path;
+  try {
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      auto eq = arg.find('=');
+      auto key = arg.substr(0, eq);
+      auto value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+      if (key == "--sets") {
+        opt.sets = detail::split(value);
+      } else if (key == "--dtypes") {
+        opt.dtypes.clear();
+        for (auto& d : detail::split(value)) {
+          if (d == "f32") opt.dtypes.push_back(data_type::f32);
+          else if (d == "bf16") opt.dtypes.push_back(data_type::bf16);
+          else if (d == "int8") opt.dtypes.push_back(data_type::s8);
+          else throw error(dnnl_invalid_arguments, "unknown dtype");
+        }
+      } else if (key == "--formats") {
+        opt.formats.clear();
+        for (auto& f : detail::split(value)) {
+          if (f == "nchw") opt.formats.push_back(layout::nchw);
+          else if (f == "nhwc") opt.formats.push_back(layout::nhwc);
+          else if (f == "blocked") opt.formats.push_back(layout::blocked);
+          else throw error(dnnl_invalid_arguments, "unknown format");
+        }
+      } else if (key == "--threads") {
+        for (auto& t : detail::split(value))
+          opt.threads.push_back(std::atoi(t.c_str()));
+      } else if (key == "--batch") {
+        opt.batch = std::atol(value.c_str());
+      } else if (key == "--iters") {
+        opt.iters = std::atoi(value.c_str());
+      } else if (key == "--warmup") {
+        opt.warmup = std::atoi(value.c_str());
+      } else if (key == "--min-time-ms") {
+        opt.min_time_ms = std::atof(value.c_str());
+      } else if (key == "--filter") {
+        opt.filter = value;
+      } else if (key == "--csv") {
+        opt.csv = true;
+      } else if (key == "--replay") {
+        replay_path = value;
+      } else {
+        std::cerr << "unknown option " << arg << "\n";
+        return 1;
+      }
+    }
+    auto results = replay_path.empty() ? run(opt) : replay(replay_path, opt);
+    std::cout << report(results, opt.csv);
+  } catch (const error& e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace benchmark
+}  // namespace ideep
+
+#endif
@@ -1,6 +1,11 @@
 #ifndef IDEEP_COMPUTATIONS_HPP
 #define IDEEP_COMPUTATIONS_HPP
 
+#include "manifest.hpp"
+#include "recorder.hpp"
+#include "tuning_cache.hpp"
+
+#include "operators/adaptive_pool.hpp"
 #include "operators/batchnorm.hpp"
 #include "operators/binary.hpp"
 #include "operators/channel_shuffle.hpp"
@@ -10,6 +15,8 @@
 #include "operators/direct_copy.hpp"
 #include "operators/dropout.hpp"
 #include "operators/eltwise.hpp"
+#include "operators/embedding_bag.hpp"
+#include "operators/groupnorm.hpp"
 #include "operators/gru.hpp"
 #include "operators/inner_product.hpp"
 #include "operators/layernorm.hpp"
@@ -17,10 +24,17 @@
 #include "operators/lrn.hpp"
 #include "operators/lstm.hpp"
 #include "operators/matmul.hpp"
+#include "operators/optimizer.hpp"
 #include "operators/pool.hpp"
+#include "operators/prelu.hpp"
+#include "operators/reduction.hpp"
+#include "operators/resampling.hpp"
+#include "operators/rnn_bucketing.hpp"
 #include "operators/softmax.hpp"
 #include "operators/spliter.hpp"
 #include "operators/sum.hpp"
 #include "operators/vanilla_rnn.hpp"
 
+#include "warmup.hpp"
+
 #endif
@@ -0,0 +1,143 @@
+#ifndef IDEEP_LRU_CACHE_HPP
+#define IDEEP_LRU_CACHE_HPP
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include "abstract_types.hpp"
+
+namespace ideep {
+namespace utils {
+
+/// A bounded map that evicts the least recently used entry once full.
+/// Not thread-safe by itself, see computation_cache for the shared version.
+template <class key_t, class value_t>
+class lru_cache {
+ public:
+  using value_type = std::pair<key_t, value_t>;
+  using list_type = std::list<value_type>;
+  using iterator = typename list_type::iterator;
+
+  explicit lru_cache(size_t capacity) : capacity_(capacity) {}
+
+  size_t size() const { return map_.size(); }
+
+  size_t capacity() const { return capacity_; }
+
+  void resize(size_t capacity) {
+    capacity_ = capacity;
+    evict();
+  }
+
+  /// Returns true and copies the value out if key is cached
+  bool find(const key_t& key, value_t& value) {
+    auto it = map_.find(key);
+    if (it == map_.end()) return false;
+    // move to the front as the most recently used
+    vlist_.splice(vlist_.begin(), vlist_, it->second);
+    value = it->second->second;
+    return true;
+  }
+
+  void insert(const key_t& key, const value_t& value) {
+    auto it = map_.find(key);
+    if (it != map_.end()) {
+      it->second->second = value;
+      vlist_.splice(vlist_.begin(), vlist_, it->second);
+      return;
+    }
+    vlist_.emplace_front(key, value);
+    map_.emplace(key, vlist_.begin());
+    evict();
+  }
+
+  void clear() {
+    map_.clear();
+    vlist_.clear();
+  }
+
+  /// Keys from the most to the least recently used
+  std::vector<key_t> keys() const {
+    std::vector<key_t> ret;
+    ret.reserve(vlist_.size());
+    for (auto& kv : vlist_) ret.push_back(kv.first);
+    return ret;
+  }
+
+ private:
+  void evict() {
+    while (map_.size() > capacity_) {
+      map_.erase(vlist_.back().first);
+      vlist_.pop_back();
+    }
+  }
+
+  size_t capacity_;
+  list_type vlist_;
+  std::unordered_map<key_t, iterator> map_;
+};
+
+inline size_t get_cache_capacity() {
+  static size_t capacity = [] {
+    auto env = std::getenv("IDEEP_LRU_CACHE_CAPACITY");
+    return env ? static_cast<size_t>(std::atol(env)) : 1024;
+  }();
+  return capacity;
+}
+
+/// Process-wide cache of prepared computations (pd + primitive, params
+/// structs, ...) keyed by `utils::create_key`. Shared by all threads so that
+/// a primitive created on one thread is reused by the others.
+template <class value_t>
+class computation_cache {
+ public:
+  /// Returns the cached value for key, or calls creator() and caches it.
+  /// creator runs outside the lock, so two threads missing on the same key
+  /// may both create it; the later insert wins, which is harmless.
+  template <typename creator_t>
+  static value_t fetch_or_create(const key_t& key, creator_t&& creator) {
+    value_t value;
+    {
+      std::lock_guard<std::mutex> lock(mutex());
+      if (cache().find(key, value)) return value;
+    }
+    value = creator();
+    {
+      std::lock_guard<std::mutex> lock(mutex());
+      cache().insert(key, value);
+    }
+    return value;
+  }
+
+  static size_t size() {
+    std::lock_guard<std::mutex> lock(mutex());
+    return cache().size();
+  }
+
+  static void clear() {
+    std::lock_guard<std::mutex> lock(mutex());
+    cache().clear();
+  }
+
+  /// Changes the capacity, evicting the least recently used values beyond it
+  static void resize(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex());
+    cache().resize(capacity);
+  }
+
+ private:
+  static lru_cache<key_t, value_t>& cache() {
+    static lru_cache<key_t, value_t> c(get_cache_capacity());
+    return c;
+  }
+
+  static std::mutex& mutex() {
+    static std::mutex m;
+    return m;
+  }
+};
+
+}  // namespace utils
+}  // namespace ideep
+
+#endif
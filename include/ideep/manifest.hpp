@@ -0,0 +1,117 @@
+#ifndef IDEEP_MANIFEST_HPP
+#define IDEEP_MANIFEST_HPP
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "lru_cache.hpp"
+#include "recorder.hpp"
+
+namespace ideep {
+namespace utils {
+
+/// The shapes a process has created primitives for. Once enabled,
+/// convolution, inner product and matmul forward add the creation arguments
+/// of each primitive they put in the computation cache, once per cache key
+/// and at most get_cache_capacity() per op, what their caches can hold.
+///
+/// save() writes them in the record file layout of utils::recorder, and
+/// utils::warm_up() creates the same primitives from such a file at the next
+/// start, so the first requests find them cached. IDEEP_MANIFEST=<path>, or
+/// enable(path), also saves the manifest when the process exits.
+class manifest {
+ public:
+  static manifest& instance() {
+    static manifest m;
+    return m;
+  }
+
+  static bool enabled() {
+    return instance().enabled_.load(std::memory_order_relaxed);
+  }
+
+  /// Starts recording, and saves to path at exit unless it is empty
+  void enable(const std::string& path = std::string()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!path.empty()) path_ = path;
+    enabled_.store(true);
+  }
+
+  void disable() { enabled_.store(false); }
+
+  /// Remembers how the primitive cached under key was created
+  template <typename... Ts>
+  void add(recorder::op_id op, const key_t& key, const Ts&... args) {
+    if (!enabled()) return;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (keys_.count(key) || counts_[op] >= get_cache_capacity()) return;
+    }
+    recorder::writer w;
+    w.put_all(args...);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (counts_[op] < get_cache_capacity() && keys_.insert(key).second) {
+      counts_[op]++;
+      entries_.push_back({op, w.bytes()});
+    }
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    keys_.clear();
+    counts_.clear();
+    entries_.clear();
+  }
+
+  void save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+      throw error(dnnl_invalid_arguments, "could not open the manifest file");
+    recorder::write_header(out);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& e : entries_) recorder::write_record(out, e.op, e.payload);
+  }
+
+ private:
+  struct entry {
+    recorder::op_id op;
+    std::string payload;
+  };
+
+  manifest() : enabled_(false) {
+    auto path = std::getenv("IDEEP_MANIFEST");
+    if (path && *path) enable(path);
+  }
+
+  ~manifest() {
+    if (path_.empty()) return;
+    try {
+      save(path_);
+    } catch (...) {
+      // nothing sensible to do at exit
+    }
+  }
+
+  std::atomic<bool> enabled_;
+  std::string path_;
+  mutable std::mutex mutex_;
+  std::unordered_set<key_t> keys_;
+  std::map<recorder::op_id, size_t> counts_;
+  // in creation order, so a warm-up creates the earliest layers first
+  std::vector<entry> entries_;
+};
+
+}  // namespace utils
+}  // namespace ideep
+
+#endif
@@ -0,0 +1,279 @@
+#ifndef IDEEP_MEMORY_TRACKER_HPP
+#define IDEEP_MEMORY_TRACKER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "profiler.hpp"
+
+namespace ideep {
+namespace utils {
+
+/// Tracks tensor buffers allocated through the engine allocator.
+///
+/// Compiled in with IDEEP_ENABLE_PROFILER and switched on with
+/// memory_tracker::instance().enable() or IDEEP_PROFILE_MEMORY=1, which
+/// also enable the profiler so every buffer is attributed to the op that
+/// allocated it. Buffers allocated while tracking was off are not counted,
+/// even when freed later.
+///
+/// Current and peak bytes are kept in total and per usage: primitive
+/// scratchpads, training workspaces and weights reordered by an op are told
+/// apart from everything else. Allocations are also counted per power-of-two
+/// size class, and live_tensors() lists the largest live buffers, e.g.
+/// cached weights that were never released. reset() starts a new window
+/// for peaks and counts, e.g. per request, and keeps the live buffers.
+class memory_tracker {
+ public:
+  enum usage {
+    general = 0,
+    weights = 1,
+    scratchpad = 2,
+    workspace = 3,
+    num_usages = 4
+  };
+
+  struct live_tensor {
+    size_t bytes;
+    usage ausage;
+    std::string op;
+    std::string desc;
+  };
+
+  /// Allocations of at most `bytes`, and more than half of it
+  struct size_class {
+    size_t bytes;
+    int64_t count;
+    int64_t total_bytes;
+  };
+
+  static memory_tracker& instance() {
+    static memory_tracker t;
+    return t;
+  }
+
+  static bool enabled() {
+    return instance().enabled_.load(std::memory_order_relaxed);
+  }
+
+  /// Turning tracking on also enables the profiler
+  void enable(bool on = true) {
+    enabled_.store(on);
+    if (on) profiler::instance().enable();
+  }
+
+  /// Starts a new window: peaks drop to the current usage and allocation
+  /// counts to zero
+  void reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    peak_ = current_;
+    std::copy(usage_current_, usage_current_ + num_usages, usage_peak_);
+    allocations_ = frees_ = 0;
+    std::fill(class_count_, class_count_ + num_classes, 0);
+    std::fill(class_bytes_, class_bytes_ + num_classes, 0);
+  }
+
+  int64_t current_bytes(usage u = num_usages) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return u == num_usages ? current_ : usage_current_[u];
+  }
+
+  int64_t peak_bytes(usage u = num_usages) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return u == num_usages ? peak_ : usage_peak_[u];
+  }
+
+  int64_t allocations() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocations_;
+  }
+
+  int64_t frees() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return frees_;
+  }
+
+  /// Size classes with at least one allocation, smallest first
+  std::vector<size_class> size_classes() const {
+    std::vector<size_class> result;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int k = 0; k < num_classes; k++) {
+      if (class_count_[k] == 0) continue;
+      result.push_back({size_t(1) << k, class_count_[k], class_bytes_[k]});
+    }
+    return result;
+  }
+
+  /// The n largest live buffers, largest first
+  std::vector<live_tensor> live_tensors(size_t n = 10) const {
+    std::vector<live_tensor> result;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto& kv : live_) result.push_back(kv.second);
+    }
+    n = std::min(n, result.size());
+    std::partial_sort(result.begin(), result.begin() + n, result.end(),
+                      [](const live_tensor& a, const live_tensor& b) {
+                        return a.bytes > b.bytes;
+                      });
+    result.resize(n);
+    return result;
+  }
+
+  /// Text report of usage, size classes and the top largest live buffers
+  std::string summary(size_t top = 10) const {
+    static const char* names[num_usages] = {
+        "general", "weights", "scratchpad", "workspace"};
+    const double mb = 1048576.;
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(3);
+    os << std::left << std::setw(12) << "usage" << std::right
+       << std::setw(14) << "current(MB)" << std::setw(12) << "peak(MB)"
+       << "\n";
+    for (int u = 0; u < num_usages; u++) {
+      auto au = static_cast<usage>(u);
+      os << std::left << std::setw(12) << names[u] << std::right
+         << std::setw(14) << current_bytes(au) / mb
+         << std::setw(12) << peak_bytes(au) / mb << "\n";
+    }
+    os << std::left << std::setw(12) << "total" << std::right
+       << std::setw(14) << current_bytes() / mb
+       << std::setw(12) << peak_bytes() / mb << "\n";
+    os << allocations() << " allocations, " << frees() << " frees\n\n";
+
+    os << std::left << std::setw(12) << "size <=" << std::right
+       << std::setw(10) << "count" << std::setw(12) << "total(MB)" << "\n";
+    for (auto& c : size_classes()) {
+      os << std::left << std::setw(12) << c.bytes << std::right
+         << std::setw(10) << c.count << std::setw(12) << c.total_bytes / mb
+         << "\n";
+    }
+
+    os << "\n" << std::right << std::setw(12) << "live(MB)" << "  "
+       << std::left << std::setw(12) << "usage" << std::setw(28) << "op"
+       << "desc\n";
+    for (auto& t : live_tensors(top)) {
+      os << std::right << std::setw(12) << t.bytes / mb << "  " << std::left
+         << std::setw(12) << names[t.ausage] << std::setw(28) << t.op
+         << t.desc << "\n";
+    }
+    return os.str();
+  }
+
+  /// Records a buffer just allocated for md and returns the deleter that
+  /// forgets it; free itself when tracking is off
+  static std::function<void(void*)> track(
+      void* ptr, size_t bytes, const dnnl_memory_desc_t& md,
+      const std::function<void(void*)>& free) {
+    if (!ptr || !enabled()) return free;
+    instance().on_alloc(ptr, bytes, md);
+    return [free](void* p) {
+      instance().on_free(p);
+      free(p);
+    };
+  }
+
+  /// Counts buffers allocated while evaluating f as usage u
+  template <typename F>
+  static auto as(usage u, F f) -> decltype(f()) {
+    usage_scope scope(u);
+    return f();
+  }
+
+ private:
+  static constexpr int num_classes = 64;
+
+  class usage_scope {
+   public:
+    explicit usage_scope(usage u) : prev_(current_usage()) {
+      current_usage() = u;
+    }
+
+    ~usage_scope() { current_usage() = prev_; }
+
+   private:
+    usage prev_;
+  };
+
+  memory_tracker() {
+    auto env = std::getenv("IDEEP_PROFILE_MEMORY");
+    enabled_ = false;
+    if (env && std::atoi(env) != 0) enable();
+  }
+
+  static usage& current_usage() {
+    static thread_local usage u = general;
+    return u;
+  }
+
+  // smallest k with bytes <= 2^k
+  static int class_of(size_t bytes) {
+    int k = 0;
+    while (k < num_classes - 1 && (size_t(1) << k) < bytes) k++;
+    return k;
+  }
+
+  void on_alloc(void* ptr, size_t bytes, const dnnl_memory_desc_t& md) {
+    live_tensor t {bytes, current_usage(), profiler::current_op(),
+                   profiler::describe(md)};
+    auto k = class_of(bytes);
+    std::lock_guard<std::mutex> lock(mutex_);
+    live_[ptr] = std::move(t);
+    current_ += bytes;
+    peak_ = std::max(peak_, current_);
+    auto u = current_usage();
+    usage_current_[u] += bytes;
+    usage_peak_[u] = std::max(usage_peak_[u], usage_current_[u]);
+    allocations_++;
+    class_count_[k]++;
+    class_bytes_[k] += bytes;
+  }
+
+  void on_free(void* ptr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = live_.find(ptr);
+    if (it == live_.end()) return;
+    current_ -= it->second.bytes;
+    usage_current_[it->second.ausage] -= it->second.bytes;
+    frees_++;
+    live_.erase(it);
+  }
+
+  std::atomic<bool> enabled_;
+  mutable std::mutex mutex_;
+  std::unordered_map<void*, live_tensor> live_;
+  int64_t current_ = 0;
+  int64_t peak_ = 0;
+  int64_t usage_current_[num_usages] = {0, 0, 0, 0};
+  int64_t usage_peak_[num_usages] = {0, 0, 0, 0};
+  int64_t allocations_ = 0;
+  int64_t frees_ = 0;
+  int64_t class_count_[num_classes] = {};
+  int64_t class_bytes_[num_classes] = {};
+};
+
+}  // namespace utils
+}  // namespace ideep
+
+#ifdef IDEEP_ENABLE_PROFILER
+// The deleter of a buffer just allocated with free, tracking it meanwhile
+#define IDEEP_PROFILE_TRACK(ptr, bytes, md, free) \
+  ideep::utils::memory_tracker::track(ptr, bytes, md, free)
+// Evaluates an expression, counting the buffers it allocates as a usage
+#define IDEEP_PROFILE_USAGE(ausage, ...)                               \
+  ideep::utils::memory_tracker::as(ideep::utils::memory_tracker::ausage, \
+                                   [&]() { return __VA_ARGS__; })
+#else
+#define IDEEP_PROFILE_TRACK(ptr, bytes, md, free) (free)
+#define IDEEP_PROFILE_USAGE(ausage, ...) (__VA_ARGS__)
+#endif
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef IDEEP_OPERATORS_ADAPTIVE_POOL_HPP
+#define IDEEP_OPERATORS_ADAPTIVE_POOL_HPP
+
+namespace ideep {
+
+/// Adaptive max/avg pooling: the dst spatial size is fixed and output o
+/// along a dim of input size in covers [floor(o * in / out),
+/// ceil((o + 1) * in / out)), so windows may differ in size and overlap.
+///
+/// Runs on the src layout (nChw8c, nChw16c, plain...) via offset tables and
+/// dst keeps it. Global pooling (all dst spatial dims 1) takes a fast path
+/// that sweeps each channel block once. f32, bf16, s8 and u8 data; int8
+/// keeps its scale. Training max pooling records the argmax of every output
+/// in dst's workspace for the backward pass.
+struct adaptive_pooling_forward {
+
+  static void compute(const tensor& src,
+                      const dims& output_sizes,
+                      tensor& dst,
+                      algorithm aalgorithm,
+                      prop_kind aprop_kind = prop_kind::forward,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("adaptive_pooling_forward", src);
+    IDEEP_RECORD(adaptive_pooling_forward, src, output_sizes, dst, aalgorithm,
+                 aprop_kind);
+    const bool is_max = aalgorithm == algorithm::pooling_max;
+    const bool with_workspace =
+        is_max && aprop_kind == prop_kind::forward_training;
+
+    dst.reinit_if_possible(src.get_desc().to_dims(output_sizes));
+    if (dst.get_desc().nelems(true) != dst.get_nelems()) {
+      std::memset(dst.get_data_handle(), 0, dst.get_size());
+    }
+    if (src.has_scale()) {
+      dst.set_scale(src.get_scale());
+    }
+    int32_t* argmax = nullptr;
+    if (with_workspace) {
+      dst.init_workspace({output_sizes, data_type::s32});
+      argmax = static_cast<int32_t*>(dst.get_workspace().get_data_handle());
+    }
+
+    // one compare or add per src element, windows barely overlap
+    IDEEP_PROFILE_FLOPS(1.0 * src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    switch (src.get_data_type()) {
+      case data_type::f32:
+        kernel<float>(src, dst, is_max, argmax);
+        break;
+      case data_type::bf16:
+        kernel<uint16_t>(src, dst, is_max, argmax);
+        break;
+      case data_type::s8:
+        kernel<int8_t>(src, dst, is_max, argmax);
+        break;
+      case data_type::u8:
+        kernel<uint8_t>(src, dst, is_max, argmax);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
+  // {N, C, D, H, W} view of a 3D to 5D tensor in its own layout
+  struct view_t {
+    dims sizes;
+    std::vector<std::vector<dim>> offsets;
+
+    view_t(const tensor& t) {
+      auto tdims = t.get_dims();
+      int ndims = tdims.size();
+      IDEEP_ENFORCE(ndims >= 3 && ndims <= 5,
+                    "adaptive pooling expects 1 to 3 spatial dims");
+      IDEEP_ENFORCE(t.get_desc().data.format_kind == dnnl_blocked,
+                    "adaptive pooling supports blocked memory only");
+      auto tables = utils::blocked_offset_tables(t.get_desc().data);
+      tables[0] = utils::fmap(tables[0], [&](dim o) {
+        return o + t.get_desc().data.offset0;
+      });
+      sizes = {tdims[0], tdims[1], 1, 1, 1};
+      offsets = {tables[0], tables[1], {0}, {0}, {0}};
+      for (int d = 2; d < ndims; d++) {
+        sizes[5 - ndims + d] = tdims[d];
+        offsets[5 - ndims + d] = tables[d];
+      }
+    }
+
+    dim spatial() const { return sizes[2] * sizes[3] * sizes[4]; }
+  };
+
+  static dim window_begin(dim o, dim in, dim out) { return o * in / out; }
+  static dim window_end(dim o, dim in, dim out) {
+    return ((o + 1) * in + out - 1) / out;
+  }
+
+ private:
+  template <typename T>
+  static void kernel(const tensor& src, tensor& dst, bool is_max,
+                     int32_t* argmax) {
+    view_t in(src), out(dst);
+    if (out.spatial() == 1) {
+      global_kernel<T>(in, out, src, dst, is_max, argmax);
+      return;
+    }
+
+    const auto src_data = static_cast<const T*>(src.get_data_handle());
+    const auto dst_data = static_cast<T*>(dst.get_data_handle());
+    const auto& is = in.sizes;
+    const auto& os = out.sizes;
+    const auto& s = in.offsets;
+    const auto& d = out.offsets;
+
+#ifdef _OPENMP
+#pragma omp parallel for collapse(4) schedule(static)
+#endif
+    for (dim n = 0; n < os[0]; n++)
+    for (dim c = 0; c < os[1]; c++)
+    for (dim od = 0; od < os[2]; od++)
+    for (dim oh = 0; oh < os[3]; oh++) {
+      const dim d0 = window_begin(od, is[2], os[2]);
+      const dim d1 = window_end(od, is[2], os[2]);
+      const dim h0 = window_begin(oh, is[3], os[3]);
+      const dim h1 = window_end(oh, is[3], os[3]);
+      const dim src_nc = s[0][n] + s[1][c];
+      for (dim ow = 0; ow < os[4]; ow++) {
+        const dim w0 = window_begin(ow, is[4], os[4]);
+        const dim w1 = window_end(ow, is[4], os[4]);
+        float acc = is_max ? -std::numeric_limits<float>::infinity() : 0.f;
+        dim best = 0;
+        for (dim id = d0; id < d1; id++)
+        for (dim ih = h0; ih < h1; ih++)
+        for (dim iw = w0; iw < w1; iw++) {
+          float x = utils::to_f32(
+              src_data[src_nc + s[2][id] + s[3][ih] + s[4][iw]]);
+          if (!is_max) {
+            acc += x;
+          } else if (x > acc) {
+            acc = x;
+            best = (id * is[3] + ih) * is[4] + iw;
+          }
+        }
+        if (!is_max) acc /= (d1 - d0) * (h1 - h0) * (w1 - w0);
+        dst_data[d[0][n] + d[1][c] + d[2][od] + d[3][oh] + d[4][ow]] =
+            utils::from_f32<T>(acc);
+        if (argmax) {
+          argmax[(((n * os[1] + c) * os[2] + od) * os[3] + oh) * os[4] + ow] =
+              static_cast<int32_t>(best);
+        }
+      }
+    }
+  }
+
+  // One output per (n, c): channels are taken a block at a time, so with
+  // blocked layouts the innermost loop runs over contiguous channels.
+  template <typename T>
+  static void global_kernel(const view_t& in, const view_t& out,
+                            const tensor& src, tensor& dst, bool is_max,
+                            int32_t* argmax) {
+    constexpr dim block = 16;
+    const auto src_data = static_cast<const T*>(src.get_data_handle());
+    const auto dst_data = static_cast<T*>(dst.get_data_handle());
+    const auto& is = in.sizes;
+    const auto& s = in.offsets;
+    const auto& d = out.offsets;
+    const dim channels = is[1];
+    const dim nblocks = (channels + block - 1) / block;
+    const dim spatial = in.spatial();
+
+    std::vector<dim> s_off;
+    s_off.reserve(spatial);
+    for (dim id = 0; id < is[2]; id++)
+      for (dim ih = 0; ih < is[3]; ih++)
+        for (dim iw = 0; iw < is[4]; iw++)
+          s_off.push_back(s[2][id] + s[3][ih] + s[4][iw]);
+
+#ifdef _OPENMP
+#pragma omp parallel for collapse(2) schedule(static)
+#endif
+    for (dim n = 0; n < is[0]; n++)
+    for (dim cb = 0; cb < nblocks; cb++) {
+      const dim c0 = cb * block;
+      const dim len = std::min(block, channels - c0);
+      float acc[block];
+      int32_t best[block];
+      for (dim k = 0; k < len; k++) {
+        acc[k] = is_max ? -std::numeric_limits<float>::infinity() : 0.f;
+        best[k] = 0;
+      }
+      for (dim sp = 0; sp < spatial; sp++) {
+        const dim base = s[0][n] + s_off[sp];
+        for (dim k = 0; k < len; k++) {
+          float x = utils::to_f32(src_data[base + s[1][c0 + k]]);
+          if (!is_max) {
+            acc[k] += x;
+          } else if (x > acc[k]) {
+            acc[k] = x;
+            best[k] = static_cast<int32_t>(sp);
+          }
+        }
+      }
+      for (dim k = 0; k < len; k++) {
+        const float v = is_max ? acc[k] : acc[k] / spatial;
+        dst_data[d[0][n] + d[1][c0 + k]] = utils::from_f32<T>(v);
+        if (argmax) argmax[n * channels + c0 + k] = best[k];
+      }
+    }
+  }
+};
+
+struct adaptive_pooling_backward {
+
+  /// dst is the forward output, carrying the argmax workspace for max
+  /// pooling; src provides dims and layout of diff_src
+  static void compute(const tensor& diff_dst,
+                      const tensor& dst,
+                      const tensor& src,
+                      tensor& diff_src,
+                      algorithm aalgorithm,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("adaptive_pooling_backward", diff_dst);
+    IDEEP_RECORD(adaptive_pooling_backward, diff_dst, dst, src, diff_src,
+                 aalgorithm);
+    const bool is_max = aalgorithm == algorithm::pooling_max;
+    IDEEP_ENFORCE(!is_max || dst.has_workspace(),
+                  "max pooling backward needs a forward_training dst");
+    auto diff_src_desc = src.get_desc();
+    if (src.get_data_type() != diff_dst.get_data_type()) {
+      diff_src_desc = diff_src_desc.to_type(diff_dst.get_data_type());
+    }
+    diff_src.reinit_if_possible(diff_src_desc);
+    if (diff_src.get_desc().nelems(true) != diff_src.get_nelems()) {
+      std::memset(diff_src.get_data_handle(), 0, diff_src.get_size());
+    }
+    const int32_t* argmax = is_max
+        ? static_cast<const int32_t*>(dst.get_workspace().get_data_handle())
+        : nullptr;
+
+    IDEEP_PROFILE_FLOPS(1.0 * diff_src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    switch (diff_dst.get_data_type()) {
+      case data_type::f32:
+        kernel<float>(diff_dst, diff_src, argmax);
+        break;
+      case data_type::bf16:
+        kernel<uint16_t>(diff_dst, diff_src, argmax);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
+ private:
+  // Windows overlap, so each thread owns whole (n, c) planes and scatters
+  // into an f32 plane buffer before writing it out.
+  template <typename T>
+  static void kernel(const tensor& diff_dst, tensor& diff_src,
+                     const int32_t* argmax) {
+    using fwd = adaptive_pooling_forward;
+    fwd::view_t in(diff_src), out(diff_dst);
+    const auto diff_dst_data =
+        static_cast<const T*>(diff_dst.get_data_handle());
+    const auto diff_src_data = static_cast<T*>(diff_src.get_data_handle());
+    const auto& is = in.sizes;
+    const auto& os = out.sizes;
+    const auto& s = in.offsets;
+    const auto& d = out.offsets;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      std::vector<float> plane(in.spatial());
+#ifdef _OPENMP
+#pragma omp for collapse(2) schedule(static)
+#endif
+      for (dim n = 0; n < os[0]; n++)
+      for (dim c = 0; c < os[1]; c++) {
+        std::fill(plane.begin(), plane.end(), 0.f);
+        for (dim od = 0; od < os[2]; od++)
+        for (dim oh = 0; oh < os[3]; oh++)
+        for (dim ow = 0; ow < os[4]; ow++) {
+          const float g = utils::to_f32(diff_dst_data[
+              d[0][n] + d[1][c] + d[2][od] + d[3][oh] + d[4][ow]]);
+          if (argmax) {
+            auto o = (((n * os[1] + c) * os[2] + od) * os[3] + oh) * os[4] + ow;
+            plane[argmax[o]] += g;
+            continue;
+          }
+          const dim d0 = fwd::window_begin(od, is[2], os[2]);
+          const dim d1 = fwd::window_end(od, is[2], os[2]);
+          const dim h0 = fwd::window_begin(oh, is[3], os[3]);
+          const dim h1 = fwd::window_end(oh, is[3], os[3]);
+          const dim w0 = fwd::window_begin(ow, is[4], os[4]);
+          const dim w1 = fwd::window_end(ow, is[4], os[4]);
+          const float share = g / ((d1 - d0) * (h1 - h0) * (w1 - w0));
+          for (dim id = d0; id < d1; id++)
+          for (dim ih = h0; ih < h1; ih++)
+          for (dim iw = w0; iw < w1; iw++)
+            plane[(id * is[3] + ih) * is[4] + iw] += share;
+        }
+
+        const dim src_nc = s[0][n] + s[1][c];
+        for (dim id = 0; id < is[2]; id++)
+        for (dim ih = 0; ih < is[3]; ih++)
+        for (dim iw = 0; iw < is[4]; iw++)
+          diff_src_data[src_nc + s[2][id] + s[3][ih] + s[4][iw]] =
+              utils::from_f32<T>(plane[(id * is[3] + ih) * is[4] + iw]);
+      }
+    }
+  }
+};
+
+}  // namespace ideep
+
+#endif
@@ -41,6 +41,9 @@ struct batch_normalization_forward_inference
                            tensor& dst,
                            float epsilon,
                            const engine& aengine) {
+    IDEEP_PROFILE_OP("batch_normalization_forward_inference", src);
+    IDEEP_RECORD(batch_normalization_forward_inference, src, mean, variance,
+                 scale, shift, dst, epsilon);
     auto flags = batch_normalization_flag::use_scale_shift;
     if (use_stats)
       flags |= batch_normalization_flag::use_global_stats;
@@ -49,20 +52,24 @@ struct batch_normalization_forward_inference
     auto src_desc = src._get_unblocked_desc_if_4c_blocked();
     // auto src_desc = src.get_desc();
 
-    auto pd = primitive_desc(
-        {prop_kind::forward_inference, src_desc, epsilon, flags}, aengine);
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, primitive_desc(
+        {prop_kind::forward_inference, src_desc, epsilon, flags}, aengine));
 
     tensor scale_shift {pd.weights_desc()};
     auto* scale_shift_buf = static_cast<char *>(scale_shift.get_data_handle());
     std::memcpy(scale_shift_buf, scale.get_data_handle(), scale.get_size());
     std::memcpy(scale_shift_buf + scale.get_size(),
                 shift.get_data_handle(), shift.get_size());
+    IDEEP_PROFILE_ARG("src");
     auto expected_src = src.reorder_if_differ_in(pd.src_desc());
     dst.reinit_if_possible(pd.dst_desc());
 
     if (use_stats) {
+      IDEEP_PROFILE_ARG("mean");
       auto expected_mean = mean.reorder_if_differ_in(pd.mean_desc());
+      IDEEP_PROFILE_ARG("variance");
       auto expected_var = variance.reorder_if_differ_in(pd.variance_desc());
+      IDEEP_PROFILE_PHASE(execute);
       super(pd).execute(stream::default_stream(),
                         {{DNNL_ARG_SRC, expected_src},
                          {DNNL_ARG_SCALE_SHIFT, scale_shift},
@@ -70,6 +77,7 @@ struct batch_normalization_forward_inference
                          {DNNL_ARG_MEAN, expected_mean},
                          {DNNL_ARG_DST, dst}});
     } else {
+      IDEEP_PROFILE_PHASE(execute);
       super(pd).execute(stream::default_stream(),
                         {{DNNL_ARG_SRC, expected_src},
                          {DNNL_ARG_SCALE_SHIFT, scale_shift},
@@ -92,25 +100,31 @@ struct batch_normalization_forward_training
                       float momentum,
                       float epsilon,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("batch_normalization_forward_training", src);
+    IDEEP_RECORD(batch_normalization_forward_training, src, scale, shift,
+                 dst, mean, variance, tensor(), tensor(), momentum, epsilon);
     auto flags = batch_normalization_flag::use_scale_shift;
 
     // workaround: use src.get_desc() once issue intel/mkl-dnn#588 is resolved
     auto src_desc = src._get_unblocked_desc_if_4c_blocked();
     // auto src_desc = src.get_desc();
 
-    auto pd = primitive_desc(
-        {prop_kind::forward_training, src_desc, epsilon, flags}, aengine);
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, primitive_desc(
+        {prop_kind::forward_training, src_desc, epsilon, flags}, aengine));
 
     tensor scale_shift {pd.weights_desc()};
     auto* scale_shift_buf = static_cast<char *>(scale_shift.get_data_handle());
     std::memcpy(scale_shift_buf, scale.get_data_handle(), scale.get_size());
     std::memcpy(scale_shift_buf + scale.get_size(),
                 shift.get_data_handle(), shift.get_size());
+    IDEEP_PROFILE_ARG("src");
     auto expected_src = src.reorder_if_differ_in(pd.src_desc());
     mean.reinit_if_possible(pd.mean_desc());
     variance.reinit_if_possible(pd.variance_desc());
     dst.reinit_if_possible(pd.dst_desc());
 
+    IDEEP_PROFILE_FLOPS(flops_per_element * src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(),
                       {{DNNL_ARG_SRC, expected_src},
                        {DNNL_ARG_SCALE_SHIFT, scale_shift},
@@ -129,12 +143,19 @@ struct batch_normalization_forward_training
                       tensor& running_var,
                       float momentum,
                       float epsilon) {
+   IDEEP_PROFILE_OP("batch_normalization_forward_training", src);
+   IDEEP_RECORD(batch_normalization_forward_training, src, scale, shift, dst,
+                mean, variance, running_mean, running_var, momentum,
+                epsilon);
    compute(src, scale, shift, dst, mean, variance, momentum, epsilon);
    ideep::sum::compute({momentum, 1 - momentum}, {running_mean, mean},
                        running_mean);
    ideep::sum::compute({momentum, 1 - momentum}, {running_var, variance},
                        running_var);
   }
+
+  // mean, variance, normalization and scale-shift, as a rough estimate
+  static constexpr double flops_per_element = 8.0;
 };
 
 struct batch_normalization_backward
@@ -151,24 +172,37 @@ struct batch_normalization_backward
                       tensor& diff_scale_shift,
                       float epsilon,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("batch_normalization_backward", src, diff_dst);
+    // told apart by whether diff_scale and diff_shift come separately
+    IDEEP_RECORD(batch_normalization_backward, false, src, mean, variance,
+                 diff_dst, scale, diff_src, epsilon);
     // TODO: support no-affine model
     auto flags = batch_normalization_flag::use_scale_shift;
     auto src_desc = src.get_desc();
-    auto forward_hints = dnnl::batch_normalization_forward::primitive_desc(
-        {prop_kind::forward_training, src_desc, epsilon, flags}, aengine);
     auto diff_src_desc = diff_dst.get_desc();
-
-    auto pd = primitive_desc(
-        {prop_kind::backward, diff_src_desc, src_desc, epsilon, flags},
-        aengine, forward_hints);
-
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, [&]() {
+      auto forward_hints = dnnl::batch_normalization_forward::primitive_desc(
+          {prop_kind::forward_training, src_desc, epsilon, flags}, aengine);
+      return primitive_desc(
+          {prop_kind::backward, diff_src_desc, src_desc, epsilon, flags},
+          aengine, forward_hints);
+    }());
+
+    IDEEP_PROFILE_ARG("diff_dst");
     auto expected_diff_dst = diff_dst.reorder_if_differ_in(pd.diff_dst_desc());
+    IDEEP_PROFILE_ARG("src");
     auto expected_src = src.reorder_if_differ_in(pd.src_desc());
+    IDEEP_PROFILE_ARG("mean");
     auto expected_mean = mean.reorder_if_differ_in(pd.mean_desc());
+    IDEEP_PROFILE_ARG("variance");
     auto expected_variance = variance.reorder_if_differ_in(pd.variance_desc());
     diff_src.reinit_if_possible(pd.diff_src_desc());
     diff_scale_shift.reinit_if_possible(pd.diff_weights_desc());
 
+    // the data and the scale-shift gradients, about twice the forward
+    IDEEP_PROFILE_FLOPS(2 * batch_normalization_forward_training::
+                                flops_per_element * src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(),
                       {{DNNL_ARG_SRC, expected_src},
                       {DNNL_ARG_DIFF_DST, expected_diff_dst},
@@ -189,6 +223,9 @@ struct batch_normalization_backward
                       tensor& diff_shift,
                       float epsilon,
                       const engine& aengine = engine::cpu_engine()) {
+  IDEEP_PROFILE_OP("batch_normalization_backward", src, diff_dst);
+  IDEEP_RECORD(batch_normalization_backward, true, src, mean, variance,
+               diff_dst, scale, diff_src, epsilon);
   tensor diff_scale_shift;
   compute(src, mean, variance, diff_dst, scale, diff_src, diff_scale_shift,
           epsilon, aengine);
@@ -3,6 +3,16 @@
 
 namespace ideep {
 
+/// Elementwise src0 (op) src1, optionally followed by attr_t post-ops.
+///
+/// src1 is broadcast against src0 numpy-style: dims are right-aligned, and
+/// each src1 dim must equal the src0 dim or be 1. So a per-channel operand
+/// for NCHW data is {C, 1, 1} (or {1, C, 1, 1}), a per-row operand for {N, K}
+/// data is {K}, and a scalar is {1}. Broadcasting happens inside the
+/// primitive, so src1 is never expanded in memory.
+///
+/// int8 inputs carrying scales are dequantized and produce an f32 dst. f32
+/// and bf16 inputs keep their data type.
 struct binary : public dnnl::binary {
 
   using super = dnnl::binary;
@@ -11,25 +21,101 @@ struct binary : public dnnl::binary {
                       const tensor& src1,
                       tensor& dst,
                       algorithm aalgorithm,
+                      const attr_t& attr = attr_t(),
                       const engine& aengine = engine::cpu_engine()) {
-    auto src0_desc = src0.get_desc();
-    auto src1_desc = src1.get_desc();
+    IDEEP_PROFILE_OP("binary", src0, src1);
+    IDEEP_RECORD(binary, src0, src1, dst, aalgorithm, attr);
+    auto expected_src0 = dequantize_if_needed(src0);
+    auto expected_src1 = dequantize_if_needed(
+        broadcast_to(src1, expected_src0.get_dims()));
+
+    auto src0_desc = expected_src0.get_desc();
+    auto src1_desc = expected_src1.get_desc();
     auto dst_desc = src0_desc.to_format_any();
 
-    auto pd = primitive_desc(
-        {aalgorithm, src0_desc, src1_desc, dst_desc}, aengine);
-    
-    auto expected_src0 = src0.reorder_if_differ_in(pd.src0_desc());
-    auto expected_src1 = src1.reorder_if_differ_in(pd.src1_desc());
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, primitive_desc(
+        {aalgorithm, src0_desc, src1_desc, dst_desc}, attr, aengine));
+
+    IDEEP_PROFILE_ARG("src0");
+    expected_src0 = expected_src0.reorder_if_differ_in(pd.src0_desc());
+    IDEEP_PROFILE_ARG("src1");
+    expected_src1 = expected_src1.reorder_if_differ_in(pd.src1_desc());
     dst.reinit_if_possible(pd.dst_desc());
 
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(),
                       {{DNNL_ARG_SRC_0, expected_src0},
                        {DNNL_ARG_SRC_1, expected_src1},
                        {DNNL_ARG_DST, dst}});
   }
+
+  static void compute(const tensor& src0,
+                      const tensor& src1,
+                      tensor& dst,
+                      algorithm aalgorithm,
+                      const engine& aengine) {
+    compute(src0, src1, dst, aalgorithm, attr_t(), aengine);
+  }
+
+  /// src0 (op) scalar
+  static void compute(const tensor& src0,
+                      float scalar,
+                      tensor& dst,
+                      algorithm aalgorithm,
+                      const attr_t& attr = attr_t(),
+                      const engine& aengine = engine::cpu_engine()) {
+    auto src0_type = src0.get_data_type();
+    auto scalar_type =
+        src0_type == data_type::bf16 ? data_type::bf16 : data_type::f32;
+    tensor src1({dims(src0.ndims(), 1), data_type::f32}, aengine);
+    *static_cast<float*>(src1.get_data_handle()) = scalar;
+    if (scalar_type != data_type::f32) {
+      src1 = src1.reorder_if_differ_in(src1.get_desc().to_type(scalar_type));
+    }
+    compute(src0, src1, dst, aalgorithm, attr, aengine);
+  }
+
+ private:
+  // Views src1 with src0's rank by prepending unit dims. The view shares
+  // src1's buffer, unless src1 has to be reordered into the default format
+  // first so that the new dims line up with its strides.
+  static tensor broadcast_to(const tensor& src1, const dims& src0_dims) {
+    auto src1_dims = src1.get_dims();
+    auto ndims = src0_dims.size();
+    IDEEP_ENFORCE(src1_dims.size() <= ndims,
+                  "src1 has more dims than src0 and cannot be broadcast");
+    auto offset = ndims - src1_dims.size();
+    for (size_t i = 0; i < src1_dims.size(); i++) {
+      if (src1_dims[i] != src0_dims[offset + i] && src1_dims[i] != 1)
+        throw error(dnnl_invalid_arguments,
+                    "src1 is not broadcastable to src0");
+    }
+    if (offset == 0) return src1;
+
+    dims new_dims(offset, 1);
+    new_dims.insert(new_dims.end(), src1_dims.begin(), src1_dims.end());
+    auto view = src1;
+    view.reshape(new_dims);
+    // a reorder in reshape gives a fresh tensor without the scale
+    if (src1.has_scale()) {
+      view.set_scale(src1.get_scale());
+    }
+    return view;
+  }
+
+  static tensor dequantize_if_needed(const tensor& src) {
+    if (!utils::one_of(src.get_data_type(), data_type::s8, data_type::u8) ||
+        !src.has_scale()) {
+      return src;
+    }
+    auto& src_scale = src.get_scale();
+    IDEEP_ENFORCE(src_scale.size() == 1,
+                  "binary supports per-tensor scales only");
+    return src.reorder_if_differ_in(src.get_desc().to_type(data_type::f32),
+                                    {0, {1.f / src_scale[0]}});
+  }
 };
 
 }  // namespace ideep
 
-#endif
\ No newline at end of file
+#endif
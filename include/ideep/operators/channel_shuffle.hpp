@@ -13,16 +13,20 @@ struct channel_shuffle_forward: public dnnl::shuffle_forward {
                       const int axis = 1,
                       prop_kind aprop_kind = prop_kind::forward,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("channel_shuffle_forward", src);
+    IDEEP_RECORD(channel_shuffle_forward, src, dst, group, axis, aprop_kind);
     IDEEP_ENFORCE(src.get_dim(axis) % group == 0, "Invalid channel and group");
     IDEEP_ENFORCE(src.get_data_type() == data_type::f32, "invalid data type");
 
     auto group_size = static_cast<int>(src.get_dim(axis) / group);
-    auto pd =
-        primitive_desc({aprop_kind, src.get_desc(), axis, group_size}, aengine);
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, primitive_desc(
+        {aprop_kind, src.get_desc(), axis, group_size}, aengine));
 
+    IDEEP_PROFILE_ARG("src");
     auto expected_src = src.reorder_if_differ_in(pd.src_desc());
     dst.reinit_if_possible(pd.dst_desc());
 
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(),
                       {{DNNL_ARG_SRC, expected_src}, {DNNL_ARG_DST, dst}});
   }
@@ -37,17 +41,23 @@ struct channel_shuffle_backward : public dnnl::shuffle_backward {
                       const int group,
                       const int axis = 1,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("channel_shuffle_backward", diff_dst);
+    IDEEP_RECORD(channel_shuffle_backward, diff_dst, diff_src, group, axis);
     auto group_size = static_cast<int>(diff_dst.get_dim(axis) / group);
     auto data_desc = diff_dst.get_desc();
 
-    auto forward_hints = dnnl::shuffle_forward::primitive_desc(
-        {prop_kind::forward, data_desc, group_size, axis}, aengine);
-    auto pd =
-        primitive_desc({data_desc, axis, group_size}, aengine, forward_hints);
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, [&]() {
+      auto forward_hints = dnnl::shuffle_forward::primitive_desc(
+          {prop_kind::forward, data_desc, group_size, axis}, aengine);
+      return primitive_desc(
+          {data_desc, axis, group_size}, aengine, forward_hints);
+    }());
 
+    IDEEP_PROFILE_ARG("diff_dst");
     auto expected_diff_dst = diff_dst.reorder_if_differ_in(pd.diff_dst_desc());
     diff_src.reinit_if_possible(pd.diff_src_desc());
 
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(),
                       {{DNNL_ARG_DIFF_DST, expected_diff_dst},
                        {DNNL_ARG_DIFF_SRC, diff_src}});
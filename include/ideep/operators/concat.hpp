@@ -11,13 +11,16 @@ struct concat : public dnnl::concat {
                       int axis,
                       tensor& output,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("concat", inputs);
+    IDEEP_RECORD(concat, inputs, axis, output);
     auto input_descs = utils::fmap(inputs, [](const tensor& t) {
       // "upcast" vector<tensor::desc> to vector<memory::desc>
       return static_cast<memory::desc>(t.get_desc());
     });
 
     // create a pd to query the optimimal format for src and dst
-    auto pd = primitive_desc(axis, input_descs, aengine);
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation,
+                                  primitive_desc(axis, input_descs, aengine));
     auto expected_desc = tensor::desc(pd.dst_desc());
 
     output.reinit_if_possible(expected_desc);
@@ -35,6 +38,7 @@ struct concat : public dnnl::concat {
     // only when there are more than two inputs.
     auto opt_inputs = inputs;
     if (inputs.size() > 2) {
+      IDEEP_PROFILE_ARG("inputs");
       opt_inputs = utils::fmap(inputs, [&](const tensor& t) {
         // construct a desc with dims of t and keep expected blocking format
         auto desc = expected_desc.to_dims(t.get_dims());
@@ -45,13 +49,16 @@ struct concat : public dnnl::concat {
         return static_cast<memory::desc>(t.get_desc());
       });
       // recreate the pd on new inputs with same formats
-      pd = primitive_desc(axis, input_descs, aengine);
+      pd = IDEEP_PROFILE_TIMED(primitive_creation,
+                               primitive_desc(axis, input_descs, aengine));
     }
 
     for (int i = 0; i < opt_inputs.size(); ++i) {
       args.insert({DNNL_ARG_MULTIPLE_SRC + i, opt_inputs[i]});
     }
 
+    // a pure copy: no FLOPS, only the execute time is reported
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(), args);
   }
 
@@ -62,6 +69,7 @@ struct concat : public dnnl::concat {
       bool add_axis,
       tensor& dst,
       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("concat", inputs);
     IDEEP_ENFORCE(axis < (inputs[0].ndims() + add_axis),
                   "invalid axis in concat");
     for (int i = 0; i < inputs[0].ndims(); i++) {
@@ -120,6 +128,7 @@ struct concat : public dnnl::concat {
     // NOTE: In dnnl concat, dim 3 and 6+ are not supported.
     // Morewhile, the tensor shape must be blockable to create a view.
     if (!add_axis && dst_dims.size() != 3 && dst_dims.size() < 6) {
+      IDEEP_PROFILE_ARG("inputs");
       for (unsigned k = 0; k < inputs.size(); k++) {
         if (!inputs[k].get_desc().is_limited_blockable()) {
           for (int i = 0; i < inputs.size(); ++i) {
@@ -1,21 +1,30 @@
 #ifndef IDEEP_OPERATORS_CONV_HPP
 #define IDEEP_OPERATORS_CONV_HPP
+#include "prelu.hpp"
 
 namespace ideep {
 
 struct convolution_forward_params {
   dnnl::convolution_forward::primitive_desc pd;
+  dnnl::convolution_forward primitive;
   // bias_attr contains requantization scales for bias
   attr_t bias_attr;
   scale_t dst_scales;
   int groups;
   tensor scratchpad;
+  // per-channel slopes of an attr_t::fuse_prelu post-op, applied to dst
+  scale_t prelu_weights;
 };
 
 struct convolution_forward : public dnnl::convolution_forward {
 
   using super = dnnl::convolution_forward;
 
+  struct params {
+    primitive_desc pd;
+    super primitive;
+  };
+
   // prepare with bias
   static void prepare(
       convolution_forward_params& param,
@@ -37,6 +46,11 @@ struct convolution_forward : public dnnl::convolution_forward {
       prop_kind aprop_kind = prop_kind::forward,
       const lowp_kind alowp_kind = u8s8,
       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("convolution_forward::prepare", src, weights);
+    IDEEP_RECORD(convolution_forward_prepare, &param, src, weights, bias,
+                 dst_dims, dst, strides, dilates, padding_l, padding_r, groups,
+                 src_scales, weights_scales, dst_scales, attr, aalgorithm,
+                 aprop_kind, alowp_kind);
     do_prepare</*with_bias=*/true>(
         param, src, weights, bias, dst_dims, dst, strides, dilates,
         padding_l, padding_r, groups, src_scales, weights_scales, dst_scales,
@@ -63,7 +77,12 @@ struct convolution_forward : public dnnl::convolution_forward {
       prop_kind aprop_kind = prop_kind::forward,
       const lowp_kind alowp_kind = u8s8,
       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("convolution_forward::prepare", src, weights);
     static tensor dummy_bias;
+    IDEEP_RECORD(convolution_forward_prepare, &param, src, weights,
+                 dummy_bias, dst_dims, dst, strides, dilates, padding_l,
+                 padding_r, groups, src_scales, weights_scales, dst_scales,
+                 attr, aalgorithm, aprop_kind, alowp_kind);
     do_prepare</*with_bias=*/false>(
         param, src, weights, dummy_bias, dst_dims, dst, strides, dilates,
         padding_l, padding_r, groups, src_scales, weights_scales, dst_scales,
@@ -76,6 +95,8 @@ struct convolution_forward : public dnnl::convolution_forward {
                       const tensor& weights,
                       const tensor& bias,
                       tensor& dst) {
+    IDEEP_PROFILE_OP("convolution_forward", src, weights);
+    IDEEP_RECORD(convolution_forward_param, &param, src, weights, bias, dst);
     do_compute</*with_bias=*/true>(param, src, weights, bias, dst);
   }
 
@@ -84,7 +105,10 @@ struct convolution_forward : public dnnl::convolution_forward {
                       const tensor& src,
                       const tensor& weights,
                       tensor& dst) {
+    IDEEP_PROFILE_OP("convolution_forward", src, weights);
     static tensor dummy_bias;
+    IDEEP_RECORD(convolution_forward_param, &param, src, weights, dummy_bias,
+                 dst);
     do_compute</*with_bias=*/false>(param, src, weights, dummy_bias, dst);
   }
 
@@ -107,6 +131,11 @@ struct convolution_forward : public dnnl::convolution_forward {
                       prop_kind aprop_kind = prop_kind::forward,
                       const lowp_kind alowp_kind = u8s8,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("convolution_forward", src, weights);
+    IDEEP_RECORD(convolution_forward, src, weights, bias,
+                 dst_dims, dst, strides, dilates, padding_l, padding_r, groups,
+                 src_scales, weights_scales, dst_scales, attr, aalgorithm,
+                 aprop_kind, alowp_kind);
     convolution_forward_params params;
     do_prepare</*with_bias=*/true>(
         params, src, weights, bias, dst_dims, dst, strides, dilates, 
@@ -133,7 +162,12 @@ struct convolution_forward : public dnnl::convolution_forward {
                       prop_kind aprop_kind = prop_kind::forward,
                       const lowp_kind alowp_kind = u8s8,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("convolution_forward", src, weights);
     static tensor dummy_bias;
+    IDEEP_RECORD(convolution_forward, src, weights, dummy_bias,
+                 dst_dims, dst, strides, dilates, padding_l, padding_r, groups,
+                 src_scales, weights_scales, dst_scales, attr, aalgorithm,
+                 aprop_kind, alowp_kind);
     convolution_forward_params params;
     do_prepare</*with_bias=*/false>(
         params, src, weights, dummy_bias, dst_dims, dst, strides, dilates, 
@@ -203,14 +237,17 @@ struct convolution_forward : public dnnl::convolution_forward {
     // the prop_kind to forward, in order to reorder and cache weights as
     // blocked format, instead of dnnl_wino_fmt.
     auto apkind = aprop_kind;
-    if (aalgorithm == algorithm::convolution_winograd &&
+    auto choice = tuned_choice(
+        src_dims.empty(), src_desc, weights_desc, dst_desc, strides, dilates_,
+        padding_l, padding_r, aalgorithm, aprop_kind, aengine);
+    if (choice.aalgorithm == algorithm::convolution_winograd &&
         aprop_kind == prop_kind::forward_inference) {
       apkind = prop_kind::forward;
     }
 
     auto pd = get_primitive_desc</*with_bias=*/false>(
         src_desc, weights_desc, tensor::desc(), dst_desc, strides, dilates_,
-        padding_l, padding_r, attr_t(), aalgorithm, apkind);
+        padding_l, padding_r, attr_t(), choice, apkind, aengine);
 
     // embed group info into weights_desc
     return tensor::desc(pd.weights_desc(), groups);
@@ -248,7 +285,188 @@ struct convolution_forward : public dnnl::convolution_forward {
     }
   }
 
+  /// get_primitive_desc for the algorithm of a tuning decision, and its
+  /// implementation when this DNNL build still provides it. Decisions are
+  /// made without attr, so when the tuned algorithm does not take it, e.g.
+  /// Winograd with some post-ops, convolution_auto is used instead.
+  template <bool with_bias>
+  static primitive_desc get_primitive_desc(
+      const tensor::desc& src_desc,
+      const tensor::desc& weights_desc,
+      const tensor::desc& bias_desc,
+      const tensor::desc& dst_desc,
+      const dims& strides,
+      const dims& dilates,
+      const dims& padding_l,
+      const dims& padding_r,
+      const attr_t& attr,
+      const utils::tuning_cache::choice& choice,
+      prop_kind aprop_kind,
+      const engine& aengine) {
+    primitive_desc pd;
+    try {
+      pd = get_primitive_desc<with_bias>(
+          src_desc, weights_desc, bias_desc, dst_desc, strides, dilates,
+          padding_l, padding_r, attr, choice.aalgorithm, aprop_kind,
+          aengine);
+    } catch (const error&) {
+      // only tuned decisions name an implementation
+      if (choice.impl.empty()) throw;
+      return get_primitive_desc<with_bias>(
+          src_desc, weights_desc, bias_desc, dst_desc, strides, dilates,
+          padding_l, padding_r, attr, algorithm::convolution_auto,
+          aprop_kind, aengine);
+    }
+    if (choice.impl.empty()) return pd;
+    while (choice.impl != pd.impl_info_str()) {
+      if (!pd.next_impl()) {
+        return get_primitive_desc<with_bias>(
+            src_desc, weights_desc, bias_desc, dst_desc, strides, dilates,
+            padding_l, padding_r, attr, choice.aalgorithm, aprop_kind,
+            aengine);
+      }
+    }
+    return pd;
+  }
+
+  /// The algorithm to create the primitive with. convolution_auto is
+  /// resolved by the tuning cache when it is enabled, timing the candidates
+  /// the first time a shape is seen; otherwise aalgorithm is kept and DNNL
+  /// picks the implementation. Dummy shapes are never tuned.
+  static utils::tuning_cache::choice tuned_choice(
+      bool dummy_shape,
+      const tensor::desc& src_desc,
+      const tensor::desc& weights_desc,
+      const tensor::desc& dst_desc,
+      const dims& strides,
+      const dims& dilates,
+      const dims& padding_l,
+      const dims& padding_r,
+      algorithm aalgorithm,
+      prop_kind aprop_kind,
+      const engine& aengine) {
+    if (dummy_shape || aalgorithm != algorithm::convolution_auto ||
+        !utils::tuning_cache::enabled())
+      return {aalgorithm, ""};
+    // formats, bias and attrs do not enter the key: candidates are created
+    // with format any, and the bias add, post-ops or scales barely change
+    // the ranking, so expected_weights_desc and the compute path share one
+    // entry. An attr the winner cannot take falls back in get_primitive_desc.
+    auto key = utils::create_key(
+        aprop_kind, src_desc.to_format_any(), weights_desc.to_format_any(),
+        dst_desc.to_format_any(), strides, dilates, padding_l, padding_r);
+    return utils::tuning_cache::instance().fetch_or_tune(key, [&]() {
+      return tune(src_desc, weights_desc, dst_desc, strides, dilates,
+                  padding_l, padding_r, aprop_kind, aengine);
+    });
+  }
+
+  /// The pd and primitive for these descs, created on the first call and
+  /// then served from the computation cache. The attr is switched to a user
+  /// scratchpad: cached primitives are shared across threads, so each
+  /// prepare allocates its own.
+  template <bool with_bias>
+  static params fetch_or_create(
+      const tensor::desc& src_desc,
+      const tensor::desc& weights_desc,
+      const tensor::desc& bias_desc,
+      const tensor::desc& dst_desc,
+      const dims& strides,
+      const dims& dilates,
+      const dims& padding_l,
+      const dims& padding_r,
+      const attr_t& attr,
+      algorithm aalgorithm,
+      prop_kind aprop_kind,
+      const engine& aengine = engine::cpu_engine()) {
+    auto key = utils::create_key(aprop_kind, aalgorithm, src_desc,
+                                 weights_desc, bias_desc, dst_desc, strides,
+                                 dilates, padding_l, padding_r, attr);
+    return utils::computation_cache<params>::fetch_or_create(key, [&]() {
+      IDEEP_PROFILE_PHASE(primitive_creation);
+      utils::manifest::instance().add(
+          utils::recorder::convolution_forward_primitive, key, src_desc,
+          weights_desc, bias_desc, dst_desc, strides, dilates, padding_l,
+          padding_r, attr, aalgorithm, aprop_kind);
+      attr_t op_attr = attr;
+      op_attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
+      auto choice = tuned_choice(
+          false, src_desc, weights_desc, dst_desc, strides, dilates,
+          padding_l, padding_r, aalgorithm, aprop_kind, aengine);
+      auto pd = get_primitive_desc<with_bias>(
+          src_desc, weights_desc, bias_desc, dst_desc, strides, dilates,
+          padding_l, padding_r, op_attr, choice, aprop_kind, aengine);
+      return params {pd, super(pd)};
+    });
+  }
+
 private:
+  // Times every implementation of the direct algorithm (jit kernels and the
+  // GEMM based ones) and of Winograd, without bias, and returns the fastest
+  static utils::tuning_cache::choice tune(
+      const tensor::desc& src_desc,
+      const tensor::desc& weights_desc,
+      const tensor::desc& dst_desc,
+      const dims& strides,
+      const dims& dilates,
+      const dims& padding_l,
+      const dims& padding_r,
+      prop_kind aprop_kind,
+      const engine& aengine) {
+    attr_t op_attr;
+    op_attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
+    utils::tuning_cache::choice best {algorithm::convolution_direct, ""};
+    double best_ms = -1.;
+    for (auto alg : {algorithm::convolution_direct,
+                     algorithm::convolution_winograd}) {
+      primitive_desc pd;
+      try {
+        pd = get_primitive_desc</*with_bias=*/false>(
+            src_desc, weights_desc, tensor::desc(), dst_desc, strides,
+            dilates, padding_l, padding_r, op_attr, alg, aprop_kind, aengine);
+      } catch (const error&) {
+        // e.g. no Winograd for this shape or ISA
+        continue;
+      }
+      do {
+        auto ms = time_execution(pd);
+        if (best_ms < 0 || ms < best_ms) {
+          best_ms = ms;
+          best = {alg, pd.impl_info_str()};
+        }
+      } while (pd.next_impl());
+    }
+    return best;
+  }
+
+  // Best of a few runs after a warm-up one, in milliseconds, on zeroed
+  // tensors: uninitialized ones may hold denormals and skew the timing
+  static double time_execution(const primitive_desc& pd) {
+    tensor src(pd.src_desc()), weights(pd.weights_desc()),
+        dst(pd.dst_desc()), scratchpad(pd.scratchpad_desc());
+    for (auto t : {&src, &weights, &dst})
+      std::memset(t->get_data_handle(), 0, t->get_size());
+    exec_args args {{DNNL_ARG_SRC, src},
+                    {DNNL_ARG_WEIGHTS, weights},
+                    {DNNL_ARG_DST, dst},
+                    {DNNL_ARG_SCRATCHPAD, scratchpad}};
+
+    super prim(pd);
+    auto& s = stream::default_stream();
+    prim.execute(s, args);
+    s.wait();
+    double best = -1.;
+    for (int i = 0; i < 3; i++) {
+      auto start = std::chrono::high_resolution_clock::now();
+      prim.execute(s, args);
+      s.wait();
+      std::chrono::duration<double, std::milli> ms =
+          std::chrono::high_resolution_clock::now() - start;
+      if (best < 0 || ms.count() < best) best = ms.count();
+    }
+    return best;
+  }
+
   template <bool with_bias>
   static void do_prepare(
       convolution_forward_params& param,
@@ -319,7 +537,9 @@ private:
           op_attr = attr_t::fuse_sum(sum_scale);
         }
       } else if (attr.has_op_kind(kind::eltwise)) {
-        op_attr = attr_t::fuse_relu();
+        // keep the negative slope of a scalar PReLU
+        auto last = attr.get_post_ops().len() - 1;
+        op_attr = attr_t::fuse_relu(1.0, std::get<2>(attr.get_params(last)));
       }
       op_attr.set_output_scales(utils::op_scale_mask(scale_size), op_scales);
 
@@ -369,20 +589,20 @@ private:
       }
     }
 
-    op_attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
-
     auto dst_desc = attr.has_op_kind(kind::sum)
                         ? dst.get_desc()
                         : tensor::desc(dst_dims, dst_data_type);
 
-    auto pd = get_primitive_desc<with_bias>(
+    auto cached = fetch_or_create<with_bias>(
         src_desc, weights_desc, bias_desc, dst_desc, strides, dilates_,
         padding_l, padding_r, op_attr, aalgorithm, aprop_kind, aengine);
 
     // allocate scratchpad
-    tensor scratchpad(pd.scratchpad_desc());
+    auto scratchpad =
+        IDEEP_PROFILE_USAGE(scratchpad, tensor(cached.pd.scratchpad_desc()));
 
-    param = {pd, bias_attr, dst_scales, groups, scratchpad};
+    param = {cached.pd, cached.primitive, bias_attr, dst_scales, groups,
+             scratchpad, attr.get_prelu_weights()};
   }
 
   template <bool with_bias>
@@ -391,30 +611,44 @@ private:
                          const tensor& bias, tensor& dst) {
     auto& pd = param.pd;
     auto scratchpad = param.scratchpad;
+    IDEEP_PROFILE_ARG("src");
     auto expected_src = src.reorder_if_differ_in(pd.src_desc());
-    auto expected_weights = weights.make_grouped_weights(param.groups)
-                                .reorder_if_differ_in(pd.weights_desc());
+    IDEEP_PROFILE_ARG("weights");
+    auto expected_weights = IDEEP_PROFILE_USAGE(weights,
+        weights.make_grouped_weights(param.groups)
+            .reorder_if_differ_in(pd.weights_desc()));
     dst.reinit_if_possible(pd.dst_desc());
 
     if (!param.dst_scales.empty() && dst.get_data_type() != data_type::f32) {
       dst.set_scale(param.dst_scales);
     }
 
+    // 2 * MACs; weights hold OC/G * IC/G * K elements per group
+    IDEEP_PROFILE_FLOPS(2.0 * dst.get_nelems() * expected_weights.get_nelems() /
+                        dst.get_dim(1));
+
     if (with_bias) {
+      IDEEP_PROFILE_ARG("bias");
       auto expected_bias =
           bias.reorder_if_differ_in(pd.bias_desc(), param.bias_attr);
-      super(pd).execute(stream::default_stream(), 
-                        {{DNNL_ARG_SRC, expected_src},
-                         {DNNL_ARG_WEIGHTS, expected_weights},
-                         {DNNL_ARG_BIAS, expected_bias},
-                         {DNNL_ARG_DST, dst},
-                         {DNNL_ARG_SCRATCHPAD, scratchpad}});
+      IDEEP_PROFILE_PHASE(execute);
+      param.primitive.execute(stream::default_stream(),
+                              {{DNNL_ARG_SRC, expected_src},
+                               {DNNL_ARG_WEIGHTS, expected_weights},
+                               {DNNL_ARG_BIAS, expected_bias},
+                               {DNNL_ARG_DST, dst},
+                               {DNNL_ARG_SCRATCHPAD, scratchpad}});
     } else {
-      super(pd).execute(stream::default_stream(), 
-                        {{DNNL_ARG_SRC, expected_src},
-                         {DNNL_ARG_WEIGHTS, expected_weights},
-                         {DNNL_ARG_DST, dst},
-                         {DNNL_ARG_SCRATCHPAD, scratchpad}});
+      IDEEP_PROFILE_PHASE(execute);
+      param.primitive.execute(stream::default_stream(),
+                              {{DNNL_ARG_SRC, expected_src},
+                               {DNNL_ARG_WEIGHTS, expected_weights},
+                               {DNNL_ARG_DST, dst},
+                               {DNNL_ARG_SCRATCHPAD, scratchpad}});
+    }
+
+    if (!param.prelu_weights.empty()) {
+      prelu_forward::compute(dst, param.prelu_weights);
     }
   }
 };
@@ -435,6 +669,10 @@ struct convolution_backward_data : public dnnl::convolution_backward_data {
                       const int groups,
                       algorithm aalgorithm = algorithm::convolution_direct,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("convolution_backward_data", diff_dst, weights);
+    IDEEP_RECORD(convolution_backward_data, diff_dst, weights, diff_src_dims,
+                 diff_src, strides, dilates, padding_l, padding_r, groups,
+                 aalgorithm);
     // make weights and dilates compatible with DNNL
     auto weights_ = weights.make_grouped_weights(groups);
     auto dilates_ = utils::get_compatible_dilates(dilates);
@@ -446,19 +684,23 @@ struct convolution_backward_data : public dnnl::convolution_backward_data {
 
     tensor::desc diff_src_desc(diff_src_dims, diff_dst_desc.get_data_type());
 
-    auto forward_hints =
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, primitive_desc(
+        {aalgorithm, diff_src_desc, weights_desc, diff_dst_desc, strides,
+         dilates_, padding_l, padding_r}, aengine,
         convolution_forward::get_primitive_desc</*with_bias=*/false>(
             diff_src_desc, weights_desc, tensor::desc(), diff_dst_desc, strides,
-            dilates_, padding_l, padding_r);
-
-    auto pd = primitive_desc(
-        {aalgorithm, diff_src_desc, weights_desc, diff_dst_desc, strides,
-         dilates_, padding_l, padding_r}, aengine, forward_hints);
+            dilates_, padding_l, padding_r)));
 
+    IDEEP_PROFILE_ARG("diff_dst");
     auto expected_diff_dst = diff_dst.reorder_if_differ_in(pd.diff_dst_desc());
-    auto expected_weights = weights_.reorder_if_differ_in(pd.weights_desc());
+    IDEEP_PROFILE_ARG("weights");
+    auto expected_weights = IDEEP_PROFILE_USAGE(weights,
+        weights_.reorder_if_differ_in(pd.weights_desc()));
     diff_src.reinit_if_possible(pd.diff_src_desc());
 
+    IDEEP_PROFILE_FLOPS(2.0 * diff_dst.get_nelems() *
+                        expected_weights.get_nelems() / diff_dst.get_dim(1));
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(), 
                       {{DNNL_ARG_DIFF_DST, expected_diff_dst},
                        {DNNL_ARG_WEIGHTS, expected_weights},
@@ -520,6 +762,10 @@ struct convolution_backward_weights
                            const int groups,
                            algorithm aalgorithm,
                            const engine& aengine) {
+    IDEEP_PROFILE_OP("convolution_backward_weights", src, diff_dst);
+    IDEEP_RECORD(convolution_backward_weights, src, diff_dst,
+                 diff_weights_dims, diff_weights, with_diff_bias, strides,
+                 dilates, padding_l, padding_r, groups, aalgorithm);
 
     // make diff_weights and dilates compatible with DNNL
     auto dilates_ = utils::get_compatible_dilates(dilates);
@@ -536,27 +782,33 @@ struct convolution_backward_weights
     auto diff_bias_desc =     
         tensor::desc({diff_dst.get_dim(1)}, data_type::f32, tag::any);
 
-    auto forward_hints =
-        convolution_forward::get_primitive_desc<with_diff_bias>(
-            src_desc, diff_weights_desc, diff_bias_desc, diff_dst_desc, strides,
-            dilates_, padding_l, padding_r, attr_t(), aalgorithm,
-            prop_kind::forward, aengine);
-
-    auto pd = with_diff_bias
-        ? primitive_desc({aalgorithm, src_desc, diff_weights_desc,
-                          diff_bias_desc, diff_dst_desc, strides, dilates_,
-                          padding_l, padding_r}, aengine, forward_hints)
-        : primitive_desc({aalgorithm, src_desc, diff_weights_desc,
-                          diff_dst_desc, strides, dilates_,
-                          padding_l, padding_r}, aengine, forward_hints);
-
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, [&]() {
+      auto forward_hints =
+          convolution_forward::get_primitive_desc<with_diff_bias>(
+              src_desc, diff_weights_desc, diff_bias_desc, diff_dst_desc,
+              strides, dilates_, padding_l, padding_r, attr_t(), aalgorithm,
+              prop_kind::forward, aengine);
+      return with_diff_bias
+          ? primitive_desc({aalgorithm, src_desc, diff_weights_desc,
+                            diff_bias_desc, diff_dst_desc, strides, dilates_,
+                            padding_l, padding_r}, aengine, forward_hints)
+          : primitive_desc({aalgorithm, src_desc, diff_weights_desc,
+                            diff_dst_desc, strides, dilates_,
+                            padding_l, padding_r}, aengine, forward_hints);
+    }());
+
+    IDEEP_PROFILE_ARG("diff_dst");
     auto expected_diff_dst = diff_dst.reorder_if_differ_in(pd.diff_dst_desc());
+    IDEEP_PROFILE_ARG("src");
     auto expected_src = src.reorder_if_differ_in(pd.src_desc());
     // embed group info into diff_weights_desc
     auto expected_diff_weights_desc =
         tensor::desc(pd.diff_weights_desc(), groups);
     diff_weights.reinit_if_possible(expected_diff_weights_desc);
 
+    IDEEP_PROFILE_FLOPS(2.0 * diff_dst.get_nelems() *
+                        diff_weights.get_nelems() / diff_dst.get_dim(1));
+    IDEEP_PROFILE_PHASE(execute);
     if (with_diff_bias) {
       diff_bias.reinit_if_possible(pd.diff_bias_desc());
       super(pd).execute(stream::default_stream(),
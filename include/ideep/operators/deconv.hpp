@@ -1,6 +1,8 @@
 #ifndef IDEEP_OPERATORS_DECONV_HPP
 #define IDEEP_OPERATORS_DECONV_HPP
 
+#include "prelu.hpp"
+
 namespace ideep {
 
 struct convolution_transpose_forward : public dnnl::deconvolution_forward {
@@ -150,6 +152,10 @@ struct convolution_transpose_forward : public dnnl::deconvolution_forward {
                            algorithm aalgorithm,
                            prop_kind aprop_kind,
                            const engine& aengine) {
+    IDEEP_PROFILE_OP("convolution_transpose_forward", src, weights);
+    IDEEP_RECORD(convolution_transpose_forward, src, weights, bias, dst_dims,
+                 dst, strides, dilates, padding_l, padding_r, groups, attr,
+                 aalgorithm, aprop_kind);
 
     // make weights and dilates compatible with DNNL
     auto weights_ = weights.make_grouped_weights(groups, true);
@@ -157,28 +163,41 @@ struct convolution_transpose_forward : public dnnl::deconvolution_forward {
 
     tensor::desc dst_desc(dst_dims, src.get_data_type());
 
-    auto pd = get_primitive_desc<with_bias>(
-        src.get_desc(), weights_.get_desc(), bias.get_desc(), dst_desc,
-        strides, dilates_, padding_l, padding_r, attr, aalgorithm,
-        aprop_kind, aengine);
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation,
+        get_primitive_desc<with_bias>(
+            src.get_desc(), weights_.get_desc(), bias.get_desc(), dst_desc,
+            strides, dilates_, padding_l, padding_r, attr, aalgorithm,
+            aprop_kind, aengine));
 
+    IDEEP_PROFILE_ARG("src");
     auto expected_src = src.reorder_if_differ_in(pd.src_desc());
+    IDEEP_PROFILE_ARG("weights");
     auto expected_weights = weights_.reorder_if_differ_in(pd.weights_desc());
     dst.reinit_if_possible(pd.dst_desc());
 
+    // every src element is scattered through the kernel into o/g channels
+    IDEEP_PROFILE_FLOPS(2.0 * src.get_nelems() *
+                        expected_weights.get_nelems() / src.get_dim(1));
     if (with_bias) {
+      IDEEP_PROFILE_ARG("bias");
       auto expected_bias = bias.reorder_if_differ_in(pd.bias_desc());
+      IDEEP_PROFILE_PHASE(execute);
       super(pd).execute(stream::default_stream(), 
                         {{DNNL_ARG_SRC, expected_src},
                          {DNNL_ARG_WEIGHTS, expected_weights},
                          {DNNL_ARG_BIAS, expected_bias},
                          {DNNL_ARG_DST, dst}});
     } else {
+      IDEEP_PROFILE_PHASE(execute);
       super(pd).execute(stream::default_stream(), 
                         {{DNNL_ARG_SRC, expected_src},
                          {DNNL_ARG_WEIGHTS, expected_weights},
                          {DNNL_ARG_DST, dst}});
     }
+
+    if (attr.has_prelu()) {
+      prelu_forward::compute(dst, attr.get_prelu_weights());
+    }
   }
 };
 
@@ -198,6 +217,10 @@ struct convolution_transpose_backward_data
                       const int groups = 1,
                       algorithm aalgorithm = algorithm::deconvolution_direct,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("convolution_transpose_backward_data", diff_dst, weights);
+    IDEEP_RECORD(convolution_transpose_backward_data, diff_dst, weights,
+                 diff_src_dims, diff_src, strides, padding_l, padding_r,
+                 dilates, groups, aalgorithm);
     // make weights and dilates compatible with DNNL
     auto weights_ = weights.make_grouped_weights(groups, true);
     auto dilates_ = utils::get_compatible_dilates(dilates);
@@ -207,19 +230,25 @@ struct convolution_transpose_backward_data
 
     tensor::desc diff_src_desc(diff_src_dims, diff_dst_desc.get_data_type());
 
-    auto forward_hints =
-        convolution_transpose_forward::get_primitive_desc</*with_bias=*/false>(
-            diff_src_desc, weights_desc, tensor::desc(), diff_dst_desc, strides,
-            dilates_, padding_l, padding_r);
-
-    auto pd = primitive_desc(
-        {aalgorithm, diff_src_desc, weights_desc, diff_dst_desc, strides,
-         dilates_, padding_l, padding_r}, aengine, forward_hints);
-
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, [&]() {
+      auto forward_hints = convolution_transpose_forward::get_primitive_desc<
+          /*with_bias=*/false>(
+          diff_src_desc, weights_desc, tensor::desc(), diff_dst_desc, strides,
+          dilates_, padding_l, padding_r);
+      return primitive_desc(
+          {aalgorithm, diff_src_desc, weights_desc, diff_dst_desc, strides,
+           dilates_, padding_l, padding_r}, aengine, forward_hints);
+    }());
+
+    IDEEP_PROFILE_ARG("diff_dst");
     auto expected_diff_dst = diff_dst.reorder_if_differ_in(pd.diff_dst_desc());
+    IDEEP_PROFILE_ARG("weights");
     auto expected_weights = weights_.reorder_if_differ_in(pd.weights_desc());
     diff_src.reinit_if_possible(pd.diff_src_desc());
 
+    IDEEP_PROFILE_FLOPS(2.0 * diff_src.get_nelems() *
+                        expected_weights.get_nelems() / diff_src.get_dim(1));
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(), 
                       {{DNNL_ARG_DIFF_DST, expected_diff_dst},
                        {DNNL_ARG_WEIGHTS, expected_weights},
@@ -279,6 +308,10 @@ private:
                            const int groups,
                            algorithm aalgorithm,
                            const engine& aengine) {
+    IDEEP_PROFILE_OP("convolution_transpose_backward_weights", src, diff_dst);
+    IDEEP_RECORD(convolution_transpose_backward_weights, src, diff_dst,
+                 diff_weights_dims, diff_weights, with_diff_bias, strides,
+                 padding_l, padding_r, dilates, groups, aalgorithm);
 
     // make diff_weights and dilates compatible with DNNL
     auto dilates_ = utils::get_compatible_dilates(dilates);
@@ -303,35 +336,42 @@ private:
               .to_format_any()
         : tensor::desc();
 
-    auto forward_hints =
-        convolution_transpose_forward::get_primitive_desc<with_diff_bias>(
-            src_desc, diff_weights_desc, diff_bias_desc, diff_dst_desc, strides,
-            dilates_, padding_l, padding_r, attr_t(), aalgorithm,
-            prop_kind::forward, aengine);
-
-    auto pd = with_diff_bias
-        ? primitive_desc({aalgorithm, src_desc, diff_weights_desc,
-                          diff_bias_desc, diff_dst_desc, strides, dilates_,
-                          padding_l, padding_r}, aengine, forward_hints)
-        : primitive_desc({aalgorithm, src_desc, diff_weights_desc,
-                          diff_dst_desc, strides, dilates_,
-                          padding_l, padding_r}, aengine, forward_hints);
-
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, [&]() {
+      auto forward_hints =
+          convolution_transpose_forward::get_primitive_desc<with_diff_bias>(
+              src_desc, diff_weights_desc, diff_bias_desc, diff_dst_desc,
+              strides, dilates_, padding_l, padding_r, attr_t(), aalgorithm,
+              prop_kind::forward, aengine);
+      return with_diff_bias
+          ? primitive_desc({aalgorithm, src_desc, diff_weights_desc,
+                            diff_bias_desc, diff_dst_desc, strides, dilates_,
+                            padding_l, padding_r}, aengine, forward_hints)
+          : primitive_desc({aalgorithm, src_desc, diff_weights_desc,
+                            diff_dst_desc, strides, dilates_,
+                            padding_l, padding_r}, aengine, forward_hints);
+    }());
+
+    IDEEP_PROFILE_ARG("diff_dst");
     auto expected_diff_dst = diff_dst.reorder_if_differ_in(pd.diff_dst_desc());
+    IDEEP_PROFILE_ARG("src");
     auto expected_src = src.reorder_if_differ_in(pd.src_desc());
     // embed group info into diff_weights_desc
     auto expected_diff_weights_desc =
         tensor::desc(pd.diff_weights_desc(), groups);
     diff_weights.reinit_if_possible(expected_diff_weights_desc);
 
+    IDEEP_PROFILE_FLOPS(2.0 * expected_src.get_nelems() *
+                        diff_weights.get_nelems() / src.get_dim(1));
     if (with_diff_bias) {
       diff_bias.reinit_if_possible(pd.diff_bias_desc());
+      IDEEP_PROFILE_PHASE(execute);
       super(pd).execute(stream::default_stream(),
                         {{DNNL_ARG_DIFF_DST, expected_diff_dst},
                          {DNNL_ARG_SRC, expected_src},
                          {DNNL_ARG_DIFF_WEIGHTS, diff_weights},
                          {DNNL_ARG_DIFF_BIAS, diff_bias}});
     } else {
+      IDEEP_PROFILE_PHASE(execute);
       super(pd).execute(stream::default_stream(),
                         {{DNNL_ARG_DIFF_DST, expected_diff_dst},
                          {DNNL_ARG_SRC, expected_src},
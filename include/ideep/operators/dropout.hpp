@@ -3,62 +3,144 @@
 
 namespace ideep {
 
+/// Dropout over a counter-based Philox stream.
+///
+/// The (seed, offset) overloads emit a bit-packed mask: one bit per element
+/// of src, stored as a u8 tensor of ceil(n / 32) * 4 bytes. Element i is kept
+/// iff bit (i % 8) of byte (i / 8) is set. The same seed and offset always
+/// produce the same mask, regardless of the number of threads. A caller
+/// stepping through training iterations typically keeps the seed and
+/// advances the offset by one per call.
+///
+/// The legacy overloads keep writing a full mask of src's type holding 0 or
+/// 1 / (1 - ratio), drawn from a process-wide seed.
 struct dropout_forward {
+  static void compute(const tensor& src, float ratio, tensor& dst,
+                      tensor& mask, uint64_t seed, uint64_t offset) {
+    IDEEP_PROFILE_OP("dropout_forward", src);
+    // told apart by whether the mask is bit-packed
+    IDEEP_RECORD(dropout_forward, true, src, ratio, dst);
+    switch (src.get_data_type()) {
+      case data_type::f32:
+        compute_impl<float, true>(src, ratio, dst, mask, seed, offset);
+        break;
+      case data_type::s32:
+        compute_impl<int32_t, true>(src, ratio, dst, mask, seed, offset);
+        break;
+      case data_type::s8:
+        compute_impl<int8_t, true>(src, ratio, dst, mask, seed, offset);
+        break;
+      case data_type::u8:
+        compute_impl<uint8_t, true>(src, ratio, dst, mask, seed, offset);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
   static void compute(const tensor& src, float ratio, tensor& dst,
                       tensor& mask) {
+    IDEEP_PROFILE_OP("dropout_forward", src);
+    IDEEP_RECORD(dropout_forward, false, src, ratio, dst);
+    auto seed = utils::philox_default_seed();
+    auto offset = utils::philox_next_offset();
     switch (src.get_data_type()) {
       case data_type::f32:
-        compute_impl<float>(src, ratio, dst, mask);
+        compute_impl<float, false>(src, ratio, dst, mask, seed, offset);
         break;
       case data_type::s32:
-        compute_impl<int32_t>(src, ratio, dst, mask);
+        compute_impl<int32_t, false>(src, ratio, dst, mask, seed, offset);
         break;
       case data_type::s8:
-        compute_impl<int8_t>(src, ratio, dst, mask);
+        compute_impl<int8_t, false>(src, ratio, dst, mask, seed, offset);
         break;
       case data_type::u8:
-        compute_impl<uint8_t>(src, ratio, dst, mask);
+        compute_impl<uint8_t, false>(src, ratio, dst, mask, seed, offset);
         break;
       default:
         throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
     }
   }
 
+  /// Bytes of the bit-packed mask for a tensor of `size` elements
+  static dim bitmask_size(dim size) {
+    return (size + 31) / 32 * sizeof(uint32_t);
+  }
+
  private:
-  template <typename T>
+  // Mask generation and scaling are fused: each 32-element word of the mask
+  // is drawn and immediately applied, so random numbers never hit memory.
+  template <typename T, bool packed>
   static void compute_impl(const tensor& src, float ratio, tensor& dst,
-                           tensor& mask) {
-    mask.reinit_if_possible(src.get_desc());
+                           tensor& mask, uint64_t seed, uint64_t offset) {
+    const auto size = static_cast<dim>(src.get_size() / sizeof(T));
+    if (packed) {
+      mask.reinit_if_possible({{bitmask_size(size)}, data_type::u8, tag::a});
+    } else {
+      mask.reinit_if_possible(src.get_desc());
+    }
     dst.reinit_if_possible(src.get_desc());
     if (src.has_scale()) {
       dst.set_scale(src.get_scale());
     }
 
-    const auto scale = 1.0 / (1.0 - ratio);
-    const auto size = src.get_size() / sizeof(T);
-    std::unique_ptr<int[]> bernouli_nums(new int[size]);
-    utils::bernoulli_generate(size, 1.0 - ratio, bernouli_nums.get());
-
-    const auto src_data = static_cast<T*>(src.get_data_handle());
-    const auto mask_data = static_cast<T*>(mask.get_data_handle());
+    const float scale = 1.0f / (1.0f - ratio);
+    const auto threshold = utils::philox_threshold(1.0 - ratio);
+    const auto nwords = (size + 31) / 32;
+    const auto src_data = static_cast<const T*>(src.get_data_handle());
     const auto dst_data = static_cast<T*>(dst.get_data_handle());
+    const auto mask_data = static_cast<char*>(mask.get_data_handle());
+    IDEEP_PROFILE_FLOPS(2.0 * size);
+    IDEEP_PROFILE_PHASE(execute);
 #ifdef _OPENMP
-#if (_OPENMP >= 201307)
-# pragma omp parallel for simd
-#else
-# pragma omp parallel for schedule(static)
-#endif
+#pragma omp parallel for schedule(static)
 #endif
-    for (auto i = 0; i < size; i++) {
-      mask_data[i] = bernouli_nums[i] * scale;
-      dst_data[i] = mask_data[i] * src_data[i];
+    for (dim w = 0; w < nwords; w++) {
+      auto bits = utils::philox_bernoulli_word(seed, offset, w, threshold);
+      const auto begin = w * 32;
+      const auto len = std::min<dim>(32, size - begin);
+      if (packed) {
+        std::memcpy(mask_data + w * sizeof(bits), &bits, sizeof(bits));
+      }
+      for (dim j = 0; j < len; j++) {
+        const float m = scale * ((bits >> j) & 1);
+        if (!packed) {
+          reinterpret_cast<T*>(mask_data)[begin + j] = static_cast<T>(m);
+        }
+        dst_data[begin + j] = static_cast<T>(m * src_data[begin + j]);
+      }
     }
   }
 };
 
 struct dropout_backward {
+  /// Consumes a bit-packed mask produced by the seeded dropout_forward
+  static void compute(const tensor& mask, float ratio, const tensor& diff_dst,
+                      tensor& diff_src) {
+    IDEEP_PROFILE_OP("dropout_backward", diff_dst);
+    IDEEP_RECORD(dropout_backward, true, mask, ratio, diff_dst, diff_src);
+    switch (diff_dst.get_data_type()) {
+      case data_type::f32:
+        compute_packed_impl<float>(mask, ratio, diff_dst, diff_src);
+        break;
+      case data_type::s32:
+        compute_packed_impl<int32_t>(mask, ratio, diff_dst, diff_src);
+        break;
+      case data_type::s8:
+        compute_packed_impl<int8_t>(mask, ratio, diff_dst, diff_src);
+        break;
+      case data_type::u8:
+        compute_packed_impl<uint8_t>(mask, ratio, diff_dst, diff_src);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type!");
+    }
+  }
+
   static void compute(const tensor& mask, const tensor& diff_dst,
                       tensor& diff_src) {
+    IDEEP_PROFILE_OP("dropout_backward", diff_dst);
+    IDEEP_RECORD(dropout_backward, false, mask, 0.f, diff_dst, diff_src);
     switch (diff_dst.get_data_type()) {
       case data_type::f32:
         compute_impl<float>(mask, diff_dst, diff_src);
@@ -78,6 +160,37 @@ struct dropout_backward {
   }
 
  private:
+  template <typename T>
+  static void compute_packed_impl(const tensor& mask, float ratio,
+                                  const tensor& diff_dst, tensor& diff_src) {
+    diff_src.reinit_if_possible(diff_dst.get_desc());
+
+    const auto size = static_cast<dim>(diff_dst.get_size() / sizeof(T));
+    IDEEP_ENFORCE(mask.get_size() >= dropout_forward::bitmask_size(size),
+                  "Mask is too small for diff_dst");
+    const float scale = 1.0f / (1.0f - ratio);
+    const auto nwords = (size + 31) / 32;
+    const auto mask_data = static_cast<const char*>(mask.get_data_handle());
+    const auto diff_dst_data = static_cast<const T*>(diff_dst.get_data_handle());
+    const auto diff_src_data = static_cast<T*>(diff_src.get_data_handle());
+    IDEEP_PROFILE_FLOPS(2.0 * size);
+    IDEEP_PROFILE_PHASE(execute);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (dim w = 0; w < nwords; w++) {
+      uint32_t bits;
+      std::memcpy(&bits, mask_data + w * sizeof(bits), sizeof(bits));
+      const auto begin = w * 32;
+      const auto len = std::min<dim>(32, size - begin);
+      for (dim j = 0; j < len; j++) {
+        const float m = scale * ((bits >> j) & 1);
+        diff_src_data[begin + j] =
+            static_cast<T>(m * diff_dst_data[begin + j]);
+      }
+    }
+  }
+
   template <typename T>
   static void compute_impl(const tensor& mask, const tensor& diff_dst,
                            tensor& diff_src) {
@@ -87,6 +200,8 @@ struct dropout_backward {
     const auto mask_data = static_cast<T*>(mask.get_data_handle());
     const auto diff_dst_data = static_cast<T*>(diff_dst.get_data_handle());
     const auto diff_src_data = static_cast<T*>(diff_src.get_data_handle());
+    IDEEP_PROFILE_FLOPS(1.0 * size);
+    IDEEP_PROFILE_PHASE(execute);
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static)
 #endif
@@ -98,4 +213,4 @@ struct dropout_backward {
 
 }  // namespace ideep
 
-#endif
\ No newline at end of file
+#endif
@@ -14,6 +14,9 @@ struct eltwise_forward : public dnnl::eltwise_forward {
                       float alpha = 0.0,
                       float beta = 0.0,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("eltwise_forward", src);
+    IDEEP_RECORD(eltwise_forward, src, dst, aalgorithm, aprop_kind, alpha,
+                 beta);
     auto src_in = src;
     // we should leave dequantization to the framework
     if (aalgorithm != algorithm::eltwise_relu &&
@@ -22,16 +25,16 @@ struct eltwise_forward : public dnnl::eltwise_forward {
     }
     auto src_desc = src_in.get_desc();
 
-    auto pd = primitive_desc(
-        {aprop_kind, aalgorithm, src_desc, alpha, beta}, aengine);
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, primitive_desc(
+        {aprop_kind, aalgorithm, src_desc, alpha, beta}, aengine));
 
     dst.reinit_if_possible(pd.dst_desc());
     if (src_in.has_scale()) {
       dst.set_scale(src_in.get_scale());
     }
 
-    super(pd).execute(stream::default_stream(),
-                      {{DNNL_ARG_SRC, src_in}, {DNNL_ARG_DST, dst}});
+    IDEEP_PROFILE_TIMED(execute, super(pd).execute(
+        stream::default_stream(), {{DNNL_ARG_SRC, src_in}, {DNNL_ARG_DST, dst}}));
 
     // xpz: ???
     if (dst.has_scale() && aalgorithm == algorithm::eltwise_relu &&
@@ -52,19 +55,29 @@ struct eltwise_backward : public dnnl::eltwise_backward {
                       float alpha = 0.0,
                       float beta = 0.0,
                       const engine& aengine = engine::cpu_engine()) {
+  IDEEP_PROFILE_OP("eltwise_backward", src, diff_dst);
+  IDEEP_RECORD(eltwise_backward, src, diff_dst, diff_src, aalgorithm, alpha,
+               beta);
   auto src_desc = src.get_desc();
+  IDEEP_PROFILE_ARG("diff_dst");
   auto diff_dst_ = diff_dst.reorder_if_differ_in(src_desc);
 
-  auto forward_hints = eltwise_forward::primitive_desc(
-      {prop_kind::forward, aalgorithm, src_desc, alpha, beta}, aengine);
-  auto pd =
-      primitive_desc({aalgorithm, diff_dst.get_desc(), src_desc, alpha, beta},
-                     aengine, forward_hints);
+  auto pd = IDEEP_PROFILE_TIMED(primitive_creation, [&]() {
+    auto forward_hints = eltwise_forward::primitive_desc(
+        {prop_kind::forward, aalgorithm, src_desc, alpha, beta}, aengine);
+    return primitive_desc(
+        {aalgorithm, diff_dst.get_desc(), src_desc, alpha, beta},
+        aengine, forward_hints);
+  }());
 
   auto expected_diff_dst = diff_dst_.reorder_if_differ_in(pd.diff_dst_desc());
+  IDEEP_PROFILE_ARG("src");
   auto expected_src = src.reorder_if_differ_in(pd.src_desc());
   diff_src.reinit_if_possible(pd.diff_src_desc());
 
+  // the derivative at src times diff_dst
+  IDEEP_PROFILE_FLOPS(2.0 * src.get_nelems());
+  IDEEP_PROFILE_PHASE(execute);
   super(pd).execute(stream::default_stream(),
                     {{DNNL_ARG_DIFF_DST, expected_diff_dst},
                     {DNNL_ARG_SRC, expected_src},
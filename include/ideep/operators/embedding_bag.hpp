@@ -0,0 +1,340 @@
+#ifndef IDEEP_OPERATORS_EMBEDDING_BAG_HPP
+#define IDEEP_OPERATORS_EMBEDDING_BAG_HPP
+
+namespace ideep {
+
+/// Pooled embedding lookups over a {num_rows, D} plain table.
+///
+/// Bag b covers indices[offsets[b] .. offsets[b + 1]), the last bag running
+/// to the end of indices. Bags are pooled with REDUCE_SUM, REDUCE_MEAN or
+/// REDUCE_MAX; an empty bag yields zeros.
+///
+/// f32 tables give f32 output, bf16 tables give bf16 output. An int8 table
+/// carries one scale per row (real = q / scale[row]) and gives f32 output.
+/// If dst is already initialized with {num_bags, D} dims, it is filled in its
+/// own layout, e.g. the src desc a following inner_product_forward expects.
+/// Otherwise dst is created as plain nc.
+struct embedding_bag {
+
+  static void compute(const tensor& weights,
+                      const std::vector<dim>& indices,
+                      const std::vector<dim>& offsets,
+                      tensor& dst,
+                      reduction_kind mode = REDUCE_SUM) {
+    IDEEP_PROFILE_OP("embedding_bag", weights);
+    IDEEP_RECORD(embedding_bag, weights, static_cast<int64_t>(indices.size()),
+                 static_cast<int64_t>(offsets.size()), dst, mode);
+    compute_impl(weights, indices, offsets, dst, mode, nullptr);
+  }
+
+  /// Max pooling for training: max_rows receives, for every (bag, column),
+  /// the table row that won, or -1 for an empty bag.
+  static void compute(const tensor& weights,
+                      const std::vector<dim>& indices,
+                      const std::vector<dim>& offsets,
+                      tensor& dst,
+                      std::vector<dim>& max_rows) {
+    IDEEP_PROFILE_OP("embedding_bag", weights);
+    max_rows.resize(offsets.size() * weights.get_dim(1));
+    compute_impl(weights, indices, offsets, dst, REDUCE_MAX, max_rows.data());
+  }
+
+  /// Offsets must start at 0 or later, never decrease and stay within
+  /// indices, or the bag loops would read past them
+  static void check_offsets(const std::vector<dim>& offsets,
+                            dim num_indices) {
+    if (offsets.empty()) return;
+    IDEEP_ENFORCE(offsets.front() >= 0, "negative embedding_bag offset");
+    for (size_t b = 1; b < offsets.size(); b++) {
+      IDEEP_ENFORCE(offsets[b] >= offsets[b - 1],
+                    "embedding_bag offsets should not decrease");
+    }
+    IDEEP_ENFORCE(offsets.back() <= num_indices,
+                  "embedding_bag offset out of range");
+  }
+
+ private:
+  // rows this many lookups ahead are prefetched while the current one is
+  // summed
+  static constexpr dim prefetch_distance = 8;
+
+  static void compute_impl(const tensor& weights,
+                           const std::vector<dim>& indices,
+                           const std::vector<dim>& offsets,
+                           tensor& dst,
+                           reduction_kind mode,
+                           dim* max_rows) {
+    IDEEP_ENFORCE(weights.ndims() == 2 && weights.get_desc().is_default(),
+                  "embedding table should be a plain 2D tensor");
+    IDEEP_ENFORCE(utils::one_of(mode, REDUCE_SUM, REDUCE_MEAN, REDUCE_MAX),
+                  "embedding_bag supports sum, mean and max pooling only");
+    check_offsets(offsets, indices.size());
+    const dim num_bags = offsets.size();
+    const dim width = weights.get_dim(1);
+    auto wtype = weights.get_data_type();
+    auto dst_type = wtype == data_type::bf16 ? data_type::bf16
+                                             : data_type::f32;
+    dims dst_dims {num_bags, width};
+    if (dst.is_empty() || dst.get_dims() != dst_dims ||
+        dst.get_data_type() != dst_type) {
+      dst.reinit_if_possible({dst_dims, dst_type, tag::nc});
+    }
+
+    // one add (or compare) per gathered element
+    IDEEP_PROFILE_FLOPS(1.0 * indices.size() * width);
+    IDEEP_PROFILE_PHASE(execute);
+    switch (wtype) {
+      case data_type::f32:
+        kernel<float>(weights, indices, offsets, dst, mode, max_rows);
+        break;
+      case data_type::bf16:
+        kernel<uint16_t>(weights, indices, offsets, dst, mode, max_rows);
+        break;
+      case data_type::s8:
+        kernel<int8_t>(weights, indices, offsets, dst, mode, max_rows);
+        break;
+      case data_type::u8:
+        kernel<uint8_t>(weights, indices, offsets, dst, mode, max_rows);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
+  template <typename T>
+  static void kernel(const tensor& weights,
+                     const std::vector<dim>& indices,
+                     const std::vector<dim>& offsets,
+                     tensor& dst,
+                     reduction_kind mode,
+                     dim* max_rows) {
+    const dim num_rows = weights.get_dim(0);
+    const dim width = weights.get_dim(1);
+    const dim num_bags = offsets.size();
+    const dim num_indices = indices.size();
+    const auto table = static_cast<const T*>(weights.get_data_handle()) +
+                       weights.get_desc().data.offset0;
+    for (auto r : indices) {
+      IDEEP_ENFORCE(r >= 0 && r < num_rows, "index out of range");
+    }
+
+    const bool quantized = !std::is_same<T, float>::value &&
+                           !std::is_same<T, uint16_t>::value;
+    std::vector<float> row_scales;
+    if (quantized) {
+      IDEEP_ENFORCE(weights.has_scale() &&
+                    (weights.get_scale().size() == num_rows ||
+                     weights.get_scale().size() == 1),
+                    "int8 embedding table needs per-row scales");
+      row_scales = utils::fmap(weights.get_scale(),
+                               [](float s) { return 1.f / s; });
+    }
+
+    auto dst_desc = dst.get_desc();
+    auto dst_tables = utils::blocked_offset_tables(dst_desc.data);
+    const bool dst_plain = dst_desc.is_default();
+    const bool dst_bf16 = dst.get_data_type() == data_type::bf16;
+    void* dst_data = static_cast<char*>(dst.get_data_handle()) +
+        dst_desc.data.offset0 * (dst_bf16 ? sizeof(uint16_t) : sizeof(float));
+    if (!dst_plain) {
+      std::memset(dst_data, 0, dst.get_size());
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      std::vector<float> acc(width);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+      for (dim b = 0; b < num_bags; b++) {
+        const dim begin = offsets[b];
+        const dim end = b + 1 < num_bags ? offsets[b + 1] : num_indices;
+        const float init = (mode == REDUCE_MAX && end > begin)
+            ? -std::numeric_limits<float>::infinity() : 0.f;
+        std::fill(acc.begin(), acc.end(), init);
+        if (max_rows) {
+          std::fill(max_rows + b * width, max_rows + (b + 1) * width, -1);
+        }
+
+        for (dim i = begin; i < end; i++) {
+          if (i + prefetch_distance < end) {
+            auto next = table + indices[i + prefetch_distance] * width;
+            prefetch_row(next, width * sizeof(T));
+          }
+          const dim r = indices[i];
+          const T* row = table + r * width;
+          const float s = quantized
+              ? row_scales[row_scales.size() == 1 ? 0 : r] : 1.f;
+          if (mode == REDUCE_MAX) {
+            for (dim j = 0; j < width; j++) {
+              float v = s * utils::to_f32(row[j]);
+              if (v > acc[j]) {
+                acc[j] = v;
+                if (max_rows) max_rows[b * width + j] = r;
+              }
+            }
+          } else {
+            for (dim j = 0; j < width; j++) acc[j] += s * utils::to_f32(row[j]);
+          }
+        }
+
+        if (mode == REDUCE_MEAN && end > begin) {
+          const float inv = 1.f / (end - begin);
+          for (dim j = 0; j < width; j++) acc[j] *= inv;
+        }
+
+        for (dim j = 0; j < width; j++) {
+          auto off = dst_plain ? b * width + j
+                               : dst_tables[0][b] + dst_tables[1][j];
+          if (dst_bf16) {
+            static_cast<uint16_t*>(dst_data)[off] =
+                utils::float_to_bf16(acc[j]);
+          } else {
+            static_cast<float*>(dst_data)[off] = acc[j];
+          }
+        }
+      }
+    }
+  }
+
+  static inline void prefetch_row(const void* p, size_t bytes) {
+#if defined(__GNUC__)
+    auto addr = static_cast<const char*>(p);
+    for (size_t line = 0; line < bytes; line += 64) {
+      __builtin_prefetch(addr + line, 0, 1);
+    }
+#endif
+  }
+};
+
+struct embedding_bag_backward {
+
+  /// Sparse gradient of a sum or mean embedding_bag: grad_rows lists each
+  /// referenced table row once, in ascending order, and row i of the f32
+  /// {grad_rows.size(), D} grad_values holds its coalesced gradient.
+  static void compute(const tensor& diff_dst,
+                      const std::vector<dim>& indices,
+                      const std::vector<dim>& offsets,
+                      std::vector<dim>& grad_rows,
+                      tensor& grad_values,
+                      reduction_kind mode = REDUCE_SUM) {
+    IDEEP_PROFILE_OP("embedding_bag_backward", diff_dst);
+    IDEEP_RECORD(embedding_bag_backward, diff_dst,
+                 static_cast<int64_t>(indices.size()),
+                 static_cast<int64_t>(offsets.size()), mode);
+    IDEEP_ENFORCE(utils::one_of(mode, REDUCE_SUM, REDUCE_MEAN),
+                  "Use the max_rows overload for max pooling");
+    const dim num_bags = offsets.size();
+    const dim num_indices = indices.size();
+    const dim width = diff_dst.get_dim(1);
+    embedding_bag::check_offsets(offsets, num_indices);
+
+    // one entry per lookup: which bag it came from and its weight
+    std::vector<dim> bag_of(num_indices);
+    std::vector<float> weight_of(num_indices);
+    for (dim b = 0; b < num_bags; b++) {
+      const dim end = b + 1 < num_bags ? offsets[b + 1] : num_indices;
+      const float w = mode == REDUCE_MEAN && end > offsets[b]
+          ? 1.f / (end - offsets[b]) : 1.f;
+      for (dim i = offsets[b]; i < end; i++) {
+        bag_of[i] = b;
+        weight_of[i] = w;
+      }
+    }
+
+    coalesce(diff_dst, indices,
+             [&](dim i, dim j) { return bag_of[i]; },
+             [&](dim i) { return weight_of[i]; },
+             false, width, grad_rows, grad_values);
+  }
+
+  /// Sparse gradient of a max embedding_bag, given the max_rows produced by
+  /// the training forward
+  static void compute(const tensor& diff_dst,
+                      const std::vector<dim>& max_rows,
+                      std::vector<dim>& grad_rows,
+                      tensor& grad_values) {
+    IDEEP_PROFILE_OP("embedding_bag_backward", diff_dst);
+    IDEEP_RECORD(embedding_bag_backward, diff_dst,
+                 static_cast<int64_t>(max_rows.size()), int64_t(0),
+                 REDUCE_MAX);
+    const dim width = diff_dst.get_dim(1);
+    coalesce(diff_dst, max_rows,
+             [&](dim e, dim j) { return e / width; },
+             [&](dim e) { return 1.f; },
+             true, width, grad_rows, grad_values);
+  }
+
+ private:
+  // Groups entries by table row and accumulates their diff_dst rows. With
+  // per_column set, entry e only feeds column e % width, as in max pooling.
+  template <typename BagOf, typename WeightOf>
+  static void coalesce(const tensor& diff_dst,
+                       const std::vector<dim>& rows,
+                       BagOf bag_of,
+                       WeightOf weight_of,
+                       bool per_column,
+                       dim width,
+                       std::vector<dim>& grad_rows,
+                       tensor& grad_values) {
+    IDEEP_ENFORCE(diff_dst.get_data_type() == data_type::f32,
+                  "embedding_bag_backward supports f32 diff_dst only");
+    // a multiply-add per entry and column it feeds
+    IDEEP_PROFILE_FLOPS(2.0 * rows.size() * (per_column ? 1 : width));
+    IDEEP_PROFILE_PHASE(execute);
+    std::vector<dim> order;
+    order.reserve(rows.size());
+    for (dim e = 0; e < rows.size(); e++) {
+      if (rows[e] >= 0) order.push_back(e);
+    }
+    std::sort(order.begin(), order.end(),
+              [&](dim a, dim b) { return rows[a] < rows[b]; });
+
+    std::vector<dim> group_begin;
+    grad_rows.clear();
+    for (dim k = 0; k < order.size(); k++) {
+      if (k == 0 || rows[order[k]] != rows[order[k - 1]]) {
+        group_begin.push_back(k);
+        grad_rows.push_back(rows[order[k]]);
+      }
+    }
+    const dim num_groups = grad_rows.size();
+    group_begin.push_back(order.size());
+
+    grad_values.reinit_if_possible(
+        {{std::max<dim>(num_groups, 1), width}, data_type::f32, tag::nc});
+    std::memset(grad_values.get_data_handle(), 0, grad_values.get_size());
+
+    auto diff_dst_desc = diff_dst.get_desc();
+    auto tables = utils::blocked_offset_tables(diff_dst_desc.data);
+    const auto diff_dst_data = static_cast<const float*>(
+        diff_dst.get_data_handle()) + diff_dst_desc.data.offset0;
+    const auto values = static_cast<float*>(grad_values.get_data_handle());
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+    for (dim g = 0; g < num_groups; g++) {
+      float* out = values + g * width;
+      for (dim k = group_begin[g]; k < group_begin[g + 1]; k++) {
+        const dim e = order[k];
+        const dim b = bag_of(e, 0);
+        const float w = weight_of(e);
+        const dim row_off = tables[0][b];
+        if (per_column) {
+          const dim j = e % width;
+          out[j] += w * diff_dst_data[row_off + tables[1][j]];
+        } else {
+          for (dim j = 0; j < width; j++)
+            out[j] += w * diff_dst_data[row_off + tables[1][j]];
+        }
+      }
+    }
+  }
+};
+
+}  // namespace ideep
+
+#endif
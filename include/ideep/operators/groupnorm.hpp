@@ -0,0 +1,397 @@
+#ifndef IDEEP_OPERATORS_GROUPNORM_HPP
+#define IDEEP_OPERATORS_GROUPNORM_HPP
+
+namespace ideep {
+
+namespace detail {
+
+// Addressing of an {N, C, spatial...} tensor in its own blocked layout:
+// offset(n, c, s) = n_off[n] + c_off[c] + s_off[s], s a flattened spatial
+// index. Statistics are computed per (n, g) over C / groups channels.
+struct norm_layout {
+  dim batch, channels, groups, group_size, spatial;
+  std::vector<dim> n_off, c_off, s_off;
+
+  norm_layout(const tensor& src, int agroups) {
+    auto src_dims = src.get_dims();
+    IDEEP_ENFORCE(src_dims.size() >= 2, "Expect an {N, C, ...} tensor");
+    IDEEP_ENFORCE(src.get_desc().data.format_kind == dnnl_blocked,
+                  "Normalization supports blocked memory only");
+    batch = src_dims[0];
+    channels = src_dims[1];
+    groups = agroups;
+    IDEEP_ENFORCE(groups > 0 && channels % groups == 0,
+                  "Channels should be divisible by groups");
+    group_size = channels / groups;
+
+    auto tables = utils::blocked_offset_tables(src.get_desc().data);
+    n_off = tables[0];
+    c_off = tables[1];
+    s_off.assign(1, src.get_desc().data.offset0);
+    for (int d = 2; d < src_dims.size(); d++) {
+      std::vector<dim> next;
+      next.reserve(s_off.size() * src_dims[d]);
+      for (auto outer : s_off)
+        for (auto inner : tables[d]) next.push_back(outer + inner);
+      s_off.swap(next);
+    }
+    spatial = s_off.size();
+  }
+};
+
+}  // namespace detail
+
+/// Group normalization over an {N, C, ...} tensor: statistics per (sample,
+/// group of C / groups channels), followed by a per-channel affine transform
+/// and an optional ReLU, all in one pass over dst. Runs on the src layout as
+/// is (e.g. nChw16c), parallel over (N, groups). f32 and bf16 data; scale,
+/// shift, mean and variance are f32. Empty scale/shift mean 1 and 0.
+struct group_normalization_forward {
+
+  // training: write {N, groups} mean and variance for the backward pass
+  static void compute(const tensor& src,
+                      const tensor& scale,
+                      const tensor& shift,
+                      tensor& dst,
+                      tensor& mean,
+                      tensor& variance,
+                      int groups,
+                      float epsilon,
+                      bool fuse_relu = false,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("group_normalization_forward", src);
+    IDEEP_RECORD(group_normalization_forward_training, src, scale, shift, dst,
+                 mean, variance, groups, epsilon, fuse_relu);
+    detail::norm_layout layout(src, groups);
+    mean.reinit_if_possible({{layout.batch, groups}, data_type::f32, tag::ab});
+    variance.reinit_if_possible(mean.get_desc());
+    compute_impl(src, scale, shift, dst, layout, epsilon, fuse_relu,
+                 static_cast<float*>(mean.get_data_handle()),
+                 static_cast<float*>(variance.get_data_handle()));
+  }
+
+  // inference: statistics are computed on the fly and not written out
+  static void compute(const tensor& src,
+                      const tensor& scale,
+                      const tensor& shift,
+                      tensor& dst,
+                      int groups,
+                      float epsilon,
+                      bool fuse_relu = false,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("group_normalization_forward", src);
+    IDEEP_RECORD(group_normalization_forward, src, scale, shift, dst, groups,
+                 epsilon, fuse_relu);
+    detail::norm_layout layout(src, groups);
+    compute_impl(src, scale, shift, dst, layout, epsilon, fuse_relu,
+                 nullptr, nullptr);
+  }
+
+ private:
+  static void compute_impl(const tensor& src,
+                           const tensor& scale,
+                           const tensor& shift,
+                           tensor& dst,
+                           const detail::norm_layout& layout,
+                           float epsilon,
+                           bool fuse_relu,
+                           float* mean,
+                           float* variance) {
+    dst.reinit_if_possible(src.get_desc());
+    // statistics, normalization and affine, a rough estimate as for
+    // layer_normalization_forward
+    IDEEP_PROFILE_FLOPS(8.0 * src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    switch (src.get_data_type()) {
+      case data_type::f32:
+        kernel<float>(src, scale, shift, dst, layout, epsilon, fuse_relu,
+                      mean, variance);
+        break;
+      case data_type::bf16:
+        kernel<uint16_t>(src, scale, shift, dst, layout, epsilon, fuse_relu,
+                         mean, variance);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
+  template <typename T>
+  static void kernel(const tensor& src,
+                     const tensor& scale,
+                     const tensor& shift,
+                     tensor& dst,
+                     const detail::norm_layout& l,
+                     float epsilon,
+                     bool fuse_relu,
+                     float* mean,
+                     float* variance) {
+    const auto src_data = static_cast<const T*>(src.get_data_handle());
+    const auto dst_data = static_cast<T*>(dst.get_data_handle());
+    const auto scale_data = scale.is_empty()
+        ? nullptr : static_cast<const float*>(scale.get_data_handle());
+    const auto shift_data = shift.is_empty()
+        ? nullptr : static_cast<const float*>(shift.get_data_handle());
+    const dim elems = l.group_size * l.spatial;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      // per-thread coefficients of the group being normalized
+      std::vector<float> a(l.group_size), b(l.group_size);
+#ifdef _OPENMP
+#pragma omp for collapse(2) schedule(static)
+#endif
+      for (dim n = 0; n < l.batch; n++) {
+        for (dim g = 0; g < l.groups; g++) {
+          const dim c0 = g * l.group_size;
+          double sum = 0., sum_sq = 0.;
+          for (dim s = 0; s < l.spatial; s++) {
+            const dim base = l.n_off[n] + l.s_off[s];
+            for (dim c = c0; c < c0 + l.group_size; c++) {
+              float x = utils::to_f32(src_data[base + l.c_off[c]]);
+              sum += x;
+              sum_sq += x * x;
+            }
+          }
+          const float m = sum / elems;
+          const float v = std::max(0., sum_sq / elems - (double)m * m);
+          const float rstd = 1.f / std::sqrt(v + epsilon);
+          if (mean) {
+            mean[n * l.groups + g] = m;
+            variance[n * l.groups + g] = v;
+          }
+
+          // y = x * a[c] + b[c], folding normalization and affine together
+          for (dim k = 0; k < l.group_size; k++) {
+            const float gamma = scale_data ? scale_data[c0 + k] : 1.f;
+            const float beta = shift_data ? shift_data[c0 + k] : 0.f;
+            a[k] = gamma * rstd;
+            b[k] = beta - m * a[k];
+          }
+          for (dim s = 0; s < l.spatial; s++) {
+            const dim base = l.n_off[n] + l.s_off[s];
+            for (dim k = 0; k < l.group_size; k++) {
+              const dim off = base + l.c_off[c0 + k];
+              float y = utils::to_f32(src_data[off]) * a[k] + b[k];
+              if (fuse_relu) y = std::max(y, 0.f);
+              dst_data[off] = utils::from_f32<T>(y);
+            }
+          }
+        }
+      }
+    }
+  }
+};
+
+struct group_normalization_backward {
+
+  /// diff_scale and diff_shift are {C} f32. fuse_relu must match the
+  /// forward call; the ReLU mask is recomputed from src and the statistics.
+  static void compute(const tensor& src,
+                      const tensor& mean,
+                      const tensor& variance,
+                      const tensor& diff_dst,
+                      const tensor& scale,
+                      const tensor& shift,
+                      tensor& diff_src,
+                      tensor& diff_scale,
+                      tensor& diff_shift,
+                      int groups,
+                      float epsilon,
+                      bool fuse_relu = false,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("group_normalization_backward", src);
+    IDEEP_RECORD(group_normalization_backward, src, mean, variance, diff_dst,
+                 scale, shift, diff_src, groups, epsilon, fuse_relu);
+    detail::norm_layout layout(src, groups);
+    IDEEP_ENFORCE(diff_dst.get_desc() == src.get_desc(),
+                  "diff_dst should have the layout of src");
+    diff_src.reinit_if_possible(src.get_desc());
+    diff_scale.reinit_if_possible({{layout.channels}, data_type::f32, tag::a});
+    diff_shift.reinit_if_possible(diff_scale.get_desc());
+
+    IDEEP_PROFILE_FLOPS(16.0 * src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    switch (src.get_data_type()) {
+      case data_type::f32:
+        kernel<float>(src, mean, variance, diff_dst, scale, shift, diff_src,
+                      diff_scale, diff_shift, layout, epsilon, fuse_relu);
+        break;
+      case data_type::bf16:
+        kernel<uint16_t>(src, mean, variance, diff_dst, scale, shift,
+                         diff_src, diff_scale, diff_shift, layout, epsilon,
+                         fuse_relu);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
+ private:
+  template <typename T>
+  static void kernel(const tensor& src,
+                     const tensor& mean,
+                     const tensor& variance,
+                     const tensor& diff_dst,
+                     const tensor& scale,
+                     const tensor& shift,
+                     tensor& diff_src,
+                     tensor& diff_scale,
+                     tensor& diff_shift,
+                     const detail::norm_layout& l,
+                     float epsilon,
+                     bool fuse_relu) {
+    const auto src_data = static_cast<const T*>(src.get_data_handle());
+    const auto diff_dst_data =
+        static_cast<const T*>(diff_dst.get_data_handle());
+    const auto diff_src_data = static_cast<T*>(diff_src.get_data_handle());
+    const auto mean_data = static_cast<const float*>(mean.get_data_handle());
+    const auto var_data = static_cast<const float*>(variance.get_data_handle());
+    const auto scale_data = scale.is_empty()
+        ? nullptr : static_cast<const float*>(scale.get_data_handle());
+    const auto shift_data = shift.is_empty()
+        ? nullptr : static_cast<const float*>(shift.get_data_handle());
+    const dim elems = l.group_size * l.spatial;
+
+    // per-(n, c) partial sums of dy * x_hat and dy, reduced over n below
+    std::vector<float> part_scale(l.batch * l.channels);
+    std::vector<float> part_shift(l.batch * l.channels);
+
+#ifdef _OPENMP
+#pragma omp parallel for collapse(2) schedule(static)
+#endif
+    for (dim n = 0; n < l.batch; n++) {
+      for (dim g = 0; g < l.groups; g++) {
+        const dim c0 = g * l.group_size;
+        const float m = mean_data[n * l.groups + g];
+        const float rstd =
+            1.f / std::sqrt(var_data[n * l.groups + g] + epsilon);
+        float* ds = &part_scale[n * l.channels + c0];
+        float* db = &part_shift[n * l.channels + c0];
+        std::fill(ds, ds + l.group_size, 0.f);
+        std::fill(db, db + l.group_size, 0.f);
+
+        auto grad = [&](dim off, dim k) {
+          float dy = utils::to_f32(diff_dst_data[off]);
+          if (fuse_relu) {
+            const float gamma = scale_data ? scale_data[c0 + k] : 1.f;
+            const float beta = shift_data ? shift_data[c0 + k] : 0.f;
+            float x_hat = (utils::to_f32(src_data[off]) - m) * rstd;
+            if (x_hat * gamma + beta <= 0.f) dy = 0.f;
+          }
+          return dy;
+        };
+
+        for (dim s = 0; s < l.spatial; s++) {
+          const dim base = l.n_off[n] + l.s_off[s];
+          for (dim k = 0; k < l.group_size; k++) {
+            const dim off = base + l.c_off[c0 + k];
+            const float dy = grad(off, k);
+            const float x_hat = (utils::to_f32(src_data[off]) - m) * rstd;
+            ds[k] += dy * x_hat;
+            db[k] += dy;
+          }
+        }
+
+        // dx = rstd * (dy * gamma - (sum(dy * gamma)
+        //                            + x_hat * sum(dy * gamma * x_hat)) / M)
+        float sum_dy_gamma = 0.f, sum_dy_gamma_xhat = 0.f;
+        for (dim k = 0; k < l.group_size; k++) {
+          const float gamma = scale_data ? scale_data[c0 + k] : 1.f;
+          sum_dy_gamma += db[k] * gamma;
+          sum_dy_gamma_xhat += ds[k] * gamma;
+        }
+        const float c1 = sum_dy_gamma / elems;
+        const float c2 = sum_dy_gamma_xhat / elems;
+        for (dim s = 0; s < l.spatial; s++) {
+          const dim base = l.n_off[n] + l.s_off[s];
+          for (dim k = 0; k < l.group_size; k++) {
+            const dim off = base + l.c_off[c0 + k];
+            const float gamma = scale_data ? scale_data[c0 + k] : 1.f;
+            const float x_hat = (utils::to_f32(src_data[off]) - m) * rstd;
+            const float dx =
+                rstd * (grad(off, k) * gamma - c1 - x_hat * c2);
+            diff_src_data[off] = utils::from_f32<T>(dx);
+          }
+        }
+      }
+    }
+
+    const auto diff_scale_data =
+        static_cast<float*>(diff_scale.get_data_handle());
+    const auto diff_shift_data =
+        static_cast<float*>(diff_shift.get_data_handle());
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (dim c = 0; c < l.channels; c++) {
+      float ds = 0.f, db = 0.f;
+      for (dim n = 0; n < l.batch; n++) {
+        ds += part_scale[n * l.channels + c];
+        db += part_shift[n * l.channels + c];
+      }
+      diff_scale_data[c] = ds;
+      diff_shift_data[c] = db;
+    }
+  }
+};
+
+/// Instance normalization is group normalization with one channel per group
+struct instance_normalization_forward {
+
+  static void compute(const tensor& src,
+                      const tensor& scale,
+                      const tensor& shift,
+                      tensor& dst,
+                      tensor& mean,
+                      tensor& variance,
+                      float epsilon,
+                      bool fuse_relu = false,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("instance_normalization_forward", src);
+    group_normalization_forward::compute(src, scale, shift, dst, mean,
+                                         variance, src.get_dim(1), epsilon,
+                                         fuse_relu, aengine);
+  }
+
+  static void compute(const tensor& src,
+                      const tensor& scale,
+                      const tensor& shift,
+                      tensor& dst,
+                      float epsilon,
+                      bool fuse_relu = false,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("instance_normalization_forward", src);
+    group_normalization_forward::compute(src, scale, shift, dst,
+                                         src.get_dim(1), epsilon, fuse_relu,
+                                         aengine);
+  }
+};
+
+struct instance_normalization_backward {
+
+  static void compute(const tensor& src,
+                      const tensor& mean,
+                      const tensor& variance,
+                      const tensor& diff_dst,
+                      const tensor& scale,
+                      const tensor& shift,
+                      tensor& diff_src,
+                      tensor& diff_scale,
+                      tensor& diff_shift,
+                      float epsilon,
+                      bool fuse_relu = false,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("instance_normalization_backward", src);
+    group_normalization_backward::compute(src, mean, variance, diff_dst,
+                                          scale, shift, diff_src, diff_scale,
+                                          diff_shift, src.get_dim(1), epsilon,
+                                          fuse_relu, aengine);
+  }
+};
+
+}  // namespace ideep
+
+#endif
@@ -1,18 +1,267 @@
 #ifndef IDEEP_OPERATORS_GRU_HPP
 #define IDEEP_OPERATORS_GRU_HPP
+#include "rnn_backward_base.hpp"
 
 namespace ideep {
 
-struct gru_forward : public dnnl::gru_forward {
-  static void compute() {
+// Shared implementation of gru and lbr_gru, which only differ in the DNNL
+// primitive and in lbr_gru having one extra bias gate.
+//
+// Tensor layouts follow DNNL:
+//   src_layer/dst_layer  {T, N, C}          tnc
+//   src_iter/dst_iter    {L, D, N, C}       ldnc
+//   weights_layer/iter   {L, D, C, 3, DIC}  ldigo
+//   bias                 {L, D, G, DIC}     ldgo (G = 3 for gru, 4 for lbr_gru)
+// An empty src_iter means a zero initial state and an empty dst_iter_dims
+// means the final state is not written out.
+template <class dnnl_forward>
+struct gru_forward_base : public dnnl_forward {
+
+  using super = dnnl_forward;
+  using primitive_desc = typename super::primitive_desc;
+
+  struct params {
+    primitive_desc pd;
+    super primitive;
+  };
+
+  // The pd and primitive are fetched from the computation cache, so repeated
+  // shapes (e.g. per-bucket shapes of rnn_bucketing) are only created once.
+  static void compute(const tensor& src_layer,
+                      const tensor& src_iter,
+                      const tensor& weights_layer,
+                      const tensor& weights_iter,
+                      const tensor& bias,
+                      const dims& dst_layer_dims,
+                      tensor& dst_layer,
+                      const dims& dst_iter_dims,
+                      tensor& dst_iter,
+                      tensor& workspace,
+                      dnnl_rnn_direction_t direction,
+                      prop_kind aprop_kind = prop_kind::forward_training,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP(
+        std::is_same<dnnl_forward, dnnl::lbr_gru_forward>::value
+            ? "lbr_gru_forward" : "gru_forward",
+        src_layer, weights_layer);
+    // lbr_gru is told apart by its first argument
+    IDEEP_RECORD(gru_forward,
+                 bool(std::is_same<dnnl_forward, dnnl::lbr_gru_forward>()),
+                 src_layer, src_iter, weights_layer, weights_iter, bias,
+                 dst_layer_dims, dst_layer, dst_iter_dims, dst_iter, direction,
+                 aprop_kind);
+    // f32 or bf16, weights follow src and bias stays in f32
+    auto dtype = src_layer.get_data_type();
+    IDEEP_ENFORCE(utils::one_of(dtype, data_type::f32, data_type::bf16),
+                  "Unsupported data type in gru");
+    auto dst_iter_desc = dst_iter_dims.empty()
+        ? tensor::desc()
+        : tensor::desc(dst_iter_dims, dtype, tag::ldnc);
+    tensor::desc dst_layer_desc(dst_layer_dims, dtype, tag::tnc);
+    auto src_layer_desc = src_layer.get_desc();
+    auto src_iter_desc = src_iter.get_desc_or_zero();
+    auto weights_layer_desc =
+        weights_layer.get_desc().to_format_any().to_type(dtype);
+    auto weights_iter_desc =
+        weights_iter.get_desc().to_format_any().to_type(dtype);
+    auto bias_desc = bias.get_desc_or_zero();
+
+    auto key = utils::create_key(
+        direction, aprop_kind, src_layer_desc, src_iter_desc,
+        weights_layer_desc, weights_iter_desc, bias_desc, dst_layer_dims,
+        dst_iter_dims);
+    auto param = utils::computation_cache<params>::fetch_or_create(key, [&]() {
+      IDEEP_PROFILE_PHASE(primitive_creation);
+      auto pd = get_primitive_desc(
+          src_layer_desc, src_iter_desc, weights_layer_desc, weights_iter_desc,
+          bias_desc, dst_layer_desc, dst_iter_desc, direction, aprop_kind,
+          aengine);
+      return params {pd, super(pd)};
+    });
+    auto& pd = param.pd;
+
+    // For inference DNNL picks the rnn_packed format, so weights already
+    // packed by `expected_weights_desc` go through without a reorder.
+    IDEEP_PROFILE_ARG("src_layer");
+    auto expected_src_layer = src_layer.reorder_if_differ_in(pd.src_layer_desc());
+    IDEEP_PROFILE_ARG("weights_layer");
+    auto expected_weights_layer = IDEEP_PROFILE_USAGE(weights,
+        weights_layer.reorder_if_differ_in(pd.weights_layer_desc()));
+    IDEEP_PROFILE_ARG("weights_iter");
+    auto expected_weights_iter = IDEEP_PROFILE_USAGE(weights,
+        weights_iter.reorder_if_differ_in(pd.weights_iter_desc()));
+    dst_layer.reinit_if_possible(pd.dst_layer_desc());
+    auto scratchpad =
+        IDEEP_PROFILE_USAGE(scratchpad, tensor(pd.scratchpad_desc()));
+
+    exec_args args {{DNNL_ARG_SRC_LAYER, expected_src_layer},
+                    {DNNL_ARG_WEIGHTS_LAYER, expected_weights_layer},
+                    {DNNL_ARG_WEIGHTS_ITER, expected_weights_iter},
+                    {DNNL_ARG_DST_LAYER, dst_layer},
+                    {DNNL_ARG_SCRATCHPAD, scratchpad}};
+
+    if (!src_iter.is_empty()) {
+      IDEEP_PROFILE_ARG("src_iter");
+      args.insert({DNNL_ARG_SRC_ITER,
+                   src_iter.reorder_if_differ_in(pd.src_iter_desc())});
+    }
+    if (!bias.is_empty()) {
+      IDEEP_PROFILE_ARG("bias");
+      args.insert({DNNL_ARG_BIAS, bias.reorder_if_differ_in(pd.bias_desc())});
+    }
+    if (!dst_iter_dims.empty()) {
+      dst_iter.reinit_if_possible(pd.dst_iter_desc());
+      args.insert({DNNL_ARG_DST_ITER, dst_iter});
+    }
+    if (aprop_kind == prop_kind::forward_training) {
+      workspace.reinit_if_possible(pd.workspace_desc());
+      args.insert({DNNL_ARG_WORKSPACE, workspace});
+    }
+
+    // the gemms of every layer, direction and gate over all timesteps
+    IDEEP_PROFILE_FLOPS(2.0 * src_layer.get_dim(0) * src_layer.get_dim(1) *
+                        (weights_layer.get_nelems() +
+                         weights_iter.get_nelems()));
+    IDEEP_PROFILE_PHASE(execute);
+    param.primitive.execute(stream::default_stream(), args);
+  }
+
+  /// Returns the {weights_layer, weights_iter} descs the inference primitive
+  /// expects, i.e. the rnn_packed format. The packed layout depends on the
+  /// gemm shapes, so pass the src_layer dims the weights will be used with.
+  static std::pair<tensor::desc, tensor::desc> expected_weights_desc(
+      const dims& weights_layer_dims,
+      const dims& weights_iter_dims,
+      const dims& bias_dims,
+      const dims& src_layer_dims,
+      dnnl_rnn_direction_t direction = dnnl_unidirectional_left2right,
+      data_type dtype = data_type::f32,
+      prop_kind aprop_kind = prop_kind::forward_inference,
+      const engine& aengine = engine::cpu_engine()) {
+    auto hidden_size = weights_layer_dims[4];
+    auto dlc = direction == dnnl_bidirectional_concat
+        ? 2 * hidden_size : hidden_size;
+
+    tensor::desc src_layer_desc(src_layer_dims, dtype, tag::tnc);
+    tensor::desc weights_layer_desc(weights_layer_dims, dtype, tag::ldigo);
+    tensor::desc weights_iter_desc(weights_iter_dims, dtype, tag::ldigo);
+    tensor::desc bias_desc(bias_dims, data_type::f32, tag::ldgo);
+    tensor::desc dst_layer_desc(
+        {src_layer_dims[0], src_layer_dims[1], dlc}, dtype, tag::tnc);
+
+    auto pd = get_primitive_desc(
+        src_layer_desc, tensor::desc(), weights_layer_desc, weights_iter_desc,
+        bias_desc, dst_layer_desc, tensor::desc(), direction, aprop_kind,
+        aengine);
+    return std::make_pair(tensor::desc(pd.weights_layer_desc()),
+                          tensor::desc(pd.weights_iter_desc()));
+  }
+
+  static primitive_desc get_primitive_desc(
+      const tensor::desc& src_layer_desc,
+      const tensor::desc& src_iter_desc,
+      const tensor::desc& weights_layer_desc,
+      const tensor::desc& weights_iter_desc,
+      const tensor::desc& bias_desc,
+      const tensor::desc& dst_layer_desc,
+      const tensor::desc& dst_iter_desc,
+      dnnl_rnn_direction_t direction,
+      prop_kind aprop_kind = prop_kind::forward_training,
+      const engine& aengine = engine::cpu_engine()) {
+    // cached primitives are shared across threads, so keep the scratchpad
+    // per call instead of per primitive
+    attr_t attr;
+    attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
+    return primitive_desc(
+        {aprop_kind, static_cast<dnnl::rnn_direction>(direction),
+         src_layer_desc, src_iter_desc, weights_layer_desc.to_format_any(),
+         weights_iter_desc.to_format_any(), bias_desc, dst_layer_desc,
+         dst_iter_desc},
+        attr, aengine);
   }
 };
 
-struct gru_backward : public dnnl::gru_backward {
-  static void compute() {
+template <class dnnl_backward, class forward>
+struct gru_backward_base : public rnn_backward_base<dnnl_backward> {
+
+  using base = rnn_backward_base<dnnl_backward>;
+  using primitive_desc = typename base::primitive_desc;
+
+  // diff_weights_layer, diff_weights_iter and diff_bias are returned in the
+  // formats DNNL picked for them (see pd.diff_weights_*_desc()). An empty
+  // bias, as accepted by the forward, leaves diff_bias untouched.
+  static void compute(const tensor& src_layer,
+                      const tensor& src_iter,
+                      const tensor& weights_layer,
+                      const tensor& weights_iter,
+                      const tensor& bias,
+                      const tensor& dst_layer,
+                      const tensor& dst_iter,
+                      const tensor& diff_dst_layer,
+                      const tensor& diff_dst_iter,
+                      const tensor& workspace,
+                      tensor& diff_src_layer,
+                      tensor& diff_src_iter,
+                      tensor& diff_weights_layer,
+                      tensor& diff_weights_iter,
+                      tensor& diff_bias,
+                      dnnl_rnn_direction_t direction,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP(
+        std::is_same<dnnl_backward, dnnl::lbr_gru_backward>::value
+            ? "lbr_gru_backward" : "gru_backward",
+        src_layer, weights_layer);
+    // lbr_gru is told apart by its first argument
+    IDEEP_RECORD(gru_backward,
+                 bool(std::is_same<dnnl_backward, dnnl::lbr_gru_backward>()),
+                 src_layer, src_iter, weights_layer, weights_iter, bias,
+                 dst_layer, dst_iter, diff_dst_layer, diff_dst_iter, workspace,
+                 direction);
+    auto dtype = src_layer.get_data_type();
+    auto src_layer_desc = src_layer.get_desc();
+    auto src_iter_desc = src_iter.get_desc_or_zero();
+    auto weights_layer_desc =
+        weights_layer.get_desc().to_format_any().to_type(dtype);
+    auto weights_iter_desc =
+        weights_iter.get_desc().to_format_any().to_type(dtype);
+    auto bias_desc = bias.get_desc_or_zero();
+    auto dst_layer_desc = dst_layer.get_desc();
+    auto dst_iter_desc = dst_iter.get_desc_or_zero();
+
+    auto key = utils::create_key(
+        direction, src_layer_desc, src_iter_desc, weights_layer_desc,
+        weights_iter_desc, bias_desc, dst_layer_desc, dst_iter_desc);
+    auto create_pd = [&]() {
+      auto forward_hints = forward::get_primitive_desc(
+          src_layer_desc, src_iter_desc, weights_layer_desc, weights_iter_desc,
+          bias_desc, dst_layer_desc, dst_iter_desc, direction,
+          prop_kind::forward_training, aengine);
+
+      attr_t attr;
+      attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
+      return primitive_desc(
+          {prop_kind::backward, static_cast<dnnl::rnn_direction>(direction),
+           src_layer_desc, src_iter_desc, weights_layer_desc,
+           weights_iter_desc, bias_desc, dst_layer_desc, dst_iter_desc,
+           src_layer_desc, src_iter_desc, weights_layer_desc,
+           weights_iter_desc, bias_desc, dst_layer_desc, dst_iter_desc},
+          attr, aengine, forward_hints);
+    };
+    // no cell state
+    tensor none;
+    base::do_compute(key, create_pd, src_layer, src_iter, none,
+                     weights_layer, weights_iter, bias, dst_layer, dst_iter,
+                     none, diff_dst_layer, diff_dst_iter, none, workspace,
+                     diff_src_layer, diff_src_iter, none, diff_weights_layer,
+                     diff_weights_iter, diff_bias);
   }
 };
 
+struct gru_forward : public gru_forward_base<dnnl::gru_forward> {};
+
+struct gru_backward
+    : public gru_backward_base<dnnl::gru_backward, gru_forward> {};
+
 }  // namespace ideep
 
-#endif
\ No newline at end of file
+#endif
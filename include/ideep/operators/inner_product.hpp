@@ -1,12 +1,23 @@
 #ifndef IDEEP_OPERATORS_INNER_PRODUCT_HPP
 #define IDEEP_OPERATORS_INNER_PRODUCT_HPP
 
+#include "matmul.hpp"
+
 namespace ideep {
 
+// DNNL inner products have fixed shapes, so one prepared for any batch size
+// runs as a matmul with runtime M
+using inner_product_forward_params = matmul_forward_params;
+
 struct inner_product_forward : public dnnl::inner_product_forward {
 
   using super = dnnl::inner_product_forward;
 
+  struct params {
+    primitive_desc pd;
+    super primitive;
+  };
+
   static void compute(const tensor& src,
                       const tensor& weights,
                       const tensor& bias,
@@ -39,6 +50,49 @@ struct inner_product_forward : public dnnl::inner_product_forward {
                                       aprop_kind, alowp_kind, aengine);
   }
 
+  /// Prepares an inner product for any batch size, so one primitive serves
+  /// them all instead of one per shape. weights are {OC, IC...} and are
+  /// packed once into param; the data type is theirs. f32 and bf16 only.
+  static void prepare(inner_product_forward_params& param,
+                      const tensor& weights,
+                      const tensor& bias,
+                      const attr_t& attr = attr_t(),
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("inner_product_forward::prepare", weights, bias);
+    IDEEP_RECORD(inner_product_forward_prepare, &param, weights, bias, attr);
+    auto oc = weights.get_dim(0);
+    IDEEP_ENFORCE(bias.get_nelems() == oc, "Invalid dims in bias");
+    // bias is 1-D, hence plain, and matmul_forward copies it
+    tensor bias_2d({1, oc}, bias.get_data_type(), tag::ab,
+                   bias.get_data_handle(), aengine);
+    do_prepare</*with_bias=*/true>(param, weights, bias_2d, attr, aengine);
+  }
+
+  static void prepare(inner_product_forward_params& param,
+                      const tensor& weights,
+                      const attr_t& attr = attr_t(),
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("inner_product_forward::prepare", weights);
+    static tensor dummy_bias;
+    IDEEP_RECORD(inner_product_forward_prepare, &param, weights, dummy_bias,
+                 attr);
+    do_prepare</*with_bias=*/false>(param, weights, dummy_bias, attr,
+                                    aengine);
+  }
+
+  /// dst = src x weights^T + bias, for src {N, IC...} of any batch size N
+  static void compute(const inner_product_forward_params& param,
+                      const tensor& src,
+                      tensor& dst) {
+    IDEEP_PROFILE_OP("inner_product_forward", src, param.weights);
+    IDEEP_RECORD(inner_product_forward_param, &param, src, dst);
+    auto src_2d = src;
+    auto ic = param.weights.get_dim(0);
+    IDEEP_ENFORCE(src.get_nelems() == src.get_dim(0) * ic,
+                  "Invalid dims in src");
+    if (src.ndims() != 2) src_2d.reshape({src.get_dim(0), ic});
+    matmul_forward::compute(param, src_2d, dst);
+  }
 
   static tensor::desc expected_weights_desc(
       const dims& weights_dims,
@@ -63,7 +117,64 @@ struct inner_product_forward : public dnnl::inner_product_forward {
     return pd.weights_desc();
   }
 
+  /// The pd and primitive for these descs, created on the first call and
+  /// then served from the computation cache
+  template <bool with_bias>
+  static params fetch_or_create(const tensor::desc& src_desc,
+                                const tensor::desc& weights_desc,
+                                const tensor::desc& bias_desc,
+                                const tensor::desc& dst_desc,
+                                const attr_t& attr,
+                                prop_kind aprop_kind,
+                                const engine& aengine = engine::cpu_engine()) {
+    auto key = utils::create_key(aprop_kind, src_desc, weights_desc,
+                                 bias_desc, dst_desc, attr);
+    return utils::computation_cache<params>::fetch_or_create(key, [&]() {
+      IDEEP_PROFILE_PHASE(primitive_creation);
+      utils::manifest::instance().add(
+          utils::recorder::inner_product_forward_primitive, key, src_desc,
+          weights_desc, bias_desc, dst_desc, attr, aprop_kind);
+      attr_t op_attr = attr;
+      op_attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
+      auto pd = with_bias
+          ? primitive_desc({aprop_kind, src_desc, weights_desc, bias_desc,
+                            dst_desc}, op_attr, aengine)
+          : primitive_desc({aprop_kind, src_desc, weights_desc, dst_desc},
+                           op_attr, aengine);
+      return params {pd, super(pd)};
+    });
+  }
+
 private:
+  template <bool with_bias>
+  static void do_prepare(inner_product_forward_params& param,
+                         const tensor& weights,
+                         const tensor& bias,
+                         const attr_t& attr,
+                         const engine& aengine) {
+    auto oc = weights.get_dim(0);
+    auto ic = weights.get_nelems() / oc;
+    auto weights_2d = weights;
+    weights_2d.reshape({oc, ic});
+    // {IC, OC} matmul weights over the same {OC, IC} data
+    tensor weights_t({ic, oc}, weights_2d.get_data_type(), tag::ba,
+                     weights_2d.get_data_handle(), aengine);
+    if (with_bias) {
+      matmul_forward::prepare(param, weights_t, bias, 1.0f, 1.0f, 1.0f, attr,
+                              aengine);
+    } else {
+      matmul_forward::prepare(param, weights_t, 1.0f, 1.0f, attr, aengine);
+    }
+    // weights_t does not own its buffer, which the reshape may have just
+    // allocated: keep a copy if the packed weights are a view of it
+    if (param.weights.get_data_handle() == weights_2d.get_data_handle() &&
+        weights_2d.get_data_handle() != weights.get_data_handle()) {
+      tensor packed {param.weights.get_desc(), aengine};
+      param.weights.reorder_to(packed);
+      param.weights = packed;
+    }
+  }
+
   template <bool with_bias>
   static void compute_impl(const tensor& src,
                            const tensor& weights,
@@ -76,6 +187,9 @@ private:
                            const prop_kind aprop_kind,
                            const lowp_kind alowp_kind,
                            const engine& aengine) {
+    IDEEP_PROFILE_OP("inner_product_forward", src, weights);
+    IDEEP_RECORD(inner_product_forward, src, weights, bias, dst, src_scales,
+                 weights_scales, dst_scales, attr, aprop_kind, alowp_kind);
     // workaround: src and weights from caffe2 may have different dims.
     // It would be better for caffe2 to do this reshape anyway.
     auto src_ = src;
@@ -194,31 +308,46 @@ private:
     }
 
     tensor::desc dst_desc(dst_dims, dst_data_type, format_tag::any);
-    auto pd = with_bias
-       ? primitive_desc({aprop_kind, src_desc, weights_desc, bias_desc,
-                         dst_desc}, op_attr, aengine)
-       : primitive_desc({aprop_kind, src_desc, weights_desc, dst_desc},
-                        op_attr, aengine);
+    auto cached = fetch_or_create<with_bias>(
+        src_desc, weights_desc, bias_desc, dst_desc, op_attr, aprop_kind,
+        aengine);
+    auto& pd = cached.pd;
 
+    IDEEP_PROFILE_ARG("src");
     auto expected_src = src.reorder_if_differ_in(pd.src_desc(), src_attr);
-    auto expected_weights = weights.reorder_if_differ_in(pd.weights_desc(), weights_attr);
+    IDEEP_PROFILE_ARG("weights");
+    auto expected_weights = IDEEP_PROFILE_USAGE(weights,
+        weights.reorder_if_differ_in(pd.weights_desc(), weights_attr));
     dst.reinit_if_possible(pd.dst_desc());
     if (!dst_scales.empty() && dst.get_data_type() != data_type::f32) {
       dst.set_scale(dst_scales_in);
     }
+    auto scratchpad =
+        IDEEP_PROFILE_USAGE(scratchpad, tensor(pd.scratchpad_desc()));
 
+    IDEEP_PROFILE_FLOPS(2.0 * dst.get_nelems() * src.get_nelems() /
+                        src.get_dim(0));
     if (with_bias){
+      IDEEP_PROFILE_ARG("bias");
       auto expected_bias = bias.reorder_if_differ_in(pd.bias_desc(), bias_attr);
-      super(pd).execute(stream::default_stream(),
-                        {{DNNL_ARG_SRC, expected_src},
-                         {DNNL_ARG_WEIGHTS, expected_weights},
-                         {DNNL_ARG_BIAS, expected_bias},
-                         {DNNL_ARG_DST, dst}});
+      IDEEP_PROFILE_PHASE(execute);
+      cached.primitive.execute(stream::default_stream(),
+                               {{DNNL_ARG_SRC, expected_src},
+                                {DNNL_ARG_WEIGHTS, expected_weights},
+                                {DNNL_ARG_BIAS, expected_bias},
+                                {DNNL_ARG_DST, dst},
+                                {DNNL_ARG_SCRATCHPAD, scratchpad}});
     } else {
-      super(pd).execute(stream::default_stream(),
-                        {{DNNL_ARG_SRC, expected_src},
-                         {DNNL_ARG_WEIGHTS, expected_weights},
-                         {DNNL_ARG_DST, dst}});
+      IDEEP_PROFILE_PHASE(execute);
+      cached.primitive.execute(stream::default_stream(),
+                               {{DNNL_ARG_SRC, expected_src},
+                                {DNNL_ARG_WEIGHTS, expected_weights},
+                                {DNNL_ARG_DST, dst},
+                                {DNNL_ARG_SCRATCHPAD, scratchpad}});
+    }
+
+    if (attr.has_prelu()) {
+      prelu_forward::compute(dst, attr.get_prelu_weights(), dst.ndims() - 1);
     }
 
     if (attr.non_negitive_output() && dst.get_data_type() == data_type::s8) {
@@ -237,8 +366,12 @@ struct inner_product_backward_data : public dnnl::inner_product_backward_data {
                       const dims& diff_src_dims,
                       tensor& diff_src,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("inner_product_backward_data", diff_dst, weights);
+    IDEEP_RECORD(inner_product_backward_data, diff_dst, weights, diff_src_dims,
+                 diff_src);
     auto weights_ = weights;
     if (diff_dst.get_data_type() == data_type::bf16) {
+      IDEEP_PROFILE_ARG("weights");
       weights_.init(weights.get_desc().to_type(data_type::bf16));
       weights_.reorder_from(weights);
     }
@@ -256,18 +389,23 @@ struct inner_product_backward_data : public dnnl::inner_product_backward_data {
     auto diff_src_desc =
         tensor::desc(diff_src_dims, diff_dst.get_data_type(), tag::any);
 
-    auto forward_hints =
-        inner_product_forward::primitive_desc(
-            {prop_kind::forward, diff_src_desc, weights_desc, diff_dst_desc},
-            aengine);
-
-    auto pd = primitive_desc(
-        {diff_src_desc, weights_desc, diff_dst_desc}, aengine, forward_hints);
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, [&]() {
+      auto forward_hints = inner_product_forward::primitive_desc(
+          {prop_kind::forward, diff_src_desc, weights_desc, diff_dst_desc},
+          aengine);
+      return primitive_desc(
+          {diff_src_desc, weights_desc, diff_dst_desc}, aengine, forward_hints);
+    }());
 
+    IDEEP_PROFILE_ARG("diff_dst");
     auto expected_diff_dst = diff_dst.reorder_if_differ_in(pd.diff_dst_desc());
+    IDEEP_PROFILE_ARG("weights");
     auto expected_weights = weights_.reorder_if_differ_in(pd.weights_desc());
     diff_src.reinit_if_possible(pd.diff_src_desc());
 
+    IDEEP_PROFILE_FLOPS(2.0 * diff_dst.get_nelems() *
+                        expected_weights.get_nelems() / diff_dst.get_dim(1));
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(),
                       {{DNNL_ARG_DIFF_DST, expected_diff_dst},
                        {DNNL_ARG_WEIGHTS, expected_weights},
@@ -305,6 +443,9 @@ private:
                            tensor& diff_weights,
                            tensor& diff_bias,
                            const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("inner_product_backward_weights", src, diff_dst);
+    IDEEP_RECORD(inner_product_backward_weights, src, diff_dst, diff_weights,
+                 with_diff_bias);
     auto src_desc = src.get_desc().to_format_any();
     auto diff_dst_desc = diff_dst.get_desc().to_format_any();
     auto diff_weights_dims = src.get_dims();
@@ -316,18 +457,23 @@ private:
     auto diff_bias_desc =
         tensor::desc({diff_dst.get_dim(1)}, data_type::f32, tag::any);
 
-    auto forward_hints = with_diff_bias
-        ? inner_product_forward::primitive_desc({prop_kind::forward, src_desc,
-            diff_weights_desc, diff_bias_desc, diff_dst_desc}, aengine)
-        : inner_product_forward::primitive_desc({prop_kind::forward, src_desc,
-            diff_weights_desc, diff_dst_desc}, aengine);
-    auto pd = with_diff_bias
-        ? primitive_desc({src_desc, diff_weights_desc, diff_bias_desc,
-                          diff_dst_desc}, aengine, forward_hints)
-        : primitive_desc({src_desc, diff_weights_desc, diff_dst_desc},
-                          aengine, forward_hints);
-
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, [&]() {
+      auto forward_hints = with_diff_bias
+          ? inner_product_forward::primitive_desc({prop_kind::forward,
+              src_desc, diff_weights_desc, diff_bias_desc, diff_dst_desc},
+              aengine)
+          : inner_product_forward::primitive_desc({prop_kind::forward,
+              src_desc, diff_weights_desc, diff_dst_desc}, aengine);
+      return with_diff_bias
+          ? primitive_desc({src_desc, diff_weights_desc, diff_bias_desc,
+                            diff_dst_desc}, aengine, forward_hints)
+          : primitive_desc({src_desc, diff_weights_desc, diff_dst_desc},
+                            aengine, forward_hints);
+    }());
+
+    IDEEP_PROFILE_ARG("diff_dst");
     auto expected_diff_dst = diff_dst.reorder_if_differ_in(pd.diff_dst_desc());
+    IDEEP_PROFILE_ARG("src");
     auto expected_src = src.reorder_if_differ_in(pd.src_desc());
     diff_weights.reinit_if_possible(pd.diff_weights_desc());
 
@@ -340,6 +486,9 @@ private:
       args.insert({DNNL_ARG_DIFF_BIAS, diff_bias});
     }
 
+    IDEEP_PROFILE_FLOPS(2.0 * diff_dst.get_nelems() *
+                        diff_weights.get_nelems() / diff_dst.get_dim(1));
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(), args);
   }
 };
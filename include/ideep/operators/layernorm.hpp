@@ -7,6 +7,7 @@ struct layer_normalization_forward : public dnnl::layer_normalization_forward {
 
   using super = dnnl::layer_normalization_forward;
 
+  // training: write mean and variance for the backward pass
   static void compute(const tensor& src,
                       const tensor& scale,
                       const tensor& shift,
@@ -15,33 +16,293 @@ struct layer_normalization_forward : public dnnl::layer_normalization_forward {
                       tensor& variance,
                       float epsilon,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("layer_normalization_forward", src);
+    IDEEP_RECORD(layer_normalization_forward_training, src, scale, shift, dst,
+                 mean, variance, epsilon);
+    compute(src, pack_scale_shift(scale, shift), dst, mean, variance,
+            epsilon, aengine);
+  }
+
+  // training with pre-packed scale_shift, skips the per-call repacking
+  static void compute(const tensor& src,
+                      const tensor& scale_shift,
+                      tensor& dst,
+                      tensor& mean,
+                      tensor& variance,
+                      float epsilon,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("layer_normalization_forward", src);
     auto flags = batch_normalization_flag::use_scale_shift;
-    auto src_desc = src.get_desc();
-    auto pd = primitive_desc(
-        {prop_kind::forward_training, src_desc, epsilon, flags}, aengine);
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, primitive_desc(
+        {prop_kind::forward_training, src.get_desc(), epsilon, flags},
+        aengine));
 
-    tensor scale_shift {pd.weights_desc()};
-    auto* scale_shift_buf = static_cast<char *>(scale_shift.get_data_handle());
-    std::memcpy(scale_shift_buf, scale.get_data_handle(), scale.get_size());
-    std::memcpy(scale_shift_buf + scale.get_size(),
-                shift.get_data_handle(), shift.get_size());
+    IDEEP_PROFILE_ARG("src");
     auto expected_src = src.reorder_if_differ_in(pd.src_desc());
+    IDEEP_PROFILE_ARG("scale_shift");
+    auto expected_scale_shift =
+        scale_shift.reorder_if_differ_in(pd.weights_desc());
     mean.reinit_if_possible(pd.mean_desc());
     variance.reinit_if_possible(pd.variance_desc());
     dst.reinit_if_possible(pd.dst_desc());
 
+    IDEEP_PROFILE_FLOPS(flops_per_element * src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(),
                       {{DNNL_ARG_SRC, expected_src},
-                       {DNNL_ARG_SCALE_SHIFT, scale_shift},
+                       {DNNL_ARG_SCALE_SHIFT, expected_scale_shift},
                        {DNNL_ARG_MEAN, mean},
                        {DNNL_ARG_VARIANCE, variance},
                        {DNNL_ARG_DST, dst}});
   }
+
+  // inference: statistics are computed on the fly and not written out
+  static void compute(const tensor& src,
+                      const tensor& scale,
+                      const tensor& shift,
+                      tensor& dst,
+                      float epsilon,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("layer_normalization_forward", src);
+    IDEEP_RECORD(layer_normalization_forward, src, tensor(), scale, shift, dst,
+                 epsilon);
+    compute(src, pack_scale_shift(scale, shift), dst, epsilon, aengine);
+  }
+
+  // inference with pre-packed scale_shift, skips the per-call repacking
+  static void compute(const tensor& src,
+                      const tensor& scale_shift,
+                      tensor& dst,
+                      float epsilon,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("layer_normalization_forward", src);
+    auto flags = batch_normalization_flag::use_scale_shift;
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, primitive_desc(
+        {prop_kind::forward_inference, src.get_desc(), epsilon, flags},
+        aengine));
+
+    IDEEP_PROFILE_ARG("src");
+    auto expected_src = src.reorder_if_differ_in(pd.src_desc());
+    IDEEP_PROFILE_ARG("scale_shift");
+    auto expected_scale_shift =
+        scale_shift.reorder_if_differ_in(pd.weights_desc());
+    dst.reinit_if_possible(pd.dst_desc());
+
+    IDEEP_PROFILE_FLOPS(flops_per_element * src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    super(pd).execute(stream::default_stream(),
+                      {{DNNL_ARG_SRC, expected_src},
+                       {DNNL_ARG_SCALE_SHIFT, expected_scale_shift},
+                       {DNNL_ARG_DST, dst}});
+  }
+
+  /// Inference of dst = LN(src + residual) over the last dim, in a single
+  /// pass: the sum of each row stays in a per-thread buffer and is never
+  /// written out. f32 and bf16 data on the default layout of src; scale and
+  /// shift are f32.
+  static void compute_with_residual(const tensor& src,
+                                    const tensor& residual,
+                                    const tensor& scale,
+                                    const tensor& shift,
+                                    tensor& dst,
+                                    float epsilon) {
+    IDEEP_PROFILE_OP("layer_normalization_forward", src, residual);
+    IDEEP_RECORD(layer_normalization_forward, src, residual, scale, shift, dst,
+                 epsilon);
+    IDEEP_ENFORCE(residual.get_dims() == src.get_dims(),
+                  "residual should have the dims of src");
+    const auto width = src.get_dim(src.ndims() - 1);
+    IDEEP_ENFORCE(scale.get_nelems() == width && shift.get_nelems() == width,
+                  "one scale and shift per element of the last dim expected");
+    IDEEP_ENFORCE(scale.get_data_type() == data_type::f32 &&
+                      shift.get_data_type() == data_type::f32,
+                  "layer norm scale and shift should be f32");
+
+    auto default_desc = src.get_desc().to_default_format();
+    IDEEP_PROFILE_ARG("src");
+    auto expected_src = src.reorder_if_differ_in(default_desc);
+    IDEEP_PROFILE_ARG("residual");
+    auto expected_residual = residual.reorder_if_differ_in(
+        default_desc.to_type(residual.get_data_type()));
+    dst.reinit_if_possible(default_desc);
+
+    IDEEP_PROFILE_FLOPS((flops_per_element + 1) * src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    switch (src.get_data_type()) {
+      case data_type::f32:
+        residual_kernel<float>(expected_src, expected_residual, scale, shift,
+                               dst, epsilon);
+        break;
+      case data_type::bf16:
+        residual_kernel<uint16_t>(expected_src, expected_residual, scale,
+                                  shift, dst, epsilon);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments,
+                    "layer norm with residual supports f32 and bf16 only");
+    }
+  }
+
+  /// Pack separate scale and shift into the {2, C} weights layout expected
+  /// by DNNL. Callers running the same layer repeatedly may pack once and
+  /// pass the result to the overloads taking `scale_shift`.
+  static tensor pack_scale_shift(const tensor& scale,
+                                 const tensor& shift,
+                                 const tensor::desc& weights_desc) {
+    tensor scale_shift {weights_desc};
+    auto* scale_shift_buf = static_cast<char *>(scale_shift.get_data_handle());
+    std::memcpy(scale_shift_buf, scale.get_data_handle(), scale.get_size());
+    std::memcpy(scale_shift_buf + scale.get_size(),
+                shift.get_data_handle(), shift.get_size());
+    return scale_shift;
+  }
+
+  static tensor pack_scale_shift(const tensor& scale, const tensor& shift) {
+    IDEEP_ENFORCE(scale.get_nelems() == shift.get_nelems(),
+                  "scale and shift should have the same size");
+    tensor::desc weights_desc(
+        {2, scale.get_nelems()}, scale.get_data_type(), tag::nc);
+    return pack_scale_shift(scale, shift, weights_desc);
+  }
+
+  // mean, variance, normalization and scale-shift, as a rough estimate
+  static constexpr double flops_per_element = 8.0;
+
+ private:
+  template <typename T>
+  static void residual_kernel(const tensor& src,
+                              const tensor& residual,
+                              const tensor& scale,
+                              const tensor& shift,
+                              tensor& dst,
+                              float epsilon) {
+    const dim width = src.get_dim(src.ndims() - 1);
+    const dim rows = src.get_nelems() / width;
+    const auto src_data = static_cast<const T*>(src.get_data_handle()) +
+                          src.get_desc().data.offset0;
+    const auto residual_data =
+        static_cast<const T*>(residual.get_data_handle()) +
+        residual.get_desc().data.offset0;
+    const auto dst_data =
+        static_cast<T*>(dst.get_data_handle()) + dst.get_desc().data.offset0;
+    const auto scale_data = static_cast<const float*>(scale.get_data_handle());
+    const auto shift_data = static_cast<const float*>(shift.get_data_handle());
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      std::vector<float> sum(width);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+      for (dim r = 0; r < rows; r++) {
+        const dim base = r * width;
+        float mean = 0.f;
+        for (dim k = 0; k < width; k++) {
+          sum[k] = utils::to_f32(src_data[base + k]) +
+                   utils::to_f32(residual_data[base + k]);
+          mean += sum[k];
+        }
+        mean /= width;
+        float variance = 0.f;
+        for (dim k = 0; k < width; k++) {
+          const float d = sum[k] - mean;
+          variance += d * d;
+        }
+        const float rstd = 1.f / std::sqrt(variance / width + epsilon);
+        for (dim k = 0; k < width; k++) {
+          dst_data[base + k] = utils::from_f32<T>(
+              (sum[k] - mean) * rstd * scale_data[k] + shift_data[k]);
+        }
+      }
+    }
+  }
 };
 
 struct layer_normalization_backward :
     public dnnl::layer_normalization_backward {
-  static void compute() {
+
+  using super = dnnl::layer_normalization_backward;
+
+  static void compute(const tensor& src,
+                      const tensor& mean,
+                      const tensor& variance,
+                      const tensor& diff_dst,
+                      const tensor& scale_shift,
+                      tensor& diff_src,
+                      tensor& diff_scale_shift,
+                      float epsilon,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("layer_normalization_backward", src);
+    // an empty shift marks a pre-packed scale_shift
+    IDEEP_RECORD(layer_normalization_backward, src, mean, variance, diff_dst,
+                 scale_shift, tensor(), diff_src, epsilon);
+    auto flags = batch_normalization_flag::use_scale_shift;
+    auto src_desc = src.get_desc();
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, [&]() {
+      auto forward_hints = dnnl::layer_normalization_forward::primitive_desc(
+          {prop_kind::forward_training, src_desc, epsilon, flags}, aengine);
+      return primitive_desc(
+          {prop_kind::backward, diff_dst.get_desc(), src_desc, epsilon, flags},
+          aengine, forward_hints);
+    }());
+
+    IDEEP_PROFILE_ARG("diff_dst");
+    auto expected_diff_dst = diff_dst.reorder_if_differ_in(pd.diff_dst_desc());
+    IDEEP_PROFILE_ARG("src");
+    auto expected_src = src.reorder_if_differ_in(pd.src_desc());
+    IDEEP_PROFILE_ARG("mean");
+    auto expected_mean = mean.reorder_if_differ_in(pd.mean_desc());
+    IDEEP_PROFILE_ARG("variance");
+    auto expected_variance = variance.reorder_if_differ_in(pd.variance_desc());
+    IDEEP_PROFILE_ARG("scale_shift");
+    auto expected_scale_shift =
+        scale_shift.reorder_if_differ_in(pd.weights_desc());
+    diff_src.reinit_if_possible(pd.diff_src_desc());
+    diff_scale_shift.reinit_if_possible(pd.diff_weights_desc());
+
+    // the data and the scale-shift gradients, about twice the forward
+    IDEEP_PROFILE_FLOPS(2 * layer_normalization_forward::flops_per_element *
+                        src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    super(pd).execute(stream::default_stream(),
+                      {{DNNL_ARG_SRC, expected_src},
+                       {DNNL_ARG_DIFF_DST, expected_diff_dst},
+                       {DNNL_ARG_SCALE_SHIFT, expected_scale_shift},
+                       {DNNL_ARG_MEAN, expected_mean},
+                       {DNNL_ARG_VARIANCE, expected_variance},
+                       {DNNL_ARG_DIFF_SRC, diff_src},
+                       {DNNL_ARG_DIFF_SCALE_SHIFT, diff_scale_shift}});
+  }
+
+  static void compute(const tensor& src,
+                      const tensor& mean,
+                      const tensor& variance,
+                      const tensor& diff_dst,
+                      const tensor& scale,
+                      const tensor& shift,
+                      tensor& diff_src,
+                      tensor& diff_scale,
+                      tensor& diff_shift,
+                      float epsilon,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("layer_normalization_backward", src);
+    IDEEP_RECORD(layer_normalization_backward, src, mean, variance, diff_dst,
+                 scale, shift, diff_src, epsilon);
+    auto scale_shift =
+        layer_normalization_forward::pack_scale_shift(scale, shift);
+    tensor diff_scale_shift;
+    compute(src, mean, variance, diff_dst, scale_shift, diff_src,
+            diff_scale_shift, epsilon, aengine);
+    diff_scale.reinit_if_possible(scale.get_desc());
+    diff_shift.reinit_if_possible(shift.get_desc());
+    auto* diff_scale_shift_buf =
+        static_cast<char*>(diff_scale_shift.get_data_handle());
+    std::memcpy(diff_scale.get_data_handle(), diff_scale_shift_buf,
+                diff_scale.get_size());
+    std::memcpy(diff_shift.get_data_handle(),
+                diff_scale_shift_buf + diff_scale.get_size(),
+                diff_shift.get_size());
   }
 };
 
@@ -1,18 +1,16 @@
 #ifndef IDEEP_OPERATORS_LBR_GRU_HPP
 #define IDEEP_OPERATORS_LBR_GRU_HPP
+#include "gru.hpp"
 
 namespace ideep {
 
-struct lbr_gru_forward : public dnnl::lbr_gru_forward {
-  static void compute() {
-  }
-};
+// Linear-before-reset GRU. Same interface as gru_forward/gru_backward, with
+// bias dims {L, D, 4, DIC}.
+struct lbr_gru_forward : public gru_forward_base<dnnl::lbr_gru_forward> {};
 
-struct lbr_gru_backward : public dnnl::lbr_gru_backward {
-  static void compute() {
-  }
-};
+struct lbr_gru_backward
+    : public gru_backward_base<dnnl::lbr_gru_backward, lbr_gru_forward> {};
 
 }  // namespace ideep
 
-#endif
\ No newline at end of file
+#endif
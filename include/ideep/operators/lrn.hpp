@@ -16,11 +16,15 @@ struct lrn_forward : public dnnl::lrn_forward {
                       algorithm aalgorithm = algorithm::lrn_across_channels,
                       prop_kind aprop_kind = prop_kind::forward_training,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("lrn_forward", src);
+    IDEEP_RECORD(lrn_forward, src, dst, local_size, alpha, beta, k,
+                 aalgorithm, aprop_kind);
     auto src_desc = src.get_desc();
-    auto pd = primitive_desc(
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, primitive_desc(
         {aprop_kind, aalgorithm, src_desc, local_size, alpha, beta, k},
-        aengine);
+        aengine));
 
+    IDEEP_PROFILE_ARG("src");
     auto expected_src = src.reorder_if_differ_in(pd.src_desc());
     dst.reinit_if_possible(pd.dst_desc());
 
@@ -32,8 +36,20 @@ struct lrn_forward : public dnnl::lrn_forward {
       args.insert({DNNL_ARG_WORKSPACE, dst.get_workspace()});
     }
 
+    IDEEP_PROFILE_FLOPS(flops(src, local_size, aalgorithm));
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(), args);
   }
+
+  // a multiply-add per element of the window summed for each output
+  static double flops(const tensor& src, dim local_size,
+                      algorithm aalgorithm) {
+    double window = local_size;
+    if (aalgorithm == algorithm::lrn_within_channel) {
+      for (int d = 3; d < src.ndims(); d++) window *= local_size;
+    }
+    return 2.0 * src.get_nelems() * window;
+  }
 };
 
 struct lrn_backward : public dnnl::lrn_backward {
@@ -50,19 +66,23 @@ struct lrn_backward : public dnnl::lrn_backward {
                       float k = 1.0,
                       algorithm aalgorithm = algorithm::lrn_across_channels,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("lrn_backward", diff_dst);
+    IDEEP_RECORD(lrn_backward, src, diff_dst, dst, diff_src, local_size, alpha,
+                 beta, k, aalgorithm);
 
     // workaround: use src.get_desc() once issue intel/mkl-dnn#588 is resolved
     auto src_desc = src._get_unblocked_desc_if_4c_blocked();
     // auto src_desc = src.get_desc();
-    auto forward_hints =
-        lrn_forward::primitive_desc({prop_kind::forward_training, aalgorithm,
-                                     src_desc, local_size, alpha, beta, k},
-                                    aengine);
-
-    auto pd = primitive_desc(
-        {aalgorithm, src_desc, diff_dst.get_desc(), local_size, alpha, beta, k},
-        aengine, forward_hints);
-    
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, [&]() {
+      auto forward_hints = lrn_forward::primitive_desc(
+          {prop_kind::forward_training, aalgorithm, src_desc, local_size,
+           alpha, beta, k}, aengine);
+      return primitive_desc(
+          {aalgorithm, src_desc, diff_dst.get_desc(), local_size, alpha, beta,
+           k}, aengine, forward_hints);
+    }());
+
+    IDEEP_PROFILE_ARG("diff_dst");
     auto expected_diff_dst = diff_dst.reorder_if_differ_in(pd.diff_dst_desc());
     diff_src.reinit_if_possible(pd.diff_src_desc());
 
@@ -71,10 +91,14 @@ struct lrn_backward : public dnnl::lrn_backward {
                     {DNNL_ARG_DIFF_SRC, diff_src}};
 
     if (dst.has_workspace()) {
+      IDEEP_PROFILE_ARG("workspace");
       auto expected_workspace =
           dst.get_workspace().reorder_if_differ_in(pd.workspace_desc());
       args.insert({DNNL_ARG_WORKSPACE, expected_workspace});
     }
+    // the window sums are recomputed and then scattered back
+    IDEEP_PROFILE_FLOPS(2 * lrn_forward::flops(src, local_size, aalgorithm));
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(), args);
   }
 };
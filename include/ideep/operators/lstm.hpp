@@ -1,18 +1,264 @@
 #ifndef IDEEP_OPERATORS_LSTM_HPP
 #define IDEEP_OPERATORS_LSTM_HPP
+#include "rnn_backward_base.hpp"
 
 namespace ideep {
 
+// Tensor layouts follow DNNL:
+//   src_layer/dst_layer      {T, N, C}             tnc
+//   src_iter[_c]/dst_iter[_c] {L, D, N, C}          ldnc
+//   weights_layer/iter       {L, D, C, 4, DIC}     ldigo
+//   bias                     {L, D, 4, DIC}        ldgo
+// An empty src_iter/src_iter_c means zero initial states and an empty
+// dst_iter_dims means the final states are not written out, so no state
+// buffers are allocated or copied for the common stateless case.
 struct lstm_forward : public dnnl::lstm_forward {
-  static void compute() {
+
+  using super = dnnl::lstm_forward;
+
+  struct params {
+    primitive_desc pd;
+    super primitive;
+  };
+
+  // The pd and primitive are fetched from the computation cache, so repeated
+  // shapes (e.g. per-bucket shapes of rnn_bucketing) are only created once.
+  static void compute(const tensor& src_layer,
+                      const tensor& src_iter,
+                      const tensor& src_iter_c,
+                      const tensor& weights_layer,
+                      const tensor& weights_iter,
+                      const tensor& bias,
+                      const dims& dst_layer_dims,
+                      tensor& dst_layer,
+                      const dims& dst_iter_dims,
+                      tensor& dst_iter,
+                      tensor& dst_iter_c,
+                      tensor& workspace,
+                      dnnl_rnn_direction_t direction,
+                      prop_kind aprop_kind = prop_kind::forward_training,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("lstm_forward", src_layer, weights_layer);
+    IDEEP_RECORD(lstm_forward, src_layer, src_iter, src_iter_c, weights_layer,
+                 weights_iter, bias, dst_layer_dims, dst_layer, dst_iter_dims,
+                 dst_iter, dst_iter_c, direction, aprop_kind);
+    auto dtype = src_layer.get_data_type();
+    auto src_iter_desc = src_iter.get_desc_or_zero();
+    auto src_iter_c_desc = src_iter_c.get_desc_or_zero();
+    // the cell state keeps its own data type, f32 even for u8 src_layer
+    auto c_dtype = !src_iter_c.is_empty() ? src_iter_c.get_data_type()
+        : dtype == data_type::u8 ? data_type::f32 : dtype;
+    auto dst_iter_desc = dst_iter_dims.empty()
+        ? tensor::desc()
+        : tensor::desc(dst_iter_dims, dtype, tag::ldnc);
+    auto dst_iter_c_desc = dst_iter_dims.empty()
+        ? tensor::desc()
+        : tensor::desc(dst_iter_dims, c_dtype, tag::ldnc);
+    tensor::desc dst_layer_desc(dst_layer_dims, dtype, tag::tnc);
+    auto src_layer_desc = src_layer.get_desc();
+    auto weights_layer_desc = weights_layer.get_desc().to_format_any();
+    auto weights_iter_desc = weights_iter.get_desc().to_format_any();
+    auto bias_desc = bias.get_desc_or_zero();
+
+    auto key = utils::create_key(
+        direction, aprop_kind, src_layer_desc, src_iter_desc, src_iter_c_desc,
+        weights_layer_desc, weights_iter_desc, bias_desc, dst_layer_dims,
+        dst_iter_dims);
+    auto param = utils::computation_cache<params>::fetch_or_create(key, [&]() {
+      IDEEP_PROFILE_PHASE(primitive_creation);
+      auto pd = get_primitive_desc(
+          src_layer_desc, src_iter_desc, src_iter_c_desc, weights_layer_desc,
+          weights_iter_desc, bias_desc, dst_layer_desc, dst_iter_desc,
+          dst_iter_c_desc, direction, aprop_kind, aengine);
+      return params {pd, super(pd)};
+    });
+    auto& pd = param.pd;
+
+    // For inference DNNL picks the rnn_packed format, so weights already
+    // packed by `expected_weights_desc` go through without a reorder.
+    IDEEP_PROFILE_ARG("src_layer");
+    auto expected_src_layer = src_layer.reorder_if_differ_in(pd.src_layer_desc());
+    IDEEP_PROFILE_ARG("weights_layer");
+    auto expected_weights_layer = IDEEP_PROFILE_USAGE(weights,
+        weights_layer.reorder_if_differ_in(pd.weights_layer_desc()));
+    IDEEP_PROFILE_ARG("weights_iter");
+    auto expected_weights_iter = IDEEP_PROFILE_USAGE(weights,
+        weights_iter.reorder_if_differ_in(pd.weights_iter_desc()));
+    dst_layer.reinit_if_possible(pd.dst_layer_desc());
+    auto scratchpad =
+        IDEEP_PROFILE_USAGE(scratchpad, tensor(pd.scratchpad_desc()));
+
+    exec_args args {{DNNL_ARG_SRC_LAYER, expected_src_layer},
+                    {DNNL_ARG_WEIGHTS_LAYER, expected_weights_layer},
+                    {DNNL_ARG_WEIGHTS_ITER, expected_weights_iter},
+                    {DNNL_ARG_DST_LAYER, dst_layer},
+                    {DNNL_ARG_SCRATCHPAD, scratchpad}};
+
+    if (!src_iter.is_empty()) {
+      IDEEP_PROFILE_ARG("src_iter");
+      args.insert({DNNL_ARG_SRC_ITER,
+                   src_iter.reorder_if_differ_in(pd.src_iter_desc())});
+    }
+    if (!src_iter_c.is_empty()) {
+      IDEEP_PROFILE_ARG("src_iter_c");
+      args.insert({DNNL_ARG_SRC_ITER_C,
+                   src_iter_c.reorder_if_differ_in(pd.src_iter_c_desc())});
+    }
+    if (!bias.is_empty()) {
+      IDEEP_PROFILE_ARG("bias");
+      args.insert({DNNL_ARG_BIAS, bias.reorder_if_differ_in(pd.bias_desc())});
+    }
+    if (!dst_iter_dims.empty()) {
+      dst_iter.reinit_if_possible(pd.dst_iter_desc());
+      dst_iter_c.reinit_if_possible(pd.dst_iter_c_desc());
+      args.insert({DNNL_ARG_DST_ITER, dst_iter});
+      args.insert({DNNL_ARG_DST_ITER_C, dst_iter_c});
+    }
+    if (aprop_kind == prop_kind::forward_training) {
+      workspace.reinit_if_possible(pd.workspace_desc());
+      args.insert({DNNL_ARG_WORKSPACE, workspace});
+    }
+
+    // the gemms of every layer, direction and gate over all timesteps
+    IDEEP_PROFILE_FLOPS(2.0 * src_layer.get_dim(0) * src_layer.get_dim(1) *
+                        (weights_layer.get_nelems() +
+                         weights_iter.get_nelems()));
+    IDEEP_PROFILE_PHASE(execute);
+    param.primitive.execute(stream::default_stream(), args);
+  }
+
+  /// Returns the {weights_layer, weights_iter} descs the inference primitive
+  /// expects, i.e. the rnn_packed format. The packed layout depends on the
+  /// gemm shapes, so pass the src_layer dims the weights will be used with.
+  static std::pair<tensor::desc, tensor::desc> expected_weights_desc(
+      const dims& weights_layer_dims,
+      const dims& weights_iter_dims,
+      const dims& src_layer_dims,
+      dnnl_rnn_direction_t direction = dnnl_unidirectional_left2right,
+      data_type dtype = data_type::f32,
+      prop_kind aprop_kind = prop_kind::forward_inference,
+      const engine& aengine = engine::cpu_engine()) {
+    auto num_layers = weights_layer_dims[0];
+    auto num_directions = weights_layer_dims[1];
+    auto num_gates = weights_layer_dims[3];
+    auto hidden_size = weights_layer_dims[4];
+    auto dlc = direction == dnnl_bidirectional_concat
+        ? 2 * hidden_size : hidden_size;
+
+    tensor::desc src_layer_desc(src_layer_dims, dtype, tag::tnc);
+    tensor::desc weights_layer_desc(weights_layer_dims, dtype, tag::ldigo);
+    tensor::desc weights_iter_desc(weights_iter_dims, dtype, tag::ldigo);
+    tensor::desc bias_desc(
+        {num_layers, num_directions, num_gates, hidden_size},
+        data_type::f32, tag::ldgo);
+    tensor::desc dst_layer_desc(
+        {src_layer_dims[0], src_layer_dims[1], dlc}, dtype, tag::tnc);
+
+    auto pd = get_primitive_desc(
+        src_layer_desc, tensor::desc(), tensor::desc(), weights_layer_desc,
+        weights_iter_desc, bias_desc, dst_layer_desc, tensor::desc(),
+        tensor::desc(), direction, aprop_kind, aengine);
+    return std::make_pair(tensor::desc(pd.weights_layer_desc()),
+                          tensor::desc(pd.weights_iter_desc()));
+  }
+
+  static primitive_desc get_primitive_desc(
+      const tensor::desc& src_layer_desc,
+      const tensor::desc& src_iter_desc,
+      const tensor::desc& src_iter_c_desc,
+      const tensor::desc& weights_layer_desc,
+      const tensor::desc& weights_iter_desc,
+      const tensor::desc& bias_desc,
+      const tensor::desc& dst_layer_desc,
+      const tensor::desc& dst_iter_desc,
+      const tensor::desc& dst_iter_c_desc,
+      dnnl_rnn_direction_t direction,
+      prop_kind aprop_kind = prop_kind::forward_training,
+      const engine& aengine = engine::cpu_engine()) {
+    // cached primitives are shared across threads, so keep the scratchpad
+    // per call instead of per primitive
+    attr_t attr;
+    attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
+    return primitive_desc(
+        {aprop_kind, static_cast<dnnl::rnn_direction>(direction),
+         src_layer_desc, src_iter_desc, src_iter_c_desc,
+         weights_layer_desc.to_format_any(), weights_iter_desc.to_format_any(),
+         bias_desc, dst_layer_desc, dst_iter_desc, dst_iter_c_desc},
+        attr, aengine);
   }
 };
 
-struct lstm_backward : public dnnl::lstm_backward {
-  static void compute() {
+struct lstm_backward : public rnn_backward_base<dnnl::lstm_backward> {
+
+  // diff_weights_layer, diff_weights_iter and diff_bias are returned in the
+  // formats DNNL picked for them (see pd.diff_weights_*_desc()). An empty
+  // bias, as accepted by the forward, leaves diff_bias untouched.
+  static void compute(const tensor& src_layer,
+                      const tensor& src_iter,
+                      const tensor& src_iter_c,
+                      const tensor& weights_layer,
+                      const tensor& weights_iter,
+                      const tensor& bias,
+                      const tensor& dst_layer,
+                      const tensor& dst_iter,
+                      const tensor& dst_iter_c,
+                      const tensor& diff_dst_layer,
+                      const tensor& diff_dst_iter,
+                      const tensor& diff_dst_iter_c,
+                      const tensor& workspace,
+                      tensor& diff_src_layer,
+                      tensor& diff_src_iter,
+                      tensor& diff_src_iter_c,
+                      tensor& diff_weights_layer,
+                      tensor& diff_weights_iter,
+                      tensor& diff_bias,
+                      dnnl_rnn_direction_t direction,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("lstm_backward", src_layer, weights_layer);
+    IDEEP_RECORD(lstm_backward, src_layer, src_iter, src_iter_c,
+                 weights_layer, weights_iter, bias, dst_layer, dst_iter,
+                 dst_iter_c, diff_dst_layer, diff_dst_iter, diff_dst_iter_c,
+                 workspace, direction);
+    auto src_layer_desc = src_layer.get_desc();
+    auto src_iter_desc = src_iter.get_desc_or_zero();
+    auto src_iter_c_desc = src_iter_c.get_desc_or_zero();
+    auto weights_layer_desc = weights_layer.get_desc().to_format_any();
+    auto weights_iter_desc = weights_iter.get_desc().to_format_any();
+    auto bias_desc = bias.get_desc_or_zero();
+    auto dst_layer_desc = dst_layer.get_desc();
+    auto dst_iter_desc = dst_iter.get_desc_or_zero();
+    auto dst_iter_c_desc = dst_iter_c.get_desc_or_zero();
+
+    auto key = utils::create_key(
+        direction, src_layer_desc, src_iter_desc, src_iter_c_desc,
+        weights_layer_desc, weights_iter_desc, bias_desc, dst_layer_desc,
+        dst_iter_desc, dst_iter_c_desc);
+    auto create_pd = [&]() {
+      auto forward_hints = lstm_forward::get_primitive_desc(
+          src_layer_desc, src_iter_desc, src_iter_c_desc, weights_layer_desc,
+          weights_iter_desc, bias_desc, dst_layer_desc, dst_iter_desc,
+          dst_iter_c_desc, direction, prop_kind::forward_training, aengine);
+
+      attr_t attr;
+      attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
+      return primitive_desc(
+          {prop_kind::backward, static_cast<dnnl::rnn_direction>(direction),
+           src_layer_desc, src_iter_desc, src_iter_c_desc,
+           weights_layer_desc, weights_iter_desc, bias_desc,
+           dst_layer_desc, dst_iter_desc, dst_iter_c_desc,
+           src_layer_desc, src_iter_desc, src_iter_c_desc,
+           weights_layer_desc, weights_iter_desc, bias_desc,
+           dst_layer_desc, dst_iter_desc, dst_iter_c_desc},
+          attr, aengine, forward_hints);
+    };
+    do_compute(key, create_pd, src_layer, src_iter, src_iter_c, weights_layer,
+               weights_iter, bias, dst_layer, dst_iter, dst_iter_c,
+               diff_dst_layer, diff_dst_iter, diff_dst_iter_c, workspace,
+               diff_src_layer, diff_src_iter, diff_src_iter_c,
+               diff_weights_layer, diff_weights_iter, diff_bias);
   }
 };
 
 }  // namespace ideep
 
-#endif
\ No newline at end of file
+#endif
@@ -1,12 +1,31 @@
 #ifndef IDEEP_OPERATORS_INNER_PRODUCT_MATMUL_HPP
 #define IDEEP_OPERATORS_INNER_PRODUCT_MATMUL_HPP
 
+#include "prelu.hpp"
+
 namespace ideep {
 
+struct matmul_forward_params {
+  // src and dst rows are DNNL_RUNTIME_DIM_VAL
+  dnnl::matmul::primitive_desc pd;
+  dnnl::matmul primitive;
+  // packed once into pd.weights_desc()
+  tensor weights;
+  // empty without bias
+  tensor bias;
+  // per-channel slopes of an attr_t::fuse_prelu post-op, applied to dst
+  scale_t prelu_weights;
+};
+
 struct matmul_forward : public dnnl::matmul {
 
   using super = dnnl::matmul;
 
+  struct params {
+    primitive_desc pd;
+    super primitive;
+  };
+
   static void compute(
       const tensor& src,
       const tensor& weights,
@@ -45,6 +64,79 @@ struct matmul_forward : public dnnl::matmul {
                                       dst_scales, attr, alowp_kind, aengine);
   }
 
+  /// Prepares a matmul for any number of src rows M (per batch when 3-D),
+  /// so one primitive serves every batch size or sequence length instead of
+  /// one per shape. K, N, the batch and the data type are those of weights,
+  /// which are packed once into param. f32 and bf16 only.
+  static void prepare(matmul_forward_params& param,
+                      const tensor& weights,
+                      const tensor& bias,
+                      const float dst_coeff = 1.0f,
+                      const float bias_coeff = 1.0f,
+                      const float sum_coeff = 1.0f,
+                      const attr_t& attr = attr_t(),
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("matmul_forward::prepare", weights, bias);
+    IDEEP_RECORD(matmul_forward_prepare, &param, weights, bias, dst_coeff,
+                 bias_coeff, sum_coeff, attr);
+    do_prepare</*with_bias=*/true>(param, weights, bias, dst_coeff,
+                                   bias_coeff, sum_coeff, attr, aengine);
+  }
+
+  static void prepare(matmul_forward_params& param,
+                      const tensor& weights,
+                      const float dst_coeff = 1.0f,
+                      const float sum_coeff = 1.0f,
+                      const attr_t& attr = attr_t(),
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("matmul_forward::prepare", weights);
+    static tensor dummy_bias;
+    IDEEP_RECORD(matmul_forward_prepare, &param, weights, dummy_bias,
+                 dst_coeff, 1.0f, sum_coeff, attr);
+    do_prepare</*with_bias=*/false>(param, weights, dummy_bias, dst_coeff,
+                                    1.0f, sum_coeff, attr, aengine);
+  }
+
+  /// dst = src x the weights of param, for src of any M
+  static void compute(const matmul_forward_params& param,
+                      const tensor& src,
+                      tensor& dst) {
+    IDEEP_PROFILE_OP("matmul_forward", src, param.weights);
+    IDEEP_RECORD(matmul_forward_param, &param, src, dst);
+    auto weights_dims = param.weights.get_dims();
+    auto ndims = weights_dims.size();
+    IDEEP_ENFORCE(src.ndims() == ndims &&
+                      src.get_dim(ndims - 1) == weights_dims[ndims - 2] &&
+                      (ndims == 2 || src.get_dim(0) == weights_dims[0]),
+                  "Invalid dims in src");
+    auto plain = ndims == 2 ? tag::ab : tag::abc;
+    auto dtype = param.weights.get_data_type();
+    auto dst_dims = src.get_dims();
+    dst_dims[ndims - 1] = weights_dims[ndims - 1];
+
+    // src and dst are plain: the pd has no layout for runtime dims to match
+    IDEEP_PROFILE_ARG("src");
+    auto expected_src =
+        src.reorder_if_differ_in(tensor::desc(src.get_dims(), dtype, plain));
+    dst.reinit_if_possible(tensor::desc(dst_dims, dtype, plain));
+    IDEEP_PROFILE_FLOPS(2.0 * dst.get_nelems() * src.get_dim(ndims - 1));
+    // per call, since param may be shared by threads
+    auto scratchpad =
+        IDEEP_PROFILE_USAGE(scratchpad, tensor(param.pd.scratchpad_desc()));
+
+    exec_args args {{DNNL_ARG_SRC, expected_src},
+                    {DNNL_ARG_WEIGHTS, param.weights},
+                    {DNNL_ARG_DST, dst},
+                    {DNNL_ARG_SCRATCHPAD, scratchpad}};
+    if (!param.bias.is_empty()) args.insert({DNNL_ARG_BIAS, param.bias});
+    IDEEP_PROFILE_PHASE(execute);
+    param.primitive.execute(stream::default_stream(), args);
+
+    if (!param.prelu_weights.empty()) {
+      prelu_forward::compute(dst, param.prelu_weights, dst.ndims() - 1);
+    }
+  }
+
   static tensor::desc expected_weights_desc(
       const dims& weights_dims,
       data_type dtype = data_type::f32,
@@ -68,8 +160,91 @@ struct matmul_forward : public dnnl::matmul {
     return pd.weights_desc();
   }
 
+  /// The pd and primitive for these descs, created on the first call and
+  /// then served from the computation cache
+  template <bool with_bias>
+  static params fetch_or_create(const tensor::desc& src_desc,
+                                const tensor::desc& weights_desc,
+                                const tensor::desc& bias_desc,
+                                const tensor::desc& dst_desc,
+                                const attr_t& attr,
+                                const engine& aengine = engine::cpu_engine()) {
+    auto key = utils::create_key(src_desc, weights_desc, bias_desc, dst_desc,
+                                 attr);
+    return utils::computation_cache<params>::fetch_or_create(key, [&]() {
+      IDEEP_PROFILE_PHASE(primitive_creation);
+      utils::manifest::instance().add(
+          utils::recorder::matmul_forward_primitive, key, src_desc,
+          weights_desc, bias_desc, dst_desc, attr);
+      attr_t op_attr = attr;
+      op_attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
+      auto pd = with_bias
+          ? primitive_desc({src_desc, weights_desc, bias_desc, dst_desc},
+                           op_attr, aengine)
+          : primitive_desc({src_desc, weights_desc, dst_desc}, op_attr,
+                           aengine);
+      return params {pd, super(pd)};
+    });
+  }
+
 private:
   template <bool with_bias>
+  static void do_prepare(matmul_forward_params& param,
+                         const tensor& weights,
+                         const tensor& bias,
+                         const float dst_coeff,
+                         const float bias_coeff,
+                         const float sum_coeff,
+                         const attr_t& attr,
+                         const engine& aengine) {
+    auto dtype = weights.get_data_type();
+    IDEEP_ENFORCE(utils::one_of(dtype, data_type::f32, data_type::bf16),
+                  "Incorrect data type in weights");
+    auto weights_dims = weights.get_dims();
+    auto ndims = weights_dims.size();
+    auto plain = ndims == 2 ? tag::ab : tag::abc;
+    // {M, K} and {M, N}, after the batch when 3-D
+    auto src_dims = weights_dims, dst_dims = weights_dims;
+    src_dims[ndims - 2] = DNNL_RUNTIME_DIM_VAL;
+    src_dims[ndims - 1] = weights_dims[ndims - 2];
+    dst_dims[ndims - 2] = DNNL_RUNTIME_DIM_VAL;
+    tensor::desc src_desc(src_dims, dtype, plain);
+    tensor::desc dst_desc(dst_dims, dtype, plain);
+    tensor::desc weights_desc(weights_dims, dtype, tag::any);
+    tensor::desc bias_desc;
+    if (with_bias) {
+      IDEEP_ENFORCE(utils::one_of(bias.get_data_type(),
+                                  data_type::f32, data_type::bf16),
+                    "Incorrect data type in bias");
+      bias_desc = {bias.get_dims(), bias.get_data_type(), plain};
+    }
+
+    attr_t op_attr = attr;
+    if (attr.has_op_kind(kind::sum)) {
+      op_attr = attr_t::fuse_sum(sum_coeff);
+    }
+    op_attr.set_output_scales(utils::op_scale_mask(1),
+                              std::vector<float>(1, dst_coeff));
+
+    auto cached = fetch_or_create<with_bias>(
+        src_desc, weights_desc, bias_desc, dst_desc, op_attr, aengine);
+    param.pd = cached.pd;
+    param.primitive = cached.primitive;
+    param.prelu_weights = attr.get_prelu_weights();
+    IDEEP_PROFILE_ARG("weights");
+    param.weights = IDEEP_PROFILE_USAGE(weights,
+        weights.reorder_if_differ_in(cached.pd.weights_desc()));
+    param.bias = tensor();
+    if (with_bias) {
+      // always a copy, scaled like the output: bias may be a view
+      IDEEP_PROFILE_ARG("bias");
+      param.bias.init(cached.pd.bias_desc(), aengine);
+      bias.reorder_to(param.bias, {utils::tensor_scale_mask(1, false),
+                                   scale_t(1, bias_coeff / dst_coeff)});
+    }
+  }
+
+  template <bool with_bias>
  static void compute_impl(const tensor& src,
                           const tensor& weights,
                           const tensor& bias,
@@ -83,6 +258,10 @@ private:
                           const attr_t& attr = attr_t(),
                           const lowp_kind alowp_kind = u8s8,
                           const engine& aengine = engine::cpu_engine()) {
+   IDEEP_PROFILE_OP("matmul_forward", src, weights);
+   IDEEP_RECORD(matmul_forward, src, weights, bias, dst, dst_coeff, bias_coeff,
+                sum_coeff, src_scales, weights_scales, dst_scales, attr,
+                alowp_kind);
    IDEEP_ENFORCE(src.ndims() == weights.ndims(), "Invalid dims in src or weights");
 
    tensor::desc src_desc, weights_desc, bias_desc;
@@ -122,6 +301,9 @@ private:
      // determine dst data type
      if (dst_scales.empty() || dst_scales == IDEEP_DEF_SCALE) {
        dst_data_type = data_type::f32;
+     } else if (attr.has_prelu()) {
+       // u8 would clip the negative side the PReLU slopes scale
+       dst_data_type = data_type::s8;
      } else {
        dst_data_type = data_type::u8;
      }
@@ -257,37 +439,50 @@ private:
    }
    
    tensor::desc dst_desc(dst_dims, dst_data_type, tag::any);
-   auto pd = with_bias
-       ? primitive_desc({src_desc, weights_desc, bias_desc, dst_desc},
-                         op_attr, aengine)
-       : primitive_desc({src_desc, weights_desc, dst_desc},
-                         op_attr, aengine);
+   auto cached = fetch_or_create<with_bias>(
+       src_desc, weights_desc, bias_desc, dst_desc, op_attr, aengine);
+   auto& pd = cached.pd;
+   IDEEP_PROFILE_ARG("src");
    auto expected_src = src.reorder_if_differ_in(pd.src_desc(), src_attr);
-   auto expected_weights = weights.reorder_if_differ_in(pd.weights_desc(), weights_attr);
+   IDEEP_PROFILE_ARG("weights");
+   auto expected_weights = IDEEP_PROFILE_USAGE(weights,
+       weights.reorder_if_differ_in(pd.weights_desc(), weights_attr));
    dst.reinit_if_possible(pd.dst_desc());
    if (!dst_scales.empty() && dst_data_type != data_type::f32) {
      dst.set_scale(dst_scales_in);
    }
+   auto scratchpad =
+       IDEEP_PROFILE_USAGE(scratchpad, tensor(pd.scratchpad_desc()));
+   IDEEP_PROFILE_FLOPS(2.0 * dst.get_nelems() * src.get_dim(src.ndims() - 1));
    if (with_bias){
+     IDEEP_PROFILE_ARG("bias");
      auto expected_bias = bias.reorder_if_differ_in(pd.bias_desc(), bias_attr);
-     super(pd).execute(stream::default_stream(),
-                       {{DNNL_ARG_SRC, expected_src},
-                        {DNNL_ARG_WEIGHTS, expected_weights},
-                        {DNNL_ARG_BIAS, expected_bias},
-                        {DNNL_ARG_DST, dst},
-                        {DNNL_ARG_ATTR_OUTPUT_SCALES, scales_m},
-                        {DNNL_ARG_ATTR_ZERO_POINTS | DNNL_ARG_SRC, src_zero_point_m},
-                        {DNNL_ARG_ATTR_ZERO_POINTS | DNNL_ARG_WEIGHTS, wei_zero_point_m},
-                        {DNNL_ARG_ATTR_ZERO_POINTS | DNNL_ARG_DST, dst_zero_point_m}});
+     IDEEP_PROFILE_PHASE(execute);
+     cached.primitive.execute(stream::default_stream(),
+                              {{DNNL_ARG_SRC, expected_src},
+                               {DNNL_ARG_WEIGHTS, expected_weights},
+                               {DNNL_ARG_BIAS, expected_bias},
+                               {DNNL_ARG_DST, dst},
+                               {DNNL_ARG_SCRATCHPAD, scratchpad},
+                               {DNNL_ARG_ATTR_OUTPUT_SCALES, scales_m},
+                               {DNNL_ARG_ATTR_ZERO_POINTS | DNNL_ARG_SRC, src_zero_point_m},
+                               {DNNL_ARG_ATTR_ZERO_POINTS | DNNL_ARG_WEIGHTS, wei_zero_point_m},
+                               {DNNL_ARG_ATTR_ZERO_POINTS | DNNL_ARG_DST, dst_zero_point_m}});
    } else {
-     super(pd).execute(stream::default_stream(),
-                       {{DNNL_ARG_SRC, expected_src},
-                        {DNNL_ARG_WEIGHTS, expected_weights},
-                        {DNNL_ARG_DST, dst},
-                        {DNNL_ARG_ATTR_OUTPUT_SCALES, scales_m},
-                        {DNNL_ARG_ATTR_ZERO_POINTS | DNNL_ARG_SRC, src_zero_point_m},
-                        {DNNL_ARG_ATTR_ZERO_POINTS | DNNL_ARG_WEIGHTS, wei_zero_point_m},
-                        {DNNL_ARG_ATTR_ZERO_POINTS | DNNL_ARG_DST, dst_zero_point_m}});
+     IDEEP_PROFILE_PHASE(execute);
+     cached.primitive.execute(stream::default_stream(),
+                              {{DNNL_ARG_SRC, expected_src},
+                               {DNNL_ARG_WEIGHTS, expected_weights},
+                               {DNNL_ARG_DST, dst},
+                               {DNNL_ARG_SCRATCHPAD, scratchpad},
+                               {DNNL_ARG_ATTR_OUTPUT_SCALES, scales_m},
+                               {DNNL_ARG_ATTR_ZERO_POINTS | DNNL_ARG_SRC, src_zero_point_m},
+                               {DNNL_ARG_ATTR_ZERO_POINTS | DNNL_ARG_WEIGHTS, wei_zero_point_m},
+                               {DNNL_ARG_ATTR_ZERO_POINTS | DNNL_ARG_DST, dst_zero_point_m}});
+   }
+
+   if (attr.has_prelu()) {
+     prelu_forward::compute(dst, attr.get_prelu_weights(), dst.ndims() - 1);
    }
   }
 };
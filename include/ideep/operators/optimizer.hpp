@@ -0,0 +1,375 @@
+#ifndef IDEEP_OPERATORS_OPTIMIZER_HPP
+#define IDEEP_OPERATORS_OPTIMIZER_HPP
+
+namespace ideep {
+
+namespace detail {
+
+// One parameter tensor of a multi-tensor optimizer step, flattened over its
+// physical buffer. Elementwise updates do not care about the layout as long
+// as weights, grad and states share it, and padding stays zero.
+struct optimizer_slot {
+  float* master;            // f32 weights, updated in place
+  uint16_t* weights_bf16;   // bf16 weights refreshed from master, or null
+  const float* grad;
+  float* state0;
+  float* state1;
+  dim size;
+  bool fresh;               // states were just created zero-filled
+};
+
+// Lines up weights, grads, master copies and optimizer states. Grads are
+// reordered into the master layout when they come in a different format,
+// e.g. straight from pd.diff_weights_desc(); empty states are zero-filled.
+class optimizer_slots {
+ public:
+  optimizer_slots(std::vector<tensor>& weights,
+                  const std::vector<tensor>& grads,
+                  std::vector<tensor>* masters,
+                  std::vector<tensor>* states0,
+                  std::vector<tensor>* states1) {
+    const auto n = weights.size();
+    IDEEP_ENFORCE(grads.size() == n, "One grad per weights tensor expected");
+    if (masters) masters->resize(n);
+    if (states0) states0->resize(n);
+    if (states1) states1->resize(n);
+
+    for (size_t i = 0; i < n; i++) {
+      auto& w = weights[i];
+      const bool bf16 = w.get_data_type() == data_type::bf16;
+      IDEEP_ENFORCE(bf16 || w.get_data_type() == data_type::f32,
+                    "Optimizer supports f32 and bf16 weights only");
+      IDEEP_ENFORCE(!bf16 || masters,
+                    "bf16 weights need an f32 master copy");
+      auto master_desc = w.get_desc().to_type(data_type::f32);
+
+      tensor master = w;
+      if (bf16) {
+        auto& m = (*masters)[i];
+        if (m.is_empty() || m.get_desc() != master_desc) {
+          IDEEP_PROFILE_ARG("master_weights");
+          m = w.reorder_if_differ_in(master_desc);
+        }
+        master = m;
+      }
+
+      IDEEP_PROFILE_ARG("grads");
+      auto grad = grads[i].reorder_if_differ_in(master_desc);
+      keep_alive_.push_back(grad);
+
+      optimizer_slot slot;
+      slot.master = static_cast<float*>(master.get_data_handle());
+      slot.weights_bf16 =
+          bf16 ? static_cast<uint16_t*>(w.get_data_handle()) : nullptr;
+      slot.grad = static_cast<const float*>(grad.get_data_handle());
+      slot.fresh = false;
+      slot.state0 =
+          states0 ? init_state((*states0)[i], master_desc, slot.fresh)
+                  : nullptr;
+      slot.state1 =
+          states1 ? init_state((*states1)[i], master_desc, slot.fresh)
+                  : nullptr;
+      slot.size = master.get_size() / sizeof(float);
+      slots_.push_back(slot);
+      size_ += slot.size;
+    }
+  }
+
+  const std::vector<optimizer_slot>& slots() const { return slots_; }
+
+  /// Elements over all tensors
+  dim size() const { return size_; }
+
+  /// Runs f(slot index, begin, end) over fixed-size chunks of all tensors, so
+  /// many small tensors and a few large ones balance across threads alike.
+  template <typename F>
+  void parallel_for(F f) const {
+    constexpr dim chunk = 16384;
+    std::vector<std::pair<int, dim>> chunks;
+    const auto n = static_cast<int>(slots_.size());
+    for (int i = 0; i < n; i++) {
+      for (dim b = 0; b < slots_[i].size; b += chunk) chunks.push_back({i, b});
+    }
+    const auto nchunks = static_cast<dim>(chunks.size());
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (dim k = 0; k < nchunks; k++) {
+      const auto i = chunks[k].first;
+      const auto b = chunks[k].second;
+      f(i, b, std::min(b + chunk, slots_[i].size));
+    }
+  }
+
+  /// Writes bf16 weights back from the master copy
+  static void store(const optimizer_slot& s, dim b, dim e) {
+    if (!s.weights_bf16) return;
+    for (dim j = b; j < e; j++)
+      s.weights_bf16[j] = utils::float_to_bf16(s.master[j]);
+  }
+
+ private:
+  static float* init_state(tensor& state, const tensor::desc& desc,
+                           bool& fresh) {
+    if (state.is_empty() || state.get_desc() != desc) {
+      state.reinit_if_possible(desc);
+      std::memset(state.get_data_handle(), 0, state.get_size());
+      fresh = true;
+    }
+    return static_cast<float*>(state.get_data_handle());
+  }
+
+  std::vector<optimizer_slot> slots_;
+  std::vector<tensor> keep_alive_;
+  dim size_ = 0;
+};
+
+}  // namespace detail
+
+/// SGD with momentum over a list of parameters, one pass per element:
+///   g = grad + weight_decay * w
+///   buf = momentum * buf + (1 - dampening) * g
+///   w -= lr * (nesterov ? g + momentum * buf : buf)
+/// As in PyTorch, a freshly created buffer starts as buf = g, undampened.
+/// Weights are updated in place in their own layout. For bf16 weights pass
+/// master_weights: the f32 copies are created on first use and updated,
+/// and the bf16 weights are refreshed from them in the same pass.
+struct sgd_update {
+
+  static void compute(std::vector<tensor>& weights,
+                      const std::vector<tensor>& grads,
+                      std::vector<tensor>& momentum_buffers,
+                      float lr,
+                      float momentum,
+                      float weight_decay = 0.f,
+                      float dampening = 0.f,
+                      bool nesterov = false) {
+    IDEEP_PROFILE_OP("sgd_update", weights);
+    // told apart by whether master weights are passed
+    IDEEP_RECORD(sgd_update, false, weights, grads, lr, momentum,
+                 weight_decay, dampening, nesterov);
+    detail::optimizer_slots slots(weights, grads, nullptr, &momentum_buffers,
+                                  nullptr);
+    compute_impl(slots, lr, momentum, weight_decay, dampening, nesterov);
+  }
+
+  static void compute(std::vector<tensor>& weights,
+                      std::vector<tensor>& master_weights,
+                      const std::vector<tensor>& grads,
+                      std::vector<tensor>& momentum_buffers,
+                      float lr,
+                      float momentum,
+                      float weight_decay = 0.f,
+                      float dampening = 0.f,
+                      bool nesterov = false) {
+    IDEEP_PROFILE_OP("sgd_update", weights);
+    IDEEP_RECORD(sgd_update, true, weights, grads, lr, momentum, weight_decay,
+                 dampening, nesterov);
+    detail::optimizer_slots slots(weights, grads, &master_weights,
+                                  &momentum_buffers, nullptr);
+    compute_impl(slots, lr, momentum, weight_decay, dampening, nesterov);
+  }
+
+ private:
+  static void compute_impl(const detail::optimizer_slots& slots, float lr,
+                           float momentum, float weight_decay,
+                           float dampening, bool nesterov) {
+    IDEEP_PROFILE_FLOPS(7.0 * slots.size());
+    IDEEP_PROFILE_PHASE(execute);
+    slots.parallel_for([&](int i, dim b, dim e) {
+      const auto& s = slots.slots()[i];
+      float* w = s.master;
+      float* buf = s.state0;
+      // buf is zero when fresh, so only the dampening needs switching off
+      const float damp = s.fresh ? 1.f : 1.f - dampening;
+      for (dim j = b; j < e; j++) {
+        const float g = s.grad[j] + weight_decay * w[j];
+        buf[j] = momentum * buf[j] + damp * g;
+        w[j] -= lr * (nesterov ? g + momentum * buf[j] : buf[j]);
+      }
+      detail::optimizer_slots::store(s, b, e);
+    });
+  }
+};
+
+/// Adam (or AdamW with decoupled weight decay) over a list of parameters.
+/// step counts from 1 and drives bias correction. exp_avg and exp_avg_sq
+/// are created zero-filled in the weights layout on first use.
+struct adam_update {
+
+  static void compute(std::vector<tensor>& weights,
+                      const std::vector<tensor>& grads,
+                      std::vector<tensor>& exp_avg,
+                      std::vector<tensor>& exp_avg_sq,
+                      int64_t step,
+                      float lr,
+                      float beta1 = 0.9f,
+                      float beta2 = 0.999f,
+                      float epsilon = 1e-8f,
+                      float weight_decay = 0.f,
+                      bool decoupled_weight_decay = false) {
+    IDEEP_PROFILE_OP("adam_update", weights);
+    IDEEP_RECORD(adam_update, false, weights, grads, step, lr, beta1, beta2,
+                 epsilon, weight_decay, decoupled_weight_decay);
+    detail::optimizer_slots slots(weights, grads, nullptr, &exp_avg,
+                                  &exp_avg_sq);
+    compute_impl(slots, step, lr, beta1, beta2, epsilon, weight_decay,
+                 decoupled_weight_decay);
+  }
+
+  static void compute(std::vector<tensor>& weights,
+                      std::vector<tensor>& master_weights,
+                      const std::vector<tensor>& grads,
+                      std::vector<tensor>& exp_avg,
+                      std::vector<tensor>& exp_avg_sq,
+                      int64_t step,
+                      float lr,
+                      float beta1 = 0.9f,
+                      float beta2 = 0.999f,
+                      float epsilon = 1e-8f,
+                      float weight_decay = 0.f,
+                      bool decoupled_weight_decay = false) {
+    IDEEP_PROFILE_OP("adam_update", weights);
+    IDEEP_RECORD(adam_update, true, weights, grads, step, lr, beta1, beta2,
+                 epsilon, weight_decay, decoupled_weight_decay);
+    detail::optimizer_slots slots(weights, grads, &master_weights, &exp_avg,
+                                  &exp_avg_sq);
+    compute_impl(slots, step, lr, beta1, beta2, epsilon, weight_decay,
+                 decoupled_weight_decay);
+  }
+
+ private:
+  static void compute_impl(const detail::optimizer_slots& slots,
+                           int64_t step, float lr, float beta1, float beta2,
+                           float epsilon, float weight_decay,
+                           bool decoupled) {
+    IDEEP_ENFORCE(step >= 1, "Adam step counts from 1");
+    const float bias1 = 1.f - std::pow(beta1, static_cast<float>(step));
+    const float bias2 = 1.f - std::pow(beta2, static_cast<float>(step));
+    const float step_size = lr / bias1;
+    const float rsqrt_bias2 = 1.f / std::sqrt(bias2);
+    const float l2 = decoupled ? 0.f : weight_decay;
+    const float decay = decoupled ? 1.f - lr * weight_decay : 1.f;
+
+    IDEEP_PROFILE_FLOPS(15.0 * slots.size());
+    IDEEP_PROFILE_PHASE(execute);
+    slots.parallel_for([&](int i, dim b, dim e) {
+      const auto& s = slots.slots()[i];
+      float* w = s.master;
+      float* m = s.state0;
+      float* v = s.state1;
+      for (dim j = b; j < e; j++) {
+        const float g = s.grad[j] + l2 * w[j];
+        m[j] = beta1 * m[j] + (1.f - beta1) * g;
+        v[j] = beta2 * v[j] + (1.f - beta2) * g * g;
+        const float denom = std::sqrt(v[j]) * rsqrt_bias2 + epsilon;
+        w[j] = w[j] * decay - step_size * m[j] / denom;
+      }
+      detail::optimizer_slots::store(s, b, e);
+    });
+  }
+};
+
+/// LAMB: Adam moments with a per-tensor trust ratio ||w|| / ||r|| scaling
+/// the update r = m_hat / (sqrt(v_hat) + eps) + weight_decay * w. Two passes:
+/// the first updates the moments and accumulates both norms per tensor, the
+/// second applies the scaled update, recomputing r rather than storing it.
+struct lamb_update {
+
+  static void compute(std::vector<tensor>& weights,
+                      const std::vector<tensor>& grads,
+                      std::vector<tensor>& exp_avg,
+                      std::vector<tensor>& exp_avg_sq,
+                      int64_t step,
+                      float lr,
+                      float beta1 = 0.9f,
+                      float beta2 = 0.999f,
+                      float epsilon = 1e-6f,
+                      float weight_decay = 0.f) {
+    IDEEP_PROFILE_OP("lamb_update", weights);
+    IDEEP_RECORD(lamb_update, false, weights, grads, step, lr, beta1, beta2,
+                 epsilon, weight_decay);
+    detail::optimizer_slots slots(weights, grads, nullptr, &exp_avg,
+                                  &exp_avg_sq);
+    compute_impl(slots, step, lr, beta1, beta2, epsilon, weight_decay);
+  }
+
+  static void compute(std::vector<tensor>& weights,
+                      std::vector<tensor>& master_weights,
+                      const std::vector<tensor>& grads,
+                      std::vector<tensor>& exp_avg,
+                      std::vector<tensor>& exp_avg_sq,
+                      int64_t step,
+                      float lr,
+                      float beta1 = 0.9f,
+                      float beta2 = 0.999f,
+                      float epsilon = 1e-6f,
+                      float weight_decay = 0.f) {
+    IDEEP_PROFILE_OP("lamb_update", weights);
+    IDEEP_RECORD(lamb_update, true, weights, grads, step, lr, beta1, beta2,
+                 epsilon, weight_decay);
+    detail::optimizer_slots slots(weights, grads, &master_weights, &exp_avg,
+                                  &exp_avg_sq);
+    compute_impl(slots, step, lr, beta1, beta2, epsilon, weight_decay);
+  }
+
+ private:
+  static void compute_impl(const detail::optimizer_slots& slots,
+                           int64_t step, float lr, float beta1, float beta2,
+                           float epsilon, float weight_decay) {
+    IDEEP_ENFORCE(step >= 1, "LAMB step counts from 1");
+    const float t = static_cast<float>(step);
+    const float rbias1 = 1.f / (1.f - std::pow(beta1, t));
+    const float rbias2 = 1.f / (1.f - std::pow(beta2, t));
+    const auto n = slots.slots().size();
+    auto update = [&](const detail::optimizer_slot& s, dim j) {
+      return (s.state0[j] * rbias1) /
+             (std::sqrt(s.state1[j] * rbias2) + epsilon) +
+             weight_decay * s.master[j];
+    };
+
+    // the moments and norms, then the update recomputed in the second pass
+    IDEEP_PROFILE_FLOPS(28.0 * slots.size());
+    IDEEP_PROFILE_PHASE(execute);
+
+    // per-tensor squared norms, reduced under a lock once per chunk
+    std::vector<double> w_norm(n, 0.), r_norm(n, 0.);
+    std::mutex mtx;
+    slots.parallel_for([&](int i, dim b, dim e) {
+      const auto& s = slots.slots()[i];
+      float* m = s.state0;
+      float* v = s.state1;
+      double wn = 0., rn = 0.;
+      for (dim j = b; j < e; j++) {
+        const float g = s.grad[j];
+        m[j] = beta1 * m[j] + (1.f - beta1) * g;
+        v[j] = beta2 * v[j] + (1.f - beta2) * g * g;
+        const float r = update(s, j);
+        wn += s.master[j] * s.master[j];
+        rn += r * r;
+      }
+      std::lock_guard<std::mutex> lock(mtx);
+      w_norm[i] += wn;
+      r_norm[i] += rn;
+    });
+
+    std::vector<float> ratio(n);
+    for (size_t i = 0; i < n; i++) {
+      const double wn = std::sqrt(w_norm[i]), rn = std::sqrt(r_norm[i]);
+      ratio[i] = wn > 0. && rn > 0. ? static_cast<float>(wn / rn) : 1.f;
+    }
+
+    slots.parallel_for([&](int i, dim b, dim e) {
+      const auto& s = slots.slots()[i];
+      const float scaled_lr = lr * ratio[i];
+      for (dim j = b; j < e; j++) {
+        s.master[j] -= scaled_lr * update(s, j);
+      }
+      detail::optimizer_slots::store(s, b, e);
+    });
+  }
+};
+
+}  // namespace ideep
+
+#endif
@@ -17,6 +17,9 @@ struct pooling_forward : public dnnl::pooling_forward {
                       algorithm aalgorithm,
                       prop_kind aprop_kind = prop_kind::forward,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("pooling_forward", src);
+    IDEEP_RECORD(pooling_forward, src, output_sizes, dst, strides, kernel,
+                 padding_l, padding_r, aalgorithm, aprop_kind);
     bool with_workspace = aprop_kind == prop_kind::forward_training &&
                           aalgorithm == dnnl::algorithm::pooling_max;
 
@@ -26,10 +29,11 @@ struct pooling_forward : public dnnl::pooling_forward {
 
     tensor::desc dst_desc(output_sizes, src.get_data_type(), tag::any);
 
-    auto pd = primitive_desc(
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, primitive_desc(
         {aprop_kind, aalgorithm, src_desc, dst_desc, strides, kernel, padding_l,
-         padding_r}, aengine);
+         padding_r}, aengine));
 
+    IDEEP_PROFILE_ARG("src");
     auto expected_src = src.reorder_if_differ_in(pd.src_desc());
     dst.reinit_if_possible(pd.dst_desc());
     if (src.has_scale()) {
@@ -42,7 +46,8 @@ struct pooling_forward : public dnnl::pooling_forward {
       args.insert({DNNL_ARG_WORKSPACE, dst.get_workspace()});
     }
 
-    super(pd).execute(stream::default_stream(), args);
+    IDEEP_PROFILE_TIMED(execute,
+                        super(pd).execute(stream::default_stream(), args));
   }
 };
 
@@ -60,29 +65,39 @@ struct pooling_backward : public dnnl::pooling_backward {
                       const dims& padding_r,
                       algorithm aalgorithm,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("pooling_backward", diff_dst, src);
+    IDEEP_RECORD(pooling_backward, diff_dst, dst, src, diff_src, strides,
+                 kernel, padding_l, padding_r, aalgorithm);
     auto src_desc = src.get_desc().to_format_any();
     auto dst_desc = dst.get_desc();
 
-    auto forward_hints =
-        pooling_forward::primitive_desc(
-            {prop_kind::forward, aalgorithm, src_desc, dst_desc, strides,
-             kernel, padding_l, padding_r}, aengine);
-
-    auto pd = primitive_desc(
-        {aalgorithm, src_desc, dst_desc, strides, kernel, padding_l, padding_r},
-        aengine, forward_hints);
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation, [&]() {
+      auto forward_hints = pooling_forward::primitive_desc(
+          {prop_kind::forward, aalgorithm, src_desc, dst_desc, strides,
+           kernel, padding_l, padding_r}, aengine);
+      return primitive_desc(
+          {aalgorithm, src_desc, dst_desc, strides, kernel, padding_l,
+           padding_r}, aengine, forward_hints);
+    }());
 
+    IDEEP_PROFILE_ARG("diff_dst");
     auto expected_diff_dst = diff_dst.reorder_if_differ_in(pd.diff_dst_desc());
     diff_src.reinit_if_possible(pd.diff_src_desc());
 
     exec_args args {{DNNL_ARG_DIFF_DST, expected_diff_dst},
                     {DNNL_ARG_DIFF_SRC, diff_src}};
     if (dst.has_workspace()) {
+      IDEEP_PROFILE_ARG("workspace");
       auto expected_workspace =
           dst.get_workspace().reorder_if_differ_in(pd.workspace_desc());
       args.insert({DNNL_ARG_WORKSPACE, expected_workspace});
     }
 
+    // each diff_dst element is spread over its kernel window
+    IDEEP_PROFILE_FLOPS(1.0 * diff_dst.get_nelems() *
+                        std::accumulate(kernel.begin(), kernel.end(), 1,
+                                        std::multiplies<dim>()));
+    IDEEP_PROFILE_PHASE(execute);
     super(pd).execute(stream::default_stream(), args);
   }
 };
@@ -0,0 +1,260 @@
+#ifndef IDEEP_OPERATORS_PRELU_HPP
+#define IDEEP_OPERATORS_PRELU_HPP
+
+namespace ideep {
+
+/// dst = src > 0 ? src : weights * src
+///
+/// weights is either a single slope, a {C} vector of per-channel slopes for
+/// an {N, C, ...} src, or a tensor of src's rank whose dims equal src's or
+/// are 1 (broadcast). src may be in any blocked layout and dst keeps it.
+struct prelu_forward {
+
+  static void compute(const tensor& src,
+                      const tensor& weights,
+                      tensor& dst,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("prelu_forward", src, weights);
+    IDEEP_RECORD(prelu_forward, src, weights, dst);
+    dst.reinit_if_possible(src.get_desc());
+    zero_padding(dst);
+    if (src.has_scale()) {
+      dst.set_scale(src.get_scale());
+    }
+    IDEEP_PROFILE_ARG("weights");
+    auto expected_weights = to_f32_weights(weights);
+    auto wdims = expected_weights.get_dims();
+    apply(src, static_cast<const float*>(expected_weights.get_data_handle()),
+          wdims, dst);
+  }
+
+  /// Applies per-channel (or single) slopes to dst in place, as done for
+  /// attr_t::fuse_prelu post-ops. The channels lie along axis: 1 for conv
+  /// outputs, the last dim for matmul and inner product outputs.
+  static void compute(tensor& dst, const scale_t& weights, int axis = 1) {
+    IDEEP_PROFILE_OP("prelu_forward", dst);
+    IDEEP_ENFORCE(axis >= 0 && axis < dst.ndims(), "Invalid PReLU axis");
+    dims wdims(dst.ndims(), 1);
+    wdims[axis] = static_cast<dim>(weights.size());
+    apply(dst, weights.data(), wdims, dst);
+  }
+
+  /// Plain f32 weights, in the layout the kernels index them
+  static tensor to_f32_weights(const tensor& weights) {
+    if (weights.get_data_type() == data_type::f32 &&
+        weights.get_desc().is_default()) {
+      return weights;
+    }
+    return weights.to_public();
+  }
+
+  /// Kernels only write logical elements, clear the rest of blocked dims
+  static void zero_padding(tensor& t) {
+    if (t.get_desc().nelems(true) != t.get_nelems()) {
+      std::memset(t.get_data_handle(), 0, t.get_size());
+    }
+  }
+
+  /// Per-dim weight offsets for src dims: 0 along broadcast dims
+  static std::vector<std::vector<dim>> weight_offsets(const dims& src_dims,
+                                                      const dims& wdims) {
+    const int ndims = src_dims.size();
+    dims full(ndims, 1);
+    dim nweights = std::accumulate(wdims.begin(), wdims.end(), 1,
+                                   std::multiplies<dim>());
+    if (nweights == 1) {
+      // scalar slope
+    } else if (wdims.size() == 1 && ndims >= 2 && wdims[0] == src_dims[1]) {
+      full[1] = src_dims[1];
+    } else {
+      IDEEP_ENFORCE(wdims.size() == ndims,
+                    "PReLU weights should be scalar, per-channel or full rank");
+      full = wdims;
+    }
+
+    std::vector<std::vector<dim>> offsets(ndims);
+    dim stride = 1;
+    for (int d = ndims - 1; d >= 0; d--) {
+      IDEEP_ENFORCE(full[d] == src_dims[d] || full[d] == 1,
+                    "PReLU weights are not broadcastable to src");
+      offsets[d].resize(src_dims[d]);
+      for (dim i = 0; i < src_dims[d]; i++)
+        offsets[d][i] = full[d] == 1 ? 0 : i * stride;
+      stride *= full[d];
+    }
+    return offsets;
+  }
+
+ private:
+  static void apply(const tensor& src, const float* w, const dims& wdims,
+                    tensor& dst) {
+    // a compare and a multiply per element
+    IDEEP_PROFILE_FLOPS(2.0 * src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    switch (src.get_data_type()) {
+      case data_type::f32:
+        kernel<float>(src, w, wdims, dst);
+        break;
+      case data_type::bf16:
+        kernel<uint16_t>(src, w, wdims, dst);
+        break;
+      case data_type::s8:
+        kernel<int8_t>(src, w, wdims, dst);
+        break;
+      case data_type::u8:
+        // u8 data is non-negative, PReLU is the identity
+        if (src.get_data_handle() != dst.get_data_handle())
+          std::memcpy(dst.get_data_handle(), src.get_data_handle(),
+                      src.get_size());
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
+  // Rows along the last dim are processed with offset tables, so any
+  // blocked layout is walked without a reorder.
+  template <typename T>
+  static void kernel(const tensor& src, const float* w, const dims& wdims,
+                     tensor& dst) {
+    auto src_dims = src.get_dims();
+    const int ndims = src_dims.size();
+    auto tables = utils::blocked_offset_tables(src.get_desc().data);
+    auto wtables = weight_offsets(src_dims, wdims);
+    const dim row = src_dims[ndims - 1];
+    const dim nrows = src.get_nelems() / std::max<dim>(row, 1);
+    const auto& last = tables[ndims - 1];
+    const auto& wlast = wtables[ndims - 1];
+
+    const auto src_data = static_cast<const T*>(src.get_data_handle()) +
+                          src.get_desc().data.offset0;
+    const auto dst_data = static_cast<T*>(dst.get_data_handle()) +
+                          dst.get_desc().data.offset0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (dim r = 0; r < nrows; r++) {
+      dim off = 0, woff = 0, rem = r;
+      for (int d = ndims - 2; d >= 0; d--) {
+        auto i = rem % src_dims[d];
+        off += tables[d][i];
+        woff += wtables[d][i];
+        rem /= src_dims[d];
+      }
+      for (dim i = 0; i < row; i++) {
+        float x = utils::to_f32(src_data[off + last[i]]);
+        dst_data[off + last[i]] =
+            utils::from_f32<T>(x > 0.f ? x : x * w[woff + wlast[i]]);
+      }
+    }
+  }
+};
+
+struct prelu_backward {
+
+  /// diff_weights has the dims of weights and is reduced over every dim
+  /// weights is broadcast along
+  static void compute(const tensor& src,
+                      const tensor& weights,
+                      const tensor& diff_dst,
+                      tensor& diff_src,
+                      tensor& diff_weights,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("prelu_backward", src, weights);
+    IDEEP_RECORD(prelu_backward, src, weights, diff_dst, diff_src,
+                 diff_weights);
+    IDEEP_ENFORCE(diff_dst.get_desc() == src.get_desc(),
+                  "diff_dst should have the layout of src");
+    diff_src.reinit_if_possible(src.get_desc());
+    prelu_forward::zero_padding(diff_src);
+    IDEEP_PROFILE_ARG("weights");
+    auto expected_weights = prelu_forward::to_f32_weights(weights);
+    diff_weights.reinit_if_possible(expected_weights.get_desc());
+
+    // diff_src and the diff_weights multiply-add
+    IDEEP_PROFILE_FLOPS(4.0 * src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    switch (src.get_data_type()) {
+      case data_type::f32:
+        kernel<float>(src, expected_weights, diff_dst, diff_src, diff_weights);
+        break;
+      case data_type::bf16:
+        kernel<uint16_t>(src, expected_weights, diff_dst, diff_src,
+                         diff_weights);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
+ private:
+  // Every thread accumulates diff_weights privately, then the partials are
+  // summed, so no atomics are needed for the broadcast reduction.
+  template <typename T>
+  static void kernel(const tensor& src, const tensor& weights,
+                     const tensor& diff_dst, tensor& diff_src,
+                     tensor& diff_weights) {
+    auto src_dims = src.get_dims();
+    const int ndims = src_dims.size();
+    auto tables = utils::blocked_offset_tables(src.get_desc().data);
+    auto wtables =
+        prelu_forward::weight_offsets(src_dims, weights.get_dims());
+    const dim row = src_dims[ndims - 1];
+    const dim nrows = src.get_nelems() / std::max<dim>(row, 1);
+    const dim nweights = weights.get_nelems();
+    const auto& last = tables[ndims - 1];
+    const auto& wlast = wtables[ndims - 1];
+
+    const auto offset0 = src.get_desc().data.offset0;
+    const auto src_data =
+        static_cast<const T*>(src.get_data_handle()) + offset0;
+    const auto diff_dst_data =
+        static_cast<const T*>(diff_dst.get_data_handle()) + offset0;
+    const auto diff_src_data =
+        static_cast<T*>(diff_src.get_data_handle()) + offset0;
+    const auto w = static_cast<const float*>(weights.get_data_handle());
+    const auto diff_w = static_cast<float*>(diff_weights.get_data_handle());
+
+    const int nthr = omp_get_max_threads();
+    std::vector<float> partial(nthr * nweights, 0.f);
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthr)
+#endif
+    {
+      float* my_diff_w = &partial[omp_get_thread_num() * nweights];
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+      for (dim r = 0; r < nrows; r++) {
+        dim off = 0, woff = 0, rem = r;
+        for (int d = ndims - 2; d >= 0; d--) {
+          auto i = rem % src_dims[d];
+          off += tables[d][i];
+          woff += wtables[d][i];
+          rem /= src_dims[d];
+        }
+        for (dim i = 0; i < row; i++) {
+          const dim o = off + last[i];
+          const dim wo = woff + wlast[i];
+          const float x = utils::to_f32(src_data[o]);
+          const float dy = utils::to_f32(diff_dst_data[o]);
+          diff_src_data[o] = utils::from_f32<T>(x > 0.f ? dy : dy * w[wo]);
+          if (x <= 0.f) my_diff_w[wo] += dy * x;
+        }
+      }
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (dim i = 0; i < nweights; i++) {
+      float acc = 0.f;
+      for (int t = 0; t < nthr; t++) acc += partial[t * nweights + i];
+      diff_w[i] = acc;
+    }
+  }
+};
+
+}  // namespace ideep
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef IDEEP_OPERATORS_REDUCTION_HPP
+#define IDEEP_OPERATORS_REDUCTION_HPP
+
+namespace ideep {
+
+/// Reduces src over an arbitrary set of axes (negative axes count from the
+/// back) with sum, mean, max, min, L1 or L2 norm.
+///
+/// src is read in place whatever its layout, blocked formats included, so no
+/// reorder is needed. dst is plain, holding the kept dims in order, with the
+/// reduced dims kept as 1 if keep_dims is set. Accumulation is in f32. bf16
+/// src gives bf16 dst. Other types give f32 dst, and int8 src with a
+/// per-tensor scale is dequantized.
+struct reduction {
+
+  static void compute(const tensor& src,
+                      tensor& dst,
+                      const std::vector<int>& axes,
+                      reduction_kind akind,
+                      bool keep_dims = false) {
+    IDEEP_PROFILE_OP("reduction", src);
+    IDEEP_RECORD(reduction, src, dst, dims(axes.begin(), axes.end()), akind,
+                 keep_dims);
+    // one add or compare per element, L2 adds a multiply
+    IDEEP_PROFILE_FLOPS((akind == REDUCE_NORM_L2 ? 2.0 : 1.0) *
+                        src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    switch (src.get_data_type()) {
+      case data_type::f32:
+        compute_impl<float>(src, dst, axes, akind, keep_dims);
+        break;
+      case data_type::bf16:
+        compute_impl<uint16_t>(src, dst, axes, akind, keep_dims);
+        break;
+      case data_type::s32:
+        compute_impl<int32_t>(src, dst, axes, akind, keep_dims);
+        break;
+      case data_type::s8:
+        compute_impl<int8_t>(src, dst, axes, akind, keep_dims);
+        break;
+      case data_type::u8:
+        compute_impl<uint8_t>(src, dst, axes, akind, keep_dims);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
+ private:
+  static float init_value(reduction_kind akind) {
+    switch (akind) {
+      case REDUCE_MAX:
+        return -std::numeric_limits<float>::infinity();
+      case REDUCE_MIN:
+        return std::numeric_limits<float>::infinity();
+      default:
+        return 0.f;
+    }
+  }
+
+  static float combine(reduction_kind akind, float a, float b) {
+    switch (akind) {
+      case REDUCE_MAX:
+        return std::max(a, b);
+      case REDUCE_MIN:
+        return std::min(a, b);
+      default:
+        return a + b;
+    }
+  }
+
+  // Folds n elements at p[table[i]] into acc. table is skipped when the row
+  // is unit-stride so the loop vectorizes.
+  template <typename T, typename F>
+  static float fold(const T* p, const dim* table, dim n, bool contiguous,
+                    float acc, F f) {
+    if (contiguous) {
+      for (dim i = 0; i < n; i++) acc = f(acc, utils::to_f32(p[i]));
+    } else {
+      for (dim i = 0; i < n; i++) acc = f(acc, utils::to_f32(p[table[i]]));
+    }
+    return acc;
+  }
+
+  template <typename T>
+  static float reduce_row(reduction_kind akind, const T* p, const dim* table,
+                          dim n, bool contiguous, float acc) {
+    switch (akind) {
+      case REDUCE_MAX:
+        return fold(p, table, n, contiguous, acc,
+                    [](float a, float x) { return std::max(a, x); });
+      case REDUCE_MIN:
+        return fold(p, table, n, contiguous, acc,
+                    [](float a, float x) { return std::min(a, x); });
+      case REDUCE_NORM_L1:
+        return fold(p, table, n, contiguous, acc,
+                    [](float a, float x) { return a + std::abs(x); });
+      case REDUCE_NORM_L2:
+        return fold(p, table, n, contiguous, acc,
+                    [](float a, float x) { return a + x * x; });
+      default:
+        return fold(p, table, n, contiguous, acc,
+                    [](float a, float x) { return a + x; });
+    }
+  }
+
+  template <typename T>
+  static void compute_impl(const tensor& src,
+                           tensor& dst,
+                           const std::vector<int>& axes,
+                           reduction_kind akind,
+                           bool keep_dims) {
+    auto src_desc = src.get_desc();
+    IDEEP_ENFORCE(src_desc.data.format_kind == dnnl_blocked,
+                  "reduction supports blocked memory only");
+    auto src_dims = src.get_dims();
+    int ndims = src_dims.size();
+
+    std::vector<bool> is_reduced(ndims, false);
+    for (auto a : axes) {
+      auto axis = a < 0 ? a + ndims : a;
+      IDEEP_ENFORCE(axis >= 0 && axis < ndims, "reduction axis out of range");
+      is_reduced[axis] = true;
+    }
+
+    dims dst_dims;
+    std::vector<int> kept, reduced;
+    dim nout = 1, nreduced = 1;
+    for (int d = 0; d < ndims; d++) {
+      if (is_reduced[d]) {
+        reduced.push_back(d);
+        nreduced *= src_dims[d];
+        if (keep_dims) dst_dims.push_back(1);
+      } else {
+        kept.push_back(d);
+        nout *= src_dims[d];
+        dst_dims.push_back(src_dims[d]);
+      }
+    }
+    if (dst_dims.empty()) dst_dims.push_back(1);
+
+    auto dst_type = std::is_same<T, uint16_t>::value ? data_type::bf16
+                                                      : data_type::f32;
+    dst.reinit_if_possible({dst_dims, dst_type});
+
+    float dequantize = 1.f;
+    if (!std::is_same<T, float>::value && !std::is_same<T, uint16_t>::value &&
+        src.has_scale()) {
+      IDEEP_ENFORCE(src.get_scale().size() == 1,
+                    "reduction supports per-tensor scales only");
+      dequantize = 1.f / src.get_scale()[0];
+    }
+
+    // The innermost reduced dim is folded in a tight loop, the remaining
+    // reduced dims are walked row by row.
+    auto tables = utils::blocked_offset_tables(src_desc.data);
+    std::vector<dim> unit_table {0};
+    const auto& row_table =
+        reduced.empty() ? unit_table : tables[reduced.back()];
+    const dim row = row_table.size();
+    const dim nrows = row > 0 ? nreduced / row : 0;
+    bool contiguous = true;
+    for (dim i = 0; i < row; i++) contiguous &= row_table[i] == i;
+
+    // Split rows across threads too when there are fewer outputs than
+    // threads, e.g. for a global reduction.
+    const dim nthr = omp_get_max_threads();
+    const dim nchunks = nout >= nthr
+        ? 1 : std::max<dim>(1, std::min<dim>((nthr + nout - 1) / nout, nrows));
+    std::vector<float> partial(nout * nchunks);
+
+    const auto src_data =
+        static_cast<const T*>(src.get_data_handle()) + src_desc.data.offset0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (dim task = 0; task < nout * nchunks; task++) {
+      const dim o = task / nchunks;
+      const dim c = task % nchunks;
+      dim base = 0, rem = o;
+      for (int k = kept.size() - 1; k >= 0; k--) {
+        auto d = kept[k];
+        base += tables[d][rem % src_dims[d]];
+        rem /= src_dims[d];
+      }
+
+      float acc = init_value(akind);
+      const dim begin = nrows * c / nchunks;
+      const dim end = nrows * (c + 1) / nchunks;
+      for (dim r = begin; r < end; r++) {
+        dim off = base;
+        rem = r;
+        for (int k = static_cast<int>(reduced.size()) - 2; k >= 0; k--) {
+          auto d = reduced[k];
+          off += tables[d][rem % src_dims[d]];
+          rem /= src_dims[d];
+        }
+        acc = reduce_row(akind, src_data + off, row_table.data(), row,
+                         contiguous, acc);
+      }
+      partial[task] = acc;
+    }
+
+    const auto dst_data = dst.get_data_handle();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (dim o = 0; o < nout; o++) {
+      float acc = partial[o * nchunks];
+      for (dim c = 1; c < nchunks; c++) {
+        acc = combine(akind, acc, partial[o * nchunks + c]);
+      }
+      if (akind == REDUCE_MEAN) acc /= nreduced;
+      if (akind == REDUCE_NORM_L2) acc = std::sqrt(acc);
+      acc *= dequantize;
+      if (dst_type == data_type::bf16) {
+        static_cast<uint16_t*>(dst_data)[o] = utils::float_to_bf16(acc);
+      } else {
+        static_cast<float*>(dst_data)[o] = acc;
+      }
+    }
+  }
+};
+
+}  // namespace ideep
+
+#endif
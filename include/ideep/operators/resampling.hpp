@@ -0,0 +1,291 @@
+#ifndef IDEEP_OPERATORS_RESAMPLING_HPP
+#define IDEEP_OPERATORS_RESAMPLING_HPP
+
+namespace ideep {
+
+/// Nearest and linear resampling over 1, 2 or 3 spatial dims of an
+/// {N, C, [D,] [H,] W} tensor.
+///
+/// Source coordinates follow the half-pixel convention:
+///   x_src = (x_dst + 0.5) / factor - 0.5
+/// with factor = out / in unless given to compute_with_factors. Linear mode
+/// interpolates between the two neighbours along each dim, and nearest mode
+/// picks floor(x_src + 0.5). Either mode clamps at the borders.
+///
+/// Kernels address memory through the blocking desc, so dst keeps src's
+/// layout (e.g. nChw16c in, nChw16c out) and no reorder is involved.
+struct resampling_forward {
+
+  /// output_sizes are the full dst dims, as in pooling_forward
+  static void compute(const tensor& src,
+                      const dims& output_sizes,
+                      tensor& dst,
+                      resampling_kind akind) {
+    IDEEP_PROFILE_OP("resampling_forward", src);
+    compute_impl(src, output_sizes, {}, dst, akind);
+  }
+
+  /// One factor per spatial dim, dst spatial size is floor(in * factor).
+  /// Named apart from compute so that a braced list such as {2, 2} is not
+  /// ambiguous between dims and factors.
+  static void compute_with_factors(const tensor& src,
+                                   const scale_t& factors,
+                                   tensor& dst,
+                                   resampling_kind akind) {
+    IDEEP_PROFILE_OP("resampling_forward", src);
+    auto src_dims = src.get_dims();
+    IDEEP_ENFORCE(factors.size() == src_dims.size() - 2,
+                  "One factor per spatial dim is expected");
+    auto output_sizes = src_dims;
+    for (size_t i = 0; i < factors.size(); i++) {
+      output_sizes[i + 2] = static_cast<dim>(src_dims[i + 2] * factors[i]);
+    }
+    compute_impl(src, output_sizes, factors, dst, akind);
+  }
+
+  /// Linear mode blends 2^spatial neighbours per output element, nearest
+  /// mode is a pure gather
+  static double flops(const tensor& dst, resampling_kind akind) {
+    if (akind != RESAMPLE_LINEAR) return 0.;
+    return 2.0 * (1 << (dst.ndims() - 2)) * dst.get_nelems();
+  }
+
+ private:
+  static void compute_impl(const tensor& src,
+                           const dims& output_sizes,
+                           const scale_t& factors,
+                           tensor& dst,
+                           resampling_kind akind) {
+    IDEEP_RECORD(resampling_forward, src, output_sizes, factors, dst, akind);
+    auto src_desc = src.get_desc();
+    dst.reinit_if_possible(src_desc.to_dims(output_sizes));
+    // kernels never touch the padding of blocked dims
+    if (dst.get_desc().nelems(true) != dst.get_nelems()) {
+      std::memset(dst.get_data_handle(), 0, dst.get_size());
+    }
+    if (src.has_scale()) {
+      dst.set_scale(src.get_scale());
+    }
+
+    IDEEP_PROFILE_FLOPS(flops(dst, akind));
+    IDEEP_PROFILE_PHASE(execute);
+    switch (src.get_data_type()) {
+      case data_type::f32:
+        kernel<float>(src, dst, factors, akind);
+        break;
+      case data_type::bf16:
+        kernel<uint16_t>(src, dst, factors, akind);
+        break;
+      case data_type::s8:
+        kernel<int8_t>(src, dst, factors, akind);
+        break;
+      case data_type::u8:
+        kernel<uint8_t>(src, dst, factors, akind);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
+  template <typename T>
+  static void kernel(const tensor& src,
+                     tensor& dst,
+                     const scale_t& factors,
+                     resampling_kind akind) {
+    auto plan = resampling_plan(src, dst, factors, akind);
+    const auto src_data = static_cast<const T*>(src.get_data_handle()) +
+                          src.get_desc().data.offset0;
+    const auto dst_data = static_cast<T*>(dst.get_data_handle());
+    const auto& odims = plan.dst_dims;
+    const auto& s = plan.src_tables;
+    const auto& d = plan.dst_tables;
+
+#ifdef _OPENMP
+#pragma omp parallel for collapse(4) schedule(static)
+#endif
+    for (dim n = 0; n < odims[0]; n++)
+    for (dim c = 0; c < odims[1]; c++)
+    for (dim od = 0; od < odims[2]; od++)
+    for (dim oh = 0; oh < odims[3]; oh++) {
+      const auto& td = plan.taps[0][od];
+      const auto& th = plan.taps[1][oh];
+      const dim src_nc = s[0][n] + s[1][c];
+      const dim dst_row = d[0][n] + d[1][c] + d[2][od] + d[3][oh];
+      for (dim ow = 0; ow < odims[4]; ow++) {
+        const auto& tw = plan.taps[2][ow];
+        float acc = 0.f;
+        for (int a = 0; a < td.n; a++)
+        for (int b = 0; b < th.n; b++)
+        for (int e = 0; e < tw.n; e++) {
+          auto off = src_nc + s[2][td.idx[a]] + s[3][th.idx[b]] +
+                     s[4][tw.idx[e]];
+          acc += td.w[a] * th.w[b] * tw.w[e] * utils::to_f32(src_data[off]);
+        }
+        dst_data[dst_row + d[4][ow]] = utils::from_f32<T>(acc);
+      }
+    }
+  }
+
+ public:
+  // Interpolation taps of one dst coordinate along one dim
+  struct tap {
+    int n;
+    dim idx[2];
+    float w[2];
+  };
+
+  // Tensors are viewed as {N, C, D, H, W}: missing spatial dims have extent
+  // one, a single tap and zero offsets.
+  struct plan_t {
+    dims dst_dims;
+    std::vector<std::vector<dim>> src_tables;
+    std::vector<std::vector<dim>> dst_tables;
+    std::vector<std::vector<tap>> taps;
+  };
+
+  static plan_t resampling_plan(const tensor& src,
+                                const tensor& dst,
+                                const scale_t& factors,
+                                resampling_kind akind) {
+    auto src_dims = src.get_dims();
+    auto dst_dims = dst.get_dims();
+    int ndims = src_dims.size();
+    IDEEP_ENFORCE(ndims >= 3 && ndims <= 5,
+                  "resampling expects 1 to 3 spatial dims");
+    IDEEP_ENFORCE(src.get_desc().data.format_kind == dnnl_blocked,
+                  "resampling supports blocked memory only");
+
+    auto src_tables = utils::blocked_offset_tables(src.get_desc().data);
+    auto dst_tables = utils::blocked_offset_tables(dst.get_desc().data);
+
+    plan_t plan;
+    plan.dst_dims = {dst_dims[0], dst_dims[1], 1, 1, 1};
+    plan.src_tables = {src_tables[0], src_tables[1], {0}, {0}, {0}};
+    plan.dst_tables = {dst_tables[0], dst_tables[1], {0}, {0}, {0}};
+    plan.taps.assign(3, std::vector<tap>(1, tap {1, {0, 0}, {1.f, 0.f}}));
+
+    const int spatial = ndims - 2;
+    for (int i = 0; i < spatial; i++) {
+      const int slot = 3 - spatial + i;
+      const dim in = src_dims[i + 2], out = dst_dims[i + 2];
+      const float factor = factors.empty()
+          ? static_cast<float>(out) / in : factors[i];
+      plan.dst_dims[slot + 2] = out;
+      plan.src_tables[slot + 2] = src_tables[i + 2];
+      plan.dst_tables[slot + 2] = dst_tables[i + 2];
+      auto& taps = plan.taps[slot];
+      taps.resize(out);
+      for (dim o = 0; o < out; o++) {
+        float x = (o + 0.5f) / factor - 0.5f;
+        if (akind == RESAMPLE_NEAREST) {
+          auto i0 = static_cast<dim>(std::floor(x + 0.5f));
+          i0 = std::min(std::max<dim>(i0, 0), in - 1);
+          taps[o] = {1, {i0, i0}, {1.f, 0.f}};
+        } else {
+          x = std::min(std::max(x, 0.f), static_cast<float>(in - 1));
+          auto i0 = static_cast<dim>(std::floor(x));
+          auto i1 = std::min(i0 + 1, in - 1);
+          float w1 = x - i0;
+          taps[o] = i1 == i0 ? tap {1, {i0, i0}, {1.f, 0.f}}
+                             : tap {2, {i0, i1}, {1.f - w1, w1}};
+        }
+      }
+    }
+    return plan;
+  }
+};
+
+struct resampling_backward {
+
+  /// diff_src takes diff_dst's layout with src_sizes as dims
+  static void compute(const tensor& diff_dst,
+                      const dims& src_sizes,
+                      tensor& diff_src,
+                      resampling_kind akind,
+                      const scale_t& factors = scale_t()) {
+    IDEEP_PROFILE_OP("resampling_backward", diff_dst);
+    IDEEP_RECORD(resampling_backward, diff_dst, src_sizes, diff_src, akind,
+                 factors);
+    diff_src.reinit_if_possible(diff_dst.get_desc().to_dims(src_sizes));
+    if (diff_src.get_desc().nelems(true) != diff_src.get_nelems()) {
+      std::memset(diff_src.get_data_handle(), 0, diff_src.get_size());
+    }
+    IDEEP_PROFILE_FLOPS(resampling_forward::flops(diff_dst, akind));
+    IDEEP_PROFILE_PHASE(execute);
+    switch (diff_dst.get_data_type()) {
+      case data_type::f32:
+        kernel<float>(diff_dst, diff_src, factors, akind);
+        break;
+      case data_type::bf16:
+        kernel<uint16_t>(diff_dst, diff_src, factors, akind);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
+ private:
+  // Every (n, c) plane is owned by one thread, which scatters its gradients
+  // into an f32 plane buffer and writes the plane out once.
+  template <typename T>
+  static void kernel(const tensor& diff_dst,
+                     tensor& diff_src,
+                     const scale_t& factors,
+                     resampling_kind akind) {
+    auto plan = resampling_forward::resampling_plan(
+        diff_src, diff_dst, factors, akind);
+    auto in_dims = diff_src.get_dims();
+    dims idims {in_dims[0], in_dims[1], 1, 1, 1};
+    std::copy(in_dims.begin() + 2, in_dims.end(),
+              idims.end() - (in_dims.size() - 2));
+    const dim plane = idims[2] * idims[3] * idims[4];
+
+    const auto diff_dst_data = static_cast<const T*>(
+        diff_dst.get_data_handle()) + diff_dst.get_desc().data.offset0;
+    const auto diff_src_data = static_cast<T*>(diff_src.get_data_handle());
+    const auto& odims = plan.dst_dims;
+    const auto& s = plan.src_tables;
+    const auto& d = plan.dst_tables;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      std::vector<float> acc(plane);
+#ifdef _OPENMP
+#pragma omp for collapse(2) schedule(static)
+#endif
+      for (dim n = 0; n < odims[0]; n++)
+      for (dim c = 0; c < odims[1]; c++) {
+        std::fill(acc.begin(), acc.end(), 0.f);
+        for (dim od = 0; od < odims[2]; od++)
+        for (dim oh = 0; oh < odims[3]; oh++)
+        for (dim ow = 0; ow < odims[4]; ow++) {
+          const auto& td = plan.taps[0][od];
+          const auto& th = plan.taps[1][oh];
+          const auto& tw = plan.taps[2][ow];
+          const float g = utils::to_f32(diff_dst_data[
+              d[0][n] + d[1][c] + d[2][od] + d[3][oh] + d[4][ow]]);
+          for (int a = 0; a < td.n; a++)
+          for (int b = 0; b < th.n; b++)
+          for (int e = 0; e < tw.n; e++) {
+            auto i = (td.idx[a] * idims[3] + th.idx[b]) * idims[4] + tw.idx[e];
+            acc[i] += td.w[a] * th.w[b] * tw.w[e] * g;
+          }
+        }
+        const dim src_nc = s[0][n] + s[1][c];
+        for (dim id = 0; id < idims[2]; id++)
+        for (dim ih = 0; ih < idims[3]; ih++)
+        for (dim iw = 0; iw < idims[4]; iw++) {
+          diff_src_data[src_nc + s[2][id] + s[3][ih] + s[4][iw]] =
+              utils::from_f32<T>(
+                  acc[(id * idims[3] + ih) * idims[4] + iw]);
+        }
+      }
+    }
+  }
+};
+
+}  // namespace ideep
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef IDEEP_OPERATORS_RNN_BACKWARD_BASE_HPP
+#define IDEEP_OPERATORS_RNN_BACKWARD_BASE_HPP
+
+namespace ideep {
+
+// Shared backward pass of lstm, gru, lbr_gru and the vanilla rnn. The cells
+// only differ in how the pd is created, lstm having the extra cell state
+// (*_iter_c) descs, so each op builds its own pd and do_compute binds the
+// arguments and runs it.
+//
+// Optional arguments are empty tensors: bias, src_iter and dst_iter for
+// every cell, and the *_iter_c cell states which are always empty except
+// for lstm. Their gradients are only written when they are present.
+template <class dnnl_backward>
+struct rnn_backward_base : public dnnl_backward {
+
+  using super = dnnl_backward;
+  using primitive_desc = typename super::primitive_desc;
+
+  struct params {
+    primitive_desc pd;
+    super primitive;
+  };
+
+ protected:
+  // The pd from create_pd() and its primitive are cached under key. The pd
+  // must use a user scratchpad: cached primitives are shared across threads.
+  template <typename F>
+  static void do_compute(const key_t& key,
+                         F create_pd,
+                         const tensor& src_layer,
+                         const tensor& src_iter,
+                         const tensor& src_iter_c,
+                         const tensor& weights_layer,
+                         const tensor& weights_iter,
+                         const tensor& bias,
+                         const tensor& dst_layer,
+                         const tensor& dst_iter,
+                         const tensor& dst_iter_c,
+                         const tensor& diff_dst_layer,
+                         const tensor& diff_dst_iter,
+                         const tensor& diff_dst_iter_c,
+                         const tensor& workspace,
+                         tensor& diff_src_layer,
+                         tensor& diff_src_iter,
+                         tensor& diff_src_iter_c,
+                         tensor& diff_weights_layer,
+                         tensor& diff_weights_iter,
+                         tensor& diff_bias) {
+    auto param = utils::computation_cache<params>::fetch_or_create(key, [&]() {
+      IDEEP_PROFILE_PHASE(primitive_creation);
+      primitive_desc pd = create_pd();
+      return params {pd, super(pd)};
+    });
+    auto& pd = param.pd;
+    // by argument, since only lstm pds have the cell state queries
+    auto md = [&](int arg) { return pd.query_md(query::exec_arg_md, arg); };
+
+    IDEEP_PROFILE_ARG("src_layer");
+    auto expected_src_layer =
+        src_layer.reorder_if_differ_in(md(DNNL_ARG_SRC_LAYER));
+    IDEEP_PROFILE_ARG("weights_layer");
+    auto expected_weights_layer =
+        weights_layer.reorder_if_differ_in(md(DNNL_ARG_WEIGHTS_LAYER));
+    IDEEP_PROFILE_ARG("weights_iter");
+    auto expected_weights_iter =
+        weights_iter.reorder_if_differ_in(md(DNNL_ARG_WEIGHTS_ITER));
+    IDEEP_PROFILE_ARG("dst_layer");
+    auto expected_dst_layer =
+        dst_layer.reorder_if_differ_in(md(DNNL_ARG_DST_LAYER));
+    IDEEP_PROFILE_ARG("diff_dst_layer");
+    auto expected_diff_dst_layer =
+        diff_dst_layer.reorder_if_differ_in(md(DNNL_ARG_DIFF_DST_LAYER));
+    IDEEP_PROFILE_ARG("workspace");
+    auto expected_workspace =
+        workspace.reorder_if_differ_in(md(DNNL_ARG_WORKSPACE));
+    diff_src_layer.reinit_if_possible(md(DNNL_ARG_DIFF_SRC_LAYER));
+    diff_weights_layer.reinit_if_possible(md(DNNL_ARG_DIFF_WEIGHTS_LAYER));
+    diff_weights_iter.reinit_if_possible(md(DNNL_ARG_DIFF_WEIGHTS_ITER));
+    auto scratchpad =
+        IDEEP_PROFILE_USAGE(scratchpad, tensor(pd.scratchpad_desc()));
+
+    // DNNL accumulates weights gradients into the destination buffers
+    std::memset(diff_weights_layer.get_data_handle(), 0,
+                diff_weights_layer.get_size());
+    std::memset(diff_weights_iter.get_data_handle(), 0,
+                diff_weights_iter.get_size());
+
+    exec_args args {{DNNL_ARG_SRC_LAYER, expected_src_layer},
+                    {DNNL_ARG_WEIGHTS_LAYER, expected_weights_layer},
+                    {DNNL_ARG_WEIGHTS_ITER, expected_weights_iter},
+                    {DNNL_ARG_DST_LAYER, expected_dst_layer},
+                    {DNNL_ARG_DIFF_DST_LAYER, expected_diff_dst_layer},
+                    {DNNL_ARG_WORKSPACE, expected_workspace},
+                    {DNNL_ARG_DIFF_SRC_LAYER, diff_src_layer},
+                    {DNNL_ARG_DIFF_WEIGHTS_LAYER, diff_weights_layer},
+                    {DNNL_ARG_DIFF_WEIGHTS_ITER, diff_weights_iter},
+                    {DNNL_ARG_SCRATCHPAD, scratchpad}};
+
+    if (!bias.is_empty()) {
+      diff_bias.reinit_if_possible(md(DNNL_ARG_DIFF_BIAS));
+      std::memset(diff_bias.get_data_handle(), 0, diff_bias.get_size());
+      IDEEP_PROFILE_ARG("bias");
+      args.insert({DNNL_ARG_BIAS,
+                   bias.reorder_if_differ_in(md(DNNL_ARG_BIAS))});
+      args.insert({DNNL_ARG_DIFF_BIAS, diff_bias});
+    }
+    if (!src_iter.is_empty()) {
+      diff_src_iter.reinit_if_possible(md(DNNL_ARG_DIFF_SRC_ITER));
+      IDEEP_PROFILE_ARG("src_iter");
+      args.insert({DNNL_ARG_SRC_ITER,
+                   src_iter.reorder_if_differ_in(md(DNNL_ARG_SRC_ITER))});
+      args.insert({DNNL_ARG_DIFF_SRC_ITER, diff_src_iter});
+    }
+    if (!src_iter_c.is_empty()) {
+      diff_src_iter_c.reinit_if_possible(md(DNNL_ARG_DIFF_SRC_ITER_C));
+      IDEEP_PROFILE_ARG("src_iter_c");
+      args.insert({DNNL_ARG_SRC_ITER_C,
+                   src_iter_c.reorder_if_differ_in(md(DNNL_ARG_SRC_ITER_C))});
+      args.insert({DNNL_ARG_DIFF_SRC_ITER_C, diff_src_iter_c});
+    }
+    if (!dst_iter.is_empty()) {
+      IDEEP_PROFILE_ARG("dst_iter");
+      args.insert({DNNL_ARG_DST_ITER,
+                   dst_iter.reorder_if_differ_in(md(DNNL_ARG_DST_ITER))});
+      IDEEP_PROFILE_ARG("diff_dst_iter");
+      args.insert({DNNL_ARG_DIFF_DST_ITER,
+                   diff_dst_iter.reorder_if_differ_in(
+                       md(DNNL_ARG_DIFF_DST_ITER))});
+    }
+    if (!dst_iter_c.is_empty()) {
+      IDEEP_PROFILE_ARG("dst_iter_c");
+      args.insert({DNNL_ARG_DST_ITER_C,
+                   dst_iter_c.reorder_if_differ_in(md(DNNL_ARG_DST_ITER_C))});
+      IDEEP_PROFILE_ARG("diff_dst_iter_c");
+      args.insert({DNNL_ARG_DIFF_DST_ITER_C,
+                   diff_dst_iter_c.reorder_if_differ_in(
+                       md(DNNL_ARG_DIFF_DST_ITER_C))});
+    }
+
+    // the data and the weights gradients, each costing about a forward pass
+    IDEEP_PROFILE_FLOPS(4.0 * src_layer.get_dim(0) * src_layer.get_dim(1) *
+                        (weights_layer.get_nelems() +
+                         weights_iter.get_nelems()));
+    IDEEP_PROFILE_PHASE(execute);
+    param.primitive.execute(stream::default_stream(), args);
+  }
+};
+
+}  // namespace ideep
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef IDEEP_OPERATORS_RNN_BUCKETING_HPP
+#define IDEEP_OPERATORS_RNN_BUCKETING_HPP
+
+namespace ideep {
+
+struct rnn_bucket {
+  // timesteps computed for every sample of the bucket
+  dim length;
+  // batch indices of the samples in the caller's layout
+  std::vector<dim> samples;
+};
+
+/// Bucketed execution of RNN operators over a padded variable-length batch.
+///
+/// Samples are grouped by length rounded up to `bucket_width`, each bucket is
+/// gathered into a dense {length, samples, C} tnc tensor and run through the
+/// RNN, and its outputs are scattered back into the caller's padded layout.
+/// Timesteps beyond a sample's own length are left as zeros. Since the rnn
+/// operators cache their primitives per shape, a bucket seen before reuses a
+/// prepared primitive.
+///
+/// With bucket_width == 1 every bucket holds samples of identical length, so
+/// outputs, final states and the right-to-left direction are all exact. With
+/// a wider bucket some padded timesteps are still computed. In that case only
+/// left-to-right dst_layer outputs are exact. Final states and right-to-left
+/// outputs then see the padding.
+///
+/// Example, LSTM inference over a padded {T, N, C} batch:
+///   rnn_bucketing::compute(src_layer, lengths, dst_layer_dims, dst_layer,
+///       [&](const tensor& src, const rnn_bucket& b, tensor& dst) {
+///     auto dst_dims = dst_layer_dims;
+///     dst_dims[0] = b.length;
+///     dst_dims[1] = b.samples.size();
+///     lstm_forward::compute(src, {}, {}, weights_layer, weights_iter, bias,
+///                           dst_dims, dst, {}, dst_iter, dst_iter_c,
+///                           workspace, dnnl_unidirectional_left2right,
+///                           prop_kind::forward_inference);
+///   });
+struct rnn_bucketing {
+
+  template <typename F>
+  static void compute(const tensor& src_layer,
+                      const std::vector<dim>& lengths,
+                      const dims& dst_layer_dims,
+                      tensor& dst_layer,
+                      F&& fn,
+                      dim bucket_width = 1) {
+    IDEEP_ENFORCE(src_layer.get_dim(1) == static_cast<dim>(lengths.size()),
+                  "lengths should have one entry per sample");
+    dst_layer.reinit_if_possible(
+        {dst_layer_dims, src_layer.get_data_type(), tag::tnc});
+    std::memset(dst_layer.get_data_handle(), 0, dst_layer.get_size());
+
+    for (auto& b : make_buckets(lengths, bucket_width, src_layer.get_dim(0))) {
+      auto bucket_src = gather_sequences(src_layer, b);
+      tensor bucket_dst;
+      fn(bucket_src, b, bucket_dst);
+      scatter_sequences(bucket_dst, b, lengths, dst_layer);
+    }
+  }
+
+  /// Groups samples by length rounded up to bucket_width and capped at
+  /// max_length. Samples of length 0 produce no bucket.
+  static std::vector<rnn_bucket> make_buckets(const std::vector<dim>& lengths,
+                                              dim bucket_width,
+                                              dim max_length) {
+    std::map<dim, std::vector<dim>> groups;
+    for (dim i = 0; i < static_cast<dim>(lengths.size()); ++i) {
+      if (lengths[i] <= 0) continue;
+      auto len = std::min(utils::rnd_up(lengths[i], bucket_width), max_length);
+      groups[len].push_back(i);
+    }
+
+    std::vector<rnn_bucket> buckets;
+    buckets.reserve(groups.size());
+    // longest first, so the largest primitive is created up front
+    for (auto it = groups.rbegin(); it != groups.rend(); ++it) {
+      buckets.push_back({it->first, std::move(it->second)});
+    }
+    return buckets;
+  }
+
+  /// {T, N, C} -> {b.length, |b.samples|, C}
+  static tensor gather_sequences(const tensor& src_layer, const rnn_bucket& b) {
+    auto src_dims = src_layer.get_dims();
+    auto nb = static_cast<dim>(b.samples.size());
+    tensor dst({b.length, nb, src_dims[2]}, src_layer.get_data_type(),
+               tag::tnc);
+    std::vector<dim> dst_idx(nb);
+    std::iota(dst_idx.begin(), dst_idx.end(), 0);
+    copy_rows(src_layer, b.samples, dst, dst_idx, b.length, {});
+    return dst;
+  }
+
+  /// {b.length, |b.samples|, C} -> rows of {T, N, C}, timesteps past each
+  /// sample's length are skipped
+  static void scatter_sequences(const tensor& bucket_dst,
+                                const rnn_bucket& b,
+                                const std::vector<dim>& lengths,
+                                tensor& dst_layer) {
+    auto nb = static_cast<dim>(b.samples.size());
+    std::vector<dim> src_idx(nb), limits(nb);
+    std::iota(src_idx.begin(), src_idx.end(), 0);
+    for (dim j = 0; j < nb; ++j) limits[j] = lengths[b.samples[j]];
+    copy_rows(bucket_dst, src_idx, dst_layer, b.samples, b.length, limits);
+  }
+
+  /// {L, D, N, C} -> {L, D, |b.samples|, C}, e.g. per-bucket initial states
+  static tensor gather_states(const tensor& src_iter, const rnn_bucket& b) {
+    auto iter_dims = src_iter.get_dims();
+    auto nb = static_cast<dim>(b.samples.size());
+    tensor dst({iter_dims[0], iter_dims[1], nb, iter_dims[3]},
+               src_iter.get_data_type(), tag::ldnc);
+    std::vector<dim> dst_idx(nb);
+    std::iota(dst_idx.begin(), dst_idx.end(), 0);
+    copy_rows(src_iter, b.samples, dst, dst_idx, iter_dims[0] * iter_dims[1],
+              {});
+    return dst;
+  }
+
+  /// {L, D, |b.samples|, C} -> rows of {L, D, N, C}
+  static void scatter_states(const tensor& bucket_iter,
+                             const rnn_bucket& b,
+                             tensor& dst_iter) {
+    auto iter_dims = bucket_iter.get_dims();
+    auto nb = static_cast<dim>(b.samples.size());
+    std::vector<dim> src_idx(nb);
+    std::iota(src_idx.begin(), src_idx.end(), 0);
+    copy_rows(bucket_iter, src_idx, dst_iter, b.samples,
+              iter_dims[0] * iter_dims[1], {});
+  }
+
+ private:
+  // Both tensors are viewed as {outer, batch, row} in plain layout. Copies
+  // row (o, src_idx[j]) to row (o, dst_idx[j]) for o < min(outer, limits[j]).
+  static void copy_rows(const tensor& src,
+                        const std::vector<dim>& src_idx,
+                        tensor& dst,
+                        const std::vector<dim>& dst_idx,
+                        dim outer,
+                        const std::vector<dim>& limits) {
+    IDEEP_ENFORCE(src.get_desc().is_default() && dst.get_desc().is_default(),
+                  "rnn_bucketing works on plain tnc/ldnc tensors only");
+    IDEEP_ENFORCE(src.get_data_type() == dst.get_data_type(),
+                  "data type mismatch");
+    auto src_dims = src.get_dims();
+    auto dst_dims = dst.get_dims();
+    auto ndims = src_dims.size();
+    auto src_batch = src_dims[ndims - 2];
+    auto dst_batch = dst_dims[ndims - 2];
+    auto row = src_dims[ndims - 1];
+    auto row_bytes = row * (src.get_size() / src.get_nelems());
+
+    auto src_data = static_cast<const char*>(src.get_data_handle());
+    auto dst_data = static_cast<char*>(dst.get_data_handle());
+    auto n = static_cast<dim>(src_idx.size());
+#ifdef _OPENMP
+#pragma omp parallel for collapse(2) schedule(static)
+#endif
+    for (dim o = 0; o < outer; ++o) {
+      for (dim j = 0; j < n; ++j) {
+        if (!limits.empty() && o >= limits[j]) continue;
+        std::memcpy(dst_data + ((o * dst_batch) + dst_idx[j]) * row_bytes,
+                    src_data + ((o * src_batch) + src_idx[j]) * row_bytes,
+                    row_bytes);
+      }
+    }
+  }
+};
+
+}  // namespace ideep
+
+#endif
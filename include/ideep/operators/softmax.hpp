@@ -7,19 +7,41 @@ struct softmax_forward : public dnnl::softmax_forward {
 
   using super = dnnl::softmax_forward;
 
+  struct params {
+    primitive_desc pd;
+    super primitive;
+  };
+
   static void compute(const tensor& src,
                       tensor& dst,
                       int softmax_axis,
                       prop_kind aprop_kind = prop_kind::forward,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("softmax_forward", src);
+    IDEEP_RECORD(softmax_forward, src, dst, softmax_axis, aprop_kind);
     auto src_desc = src.get_desc();
-    dst.reinit_if_possible(src_desc);
+    auto key = utils::create_key(aprop_kind, src_desc, softmax_axis);
+    auto param = utils::computation_cache<params>::fetch_or_create(key, [&]() {
+      IDEEP_PROFILE_PHASE(primitive_creation);
+      // the cached primitive is shared across threads
+      attr_t attr;
+      attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
+      auto pd = primitive_desc({aprop_kind, src_desc, softmax_axis}, attr,
+                               aengine);
+      return params {pd, super(pd)};
+    });
 
-    auto pd = primitive_desc(
-        {aprop_kind, src_desc, softmax_axis}, aengine);
+    IDEEP_PROFILE_ARG("src");
+    auto expected_src = src.reorder_if_differ_in(param.pd.src_desc());
+    dst.reinit_if_possible(param.pd.dst_desc());
+    auto scratchpad =
+        IDEEP_PROFILE_USAGE(scratchpad, tensor(param.pd.scratchpad_desc()));
 
-    super(pd).execute(stream::default_stream(),
-                      {{DNNL_ARG_SRC, src}, {DNNL_ARG_DST, dst}});
+    IDEEP_PROFILE_TIMED(execute, param.primitive.execute(
+        stream::default_stream(),
+        {{DNNL_ARG_SRC, expected_src},
+         {DNNL_ARG_DST, dst},
+         {DNNL_ARG_SCRATCHPAD, scratchpad}}));
   }
 };
 
@@ -27,30 +49,302 @@ struct softmax_backward : public dnnl::softmax_backward {
 
   using super = dnnl::softmax_backward;
 
+  struct params {
+    primitive_desc pd;
+    super primitive;
+  };
+
   static void compute(const tensor& dst,
                       const tensor& diff_dst,
                       tensor& diff_src,
                       int softmax_axis,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("softmax_backward", dst, diff_dst);
+    IDEEP_RECORD(softmax_backward, dst, diff_dst, diff_src, softmax_axis);
+    auto dst_desc = dst.get_desc();
+    auto diff_dst_desc = diff_dst.get_desc();
+    // the forward hint is only needed when the primitive is first created
+    auto key = utils::create_key(dst_desc, diff_dst_desc, softmax_axis);
+    auto param = utils::computation_cache<params>::fetch_or_create(key, [&]() {
+      IDEEP_PROFILE_PHASE(primitive_creation);
+      auto forward_hints = softmax_forward::primitive_desc(
+          {prop_kind::forward_inference, dst_desc, softmax_axis}, aengine);
+      attr_t attr;
+      attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
+      auto pd = primitive_desc({diff_dst_desc, dst_desc, softmax_axis},
+                               attr, aengine, forward_hints);
+      return params {pd, super(pd)};
+    });
 
-    auto forward_hints = softmax_forward::primitive_desc(
-        {prop_kind::forward_inference, dst.get_desc(), softmax_axis}, aengine);
-
-    auto pd =
-        primitive_desc({diff_dst.get_desc(), dst.get_desc(), softmax_axis},
-                       aengine, forward_hints);
+    auto& pd = param.pd;
+    IDEEP_PROFILE_ARG("dst");
     auto expected_dst = dst.reorder_if_differ_in(pd.dst_desc());
+    IDEEP_PROFILE_ARG("diff_dst");
     auto expected_diff_dst = diff_dst.reorder_if_differ_in(pd.diff_dst_desc());
     diff_src.reinit_if_possible(pd.diff_src_desc());
+    auto scratchpad =
+        IDEEP_PROFILE_USAGE(scratchpad, tensor(pd.scratchpad_desc()));
+
+    // diff_src = dst * (diff_dst - sum(diff_dst * dst)) along the axis
+    IDEEP_PROFILE_FLOPS(4.0 * dst.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    param.primitive.execute(stream::default_stream(),
+                            {{DNNL_ARG_DST, expected_dst},
+                             {DNNL_ARG_DIFF_DST, expected_diff_dst},
+                             {DNNL_ARG_DIFF_SRC, diff_src},
+                             {DNNL_ARG_SCRATCHPAD, scratchpad}});
+  }
+};
+
+namespace detail {
+
+// A plain tensor seen as {outer, axis, inner} around the softmax axis. Rows
+// along the axis are strided by inner; with the last axis they are
+// contiguous and the loops vectorize.
+struct softmax_view {
+  dim outer, axis, inner;
+
+  softmax_view(const tensor& t, int softmax_axis) {
+    auto tdims = t.get_dims();
+    const auto ndims = static_cast<int>(tdims.size());
+    IDEEP_ENFORCE(softmax_axis >= 0 && softmax_axis < ndims,
+                  "softmax axis out of range");
+    outer = std::accumulate(tdims.begin(), tdims.begin() + softmax_axis,
+                            dim(1), std::multiplies<dim>());
+    axis = tdims[softmax_axis];
+    inner = std::accumulate(tdims.begin() + softmax_axis + 1, tdims.end(),
+                            dim(1), std::multiplies<dim>());
+  }
+
+  dim rows() const { return outer * inner; }
+  dim base(dim row) const { return (row / inner) * axis * inner + row % inner; }
+};
+
+inline tensor to_default_layout(const tensor& t) {
+  return t.reorder_if_differ_in(t.get_desc().to_default_format());
+}
+
+}  // namespace detail
+
+/// dst = src - max - log(sum(exp(src - max))) along softmax_axis.
+/// Computed in f32 on the default layout of src, for f32 and bf16 data.
+struct log_softmax_forward {
+
+  static void compute(const tensor& src,
+                      tensor& dst,
+                      int softmax_axis,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("log_softmax_forward", src);
+    IDEEP_RECORD(log_softmax_forward, src, dst, softmax_axis);
+    IDEEP_PROFILE_ARG("src");
+    auto expected_src = detail::to_default_layout(src);
+    dst.reinit_if_possible(expected_src.get_desc());
+    // max, exp and sum, then the shift, counting exp as one
+    IDEEP_PROFILE_FLOPS(4.0 * src.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    switch (src.get_data_type()) {
+      case data_type::f32:
+        kernel<float>(expected_src, dst, softmax_axis);
+        break;
+      case data_type::bf16:
+        kernel<uint16_t>(expected_src, dst, softmax_axis);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
+ private:
+  template <typename T>
+  static void kernel(const tensor& src, tensor& dst, int softmax_axis) {
+    detail::softmax_view v(src, softmax_axis);
+    const auto src_data = static_cast<const T*>(src.get_data_handle());
+    const auto dst_data = static_cast<T*>(dst.get_data_handle());
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (dim r = 0; r < v.rows(); r++) {
+      const dim base = v.base(r);
+      float max = -std::numeric_limits<float>::infinity();
+      for (dim k = 0; k < v.axis; k++)
+        max = std::max(max, utils::to_f32(src_data[base + k * v.inner]));
+      float sum = 0.f;
+      for (dim k = 0; k < v.axis; k++)
+        sum += std::exp(
+            utils::to_f32(src_data[base + k * v.inner]) - max);
+      const float shift = max + std::log(sum);
+      for (dim k = 0; k < v.axis; k++) {
+        const dim off = base + k * v.inner;
+        dst_data[off] =
+            utils::from_f32<T>(utils::to_f32(src_data[off]) - shift);
+      }
+    }
+  }
+};
+
+/// diff_src = diff_dst - exp(dst) * sum(diff_dst) along softmax_axis, with
+/// dst the log_softmax_forward output
+struct log_softmax_backward {
+
+  static void compute(const tensor& dst,
+                      const tensor& diff_dst,
+                      tensor& diff_src,
+                      int softmax_axis,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("log_softmax_backward", dst, diff_dst);
+    IDEEP_RECORD(log_softmax_backward, dst, diff_dst, diff_src, softmax_axis);
+    IDEEP_PROFILE_ARG("dst");
+    auto expected_dst = detail::to_default_layout(dst);
+    IDEEP_PROFILE_ARG("diff_dst");
+    auto expected_diff_dst = detail::to_default_layout(diff_dst);
+    diff_src.reinit_if_possible(expected_diff_dst.get_desc());
+    IDEEP_PROFILE_FLOPS(4.0 * dst.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    switch (diff_dst.get_data_type()) {
+      case data_type::f32:
+        kernel<float>(expected_dst, expected_diff_dst, diff_src, softmax_axis);
+        break;
+      case data_type::bf16:
+        kernel<uint16_t>(expected_dst, expected_diff_dst, diff_src,
+                         softmax_axis);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
+ private:
+  template <typename T>
+  static void kernel(const tensor& dst, const tensor& diff_dst,
+                     tensor& diff_src, int softmax_axis) {
+    detail::softmax_view v(dst, softmax_axis);
+    const auto dst_data = static_cast<const T*>(dst.get_data_handle());
+    const auto diff_dst_data =
+        static_cast<const T*>(diff_dst.get_data_handle());
+    const auto diff_src_data = static_cast<T*>(diff_src.get_data_handle());
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (dim r = 0; r < v.rows(); r++) {
+      const dim base = v.base(r);
+      float sum = 0.f;
+      for (dim k = 0; k < v.axis; k++)
+        sum += utils::to_f32(diff_dst_data[base + k * v.inner]);
+      for (dim k = 0; k < v.axis; k++) {
+        const dim off = base + k * v.inner;
+        const float y = utils::to_f32(dst_data[off]);
+        const float dy = utils::to_f32(diff_dst_data[off]);
+        diff_src_data[off] = utils::from_f32<T>(dy - std::exp(y) * sum);
+      }
+    }
+  }
+};
+
+/// Softmax followed by cross-entropy against class-index labels, returning
+/// the loss and its gradient together. logits is {N, C} (classes on axis
+/// 1); samples labelled ignore_index contribute neither loss nor gradient.
+/// loss is a {1} f32 tensor averaged over counted samples and diff_src
+/// = (softmax(logits) - one_hot(label)) / count, in the logits data type.
+///
+/// Each row is read twice: once for the online max and sum of exponents, and
+/// once to write the gradient. No softmax or log-probability tensor is
+/// materialized.
+struct softmax_cross_entropy {
+
+  static void compute(const tensor& logits,
+                      const std::vector<dim>& labels,
+                      tensor& loss,
+                      tensor& diff_src,
+                      dim ignore_index = -100,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("softmax_cross_entropy", logits);
+    IDEEP_RECORD(softmax_cross_entropy, logits,
+                 static_cast<int64_t>(labels.size()), loss, diff_src,
+                 ignore_index);
+    IDEEP_ENFORCE(logits.ndims() == 2, "logits should be {N, C}");
+    IDEEP_ENFORCE(static_cast<dim>(labels.size()) == logits.get_dim(0),
+                  "one label per sample expected");
+    IDEEP_PROFILE_ARG("logits");
+    auto expected_logits = detail::to_default_layout(logits);
+    diff_src.reinit_if_possible(expected_logits.get_desc());
+    loss.reinit_if_possible({{1}, data_type::f32, tag::a});
+    // the online max and sum of exponents, then the gradient
+    IDEEP_PROFILE_FLOPS(6.0 * logits.get_nelems());
+    IDEEP_PROFILE_PHASE(execute);
+    switch (logits.get_data_type()) {
+      case data_type::f32:
+        kernel<float>(expected_logits, labels, loss, diff_src, ignore_index);
+        break;
+      case data_type::bf16:
+        kernel<uint16_t>(expected_logits, labels, loss, diff_src,
+                         ignore_index);
+        break;
+      default:
+        throw error(dnnl_invalid_arguments, "Unsupported dnnl data type");
+    }
+  }
+
+ private:
+  template <typename T>
+  static void kernel(const tensor& logits,
+                     const std::vector<dim>& labels,
+                     tensor& loss,
+                     tensor& diff_src,
+                     dim ignore_index) {
+    const dim batch = logits.get_dim(0);
+    const dim classes = logits.get_dim(1);
+    const auto x = static_cast<const T*>(logits.get_data_handle());
+    const auto dx = static_cast<T*>(diff_src.get_data_handle());
+
+    dim count = 0;
+    for (auto l : labels) {
+      if (l == ignore_index) continue;
+      IDEEP_ENFORCE(l >= 0 && l < classes, "label out of range");
+      count++;
+    }
+    const float scale = count > 0 ? 1.f / count : 0.f;
+
+    double total = 0.;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) reduction(+ : total)
+#endif
+    for (dim n = 0; n < batch; n++) {
+      const dim base = n * classes;
+      const dim label = labels[n];
+      if (label == ignore_index) {
+        for (dim c = 0; c < classes; c++)
+          dx[base + c] = utils::from_f32<T>(0.f);
+        continue;
+      }
+
+      // online max and sum: sum is rescaled whenever the max grows
+      float max = -std::numeric_limits<float>::infinity(), sum = 0.f;
+      for (dim c = 0; c < classes; c++) {
+        const float v = utils::to_f32(x[base + c]);
+        if (v > max) {
+          sum = sum * std::exp(max - v) + 1.f;
+          max = v;
+        } else {
+          sum += std::exp(v - max);
+        }
+      }
+      const float log_sum = std::log(sum);
+      total += log_sum + max - utils::to_f32(x[base + label]);
+
+      const float rsum = 1.f / sum;
+      for (dim c = 0; c < classes; c++) {
+        const float p =
+            std::exp(utils::to_f32(x[base + c]) - max) * rsum;
+        dx[base + c] =
+            utils::from_f32<T>((p - (c == label ? 1.f : 0.f)) * scale);
+      }
+    }
 
-    super(pd).execute(stream::default_stream(),
-                      {{DNNL_ARG_DST, expected_dst},
-                       {DNNL_ARG_DIFF_DST, expected_diff_dst},
-                       {DNNL_ARG_DIFF_SRC, diff_src}});
-    
+    *static_cast<float*>(loss.get_data_handle()) =
+        static_cast<float>(total * scale);
   }
 };
 
 }  // namespace ideep
 
-#endif
\ No newline at end of file
+#endif
@@ -11,11 +11,14 @@ struct sum : public dnnl::sum {
                       const std::vector<tensor>& srcs,
                       tensor& dst,
                       const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("sum", srcs.front());
+    IDEEP_RECORD(sum, scales, srcs, dst);
     auto src_descs = utils::fmap(srcs, [](const tensor& t) {
       // "upcast" vector<tensor::desc> to vector<memory::desc>
       return static_cast<memory::desc>(t.get_desc());
     });
-    auto pd = primitive_desc(scales, src_descs, aengine);
+    auto pd = IDEEP_PROFILE_TIMED(primitive_creation,
+                                  primitive_desc(scales, src_descs, aengine));
 
     dst.reinit_if_possible(pd.dst_desc());
 
@@ -24,7 +27,8 @@ struct sum : public dnnl::sum {
       args.insert({DNNL_ARG_MULTIPLE_SRC + i, srcs[i]});
     }
 
-    super(pd).execute(stream::default_stream(), args);
+    IDEEP_PROFILE_TIMED(execute,
+                        super(pd).execute(stream::default_stream(), args));
   }
 };
 
@@ -1,19 +1,177 @@
 #ifndef IDEEP_OPERATORS_VANILLA_RNN_HPP
 #define IDEEP_OPERATORS_VANILLA_RNN_HPP
+#include "rnn_backward_base.hpp"
 
 namespace ideep {
 
+struct rnn_forward_params {
+  dnnl::vanilla_rnn_forward::primitive_desc pd;
+  dnnl::vanilla_rnn_forward primitive;
+};
+
+// Tensor layouts follow DNNL:
+//   src_layer/dst_layer  {T, N, C}          tnc
+//   src_iter/dst_iter    {L, D, N, C}       ldnc
+//   weights_layer/iter   {L, D, C, 1, DIC}  ldigo
+//   bias                 {L, D, 1, DIC}     ldgo
+// An empty src_iter means a zero initial state and an empty dst_iter_dims
+// means the final state is not written out.
 struct rnn_forward : public dnnl::vanilla_rnn_forward {
+
+  using super = dnnl::vanilla_rnn_forward;
+
+  /// Fetch the pd and primitive for this shape from the computation cache,
+  /// creating them on first use. Sequences with a timestep count seen before
+  /// reuse the primitive instead of rebuilding it.
+  static void prepare(rnn_forward_params& param,
+                      const tensor& src_layer,
+                      const tensor& src_iter,
+                      const tensor& weights_layer,
+                      const tensor& weights_iter,
+                      const tensor& bias,
+                      const dims& dst_layer_dims,
+                      const dims& dst_iter_dims,
+                      rnn_kind akind,
+                      dnnl_rnn_direction_t direction,
+                      prop_kind aprop_kind = prop_kind::forward_training,
+                      const engine& aengine = engine::cpu_engine()) {
+    IDEEP_PROFILE_OP("rnn_forward::prepare", src_layer, weights_layer);
+    IDEEP_RECORD(rnn_forward_prepare, &param, src_layer, src_iter,
+                 weights_layer, weights_iter, bias, dst_layer_dims,
+                 dst_iter_dims, akind, direction, aprop_kind);
+    IDEEP_ENFORCE(utils::one_of(akind, RNN_RELU, RNN_TANH),
+                  "Use lstm_forward or lbr_gru_forward for LSTM and GRU");
+    auto dtype = src_layer.get_data_type();
+    auto src_layer_desc = src_layer.get_desc();
+    auto src_iter_desc = src_iter.get_desc_or_zero();
+    auto weights_layer_desc = weights_layer.get_desc().to_format_any();
+    auto weights_iter_desc = weights_iter.get_desc().to_format_any();
+    auto bias_desc = bias.get_desc_or_zero();
+    tensor::desc dst_layer_desc(dst_layer_dims, dtype, tag::tnc);
+    auto dst_iter_desc = dst_iter_dims.empty()
+        ? tensor::desc()
+        : tensor::desc(dst_iter_dims, dtype, tag::ldnc);
+
+    auto key = utils::create_key(
+        akind, direction, aprop_kind, src_layer_desc, src_iter_desc,
+        weights_layer_desc, weights_iter_desc, bias_desc, dst_layer_dims,
+        dst_iter_dims);
+
+    param = utils::computation_cache<rnn_forward_params>::fetch_or_create(
+        key, [&]() {
+      IDEEP_PROFILE_PHASE(primitive_creation);
+      auto pd = get_primitive_desc(
+          src_layer_desc, src_iter_desc, weights_layer_desc, weights_iter_desc,
+          bias_desc, dst_layer_desc, dst_iter_desc, akind, direction,
+          aprop_kind, aengine);
+      return rnn_forward_params {pd, super(pd)};
+    });
+  }
+
+  static void compute(const rnn_forward_params& param,
+                      const tensor& src_layer,
+                      const tensor& src_iter,
+                      const tensor& weights_layer,
+                      const tensor& weights_iter,
+                      const tensor& bias,
+                      tensor& dst_layer,
+                      tensor& dst_iter,
+                      tensor& workspace) {
+    IDEEP_PROFILE_OP("rnn_forward", src_layer, weights_layer);
+    IDEEP_RECORD(rnn_forward_param, &param, src_layer, src_iter,
+                 weights_layer, weights_iter, bias, dst_layer, dst_iter);
+    auto& pd = param.pd;
+    IDEEP_PROFILE_ARG("src_layer");
+    auto expected_src_layer = src_layer.reorder_if_differ_in(pd.src_layer_desc());
+    IDEEP_PROFILE_ARG("weights_layer");
+    auto expected_weights_layer = IDEEP_PROFILE_USAGE(weights,
+        weights_layer.reorder_if_differ_in(pd.weights_layer_desc()));
+    IDEEP_PROFILE_ARG("weights_iter");
+    auto expected_weights_iter = IDEEP_PROFILE_USAGE(weights,
+        weights_iter.reorder_if_differ_in(pd.weights_iter_desc()));
+    dst_layer.reinit_if_possible(pd.dst_layer_desc());
+    auto scratchpad =
+        IDEEP_PROFILE_USAGE(scratchpad, tensor(pd.scratchpad_desc()));
+
+    exec_args args {{DNNL_ARG_SRC_LAYER, expected_src_layer},
+                    {DNNL_ARG_WEIGHTS_LAYER, expected_weights_layer},
+                    {DNNL_ARG_WEIGHTS_ITER, expected_weights_iter},
+                    {DNNL_ARG_DST_LAYER, dst_layer},
+                    {DNNL_ARG_SCRATCHPAD, scratchpad}};
+
+    if (!src_iter.is_empty()) {
+      IDEEP_PROFILE_ARG("src_iter");
+      args.insert({DNNL_ARG_SRC_ITER,
+                   src_iter.reorder_if_differ_in(pd.src_iter_desc())});
+    }
+    if (!bias.is_empty()) {
+      IDEEP_PROFILE_ARG("bias");
+      args.insert({DNNL_ARG_BIAS, bias.reorder_if_differ_in(pd.bias_desc())});
+    }
+    if (!tensor::desc(pd.dst_iter_desc()).is_zero()) {
+      dst_iter.reinit_if_possible(pd.dst_iter_desc());
+      args.insert({DNNL_ARG_DST_ITER, dst_iter});
+    }
+    if (!tensor::desc(pd.workspace_desc()).is_zero()) {
+      workspace.reinit_if_possible(pd.workspace_desc());
+      args.insert({DNNL_ARG_WORKSPACE, workspace});
+    }
+
+    // the gemms of every layer, direction and gate over all timesteps
+    IDEEP_PROFILE_FLOPS(2.0 * src_layer.get_dim(0) * src_layer.get_dim(1) *
+                        (weights_layer.get_nelems() +
+                         weights_iter.get_nelems()));
+    IDEEP_PROFILE_PHASE(execute);
+    param.primitive.execute(stream::default_stream(), args);
+  }
+
+  // 2-in-1 compute (prepare & compute)
   static void compute(const tensor& src_layer, const tensor& src_iter,
       const tensor& weights_layer, const tensor& weights_iter, const tensor& bias,
       const dims& dst_layer_dims, tensor& dst_layer,
       const dims& dst_iter_dims, tensor& dst_iter,
       tensor& workspace, rnn_kind akind, dnnl_rnn_direction_t direction,
       prop_kind aprop_kind = prop_kind::forward_training) {
+    IDEEP_PROFILE_OP("rnn_forward", src_layer, weights_layer);
+    IDEEP_RECORD(rnn_forward, src_layer, src_iter, weights_layer, weights_iter,
+                 bias, dst_layer_dims, dst_layer, dst_iter_dims, dst_iter,
+                 akind, direction, aprop_kind);
+    rnn_forward_params param;
+    prepare(param, src_layer, src_iter, weights_layer, weights_iter, bias,
+            dst_layer_dims, dst_iter_dims, akind, direction, aprop_kind);
+    compute(param, src_layer, src_iter, weights_layer, weights_iter, bias,
+            dst_layer, dst_iter, workspace);
+  }
+
+  static primitive_desc get_primitive_desc(
+      const tensor::desc& src_layer_desc,
+      const tensor::desc& src_iter_desc,
+      const tensor::desc& weights_layer_desc,
+      const tensor::desc& weights_iter_desc,
+      const tensor::desc& bias_desc,
+      const tensor::desc& dst_layer_desc,
+      const tensor::desc& dst_iter_desc,
+      rnn_kind akind,
+      dnnl_rnn_direction_t direction,
+      prop_kind aprop_kind = prop_kind::forward_training,
+      const engine& aengine = engine::cpu_engine()) {
+    // primitives are shared across threads through the cache, so keep the
+    // scratchpad per call instead of per primitive
+    attr_t attr;
+    attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
+    return primitive_desc(
+        {aprop_kind, utils::rnn_kind_to_activation(akind),
+         static_cast<dnnl::rnn_direction>(direction), src_layer_desc,
+         src_iter_desc, weights_layer_desc, weights_iter_desc, bias_desc,
+         dst_layer_desc, dst_iter_desc},
+        attr, aengine);
   }
 };
 
-struct rnn_backward : public dnnl::vanilla_rnn_backward {
+struct rnn_backward : public rnn_backward_base<dnnl::vanilla_rnn_backward> {
+
+  // diff_weights_layer, diff_weights_iter and diff_bias are returned in the
+  // formats DNNL picked for them (see pd.diff_weights_*_desc()).
   template <class alloc = utils::allocator>
   static void compute(const tensor& src_layer, const tensor& src_iter, const tensor& weights_layer,
       const tensor& weights_iter, const tensor& bias, const tensor& dst_layer, const tensor& dst_iter,
@@ -21,9 +179,52 @@ struct rnn_backward : public dnnl::vanilla_rnn_backward {
       const bool with_bias, tensor& diff_src_layer, tensor& diff_src_iter, tensor& diff_weights_layer,
       tensor& diff_weights_iter, tensor& diff_bias, rnn_kind akind, dnnl_rnn_direction_t direction,
       prop_kind aprop_kind = prop_kind::backward) {
+    IDEEP_PROFILE_OP("rnn_backward", src_layer, weights_layer);
+    IDEEP_RECORD(rnn_backward, src_layer, src_iter, weights_layer,
+                 weights_iter, bias, dst_layer, dst_iter, diff_dst_layer,
+                 diff_dst_iter, workspace, with_bias, akind, direction,
+                 aprop_kind);
+    IDEEP_ENFORCE(utils::one_of(akind, RNN_RELU, RNN_TANH),
+                  "Use lstm_backward or lbr_gru_backward for LSTM and GRU");
+    auto src_layer_desc = src_layer.get_desc();
+    auto src_iter_desc = src_iter.get_desc_or_zero();
+    auto weights_layer_desc = weights_layer.get_desc().to_format_any();
+    auto weights_iter_desc = weights_iter.get_desc().to_format_any();
+    auto bias_desc = with_bias ? bias.get_desc() : tensor::desc();
+    auto dst_layer_desc = dst_layer.get_desc();
+    auto dst_iter_desc = dst_iter.get_desc_or_zero();
+
+    auto key = utils::create_key(
+        akind, direction, aprop_kind, src_layer_desc, src_iter_desc,
+        weights_layer_desc, weights_iter_desc, bias_desc, dst_layer_desc,
+        dst_iter_desc);
+    auto create_pd = [&]() {
+      auto forward_hints = rnn_forward::get_primitive_desc(
+          src_layer_desc, src_iter_desc, weights_layer_desc, weights_iter_desc,
+          bias_desc, dst_layer_desc, dst_iter_desc, akind, direction,
+          prop_kind::forward_training);
+
+      attr_t attr;
+      attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
+      return primitive_desc(
+          {aprop_kind, utils::rnn_kind_to_activation(akind),
+           static_cast<dnnl::rnn_direction>(direction),
+           src_layer_desc, src_iter_desc, weights_layer_desc,
+           weights_iter_desc, bias_desc, dst_layer_desc, dst_iter_desc,
+           src_layer_desc, src_iter_desc, weights_layer_desc,
+           weights_iter_desc, bias_desc, dst_layer_desc, dst_iter_desc},
+          attr, engine::cpu_engine(), forward_hints);
+    };
+    // no cell state; the bias is left out unless with_bias
+    tensor none;
+    do_compute(key, create_pd, src_layer, src_iter, none, weights_layer,
+               weights_iter, with_bias ? bias : none, dst_layer, dst_iter,
+               none, diff_dst_layer, diff_dst_iter, none, workspace,
+               diff_src_layer, diff_src_iter, none, diff_weights_layer,
+               diff_weights_iter, diff_bias);
   }
 };
 
 }  // namespace ideep
 
-#endif
\ No newline at end of file
+#endif
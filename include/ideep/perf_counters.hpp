@@ -0,0 +1,212 @@
+#ifndef IDEEP_PERF_COUNTERS_HPP
+#define IDEEP_PERF_COUNTERS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace ideep {
+namespace utils {
+
+/// Hardware counters of the threads that run ops: the calling thread and
+/// the OpenMP threads DNNL executes on, through Linux perf_event_open.
+///
+/// Each thread gets one counter group, read with a single syscall and
+/// scaled by enabled / running time when the kernel multiplexes counters.
+/// Counters the CPU or kernel does not provide (e.g. backend stalls on most
+/// Intel parts), or all of them when perf_event_paranoid forbids user
+/// counting or off Linux, read as zero and report !available().
+///
+/// read() sums over every thread, so ops executed concurrently from several
+/// caller threads share the worker counts.
+class perf_counters {
+ public:
+  enum counter {
+    cycles = 0,
+    instructions = 1,
+    llc_misses = 2,
+    stalled_cycles_backend = 3,
+    num_counters = 4
+  };
+
+  struct values {
+    double v[num_counters] = {0., 0., 0., 0.};
+
+    values operator-(const values& other) const {
+      values d;
+      for (int c = 0; c < num_counters; c++) d.v[c] = v[c] - other.v[c];
+      return d;
+    }
+  };
+
+  static perf_counters& instance() {
+    static perf_counters p;
+    return p;
+  }
+
+  static const char* name(counter c) {
+    static const char* names[num_counters] = {
+        "cycles", "instructions", "llc_misses", "stalled_cycles_backend"};
+    return names[c];
+  }
+
+  bool available(counter c) const {
+    return (available_.load(std::memory_order_relaxed) >> c) & 1;
+  }
+
+  /// Current totals over all threads. The first call on a thread, and the
+  /// first after the OpenMP pool grows, opens the missing counters.
+  values read() {
+    attach();
+    values total;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto g : groups_) g->read_into(total);
+    return total;
+  }
+
+ private:
+  // The counters of one thread, closed when the thread exits
+  class group {
+   public:
+    group() {
+      std::fill(slot_, slot_ + num_counters, -1);
+#ifdef __linux__
+      for (int c = 0; c < num_counters; c++) {
+        int fd = open_event(static_cast<counter>(c), leader_);
+        if (fd < 0) continue;
+        if (leader_ < 0) leader_ = fd;
+        fds_.push_back(fd);
+        slot_[c] = fds_.size() - 1;
+      }
+      if (leader_ >= 0) ioctl(leader_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    ~group() {
+#ifdef __linux__
+      for (auto fd : fds_) close(fd);
+#endif
+    }
+
+    unsigned available() const {
+      unsigned mask = 0;
+      for (int c = 0; c < num_counters; c++)
+        if (slot_[c] >= 0) mask |= 1u << c;
+      return mask;
+    }
+
+    void read_into(values& total) const {
+#ifdef __linux__
+      if (leader_ < 0) return;
+      // nr, time_enabled, time_running, then one value per counter
+      uint64_t buf[3 + num_counters];
+      auto want = (3 + fds_.size()) * sizeof(uint64_t);
+      if (::read(leader_, buf, sizeof(buf)) != static_cast<ssize_t>(want))
+        return;
+      if (buf[2] == 0) return;
+      double scale = static_cast<double>(buf[1]) / buf[2];
+      for (int c = 0; c < num_counters; c++)
+        if (slot_[c] >= 0) total.v[c] += buf[3 + slot_[c]] * scale;
+#endif
+    }
+
+   private:
+#ifdef __linux__
+    static int open_event(counter c, int group_fd) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      switch (c) {
+        case cycles:
+          attr.config = PERF_COUNT_HW_CPU_CYCLES;
+          break;
+        case instructions:
+          attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+          break;
+        case llc_misses:
+          attr.type = PERF_TYPE_HW_CACHE;
+          attr.config = PERF_COUNT_HW_CACHE_LL |
+                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+          break;
+        default:
+          attr.config = PERF_COUNT_HW_STALLED_CYCLES_BACKEND;
+          break;
+      }
+      // the leader starts disabled and enables the whole group at once
+      attr.disabled = group_fd < 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP |
+                         PERF_FORMAT_TOTAL_TIME_ENABLED |
+                         PERF_FORMAT_TOTAL_TIME_RUNNING;
+      // pid 0 and cpu -1: the calling thread, on whichever cpu it runs
+      return static_cast<int>(
+          syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+    }
+#endif
+
+    int leader_ = -1;
+    std::vector<int> fds_;
+    int slot_[num_counters];
+  };
+
+  // Unregisters the thread's group when the thread exits
+  struct thread_group {
+    std::unique_ptr<group> g;
+
+    ~thread_group() {
+      if (!g) return;
+      auto& p = instance();
+      std::lock_guard<std::mutex> lock(p.mutex_);
+      p.groups_.erase(std::remove(p.groups_.begin(), p.groups_.end(),
+                                  g.get()), p.groups_.end());
+    }
+  };
+
+  perf_counters() : available_(0), omp_threads_(0) {}
+
+  void attach_this_thread() {
+    static thread_local thread_group tg;
+    if (tg.g) return;
+    tg.g.reset(new group);
+    available_.fetch_or(tg.g->available());
+    std::lock_guard<std::mutex> lock(mutex_);
+    groups_.push_back(tg.g.get());
+  }
+
+  void attach() {
+    attach_this_thread();
+#ifdef _OPENMP
+    int nthr = omp_get_max_threads();
+    if (omp_in_parallel() || nthr <= omp_threads_.load()) return;
+#pragma omp parallel num_threads(nthr)
+    attach_this_thread();
+    omp_threads_.store(nthr);
+#endif
+  }
+
+  std::atomic<unsigned> available_;
+  std::atomic<int> omp_threads_;
+  std::mutex mutex_;
+  std::vector<group*> groups_;
+};
+
+}  // namespace utils
+}  // namespace ideep
+
+#endif
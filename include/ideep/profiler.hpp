@@ -0,0 +1,666 @@
+#ifndef IDEEP_PROFILER_HPP
+#define IDEEP_PROFILER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dnnl_debug.h>
+#include "abstract_types.hpp"
+#ifdef IDEEP_ENABLE_PROFILER
+#include "perf_counters.hpp"
+#endif
+
+namespace ideep {
+namespace utils {
+
+/// Opt-in per-op profiler.
+///
+/// Instrumentation is compiled in only with IDEEP_ENABLE_PROFILER defined;
+/// otherwise every IDEEP_PROFILE_* macro expands to nothing and ops carry no
+/// profiling code at all. When compiled in, recording is switched on with
+/// profiler::instance().enable() or IDEEP_PROFILE=1 in the environment, and
+/// a disabled profiler costs one relaxed atomic load per op.
+///
+/// Each op call is attributed its primitive creation, implicit reorder and
+/// execute times, the bytes it allocated and an estimated FLOP count, and is
+/// aggregated per (op, signature), the signature listing dims, data types
+/// and formats of its inputs. Ops invoked from within another op (e.g. a
+/// binary add inside layer norm) are attributed to the outer op.
+///
+/// With tracing on (enable_trace() or IDEEP_PROFILE_TRACE=<file>), every op
+/// call is also kept as a Chrome trace-event span with its primitive
+/// creation, reorder and execute phases nested inside, and chrome_trace()
+/// renders them as JSON for chrome://tracing or Perfetto. The file named by
+/// IDEEP_PROFILE_TRACE is written at process exit.
+///
+/// Every reorder of tensor data is also counted per (op, argument, source
+/// format, target format), whether or not it happens inside a profiled op,
+/// and reorder_summary() lists the conversions by bytes moved. Ops label
+/// their arguments with IDEEP_PROFILE_ARG; unlabelled reorders are numbered
+/// in the order they happen within the op. enable_reorder_log() or
+/// IDEEP_PROFILE_REORDER_LOG=1 also prints each reorder to stderr as it
+/// happens.
+///
+/// With hardware counters on (enable_counters() or IDEEP_PROFILE_COUNTERS=1,
+/// Linux only), the execute phase also accumulates cycles, instructions,
+/// LLC misses and backend stall cycles of every thread, see perf_counters,
+/// which like the macros is only compiled in with IDEEP_ENABLE_PROFILER.
+/// summary() then adds IPC, LLC misses per KFLOP and the stalled share of
+/// cycles: low IPC with many misses or stalls marks a bandwidth-bound layer.
+class profiler {
+ public:
+  enum phase {
+    primitive_creation = 0,
+    reorder = 1,
+    execute = 2,
+    num_phases = 3
+  };
+
+  struct stats {
+    std::string op;
+    std::string signature;
+    int64_t calls = 0;
+    double total_ms = 0.;
+    double phase_ms[num_phases] = {0., 0., 0.};
+    int64_t reorders = 0;
+    int64_t bytes_allocated = 0;
+    double flops = 0.;
+#ifdef IDEEP_ENABLE_PROFILER
+    double counters[perf_counters::num_counters] = {0., 0., 0., 0.};
+#endif
+  };
+
+  struct reorder_stats {
+    std::string op;
+    std::string arg;
+    std::string from;
+    std::string to;
+    int64_t count = 0;
+    int64_t bytes = 0;
+    double total_ms = 0.;
+  };
+
+  /// A complete ("X") trace event, times in us since the profiler started
+  struct trace_event {
+    std::string name;
+    std::string args;
+    int tid;
+    double ts;
+    double dur;
+  };
+
+  /// Events beyond this many are dropped rather than grow without bound
+  static constexpr size_t max_trace_events = 1 << 20;
+
+  using clock = std::chrono::steady_clock;
+
+  static profiler& instance() {
+    static profiler p;
+    return p;
+  }
+
+  static bool enabled() {
+    return instance().enabled_.load(std::memory_order_relaxed);
+  }
+
+  void enable(bool on = true) { enabled_.store(on); }
+
+  static bool tracing() {
+    return instance().tracing_.load(std::memory_order_relaxed);
+  }
+
+  /// Turning tracing on also enables the profiler
+  void enable_trace(bool on = true) {
+    tracing_.store(on);
+    if (on) enable();
+  }
+
+  void enable_reorder_log(bool on = true) {
+    reorder_log_.store(on);
+    if (on) enable();
+  }
+
+  static bool counting() {
+    return instance().counting_.load(std::memory_order_relaxed);
+  }
+
+  /// Turning hardware counters on also enables the profiler
+  void enable_counters(bool on = true) {
+    counting_.store(on);
+    if (on) enable();
+  }
+
+  void reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.clear();
+    reorder_stats_.clear();
+    events_.clear();
+    dropped_events_ = 0;
+  }
+
+  /// Aggregated stats, most expensive first
+  std::vector<stats> query() const {
+    std::vector<stats> result;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto& kv : stats_) result.push_back(kv.second);
+    }
+    std::sort(result.begin(), result.end(), [](const stats& a, const stats& b) {
+      return a.total_ms > b.total_ms;
+    });
+    return result;
+  }
+
+  /// Text table of query()
+  std::string summary() const {
+    std::ostringstream os;
+    os << std::left << std::setw(28) << "op" << std::right
+       << std::setw(8) << "calls" << std::setw(12) << "total(ms)"
+       << std::setw(10) << "avg(ms)" << std::setw(10) << "pd(ms)"
+       << std::setw(14) << "reorder(ms/n)" << std::setw(10) << "exec(ms)"
+       << std::setw(10) << "alloc(MB)" << std::setw(10) << "GFLOP/s";
+#ifdef IDEEP_ENABLE_PROFILER
+    bool with_counters = counting();
+#else
+    bool with_counters = false;
+#endif
+    if (with_counters) {
+      os << std::setw(8) << "IPC" << std::setw(14) << "LLC-miss/KF"
+         << std::setw(8) << "stall%";
+    }
+    os << "  signature\n";
+    os << std::fixed << std::setprecision(3);
+    for (auto& s : query()) {
+      std::ostringstream reorders;
+      reorders << std::fixed << std::setprecision(3)
+               << s.phase_ms[reorder] << "/" << s.reorders;
+      os << std::left << std::setw(28) << s.op << std::right
+         << std::setw(8) << s.calls << std::setw(12) << s.total_ms
+         << std::setw(10) << s.total_ms / s.calls
+         << std::setw(10) << s.phase_ms[primitive_creation]
+         << std::setw(14) << reorders.str()
+         << std::setw(10) << s.phase_ms[execute]
+         << std::setw(10) << s.bytes_allocated / 1048576.
+         << std::setw(10)
+         << (s.total_ms > 0. ? s.flops / s.total_ms / 1e6 : 0.);
+#ifdef IDEEP_ENABLE_PROFILER
+      if (with_counters) counter_columns(os, s);
+#endif
+      os << "  " << s.signature << "\n";
+    }
+    return os.str();
+  }
+
+  /// Reorders grouped by call site and formats, most bytes first
+  std::vector<reorder_stats> reorder_report() const {
+    std::vector<reorder_stats> result;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto& kv : reorder_stats_) result.push_back(kv.second);
+    }
+    std::sort(result.begin(), result.end(),
+              [](const reorder_stats& a, const reorder_stats& b) {
+                return a.bytes > b.bytes;
+              });
+    return result;
+  }
+
+  /// Text table of reorder_report()
+  std::string reorder_summary() const {
+    std::ostringstream os;
+    os << std::left << std::setw(40) << "op/arg" << std::right
+       << std::setw(8) << "count" << std::setw(12) << "MB"
+       << std::setw(12) << "total(ms)" << "  from -> to\n";
+    os << std::fixed << std::setprecision(3);
+    for (auto& r : reorder_report()) {
+      os << std::left << std::setw(40) << r.op + "/" + r.arg << std::right
+         << std::setw(8) << r.count << std::setw(12) << r.bytes / 1048576.
+         << std::setw(12) << r.total_ms
+         << "  " << r.from << " -> " << r.to << "\n";
+    }
+    return os.str();
+  }
+
+  /// Recorded spans as Chrome trace-event JSON
+  std::string chrome_trace() const {
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(3);
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool first = true;
+    for (auto& e : events_) {
+      os << (first ? "\n" : ",\n") << "{\"name\":\"" << json_escape(e.name)
+         << "\",\"cat\":\"ideep\",\"ph\":\"X\",\"pid\":0,\"tid\":"
+         << e.tid << ",\"ts\":" << e.ts << ",\"dur\":" << e.dur;
+      if (!e.args.empty())
+        os << ",\"args\":{\"detail\":\"" << json_escape(e.args) << "\"}";
+      os << "}";
+      first = false;
+    }
+    os << "\n],\"otherData\":{\"dropped_events\":" << dropped_events_
+       << "}}\n";
+    return os.str();
+  }
+
+  void save_chrome_trace(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out)
+      throw error(dnnl_invalid_arguments, "could not open the trace file");
+    out << chrome_trace();
+  }
+
+  /// Times one op call. Inactive when the profiler is off or another op is
+  /// already being timed on this thread.
+  class op_scope {
+   public:
+    template <typename F>
+    op_scope(const char* op, F signature) : active_(false) {
+      if (!enabled() || current()) return;
+      active_ = true;
+      record_.op = op;
+      record_.signature = signature();
+      record_.calls = 1;
+      tracing_ = profiler::tracing();
+      current() = this;
+      start_ = clock::now();
+    }
+
+    ~op_scope() {
+      if (!active_) return;
+      record_.total_ms = elapsed_ms(start_);
+      current() = nullptr;
+      if (tracing_) {
+        events_.push_back(
+            span(record_.op, record_.signature, start_, record_.total_ms));
+      }
+      instance().commit(record_, events_);
+    }
+
+    stats& record() { return record_; }
+
+    bool tracing() const { return tracing_; }
+
+    void add_event(trace_event&& e) { events_.push_back(std::move(e)); }
+
+   private:
+    bool active_;
+    bool tracing_;
+    stats record_;
+    std::vector<trace_event> events_;
+    clock::time_point start_;
+  };
+
+  /// Adds the time of the enclosing block to a phase of the current op.
+  /// detail, e.g. the formats of a reorder, is only built when tracing.
+  class phase_scope {
+   public:
+    explicit phase_scope(phase aphase)
+        : op_(current()), phase_(aphase) {
+      if (!op_) return;
+#ifdef IDEEP_ENABLE_PROFILER
+      if (phase_ == execute && counting()) {
+        counting_ = true;
+        before_ = perf_counters::instance().read();
+      }
+#endif
+      start_ = clock::now();
+    }
+
+    template <typename F>
+    phase_scope(phase aphase, F detail) : phase_scope(aphase) {
+      if (op_ && op_->tracing()) detail_ = detail();
+    }
+
+    ~phase_scope() {
+      if (!op_) return;
+      auto ms = elapsed_ms(start_);
+      op_->record().phase_ms[phase_] += ms;
+      if (phase_ == reorder) op_->record().reorders++;
+#ifdef IDEEP_ENABLE_PROFILER
+      if (counting_) {
+        auto delta = perf_counters::instance().read() - before_;
+        for (int c = 0; c < perf_counters::num_counters; c++)
+          op_->record().counters[c] += delta.v[c];
+      }
+#endif
+      if (op_->tracing())
+        op_->add_event(span(phase_name(phase_), detail_, start_, ms));
+    }
+
+   private:
+    op_scope* op_;
+    phase phase_;
+#ifdef IDEEP_ENABLE_PROFILER
+    bool counting_ = false;
+    perf_counters::values before_;
+#endif
+    std::string detail_;
+    clock::time_point start_;
+  };
+
+  static const char* phase_name(phase aphase) {
+    static const char* names[num_phases] = {
+        "primitive_creation", "reorder", "execute"};
+    return names[aphase];
+  }
+
+  /// Names the op argument that reorders in the enclosing block belong to
+  class arg_scope {
+   public:
+    explicit arg_scope(const char* arg) : prev_(current_arg()) {
+      current_arg() = arg;
+    }
+
+    ~arg_scope() { current_arg() = prev_; }
+
+   private:
+    const char* prev_;
+  };
+
+  /// Times and attributes one reorder of src into dst
+  class reorder_scope {
+   public:
+    template <typename T>
+    reorder_scope(const T& src, const T& dst)
+        : record_(make_record(src, dst)),
+          phase_(reorder,
+                 [this]() { return record_.from + " -> " + record_.to; }),
+          start_(clock::now()) {}
+
+    ~reorder_scope() {
+      if (record_.count == 0) return;
+      record_.total_ms = elapsed_ms(start_);
+      instance().commit_reorder(record_);
+    }
+
+   private:
+    template <typename T>
+    static reorder_stats make_record(const T& src, const T& dst) {
+      reorder_stats r;
+      if (!enabled()) return r;
+      auto op = current();
+      r.op = op ? op->record().op : "-";
+      if (current_arg()) {
+        r.arg = current_arg();
+      } else {
+        r.arg = op ? "#" + std::to_string(op->record().reorders) : "-";
+      }
+      r.from = describe(src.get_desc().data);
+      r.to = describe(dst.get_desc().data);
+      r.count = 1;
+      r.bytes = dst.get_desc().get_size();
+      return r;
+    }
+
+    reorder_stats record_;
+    phase_scope phase_;
+    clock::time_point start_;
+  };
+
+  template <typename F>
+  static auto timed(phase aphase, F f) -> decltype(f()) {
+    phase_scope scope(aphase);
+    return f();
+  }
+
+  static void add_bytes(size_t bytes) {
+    if (auto op = current()) op->record().bytes_allocated += bytes;
+  }
+
+  static void add_flops(double flops) {
+    if (auto op = current()) op->record().flops += flops;
+  }
+
+  /// The op being profiled on this thread, "-" outside of one
+  static std::string current_op() {
+    auto op = current();
+    return op ? op->record().op : "-";
+  }
+
+  /// "1x64x56x56:f32:aBcd16b" per tensor, joined by spaces. A template so it
+  /// can take ideep tensors without this header depending on tensor.hpp.
+  template <typename T, typename... Ts>
+  static std::string signature(const T& t, const Ts&... ts) {
+    std::string s = describe(t.get_desc().data);
+    std::string rest = signature(ts...);
+    return rest.empty() ? s : s + " " + rest;
+  }
+
+  /// A list of tensors, e.g. concat inputs or optimizer parameters, is
+  /// described by its first tensor and its length
+  template <typename T, typename... Ts>
+  static std::string signature(const std::vector<T>& v, const Ts&... ts) {
+    std::string s = v.empty() ? "none" : signature(v.front());
+    if (v.size() > 1) s += " x" + std::to_string(v.size());
+    std::string rest = signature(ts...);
+    return rest.empty() ? s : s + " " + rest;
+  }
+
+  static std::string signature() { return {}; }
+
+  /// DNNL-style format tag of a memory desc, e.g. "abcd" or "aBcd16b"
+  static std::string describe(const dnnl_memory_desc_t& md) {
+    if (md.ndims == 0) return "none";
+    std::ostringstream os;
+    for (int d = 0; d < md.ndims; d++) os << (d ? "x" : "") << md.dims[d];
+    os << ":" << dnnl_dt2str(md.data_type) << ":";
+    if (md.format_kind != dnnl_blocked) {
+      os << dnnl_fmt_kind2str(md.format_kind);
+      return os.str();
+    }
+    const auto& blk = md.format_desc.blocking;
+    std::vector<int> order(md.ndims);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+      return blk.strides[a] > blk.strides[b];
+    });
+    std::vector<bool> blocked(md.ndims, false);
+    for (int k = 0; k < blk.inner_nblks; k++) blocked[blk.inner_idxs[k]] = true;
+    for (auto d : order) os << static_cast<char>((blocked[d] ? 'A' : 'a') + d);
+    for (int k = 0; k < blk.inner_nblks; k++)
+      os << blk.inner_blks[k] << static_cast<char>('a' + blk.inner_idxs[k]);
+    return os.str();
+  }
+
+ private:
+  profiler() : epoch_(clock::now()) {
+    auto env = std::getenv("IDEEP_PROFILE");
+    enabled_ = env && std::atoi(env) != 0;
+    auto log = std::getenv("IDEEP_PROFILE_REORDER_LOG");
+    reorder_log_ = log && std::atoi(log) != 0;
+    if (reorder_log_) enabled_ = true;
+    auto counters = std::getenv("IDEEP_PROFILE_COUNTERS");
+    counting_ = counters && std::atoi(counters) != 0;
+    if (counting_) enabled_ = true;
+    auto trace = std::getenv("IDEEP_PROFILE_TRACE");
+    tracing_ = trace && *trace;
+    if (tracing_) {
+      trace_path_ = trace;
+      enabled_ = true;
+    }
+  }
+
+  ~profiler() {
+    if (trace_path_.empty()) return;
+    try {
+      save_chrome_trace(trace_path_);
+    } catch (...) {
+      // nothing sensible to do at exit
+    }
+  }
+
+  // Small per-thread ids keep the trace viewer's rows readable
+  static int thread_id() {
+    static std::atomic<int> next {0};
+    static thread_local int id = next++;
+    return id;
+  }
+
+  static trace_event span(const std::string& name, const std::string& args,
+                          clock::time_point start, double dur_ms) {
+    auto ts = std::chrono::duration<double, std::micro>(
+        start - instance().epoch_).count();
+    return {name, args, thread_id(), ts, dur_ms * 1e3};
+  }
+
+  static std::string json_escape(const std::string& str) {
+    std::string out;
+    for (auto c : str) {
+      if (c == '"' || c == '\\') out += '\\';
+      out += c;
+    }
+    return out;
+  }
+
+#ifdef IDEEP_ENABLE_PROFILER
+  // IPC, LLC misses per KFLOP and stalled share of cycles, "-" for what the
+  // counters could not measure
+  static void counter_columns(std::ostream& os, const stats& s) {
+    auto& pc = perf_counters::instance();
+    auto cyc = s.counters[perf_counters::cycles];
+    auto column = [&](int width, bool valid, double v) {
+      if (valid) {
+        os << std::setw(width) << v;
+      } else {
+        os << std::setw(width) << "-";
+      }
+    };
+    bool has_cycles = pc.available(perf_counters::cycles) && cyc > 0.;
+    column(8, has_cycles && pc.available(perf_counters::instructions),
+           s.counters[perf_counters::instructions] / cyc);
+    column(14, pc.available(perf_counters::llc_misses) && s.flops > 0.,
+           s.counters[perf_counters::llc_misses] / s.flops * 1e3);
+    column(8, has_cycles &&
+                  pc.available(perf_counters::stalled_cycles_backend),
+           s.counters[perf_counters::stalled_cycles_backend] / cyc * 100.);
+  }
+#endif
+
+  static double elapsed_ms(clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(clock::now() - start)
+        .count();
+  }
+
+  static op_scope*& current() {
+    static thread_local op_scope* op = nullptr;
+    return op;
+  }
+
+  static const char*& current_arg() {
+    static thread_local const char* arg = nullptr;
+    return arg;
+  }
+
+  void commit_reorder(const reorder_stats& r) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& s = reorder_stats_[r.op + "|" + r.arg + "|" + r.from + "|" + r.to];
+    if (s.count == 0) {
+      s.op = r.op;
+      s.arg = r.arg;
+      s.from = r.from;
+      s.to = r.to;
+    }
+    s.count += r.count;
+    s.bytes += r.bytes;
+    s.total_ms += r.total_ms;
+    if (reorder_log_.load(std::memory_order_relaxed)) {
+      std::cerr << "ideep reorder: " << r.op << "/" << r.arg << " " << r.from
+                << " -> " << r.to << " " << r.bytes << " bytes "
+                << r.total_ms << " ms\n";
+    }
+  }
+
+  void commit(const stats& r, std::vector<trace_event>& events) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& e : events) {
+      if (events_.size() < max_trace_events) {
+        events_.push_back(std::move(e));
+      } else {
+        dropped_events_++;
+      }
+    }
+    auto& s = stats_[r.op + "|" + r.signature];
+    if (s.calls == 0) {
+      s.op = r.op;
+      s.signature = r.signature;
+    }
+    s.calls += r.calls;
+    s.total_ms += r.total_ms;
+    for (int p = 0; p < num_phases; p++) s.phase_ms[p] += r.phase_ms[p];
+    s.reorders += r.reorders;
+    s.bytes_allocated += r.bytes_allocated;
+    s.flops += r.flops;
+#ifdef IDEEP_ENABLE_PROFILER
+    for (int c = 0; c < perf_counters::num_counters; c++)
+      s.counters[c] += r.counters[c];
+#endif
+  }
+
+  std::atomic<bool> enabled_;
+  std::atomic<bool> tracing_;
+  std::atomic<bool> reorder_log_;
+  std::atomic<bool> counting_;
+  std::string trace_path_;
+  clock::time_point epoch_;
+  mutable std::mutex mutex_;
+  std::map<std::string, stats> stats_;
+  std::map<std::string, reorder_stats> reorder_stats_;
+  std::vector<trace_event> events_;
+  int64_t dropped_events_ = 0;
+};
+
+}  // namespace utils
+}  // namespace ideep
+
+#define IDEEP_PROFILE_CONCAT_IMPL(a, b) a##b
+#define IDEEP_PROFILE_CONCAT(a, b) IDEEP_PROFILE_CONCAT_IMPL(a, b)
+
+#ifdef IDEEP_ENABLE_PROFILER
+// Times the rest of the enclosing op; the arguments are the tensors that make
+// up its signature
+#define IDEEP_PROFILE_OP(name, ...)                                 \
+  ideep::utils::profiler::op_scope IDEEP_PROFILE_CONCAT(            \
+      ideep_profile_op_, __LINE__)(name, [&]() {                    \
+    return ideep::utils::profiler::signature(__VA_ARGS__);          \
+  })
+// Times the rest of the enclosing block as a phase of the current op
+#define IDEEP_PROFILE_PHASE(aphase)                                 \
+  ideep::utils::profiler::phase_scope IDEEP_PROFILE_CONCAT(         \
+      ideep_profile_phase_, __LINE__)(ideep::utils::profiler::aphase)
+// Times the rest of the enclosing block as a reorder of src into dst
+#define IDEEP_PROFILE_REORDER(src, dst)                             \
+  ideep::utils::profiler::reorder_scope IDEEP_PROFILE_CONCAT(       \
+      ideep_profile_reorder_, __LINE__)(src, dst)
+// Attributes reorders in the rest of the enclosing block to an argument
+#define IDEEP_PROFILE_ARG(arg)                                      \
+  ideep::utils::profiler::arg_scope IDEEP_PROFILE_CONCAT(           \
+      ideep_profile_arg_, __LINE__)(arg)
+// Evaluates an expression as a phase of the current op
+#define IDEEP_PROFILE_TIMED(aphase, ...)                            \
+  ideep::utils::profiler::timed(ideep::utils::profiler::aphase,     \
+                                [&]() { return __VA_ARGS__; })
+#define IDEEP_PROFILE_FLOPS(flops) \
+  ideep::utils::profiler::add_flops(flops)
+#define IDEEP_PROFILE_BYTES(bytes) \
+  ideep::utils::profiler::add_bytes(bytes)
+#else
+#define IDEEP_PROFILE_OP(name, ...)
+#define IDEEP_PROFILE_PHASE(aphase)
+#define IDEEP_PROFILE_REORDER(src, dst)
+#define IDEEP_PROFILE_ARG(arg)
+#define IDEEP_PROFILE_TIMED(aphase, ...) (__VA_ARGS__)
+#define IDEEP_PROFILE_FLOPS(flops)
+#define IDEEP_PROFILE_BYTES(bytes)
+#endif
+
+#endif
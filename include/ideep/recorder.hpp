@@ -0,0 +1,474 @@
+#ifndef IDEEP_RECORDER_HPP
+#define IDEEP_RECORDER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "tensor.hpp"
+
+namespace ideep {
+namespace utils {
+
+/// Records op calls (the op, and every dim, stride, format, data type,
+/// scale, attr and scalar argument, but no tensor data) to a compact binary
+/// file that benchmark::replay re-runs on synthetic data.
+///
+/// Compiled in with IDEEP_ENABLE_PROFILER, like the profiler, and started
+/// with recorder::instance().start(path) or IDEEP_RECORD=<path>. Calls made
+/// from within another recorded op are not recorded on their own.
+///
+/// The file is "IDEEPREC", a u32 version, then one record per call: a u8
+/// op id, a u32 payload size and the arguments in the order the op passes
+/// them to IDEEP_RECORD. A tensor is its dims, data type, format and groups
+/// (blocked formats keep their strides and inner blocks) and its scales.
+/// utils::manifest writes files of the same layout.
+///
+/// Forward and training calls are recorded, prepare + compute(param, ...)
+/// pairs included, except for spliter, direct_copy and layer norm with a
+/// pre-packed scale_shift.
+/// embedding_bag, its backward and softmax_cross_entropy keep the number of
+/// indices, bags or labels, not their values. The optimizers keep the
+/// weights and grads; their states are created again by the replay.
+class recorder {
+ public:
+  enum op_id : uint8_t {
+    convolution_forward = 1,
+    convolution_forward_prepare = 2,
+    convolution_forward_param = 3,
+    inner_product_forward = 4,
+    matmul_forward = 5,
+    pooling_forward = 6,
+    eltwise_forward = 7,
+    batch_normalization_forward_inference = 8,
+    softmax_forward = 9,
+    binary = 10,
+    sum = 11,
+    concat = 12,
+    // primitive creations kept by utils::manifest
+    convolution_forward_primitive = 13,
+    inner_product_forward_primitive = 14,
+    matmul_forward_primitive = 15,
+    convolution_transpose_forward = 16,
+    lrn_forward = 17,
+    layer_normalization_forward = 18,
+    channel_shuffle_forward = 19,
+    prelu_forward = 20,
+    reduction = 21,
+    resampling_forward = 22,
+    group_normalization_forward = 23,
+    adaptive_pooling_forward = 24,
+    log_softmax_forward = 25,
+    embedding_bag = 26,
+    lstm_forward = 27,
+    gru_forward = 28,
+    rnn_forward = 29,
+    matmul_forward_prepare = 30,
+    matmul_forward_param = 31,
+    inner_product_forward_prepare = 32,
+    inner_product_forward_param = 33,
+    // training
+    convolution_backward_data = 34,
+    convolution_backward_weights = 35,
+    convolution_transpose_backward_data = 36,
+    convolution_transpose_backward_weights = 37,
+    inner_product_backward_data = 38,
+    inner_product_backward_weights = 39,
+    pooling_backward = 40,
+    eltwise_backward = 41,
+    softmax_backward = 42,
+    log_softmax_backward = 43,
+    batch_normalization_forward_training = 44,
+    batch_normalization_backward = 45,
+    layer_normalization_backward = 46,
+    lrn_backward = 47,
+    channel_shuffle_backward = 48,
+    prelu_backward = 49,
+    group_normalization_backward = 50,
+    adaptive_pooling_backward = 51,
+    resampling_backward = 52,
+    embedding_bag_backward = 53,
+    lstm_backward = 54,
+    gru_backward = 55,
+    rnn_backward = 56,
+    dropout_forward = 57,
+    dropout_backward = 58,
+    sgd_update = 59,
+    adam_update = 60,
+    lamb_update = 61,
+    layer_normalization_forward_training = 62,
+    group_normalization_forward_training = 63,
+    softmax_cross_entropy = 64,
+    rnn_forward_prepare = 65,
+    rnn_forward_param = 66,
+  };
+
+  static constexpr uint32_t version = 2;
+
+  static recorder& instance() {
+    static recorder r;
+    return r;
+  }
+
+  static bool active() {
+    return instance().active_.load(std::memory_order_relaxed);
+  }
+
+  void start(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    out_.reset(new std::ofstream(path, std::ios::binary));
+    if (!*out_) {
+      out_.reset();
+      throw error(dnnl_invalid_arguments, "could not open the record file");
+    }
+    write_header(*out_);
+    active_.store(true);
+  }
+
+  void stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    active_.store(false);
+    out_.reset();
+  }
+
+  static void write_header(std::ostream& out) {
+    uint32_t file_version = version;
+    out.write("IDEEPREC", 8);
+    out.write(reinterpret_cast<const char*>(&file_version),
+              sizeof(file_version));
+  }
+
+  static void write_record(std::ostream& out, op_id op,
+                           const std::string& payload) {
+    uint8_t id = op;
+    uint32_t size = payload.size();
+    out.write(reinterpret_cast<const char*>(&id), sizeof(id));
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    out.write(payload.data(), size);
+  }
+
+  /// Serialized arguments of one call
+  class writer {
+   public:
+    void put(const tensor& t) {
+      put(t.get_desc());
+      put(t.has_scale() ? t.get_scale() : scale_t());
+    }
+
+    void put(const tensor::desc& desc) {
+      const auto& md = desc.data;
+      pod<uint8_t>(md.ndims);
+      for (int d = 0; d < md.ndims; d++) pod<int64_t>(md.dims[d]);
+      pod<uint8_t>(md.data_type);
+      pod<uint8_t>(md.format_kind);
+      if (md.format_kind == dnnl_blocked) {
+        const auto& blk = md.format_desc.blocking;
+        for (int d = 0; d < md.ndims; d++) pod<int64_t>(blk.strides[d]);
+        pod<uint8_t>(blk.inner_nblks);
+        for (int k = 0; k < blk.inner_nblks; k++) {
+          pod<int64_t>(blk.inner_blks[k]);
+          pod<uint8_t>(blk.inner_idxs[k]);
+        }
+      }
+      pod<int64_t>(desc.g());
+    }
+
+    void put(const std::vector<tensor>& ts) {
+      pod<uint32_t>(ts.size());
+      for (auto& t : ts) put(t);
+    }
+
+    void put(const dims& adims) {
+      pod<uint8_t>(adims.size());
+      for (auto d : adims) pod<int64_t>(d);
+    }
+
+    void put(const scale_t& scales) {
+      pod<uint32_t>(scales.size());
+      for (auto s : scales) pod<float>(s);
+    }
+
+    void put(const attr_t& attr) {
+      auto scales = attr.get_output_scales();
+      pod<int32_t>(scales.second);
+      put(scales.first);
+      auto po = attr.get_post_ops();
+      pod<uint8_t>(po.len());
+      for (int i = 0; i < po.len(); i++) {
+        kind akind;
+        float scale, alpha, beta;
+        algorithm alg;
+        std::tie(akind, scale, alpha, beta, alg) = attr.get_params(i);
+        pod<int32_t>(static_cast<int32_t>(akind));
+        pod<float>(scale);
+        if (akind == kind::eltwise) {
+          pod<int32_t>(static_cast<int32_t>(alg));
+          pod<float>(alpha);
+          pod<float>(beta);
+        }
+      }
+      put(attr.get_prelu_weights());
+      for (auto arg : {DNNL_ARG_SRC, DNNL_ARG_WEIGHTS, DNNL_ARG_DST}) {
+        int mask;
+        std::vector<int32_t> zero_points;
+        attr.get_zero_points(arg, mask, zero_points);
+        pod<int32_t>(mask);
+        pod<uint32_t>(zero_points.size());
+        for (auto zp : zero_points) pod<int32_t>(zp);
+      }
+    }
+
+    void put(int32_t v) { pod(v); }
+    void put(int64_t v) { pod(v); }
+    void put(float v) { pod(v); }
+    void put(bool v) { pod<uint8_t>(v); }
+    void put(algorithm v) { pod<int32_t>(static_cast<int32_t>(v)); }
+    void put(prop_kind v) { pod<int32_t>(static_cast<int32_t>(v)); }
+    void put(lowp_kind v) { pod<int32_t>(v); }
+    void put(rnn_kind v) { pod<int32_t>(v); }
+    void put(reduction_kind v) { pod<int32_t>(v); }
+    void put(resampling_kind v) { pod<int32_t>(v); }
+    void put(dnnl_rnn_direction_t v) { pod<int32_t>(v); }
+    void put(const void* v) { pod<uint64_t>(reinterpret_cast<uintptr_t>(v)); }
+
+    void put_all() {}
+
+    template <typename T, typename... Ts>
+    void put_all(const T& arg, const Ts&... args) {
+      put(arg);
+      put_all(args...);
+    }
+
+    const std::string& bytes() const { return buf_; }
+
+   private:
+    template <typename T>
+    void pod(T v) {
+      buf_.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    std::string buf_;
+  };
+
+  template <typename... Ts>
+  void record(op_id op, const Ts&... args) {
+    writer w;
+    w.put_all(args...);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (out_) write_record(*out_, op, w.bytes());
+  }
+
+  /// Records the op it is created in unless another one is being recorded
+  /// on this thread
+  class scope {
+   public:
+    template <typename... Ts>
+    scope(op_id op, const Ts&... args) : armed_(active()) {
+      if (!armed_) return;
+      if (depth()++ == 0) instance().record(op, args...);
+    }
+
+    ~scope() {
+      if (armed_) depth()--;
+    }
+
+   private:
+    static int& depth() {
+      static thread_local int d = 0;
+      return d;
+    }
+
+    bool armed_;
+  };
+
+  /// A recorded tensor: its desc and scales
+  struct tensor_spec {
+    tensor::desc desc;
+    scale_t scale;
+
+    bool empty() const { return desc.data.ndims == 0; }
+  };
+
+  /// Reads records back in the order they were written
+  class reader {
+   public:
+    explicit reader(const std::string& path)
+        : in_(path, std::ios::binary) {
+      char magic[8];
+      uint32_t file_version = 0;
+      in_.read(magic, sizeof(magic));
+      in_.read(reinterpret_cast<char*>(&file_version), sizeof(file_version));
+      if (!in_ || std::memcmp(magic, "IDEEPREC", 8) != 0 ||
+          file_version != version)
+        throw error(dnnl_invalid_arguments, "not an ideep record file");
+    }
+
+    /// Moves to the next record; false at the end of the file
+    bool next(op_id& op) {
+      if (in_.tellg() < end_) in_.seekg(end_);
+      uint8_t id;
+      if (!in_.read(reinterpret_cast<char*>(&id), sizeof(id))) return false;
+      auto size = pod<uint32_t>();
+      end_ = in_.tellg() + static_cast<std::streamoff>(size);
+      op = static_cast<op_id>(id);
+      return true;
+    }
+
+    tensor_spec get_tensor() {
+      tensor_spec spec;
+      spec.desc = get_desc();
+      spec.scale = get_scales();
+      return spec;
+    }
+
+    tensor::desc get_desc() {
+      dnnl_memory_desc_t md;
+      std::memset(&md, 0, sizeof(md));
+      md.ndims = pod<uint8_t>();
+      for (int d = 0; d < md.ndims; d++) md.dims[d] = pod<int64_t>();
+      md.data_type = static_cast<dnnl_data_type_t>(pod<uint8_t>());
+      auto format_kind = static_cast<dnnl_format_kind_t>(pod<uint8_t>());
+      bool blocked = format_kind == dnnl_blocked;
+      if (blocked) {
+        md.format_kind = dnnl_blocked;
+        auto& blk = md.format_desc.blocking;
+        for (int d = 0; d < md.ndims; d++) blk.strides[d] = pod<int64_t>();
+        blk.inner_nblks = pod<uint8_t>();
+        for (int d = 0; d < md.ndims; d++) md.padded_dims[d] = 1;
+        for (int k = 0; k < blk.inner_nblks; k++) {
+          blk.inner_blks[k] = pod<int64_t>();
+          blk.inner_idxs[k] = pod<uint8_t>();
+          md.padded_dims[blk.inner_idxs[k]] *= blk.inner_blks[k];
+        }
+        // dims are padded up to a multiple of their blocks
+        for (int d = 0; d < md.ndims; d++) {
+          auto b = md.padded_dims[d];
+          md.padded_dims[d] = (md.dims[d] + b - 1) / b * b;
+        }
+      }
+      auto groups = pod<int64_t>();
+      if (md.ndims == 0) return tensor::desc();
+      if (blocked) return tensor::desc(memory::desc(md), groups);
+      dims adims(md.dims, md.dims + md.ndims);
+      auto dt = static_cast<data_type>(md.data_type);
+      if (format_kind == dnnl_format_kind_any)
+        return tensor::desc(adims, dt, format_tag::any);
+      // opaque formats (e.g. Winograd weights) fall back to the default
+      return tensor::desc(adims, dt);
+    }
+
+    std::vector<tensor_spec> get_tensors() {
+      std::vector<tensor_spec> specs(pod<uint32_t>());
+      for (auto& s : specs) s = get_tensor();
+      return specs;
+    }
+
+    dims get_dims() {
+      dims adims(pod<uint8_t>());
+      for (auto& d : adims) d = pod<int64_t>();
+      return adims;
+    }
+
+    scale_t get_scales() {
+      scale_t scales(pod<uint32_t>());
+      for (auto& s : scales) s = pod<float>();
+      return scales;
+    }
+
+    attr_t get_attr() {
+      auto mask = pod<int32_t>();
+      auto scales = get_scales();
+      post_ops po;
+      auto len = pod<uint8_t>();
+      for (int i = 0; i < len; i++) {
+        auto akind = static_cast<kind>(pod<int32_t>());
+        auto scale = pod<float>();
+        if (akind == kind::eltwise) {
+          auto alg = static_cast<algorithm>(pod<int32_t>());
+          auto alpha = pod<float>();
+          auto beta = pod<float>();
+          po.append_eltwise(scale, alg, alpha, beta);
+        } else {
+          po.append_sum(scale);
+        }
+      }
+      auto prelu_weights = get_scales();
+      attr_t attr = prelu_weights.empty() ? attr_t()
+                                          : attr_t::fuse_prelu(prelu_weights);
+      if (len > 0) attr.set_post_ops(po);
+      attr.set_output_scales(mask, scales);
+      for (auto arg : {DNNL_ARG_SRC, DNNL_ARG_WEIGHTS, DNNL_ARG_DST}) {
+        auto zp_mask = pod<int32_t>();
+        std::vector<int32_t> zero_points(pod<uint32_t>());
+        for (auto& zp : zero_points) zp = pod<int32_t>();
+        // setting the default would mark the attr as non-default
+        bool is_default = zp_mask == 0 && zero_points.size() == 1 &&
+                          zero_points[0] == 0;
+        if (!is_default) attr.set_zero_points(arg, zp_mask, zero_points);
+      }
+      return attr;
+    }
+
+    int32_t get_int() { return pod<int32_t>(); }
+    int64_t get_dim() { return pod<int64_t>(); }
+    float get_float() { return pod<float>(); }
+    bool get_bool() { return pod<uint8_t>() != 0; }
+    algorithm get_algorithm() { return static_cast<algorithm>(pod<int32_t>()); }
+    prop_kind get_prop_kind() { return static_cast<prop_kind>(pod<int32_t>()); }
+    lowp_kind get_lowp_kind() { return static_cast<lowp_kind>(pod<int32_t>()); }
+    rnn_kind get_rnn_kind() { return static_cast<rnn_kind>(pod<int32_t>()); }
+    reduction_kind get_reduction_kind() {
+      return static_cast<reduction_kind>(pod<int32_t>());
+    }
+    resampling_kind get_resampling_kind() {
+      return static_cast<resampling_kind>(pod<int32_t>());
+    }
+    dnnl_rnn_direction_t get_direction() {
+      return static_cast<dnnl_rnn_direction_t>(pod<int32_t>());
+    }
+    uint64_t get_handle() { return pod<uint64_t>(); }
+
+   private:
+    template <typename T>
+    T pod() {
+      T v;
+      if (!in_.read(reinterpret_cast<char*>(&v), sizeof(T)))
+        throw error(dnnl_invalid_arguments, "truncated record file");
+      return v;
+    }
+
+    std::ifstream in_;
+    // where the current record ends, so unread or unknown ones are skipped
+    std::streampos end_ = 0;
+  };
+
+ private:
+  recorder() : active_(false) {
+    auto path = std::getenv("IDEEP_RECORD");
+    if (path && *path) start(path);
+  }
+
+  std::atomic<bool> active_;
+  std::mutex mutex_;
+  std::unique_ptr<std::ofstream> out_;
+};
+
+}  // namespace utils
+}  // namespace ideep
+
+#ifdef IDEEP_ENABLE_PROFILER
+// Records the enclosing op call with its arguments, see utils::recorder
+#define IDEEP_RECORD(op, ...)                                       \
+  ideep::utils::recorder::scope IDEEP_PROFILE_CONCAT(               \
+      ideep_record_, __LINE__)(ideep::utils::recorder::op, __VA_ARGS__)
+#else
+#define IDEEP_RECORD(op, ...)
+#endif
+
+#endif
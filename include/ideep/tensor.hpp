@@ -3,6 +3,8 @@
 
 #include "attributes.hpp"
 #include "utils.hpp"
+#include "memory_tracker.hpp"
+#include "profiler.hpp"
 
 namespace ideep {
 
@@ -467,7 +469,11 @@ class tensor : public memory {
 
   /// Function that refill tensor with new description or buffer
   void init(const desc &adesc, const engine &aengine = engine::cpu_engine()) {
-    buffer_.reset(aengine.malloc(adesc.get_size()), aengine.free);
+    auto size = adesc.get_size();
+    IDEEP_PROFILE_BYTES(size);
+    auto ptr = aengine.malloc(size);
+    buffer_.reset(ptr,
+                  IDEEP_PROFILE_TRACK(ptr, size, adesc.data, aengine.free));
     scale_.reset();
     zero_point_.reset();
     eng_ = aengine;
@@ -588,6 +594,12 @@ class tensor : public memory {
     return get_desc().is_zero() && get_data_handle() == nullptr;
   }
 
+  /// Returns the descriptor, or a zero one for an empty tensor such as an
+  /// optional argument left out
+  inline desc get_desc_or_zero() const {
+    return is_empty() ? desc() : get_desc();
+  }
+
   // "public format" has the same semantic as DNNL's "plain format"
   inline bool is_public_format() const {
     return get_desc().is_plain();
@@ -689,6 +701,7 @@ class tensor : public memory {
       // so we first make sure current tensor is already the default format.
       // Specifically, the format does not matter if the actual rank <= 1
       if (!get_desc().is_default() && actual_rank(old_dims) > 1) {
+        IDEEP_PROFILE_ARG("tensor::reshape");
         to_default_format();
       }
       // set desc with default format
@@ -711,11 +724,13 @@ class tensor : public memory {
   }
 
   inline void reorder_from(const tensor &src) {
+    IDEEP_PROFILE_REORDER(src, *this);
     dnnl::reorder(src, *this)
         .execute(stream::default_stream(), const_cast<tensor &>(src), *this);
   }
 
   inline void reorder_to(tensor &dst, const attr_t &aattr = attr_t()) const {
+    IDEEP_PROFILE_REORDER(*this, dst);
     auto pd = dnnl::reorder::primitive_desc(*this, dst, aattr);
     dnnl::reorder(pd)
         .execute(stream::default_stream(), const_cast<tensor &>(*this), dst);
@@ -724,6 +739,7 @@ class tensor : public memory {
   /// Convert the tensor to public format, and f32 data type by default
   tensor to_public(void *buffer = nullptr,
                    data_type dst_type = data_type::f32) const {
+    IDEEP_PROFILE_ARG("tensor::to_public");
     auto dst_desc = get_desc();
 
     // If we get a non-plain blocking format, say `Acdb16A`, we may not be able 
@@ -761,6 +777,7 @@ class tensor : public memory {
   /// Fill the tensor with a src tensor
   /// TODO(xpz): may replace is_deconv_weights with a enum for other purposes
   void feed_from(const tensor &src, bool is_deconv_weights = false) {
+    IDEEP_PROFILE_ARG("tensor::feed_from");
   	scale_t dst_scale, src_scale;
     if (has_scale() && src.has_scale()) {
       dst_scale = get_scale();
@@ -833,7 +850,8 @@ class tensor : public memory {
   }
 
   void init_workspace(const desc &desc) {
-    auto workspace = new tensor(desc, get_engine());
+    auto workspace =
+        IDEEP_PROFILE_USAGE(workspace, new tensor(desc, get_engine()));
     workspace_.reset(workspace);
   }
 
@@ -874,6 +892,7 @@ class tensor : public memory {
   tensor permute(const std::vector<int> &permute_axes = {}) const {
     auto src_mask = *this;
     src_mask.permute_(permute_axes);
+    IDEEP_PROFILE_ARG("tensor::permute");
     auto dst = tensor(src_mask.get_desc().to_default_format());
     src_mask.reorder_to(dst);
     return dst;
@@ -886,6 +905,7 @@ class tensor : public memory {
   tensor transpose(dim dim0, dim dim1) const {
     auto src_mask = *this;
     src_mask.transpose_(dim0, dim1);
+    IDEEP_PROFILE_ARG("tensor::transpose");
     auto dst = tensor(src_mask.get_desc().to_default_format());
     src_mask.reorder_to(dst);
     return dst;
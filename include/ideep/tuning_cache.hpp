@@ -0,0 +1,139 @@
+#ifndef IDEEP_TUNING_CACHE_HPP
+#define IDEEP_TUNING_CACHE_HPP
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+#include "utils.hpp"
+
+namespace ideep {
+namespace utils {
+
+/// Which convolution algorithm and implementation measured fastest, per
+/// shape, on this machine.
+///
+/// Switched on with tuning_cache::instance().enable(path) or
+/// IDEEP_CONV_TUNING=<path>. Convolutions asked for
+/// algorithm::convolution_auto then time every candidate the first time a
+/// shape is seen, instead of leaving the choice to DNNL's heuristic, and
+/// keep the winner here. Decisions are loaded from the file when enabled
+/// and appended to it as they are made, so later runs reuse them.
+///
+/// Keys start with machine(), the ISA and OpenMP thread count, so one file
+/// can be shared by hosts that differ in either.
+class tuning_cache {
+ public:
+  struct choice {
+    algorithm aalgorithm;
+    // impl_info_str() of the primitive_desc, e.g. "jit:avx512_common"
+    std::string impl;
+  };
+
+  static tuning_cache& instance() {
+    static tuning_cache c;
+    return c;
+  }
+
+  static bool enabled() {
+    return instance().enabled_.load(std::memory_order_relaxed);
+  }
+
+  /// Loads the decisions saved in path, if any, and appends new ones to it
+  void enable(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+      // key, algorithm and implementation, tab separated
+      auto t1 = line.find('\t');
+      auto t2 = t1 == std::string::npos ? t1 : line.find('\t', t1 + 1);
+      if (t2 == std::string::npos) continue;
+      auto alg = std::atoi(line.substr(t1 + 1, t2 - t1 - 1).c_str());
+      choices_[line.substr(0, t1)] = {static_cast<algorithm>(alg),
+                                      line.substr(t2 + 1)};
+    }
+    enabled_.store(true);
+  }
+
+  void disable() { enabled_.store(false); }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return choices_.size();
+  }
+
+  /// The decision stored for key on this machine, or the result of tune()
+  /// which is stored and saved. tune() runs without the lock held, so a
+  /// shape first seen by two threads at once may be timed twice.
+  template <typename F>
+  choice fetch_or_tune(const key_t& key, F tune) {
+    auto full_key = machine() + "|" + key;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = choices_.find(full_key);
+      if (it != choices_.end()) return it->second;
+    }
+    choice c = tune();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (choices_.insert({full_key, c}).second && !path_.empty()) {
+      std::ofstream out(path_, std::ios::app);
+      out << full_key << '\t' << static_cast<int>(c.aalgorithm) << '\t'
+          << c.impl << '\n';
+    }
+    return c;
+  }
+
+  /// The widest ISA of the CPU and the OpenMP thread count, e.g.
+  /// "avx512_core_vnni/28t"
+  static std::string machine() {
+    std::ostringstream os;
+    os << isa() << "/" << omp_get_max_threads() << "t";
+    return os.str();
+  }
+
+ private:
+  tuning_cache() : enabled_(false) {
+    auto path = std::getenv("IDEEP_CONV_TUNING");
+    if (path && *path) enable(path);
+  }
+
+  static const char* isa() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    unsigned eax, ebx, ecx, edx;
+    if (__get_cpuid_count(7, 1, &eax, &ebx, &ecx, &edx) && (eax >> 5 & 1))
+      return "avx512_core_bf16";
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+      // avx512f, avx512dq, avx512bw and avx512vl make avx512_core
+      auto core = (ebx >> 16 & 1) && (ebx >> 17 & 1) && (ebx >> 30 & 1) &&
+                  (ebx >> 31 & 1);
+      if (core && (ecx >> 11 & 1)) return "avx512_core_vnni";
+      if (core) return "avx512_core";
+      if (ebx >> 16 & 1) return "avx512_common";
+      if (ebx >> 5 & 1) return "avx2";
+    }
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+      if (ecx >> 28 & 1) return "avx";
+      if (ecx >> 19 & 1) return "sse41";
+    }
+#endif
+    return "any";
+  }
+
+  std::atomic<bool> enabled_;
+  mutable std::mutex mutex_;
+  std::string path_;
+  std::map<key_t, choice> choices_;
+};
+
+}  // namespace utils
+}  // namespace ideep
+
+#endif
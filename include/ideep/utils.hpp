@@ -6,12 +6,15 @@
 #include <memory>
 #include <algorithm>
 #include <climits>
+#include <cmath>
+#include <limits>
 #include <random>
 #include <numeric>
 #include <atomic>
 #include <chrono>
 #include <vector>
 #include <iterator>
+#include <type_traits>
 #ifdef IDEEP_USE_MKL
 #include <mkl_vsl.h>
 #include <mkl_vml_functions.h>
@@ -30,9 +33,98 @@
 namespace ideep {
 namespace utils {
 
+// Philox4x32-10 counter-based generator (Salmon et al., SC'11). Every
+// 4-element block of random numbers is a pure function of (seed, offset,
+// block index), so any thread can produce any part of the stream and the
+// result does not depend on how work is partitioned.
+constexpr uint32_t philox_m0 = 0xD2511F53;
+constexpr uint32_t philox_m1 = 0xCD9E8D57;
+constexpr uint32_t philox_w0 = 0x9E3779B9;
+constexpr uint32_t philox_w1 = 0xBB67AE85;
+
+/// Returns a 32-bit Bernoulli mask for elements [32 * word, 32 * word + 32).
+/// Bit j is set with probability threshold / 2^32. The eight Philox blocks
+/// of a word are computed lane-parallel so the rounds vectorize.
+inline uint32_t philox_bernoulli_word(uint64_t seed, uint64_t offset,
+                                      uint64_t word, uint64_t threshold) {
+  constexpr int lanes = 8;
+  uint32_t c0[lanes], c1[lanes], c2[lanes], c3[lanes];
+  for (int l = 0; l < lanes; ++l) {
+    uint64_t block = word * lanes + l;
+    c0[l] = static_cast<uint32_t>(block);
+    c1[l] = static_cast<uint32_t>(block >> 32);
+    c2[l] = static_cast<uint32_t>(offset);
+    c3[l] = static_cast<uint32_t>(offset >> 32);
+  }
+
+  uint32_t k0 = static_cast<uint32_t>(seed);
+  uint32_t k1 = static_cast<uint32_t>(seed >> 32);
+  for (int round = 0; round < 10; ++round) {
+#if defined(_OPENMP) && (_OPENMP >= 201307)
+#pragma omp simd
+#endif
+    for (int l = 0; l < lanes; ++l) {
+      uint64_t p0 = static_cast<uint64_t>(philox_m0) * c0[l];
+      uint64_t p1 = static_cast<uint64_t>(philox_m1) * c2[l];
+      uint32_t r0 = static_cast<uint32_t>(p1 >> 32) ^ c1[l] ^ k0;
+      uint32_t r2 = static_cast<uint32_t>(p0 >> 32) ^ c3[l] ^ k1;
+      c1[l] = static_cast<uint32_t>(p1);
+      c3[l] = static_cast<uint32_t>(p0);
+      c0[l] = r0;
+      c2[l] = r2;
+    }
+    k0 += philox_w0;
+    k1 += philox_w1;
+  }
+
+  uint32_t bits = 0;
+  for (int l = 0; l < lanes; ++l) {
+    bits |= static_cast<uint32_t>(c0[l] < threshold) << (4 * l);
+    bits |= static_cast<uint32_t>(c1[l] < threshold) << (4 * l + 1);
+    bits |= static_cast<uint32_t>(c2[l] < threshold) << (4 * l + 2);
+    bits |= static_cast<uint32_t>(c3[l] < threshold) << (4 * l + 3);
+  }
+  return bits;
+}
+
+/// Threshold for philox_bernoulli_word keeping elements with probability p
+inline uint64_t philox_threshold(double p) {
+  p = std::min(std::max(p, 0.0), 1.0);
+  return static_cast<uint64_t>(p * 4294967296.0);
+}
+
+/// Process-wide seed, drawn once from std::random_device
+inline uint64_t philox_default_seed() {
+  static const uint64_t seed = [] {
+    std::random_device rd;
+    return (static_cast<uint64_t>(rd()) << 32) | rd();
+  }();
+  return seed;
+}
+
+/// Hands out a fresh Philox offset per call so that successive calls using
+/// the default seed draw independent streams
+inline uint64_t philox_next_offset() {
+  static std::atomic<uint64_t> offset {0};
+  return offset++;
+}
+
 static void bernoulli_generate(const long n, const double p, int* r) {
 #ifndef IDEEP_USE_MKL
-  IDEEP_ENFORCE(0, "can not use bernoulli_generate without MKL support");
+  auto seed = philox_default_seed();
+  auto offset = philox_next_offset();
+  auto threshold = philox_threshold(p);
+  const long nwords = (n + 31) / 32;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (long w = 0; w < nwords; ++w) {
+    auto bits = philox_bernoulli_word(seed, offset, w, threshold);
+    const long begin = w * 32;
+    const long end = std::min(begin + 32, n);
+    for (long i = begin; i < end; ++i)
+      r[i] = (bits >> (i - begin)) & 1;
+  }
 #else
   std::srand(std::time(0));
   const int seed = 17 + std::rand() % 4096;
@@ -169,6 +261,78 @@ inline int tensor_zp_mask(dim zp_size) {
   return zp_size > 1 ? 1 : 0;
 }
 
+/// bfloat16 <-> float, rounding to nearest even
+inline float bf16_to_float(uint16_t v) {
+  uint32_t bits = static_cast<uint32_t>(v) << 16;
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+inline uint16_t float_to_bf16(float f) {
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  if ((bits & 0x7fffffff) > 0x7f800000) return 0x7fc0;  // NaN
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return static_cast<uint16_t>(bits >> 16);
+}
+
+/// Element <-> float conversions for the hand-written kernels, uint16_t
+/// holding bf16. Integers are rounded and saturated on the way back.
+inline float to_f32(float v) { return v; }
+inline float to_f32(uint16_t v) { return bf16_to_float(v); }
+inline float to_f32(int32_t v) { return static_cast<float>(v); }
+inline float to_f32(int8_t v) { return static_cast<float>(v); }
+inline float to_f32(uint8_t v) { return static_cast<float>(v); }
+
+template <typename T>
+inline T from_f32(float v) {
+  // max() of int32_t rounds up to 2^31 as a float, so compare with >=
+  v = std::nearbyint(v);
+  if (v >= static_cast<float>(std::numeric_limits<T>::max()))
+    return std::numeric_limits<T>::max();
+  if (v <= static_cast<float>(std::numeric_limits<T>::lowest()))
+    return std::numeric_limits<T>::lowest();
+  return static_cast<T>(v);
+}
+
+template <>
+inline float from_f32<float>(float v) { return v; }
+
+template <>
+inline uint16_t from_f32<uint16_t>(float v) { return float_to_bf16(v); }
+
+/// Per-dimension offset tables of a blocked memory desc: the physical
+/// offset of logical index (i0, i1, ...) is the sum of tables[d][id] over all
+/// dims plus offset0. Works for plain and blocked layouts alike, since the
+/// contributions of different dims are independent.
+inline std::vector<std::vector<dim>> blocked_offset_tables(
+    const dnnl_memory_desc_t& md) {
+  const auto& blk = md.format_desc.blocking;
+  std::vector<std::vector<dim>> tables(md.ndims);
+  for (int d = 0; d < md.ndims; d++) {
+    dim block = 1;
+    for (int k = 0; k < blk.inner_nblks; k++) {
+      if (blk.inner_idxs[k] == d) block *= blk.inner_blks[k];
+    }
+    tables[d].resize(md.dims[d]);
+    for (dim i = 0; i < md.dims[d]; i++) {
+      dim off = (i / block) * blk.strides[d];
+      dim rem = i % block;
+      dim inner_stride = 1;
+      for (int k = blk.inner_nblks - 1; k >= 0; k--) {
+        if (blk.inner_idxs[k] == d) {
+          off += (rem % blk.inner_blks[k]) * inner_stride;
+          rem /= blk.inner_blks[k];
+        }
+        inner_stride *= blk.inner_blks[k];
+      }
+      tables[d][i] = off;
+    }
+  }
+  return tables;
+}
+
 inline uintptr_t mod_ptr(void *ptr, size_t bytes) {
   return reinterpret_cast<uintptr_t>(ptr) & (bytes - 1);
 }
@@ -196,6 +360,130 @@ inline void array_set(T *arr, const U &val, size_t size) {
     arr[i] = static_cast<T>(val);
 }
 
+// Helpers to build computation cache keys. Each argument is appended in a
+// compact textual form, separated by '*'.
+inline void to_bytes(key_t& bytes, int64_t arg) {
+  bytes.append(std::to_string(arg));
+}
+
+inline void to_bytes(key_t& bytes, int arg) {
+  to_bytes(bytes, static_cast<int64_t>(arg));
+}
+
+inline void to_bytes(key_t& bytes, bool arg) {
+  bytes.append(arg ? "1" : "0");
+}
+
+inline void to_bytes(key_t& bytes, float arg) {
+  // exact bit pattern, keeps the key printable
+  uint32_t bits;
+  std::memcpy(&bits, &arg, sizeof(bits));
+  to_bytes(bytes, static_cast<int64_t>(bits));
+}
+
+template <typename T,
+          typename = typename std::enable_if<std::is_enum<T>::value>::type>
+inline void to_bytes(key_t& bytes, T arg) {
+  to_bytes(bytes, static_cast<int64_t>(arg));
+}
+
+template <typename T>
+inline void to_bytes(key_t& bytes, const std::vector<T>& arg) {
+  for (auto& elem : arg) {
+    to_bytes(bytes, elem);
+    bytes.append(1, 'x');
+  }
+}
+
+inline void to_bytes(key_t& bytes, const dnnl_memory_desc_t& md) {
+  to_bytes(bytes, md.data_type);
+  to_bytes(bytes, md.format_kind);
+  to_bytes(bytes, md.offset0);
+  for (int i = 0; i < md.ndims; ++i) {
+    to_bytes(bytes, md.dims[i]);
+    bytes.append(1, 'x');
+  }
+  for (int i = 0; i < md.ndims; ++i) {
+    to_bytes(bytes, md.padded_dims[i]);
+    bytes.append(1, 'x');
+  }
+  if (md.format_kind == dnnl_blocked) {
+    const auto& blk = md.format_desc.blocking;
+    for (int i = 0; i < md.ndims; ++i) {
+      to_bytes(bytes, blk.strides[i]);
+      bytes.append(1, 's');
+    }
+    for (int i = 0; i < blk.inner_nblks; ++i) {
+      to_bytes(bytes, blk.inner_blks[i]);
+      to_bytes(bytes, blk.inner_idxs[i]);
+      bytes.append(1, 'b');
+    }
+  } else if (md.format_kind == dnnl_format_kind_rnn_packed) {
+    const auto& rnn = md.format_desc.rnn_packed_desc;
+    to_bytes(bytes, rnn.format);
+    to_bytes(bytes, rnn.n_parts);
+    to_bytes(bytes, rnn.n);
+    to_bytes(bytes, rnn.ldb);
+    to_bytes(bytes, static_cast<int64_t>(rnn.size));
+  }
+}
+
+inline void to_bytes(key_t& bytes, const memory::desc& adesc) {
+  to_bytes(bytes, adesc.data);
+}
+
+inline void to_bytes(key_t& bytes, const dnnl::primitive_attr& attr) {
+  // scales, zero points and post-ops are what the operators in ideep vary
+  dnnl_dim_t count;
+  int mask;
+  const float* scales;
+  if (dnnl_primitive_attr_get_output_scales(
+          attr.get(), &count, &mask, &scales) == dnnl_success) {
+    to_bytes(bytes, mask);
+    for (dnnl_dim_t i = 0; i < count; ++i) to_bytes(bytes, scales[i]);
+  }
+  auto po = attr.get_post_ops();
+  for (int i = 0; i < po.len(); ++i) {
+    auto akind = po.kind(i);
+    to_bytes(bytes, akind);
+    if (akind == dnnl::primitive::kind::sum) {
+      float scale;
+      po.get_params_sum(i, scale);
+      to_bytes(bytes, scale);
+    } else if (akind == dnnl::primitive::kind::eltwise) {
+      float scale, alpha, beta;
+      dnnl::algorithm alg;
+      po.get_params_eltwise(i, scale, alg, alpha, beta);
+      to_bytes(bytes, alg);
+      to_bytes(bytes, scale);
+      to_bytes(bytes, alpha);
+      to_bytes(bytes, beta);
+    }
+  }
+  for (auto arg : {DNNL_ARG_SRC, DNNL_ARG_WEIGHTS, DNNL_ARG_DST}) {
+    int zp_mask;
+    std::vector<int32_t> zero_points;
+    attr.get_zero_points(arg, zp_mask, zero_points);
+    to_bytes(bytes, zp_mask);
+    for (auto zp : zero_points) to_bytes(bytes, static_cast<int64_t>(zp));
+  }
+}
+
+template <typename T, typename U, typename... Ts>
+inline void to_bytes(key_t& bytes, T&& arg, U&& next, Ts&&... args) {
+  to_bytes(bytes, std::forward<T>(arg));
+  bytes.append(1, '*');
+  to_bytes(bytes, std::forward<U>(next), std::forward<Ts>(args)...);
+}
+
+template <typename... Ts>
+inline key_t create_key(Ts&&... args) {
+  key_t key;
+  key.reserve(256);
+  to_bytes(key, std::forward<Ts>(args)...);
+  return key;
+}
+
 }
 }
 #endif
@@ -0,0 +1,113 @@
+#ifndef IDEEP_WARMUP_HPP
+#define IDEEP_WARMUP_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "manifest.hpp"
+
+namespace ideep {
+namespace utils {
+
+/// Creates the primitives listed in a file written by manifest::save() and
+/// puts them in the computation cache, spread over nthreads threads (the
+/// hardware concurrency when 0). Call it at startup, before the first
+/// request. Returns how many were created; entries that cannot be created
+/// on this machine, e.g. for an ISA it lacks, are skipped.
+inline size_t warm_up(const std::string& path, int nthreads = 0) {
+  recorder::reader in(path);
+  std::vector<std::function<void()>> creators;
+  recorder::op_id op;
+  // decode in file order, since the fields of a record are read in sequence
+  while (in.next(op)) {
+    switch (op) {
+      case recorder::convolution_forward_primitive: {
+        auto src_desc = in.get_desc();
+        auto weights_desc = in.get_desc();
+        auto bias_desc = in.get_desc();
+        auto dst_desc = in.get_desc();
+        auto strides = in.get_dims();
+        auto dilates = in.get_dims();
+        auto padding_l = in.get_dims();
+        auto padding_r = in.get_dims();
+        auto attr = in.get_attr();
+        auto aalgorithm = in.get_algorithm();
+        auto aprop_kind = in.get_prop_kind();
+        creators.push_back([=]() {
+          if (bias_desc.data.ndims == 0)
+            convolution_forward::fetch_or_create</*with_bias=*/false>(
+                src_desc, weights_desc, bias_desc, dst_desc, strides, dilates,
+                padding_l, padding_r, attr, aalgorithm, aprop_kind);
+          else
+            convolution_forward::fetch_or_create</*with_bias=*/true>(
+                src_desc, weights_desc, bias_desc, dst_desc, strides, dilates,
+                padding_l, padding_r, attr, aalgorithm, aprop_kind);
+        });
+        break;
+      }
+      case recorder::inner_product_forward_primitive: {
+        auto src_desc = in.get_desc();
+        auto weights_desc = in.get_desc();
+        auto bias_desc = in.get_desc();
+        auto dst_desc = in.get_desc();
+        auto attr = in.get_attr();
+        auto aprop_kind = in.get_prop_kind();
+        creators.push_back([=]() {
+          if (bias_desc.data.ndims == 0)
+            inner_product_forward::fetch_or_create</*with_bias=*/false>(
+                src_desc, weights_desc, bias_desc, dst_desc, attr, aprop_kind);
+          else
+            inner_product_forward::fetch_or_create</*with_bias=*/true>(
+                src_desc, weights_desc, bias_desc, dst_desc, attr, aprop_kind);
+        });
+        break;
+      }
+      case recorder::matmul_forward_primitive: {
+        auto src_desc = in.get_desc();
+        auto weights_desc = in.get_desc();
+        auto bias_desc = in.get_desc();
+        auto dst_desc = in.get_desc();
+        auto attr = in.get_attr();
+        creators.push_back([=]() {
+          if (bias_desc.data.ndims == 0)
+            matmul_forward::fetch_or_create</*with_bias=*/false>(
+                src_desc, weights_desc, bias_desc, dst_desc, attr);
+          else
+            matmul_forward::fetch_or_create</*with_bias=*/true>(
+                src_desc, weights_desc, bias_desc, dst_desc, attr);
+        });
+        break;
+      }
+      default:
+        // op calls of a recording are not primitives to create
+        break;
+    }
+  }
+
+  if (nthreads <= 0)
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  std::atomic<size_t> next {0}, created {0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < creators.size(); i = next++) {
+      try {
+        creators[i]();
+        created++;
+      } catch (const error&) {
+        // not supported here; the op will fail or fall back on its own
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < nthreads; t++) threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads) t.join();
+  return created;
+}
+
+}  // namespace utils
+}  // namespace ideep
+
+#endif